@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "analysis.h"
+#include "worker.h"
+#include "buffer.h"
+#include "highlight.h"
+
+/* how much of the data is looked at before checking for cancellation */
+#define ANALYSIS_CHUNK_SIZE (1024 * 1024)
+
+struct analysis_job {
+	struct worker_job _parent;
+	struct analysis *analysis;
+	analysis_task_t task;
+};
+
+/*
+ * An analysis takes a snapshot of a buffer and runs the requested tasks on
+ * it on a worker pool. The workers only ever look at the snapshot, and
+ * everything else, including freeing the snapshot, happens on the thread
+ * that started the analysis when it collects the finished jobs. Since the
+ * jobs hold on to the analysis, a cancelled analysis is only freed once
+ * the last of its jobs came back. The snapshot is let go of as soon as
+ * all jobs are done, so that the next edit of the buffer does not have to
+ * copy the contents away from it.
+ */
+struct analysis {
+	struct buffer *snapshot;
+	unsigned long generation;
+
+	struct analysis_job jobs[ANALYSIS_TASKS];
+	int pending;
+	int cancelled;
+
+	analysis_handler_t *handler;
+	void *user_data;
+
+	size_t pattern_start;
+	size_t pattern_len;
+
+	unsigned char *states;
+	int num_states;
+	struct analysis_stats stats;
+};
+
+static void _analysis_free(struct analysis *analysis)
+{
+	buffer_close(&analysis->snapshot);
+	free(analysis->states);
+	free(analysis);
+}
+
+/*
+ * Step through the snapshot, so its line index is built up to the end.
+ */
+static int _analysis_index(struct analysis_job *job)
+{
+	struct buffer *snapshot;
+	size_t offset;
+	size_t size;
+
+	snapshot = job->analysis->snapshot;
+	size = buffer_get_size(snapshot);
+
+	for(offset = 0; offset < size; offset += ANALYSIS_CHUNK_SIZE) {
+		size_t start;
+		size_t len;
+		int line;
+		int err;
+
+		if(worker_job_cancelled(&job->_parent)) {
+			return(-ECANCELED);
+		}
+
+		if((err = buffer_get_line_range(snapshot, offset, &line, &start, &len)) < 0) {
+			return(err);
+		}
+	}
+
+	if(size > 0) {
+		size_t start;
+		size_t len;
+		int line;
+
+		return(buffer_get_line_range(snapshot, size - 1, &line, &start, &len));
+	}
+
+	return(0);
+}
+
+static int _analysis_highlight(struct analysis_job *job)
+{
+	struct analysis *analysis;
+
+	analysis = job->analysis;
+
+	return(highlight_lex(buffer_get_data(analysis->snapshot),
+			     buffer_get_size(analysis->snapshot),
+			     &job->_parent.cancelled,
+			     &analysis->states, &analysis->num_states));
+}
+
+static int _analysis_stats(struct analysis_job *job)
+{
+	struct analysis_stats stats;
+	struct analysis *analysis;
+	const char *data;
+	const char *pos;
+	size_t size;
+	size_t i;
+	int word;
+
+	analysis = job->analysis;
+	data = buffer_get_data(analysis->snapshot);
+	size = buffer_get_size(analysis->snapshot);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.bytes = size;
+	word = 0;
+
+	for(i = 0; i < size; i++) {
+		if(i % ANALYSIS_CHUNK_SIZE == 0 && worker_job_cancelled(&job->_parent)) {
+			return(-ECANCELED);
+		}
+
+		if(data[i] == '\n') {
+			stats.lines++;
+		}
+
+		if(isspace((unsigned char)data[i])) {
+			word = 0;
+		} else if(!word) {
+			word = 1;
+			stats.words++;
+		}
+	}
+
+	/* a last line without a newline is still a line */
+	if(size > 0 && data[size - 1] != '\n') {
+		stats.lines++;
+	}
+
+	if(analysis->pattern_len > 0) {
+		const char *pattern;
+
+		pattern = data + analysis->pattern_start;
+
+		for(pos = data;
+		    (pos = memmem(pos, size - (pos - data), pattern, analysis->pattern_len));
+		    pos += analysis->pattern_len) {
+			if(worker_job_cancelled(&job->_parent)) {
+				return(-ECANCELED);
+			}
+
+			stats.hits++;
+		}
+	}
+
+	analysis->stats = stats;
+	return(0);
+}
+
+static int _analysis_run(struct worker_job *job)
+{
+	struct analysis_job *ajob;
+
+	ajob = (struct analysis_job*)job;
+
+	switch(ajob->task) {
+	case ANALYSIS_INDEX:
+		return(_analysis_index(ajob));
+
+	case ANALYSIS_HIGHLIGHT:
+		return(_analysis_highlight(ajob));
+
+	case ANALYSIS_STATS:
+		return(_analysis_stats(ajob));
+
+	default:
+		return(-EINVAL);
+	}
+}
+
+static void _analysis_done(struct worker_job *job)
+{
+	struct analysis_job *ajob;
+	struct analysis *analysis;
+
+	ajob = (struct analysis_job*)job;
+	analysis = ajob->analysis;
+
+	if(!analysis->cancelled && job->result == 0) {
+		analysis->handler(analysis, ajob->task, analysis->user_data);
+	}
+
+	if(--analysis->pending > 0) {
+		return;
+	}
+
+	if(analysis->cancelled) {
+		_analysis_free(analysis);
+	} else {
+		buffer_close(&analysis->snapshot);
+	}
+}
+
+/*
+ * Start the tasks in `tasks' (made with ANALYSIS_TASK()) on a snapshot of
+ * `buffer'. The handler is called for each task that completes, from
+ * worker_pool_collect(). Occurrences of the `pattern_len' bytes at
+ * `pattern_start' in the buffer are counted along with the statistics.
+ * The pattern is looked up in the snapshot, so it is never copied.
+ */
+int analysis_start(struct analysis **analysis, struct worker_pool *pool,
+		   struct buffer *buffer, const int tasks, const size_t pattern_start,
+		   const size_t pattern_len, analysis_handler_t *handler, void *user_data)
+{
+	struct analysis *an;
+	int task;
+	int err;
+
+	if(!analysis || !pool || !buffer || !handler ||
+	   pattern_start > buffer_get_size(buffer) ||
+	   pattern_len > buffer_get_size(buffer) - pattern_start) {
+		return(-EINVAL);
+	}
+
+	if(!(an = calloc(1, sizeof(*an)))) {
+		return(-ENOMEM);
+	}
+
+	if((err = buffer_snapshot(buffer, &an->snapshot)) < 0) {
+		free(an);
+		return(err);
+	}
+
+	an->pattern_start = pattern_start;
+	an->pattern_len = pattern_len;
+
+	an->generation = buffer_get_generation(buffer);
+	an->handler = handler;
+	an->user_data = user_data;
+
+	for(task = 0; task < ANALYSIS_TASKS; task++) {
+		struct analysis_job *job;
+
+		if(!(tasks & ANALYSIS_TASK(task))) {
+			continue;
+		}
+
+		job = &an->jobs[task];
+		job->analysis = an;
+		job->task = task;
+
+		worker_job_init(&job->_parent, _analysis_run, _analysis_done);
+
+		if(worker_pool_submit(pool, &job->_parent) == 0) {
+			an->pending++;
+		}
+	}
+
+	if(an->pending == 0) {
+		_analysis_free(an);
+		return(-ENOENT);
+	}
+
+	*analysis = an;
+	return(0);
+}
+
+/*
+ * Stop the tasks of an analysis. No more handlers are called for it, and
+ * it is freed as soon as the workers are done with it.
+ */
+int analysis_cancel(struct analysis **analysis)
+{
+	struct analysis *an;
+	int task;
+
+	if(!analysis || !*analysis) {
+		return(-EINVAL);
+	}
+
+	an = *analysis;
+	*analysis = NULL;
+	an->cancelled = 1;
+
+	for(task = 0; task < ANALYSIS_TASKS; task++) {
+		worker_job_cancel(&an->jobs[task]._parent);
+	}
+
+	if(an->pending == 0) {
+		_analysis_free(an);
+	}
+
+	return(0);
+}
+
+unsigned long analysis_get_generation(struct analysis *analysis)
+{
+	return(analysis ? analysis->generation : 0);
+}
+
+struct buffer* analysis_get_snapshot(struct analysis *analysis)
+{
+	return(analysis ? analysis->snapshot : NULL);
+}
+
+/* the caller becomes the owner of the states */
+int analysis_take_states(struct analysis *analysis, unsigned char **states, int *num_states)
+{
+	if(!analysis || !states || !num_states) {
+		return(-EINVAL);
+	}
+
+	if(!analysis->states) {
+		return(-ENOENT);
+	}
+
+	*states = analysis->states;
+	*num_states = analysis->num_states;
+	analysis->states = NULL;
+
+	return(0);
+}
+
+const struct analysis_stats* analysis_get_stats(struct analysis *analysis)
+{
+	return(analysis ? &analysis->stats : NULL);
+}
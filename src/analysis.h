@@ -0,0 +1,39 @@
+#ifndef E_ANALYSIS_H
+#define E_ANALYSIS_H
+
+#include <stddef.h>
+
+struct buffer;
+struct worker_pool;
+struct analysis;
+
+typedef enum {
+	ANALYSIS_INDEX = 0,
+	ANALYSIS_HIGHLIGHT,
+	ANALYSIS_STATS,
+	ANALYSIS_TASKS
+} analysis_task_t;
+
+#define ANALYSIS_TASK(task) (1 << (task))
+
+struct analysis_stats {
+	size_t bytes;
+	size_t lines;
+	size_t words;
+	size_t hits;
+};
+
+typedef void (analysis_handler_t)(struct analysis *analysis, const analysis_task_t task,
+				  void *user_data);
+
+int analysis_start(struct analysis **analysis, struct worker_pool *pool,
+		   struct buffer *buffer, const int tasks, const size_t pattern_start,
+		   const size_t pattern_len, analysis_handler_t *handler, void *user_data);
+int analysis_cancel(struct analysis **analysis);
+
+unsigned long analysis_get_generation(struct analysis *analysis);
+struct buffer* analysis_get_snapshot(struct analysis *analysis);
+int analysis_take_states(struct analysis *analysis, unsigned char **states, int *num_states);
+const struct analysis_stats* analysis_get_stats(struct analysis *analysis);
+
+#endif /* E_ANALYSIS_H */
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -7,21 +8,85 @@
 #include "buffer.h"
 #include "file.h"
 #include "config.h"
+#include "lineindex.h"
+#include "journal.h"
 #include <telex/telex.h>
 
+#define BUFFER_INIT_FOLDS 8
+
+/*
+ * The whole lines from `start' to `end'. Only the last line of a buffer
+ * can lack a newline, so the newlines are counted rather than the lines.
+ */
+struct buffer_fold {
+	size_t start;
+	size_t end;
+	int newlines;
+};
+
 struct buffer {
 	struct file *file;
 	char *data;
 	size_t size;
 	int dirty;
+
+	struct lineindex *lines;
+	struct lineindex_key lines_key;
+	int lines_cached;
+
+	/* snapshots are private copies and never write to the cache */
+	int snapshot;
+
+	/*
+	 * The contents are shared with the snapshots that were taken since
+	 * they last changed, and `data_refs' counts the buffers that share
+	 * them. Snapshots never change, so the buffer copies the contents
+	 * before it changes them, as long as they are shared.
+	 */
+	int *data_refs;
+
+	/* an unloaded buffer only keeps the number of lines it had */
+	int unloaded;
+	long unloaded_lines;
+
+	/* number of bytes of the file that are reflected in the buffer */
+	size_t file_size;
+	int reopen_pending;
+	int follow;
+	int stale;
+
+	/* not owned by the buffer */
+	struct journal *journal;
+
+	/* sorted, and they don't overlap */
+	struct buffer_fold *folds;
+	int num_folds;
+	int max_folds;
+	unsigned long fold_generation;
+
+	/* the most recent edits, so views can tell what they need to redraw */
+	unsigned long generation;
+	struct buffer_edit {
+		unsigned long generation;
+		size_t offset;
+		size_t len;
+		size_t data_len;
+		long lines;
+	} edits[BUFFER_EDIT_HISTORY];
 };
 
+#define BUFFER_RELOAD_BLOCK_SIZE (64 * 1024)
+
+/*
+ * Lines point into the data of the buffer rather than holding a copy of
+ * it, so they are not terminated and only valid until the buffer changes.
+ */
 struct line {
 	struct line *next;
 	int no;
-	char *data;
+	const char *data;
 	size_t len;
-	const char *source;
+	int folded;
 };
 
 struct snippet {
@@ -50,25 +115,74 @@ static int _buffer_new(struct buffer **buffer)
 	}
 
 	memset(buf, 0, sizeof(*buf));
+
+	if(lineindex_new(&(buf->lines)) < 0) {
+		free(buf);
+		return(-ENOMEM);
+	}
+
 	*buffer = buf;
 
 	return(0);
 }
 
+/* let go of the contents, which are freed by the last buffer sharing them */
+static void _buffer_release_data(struct buffer *buffer)
+{
+	if(!buffer->data_refs || --(*buffer->data_refs) == 0) {
+		free(buffer->data_refs);
+		free(buffer->data);
+	}
+
+	buffer->data_refs = NULL;
+	buffer->data = NULL;
+}
+
+/* make sure the contents aren't shared with a snapshot before changing them */
+static int _buffer_own_data(struct buffer *buffer)
+{
+	char *data;
+
+	if(!buffer->data_refs) {
+		return(0);
+	}
+
+	if(*buffer->data_refs > 1) {
+		if(!(data = malloc(buffer->size + 1))) {
+			return(-ENOMEM);
+		}
+
+		memcpy(data, buffer->data, buffer->size);
+		data[buffer->size] = 0;
+
+		(*buffer->data_refs)--;
+		buffer->data = data;
+	} else {
+		free(buffer->data_refs);
+	}
+
+	buffer->data_refs = NULL;
+	return(0);
+}
+
 static int _buffer_free(struct buffer **buffer)
 {
 	if(!buffer || !*buffer) {
 		return(-EINVAL);
 	}
 
-	if((*buffer)->data) {
-		free((*buffer)->data);
-	}
+	_buffer_release_data(*buffer);
 
 	if((*buffer)->file) {
 		file_close(&((*buffer)->file));
 	}
 
+	if((*buffer)->lines) {
+		lineindex_free(&((*buffer)->lines));
+	}
+
+	free((*buffer)->folds);
+
 	memset(*buffer, 0, sizeof(**buffer));
 	free(*buffer);
 	*buffer = NULL;
@@ -76,6 +190,121 @@ static int _buffer_free(struct buffer **buffer)
 	return(0);
 }
 
+static void _buffer_journal(struct buffer *buffer, const size_t offset, const size_t len,
+			    const char *data, const size_t data_len)
+{
+	int err;
+
+	if (buffer->journal &&
+	    (err = journal_record(buffer->journal, offset, len, data, data_len)) < 0) {
+		fprintf(stderr, "Could not journal edit: %s [%d]\n", strerror(-err), -err);
+	}
+}
+
+static long _buffer_count_lines(const char *data, const size_t len)
+{
+	const char *end;
+	long lines;
+
+	for (end = data + len, lines = 0; data < end; lines++, data++) {
+		if (!(data = memchr(data, '\n', end - data))) {
+			break;
+		}
+	}
+
+	return lines;
+}
+
+/*
+ * The buffer is what is on disk now, so the journal has to start over with
+ * the file as it is. Edits recorded against the old header would be thrown
+ * away on recovery.
+ */
+static void _buffer_reset_journal(struct buffer *buffer)
+{
+	int err;
+
+	if (buffer->journal && (err = journal_reset(buffer->journal)) < 0) {
+		fprintf(stderr, "Could not reset journal: %s [%d]\n", strerror(-err), -err);
+	}
+}
+
+/* the number of lines that are hidden in a fold */
+static int _buffer_fold_lines(struct buffer *buffer, struct buffer_fold *fold)
+{
+	return(fold->newlines + (buffer->data[fold->end - 1] != '\n'));
+}
+
+static int _buffer_fold_is_valid(struct buffer *buffer, struct buffer_fold *fold)
+{
+	return(fold->start < fold->end && fold->end <= buffer->size &&
+	       (fold->start == 0 || buffer->data[fold->start - 1] == '\n') &&
+	       (fold->end == buffer->size || buffer->data[fold->end - 1] == '\n'));
+}
+
+/*
+ * Folds move along with the text in front of them and grow or shrink with
+ * the edits inside of them. An edit that crosses the boundary of a fold,
+ * or leaves it without whole lines, unfolds it.
+ */
+static void _buffer_move_folds(struct buffer *buffer, const size_t offset, const size_t len,
+			       const size_t data_len, const long lines)
+{
+	int kept;
+	int i;
+
+	for(i = 0, kept = 0; i < buffer->num_folds; i++) {
+		struct buffer_fold fold;
+
+		fold = buffer->folds[i];
+
+		if(offset < fold.start && offset + len <= fold.start) {
+			fold.start = fold.start - len + data_len;
+			fold.end = fold.end - len + data_len;
+		} else if(offset >= fold.start && offset < fold.end && offset + len <= fold.end) {
+			fold.end = fold.end - len + data_len;
+			fold.newlines += lines;
+		} else if(offset < fold.end) {
+			continue;
+		}
+
+		if(_buffer_fold_is_valid(buffer, &fold)) {
+			buffer->folds[kept++] = fold;
+		}
+	}
+
+	if(kept != buffer->num_folds) {
+		buffer->num_folds = kept;
+		buffer->fold_generation++;
+	}
+}
+
+/*
+ * Every change of the buffer contents goes through here: the line index
+ * is rewound to the start of the change and the change is recorded so
+ * that views can limit their redraws to the affected range. `lines' is
+ * the number of lines that the change added, or removed if negative.
+ */
+static void _buffer_changed(struct buffer *buffer, const size_t offset, const size_t len,
+			    const size_t data_len, const long lines)
+{
+	struct buffer_edit *edit;
+
+	lineindex_invalidate(buffer->lines, offset);
+
+	if(buffer->num_folds > 0) {
+		_buffer_move_folds(buffer, offset, len, data_len, lines);
+	}
+
+	buffer->generation++;
+	edit = &buffer->edits[buffer->generation % BUFFER_EDIT_HISTORY];
+	edit->generation = buffer->generation;
+	edit->offset = offset;
+	edit->len = len;
+	edit->data_len = data_len;
+	edit->lines = lines;
+}
+
 int buffer_clone(struct buffer *src, struct buffer **dst)
 {
 	struct buffer *nbuf;
@@ -96,6 +325,7 @@ int buffer_clone(struct buffer *src, struct buffer **dst)
 
 	memcpy(nbuf->data, src->data, src->size);
 	nbuf->size = src->size;
+	nbuf->file_size = src->file_size;
 
 	err = file_ref(src->file);
 
@@ -110,6 +340,148 @@ int buffer_clone(struct buffer *src, struct buffer **dst)
 	return(0);
 }
 
+/*
+ * A snapshot is a copy of the buffer that other threads can read while the
+ * buffer itself is being edited. It starts with an empty line index, which
+ * may be handed back to the buffer with buffer_adopt_index() once it has
+ * been built. The contents are only copied when the buffer changes while
+ * they are shared, so taking any number of snapshots of a buffer that
+ * didn't change doesn't copy anything. Snapshots have to be freed on the
+ * thread that changes the buffer.
+ */
+int buffer_snapshot(struct buffer *src, struct buffer **dst)
+{
+	struct buffer *nbuf;
+	int err;
+
+	if(!src || !dst) {
+		return(-EINVAL);
+	}
+
+	if(src->unloaded) {
+		return(-EBUSY);
+	}
+
+	if((err = _buffer_new(&nbuf)) < 0) {
+		return(err);
+	}
+
+	if(!src->data_refs) {
+		if(!(src->data_refs = malloc(sizeof(*src->data_refs)))) {
+			_buffer_free(&nbuf);
+			return(-ENOMEM);
+		}
+
+		*src->data_refs = 1;
+	}
+
+	if((err = file_ref(src->file)) < 0) {
+		_buffer_free(&nbuf);
+		return(err);
+	}
+
+	(*src->data_refs)++;
+	nbuf->data_refs = src->data_refs;
+	nbuf->data = src->data;
+	nbuf->size = src->size;
+	nbuf->file_size = src->file_size;
+	nbuf->file = src->file;
+	nbuf->snapshot = 1;
+
+	*dst = nbuf;
+	return(0);
+}
+
+/*
+ * Take over the line index of a snapshot that was taken at `generation',
+ * if the buffer didn't change since and the snapshot's index covers more
+ * of it than the buffer's own.
+ */
+int buffer_adopt_index(struct buffer *buffer, struct buffer *snapshot,
+		       const unsigned long generation)
+{
+	struct lineindex *lines;
+
+	if(!buffer || !snapshot || !snapshot->snapshot) {
+		return(-EINVAL);
+	}
+
+	if(buffer->generation != generation || buffer->size != snapshot->size) {
+		return(-ESTALE);
+	}
+
+	if(lineindex_get_scanned(snapshot->lines) <= lineindex_get_scanned(buffer->lines)) {
+		return(-EALREADY);
+	}
+
+	lines = buffer->lines;
+	buffer->lines = snapshot->lines;
+	snapshot->lines = lines;
+
+	return(0);
+}
+
+/* the number of bytes from the start of the buffer whose lines are known */
+size_t buffer_get_indexed(struct buffer *buffer)
+{
+	return(buffer ? lineindex_get_scanned(buffer->lines) : 0);
+}
+
+static int _buffer_get_line_cache_key(struct buffer *buffer, struct lineindex_key *key)
+{
+	struct timespec mtime;
+	int err;
+
+	if((err = file_get_mtime(buffer->file, &mtime)) < 0) {
+		return(err);
+	}
+
+	return(lineindex_key_init(key, buffer->data, buffer->size, &mtime));
+}
+
+/*
+ * Large files take a while to index, so we keep their line indices in a
+ * cache directory. When the same file is opened again, the cached index
+ * is mapped into memory and any line can be looked up immediately. This
+ * only saves scanning for newlines; the contents are still read in full
+ * by buffer_open(), since reloading compares them with the file on disk.
+ */
+static int _buffer_load_line_cache(struct buffer *buffer)
+{
+	int err;
+
+	if((err = _buffer_get_line_cache_key(buffer, &buffer->lines_key)) < 0 ||
+	   (err = lineindex_load(buffer->lines, file_get_path(buffer->file),
+				 &buffer->lines_key)) < 0) {
+		return(err);
+	}
+
+	buffer->lines_cached = 1;
+	return(0);
+}
+
+static int _buffer_save_line_cache(struct buffer *buffer)
+{
+	struct lineindex_key key;
+	int err;
+
+	if((err = _buffer_get_line_cache_key(buffer, &key)) < 0) {
+		return(err);
+	}
+
+	/* nothing to do if the file is still what the cached index describes */
+	if(buffer->lines_cached && memcmp(&key, &buffer->lines_key, sizeof(key)) == 0) {
+		return(0);
+	}
+
+	if((err = lineindex_save(buffer->lines, buffer->data, buffer->size,
+				 file_get_path(buffer->file), &key)) < 0) {
+		fprintf(stderr, "Could not save line index: %s [%d]\n", strerror(-err), -err);
+	}
+
+	return(err);
+}
+
 int buffer_open(struct buffer **buffer, const char *path, const int readonly)
 {
 	struct buffer *buf;
@@ -135,10 +507,16 @@ int buffer_open(struct buffer **buffer, const char *path, const int readonly)
 	}
 
 #ifdef DEBUG
-	fprintf(stderr, "Read %lu bytes from %s\n", strlen(data), path);
+	fprintf(stderr, "Read %lu bytes from %s\n", buf->size, path);
 #endif /* DEBUG */
 
 	buf->data = data;
+	buf->file_size = buf->size;
+
+	if(config.line_index_cache && buf->size >= config.line_index_cache_min) {
+		_buffer_load_line_cache(buf);
+	}
+
 	*buffer = buf;
 
 	return(err);
@@ -150,10 +528,111 @@ int buffer_close(struct buffer **buffer)
 		return(-EINVAL);
 	}
 
+	/*
+	 * Only an index that is complete already is saved. Completing it here
+	 * would mean scanning the whole buffer on the way out.
+	 */
+	if(config.line_index_cache && !(*buffer)->dirty && !(*buffer)->snapshot &&
+	   !(*buffer)->unloaded && (*buffer)->size >= config.line_index_cache_min &&
+	   lineindex_get_scanned((*buffer)->lines) >= (*buffer)->size) {
+		_buffer_save_line_cache(*buffer);
+	}
+
         return(_buffer_free(buffer));
 }
 
-int buffer_save(struct buffer *buffer)
+/*
+ * Free the contents of an unmodified buffer to make room for others. The
+ * line index and the edit history are kept, so if the file is the same
+ * when the buffer is loaded again, everything that was derived from the
+ * contents remains valid.
+ */
+int buffer_unload(struct buffer *buffer)
+{
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	if (buffer->unloaded) {
+		return 0;
+	}
+
+	if (buffer->dirty || buffer->stale || buffer->snapshot) {
+		return -EBUSY;
+	}
+
+	buffer->unloaded_lines = _buffer_count_lines(buffer->data, buffer->size);
+	buffer->unloaded = 1;
+	_buffer_release_data(buffer);
+
+	return 0;
+}
+
+/*
+ * Read the contents of an unloaded buffer from its file again. If the file
+ * changed in the meantime, the buffer changes as if it had been edited.
+ */
+int buffer_load(struct buffer *buffer)
+{
+	size_t size;
+	char *data;
+	int modified;
+	int err;
+
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	if (!buffer->unloaded) {
+		return 0;
+	}
+
+	/* follow the path if the file was replaced */
+	if ((modified = file_is_modified(buffer->file)) > 0 &&
+	    (err = file_reopen(buffer->file)) < 0 && err != -ENOENT) {
+		return err;
+	}
+
+	if ((err = file_read(buffer->file, &data, &size)) < 0) {
+		return err;
+	}
+
+	buffer->data = data;
+	buffer->unloaded = 0;
+
+	if (modified || size != buffer->size) {
+		size_t old_size;
+
+		old_size = buffer->size;
+		buffer->size = size;
+		_buffer_changed(buffer, 0, old_size, size,
+				_buffer_count_lines(data, size) - buffer->unloaded_lines);
+		_buffer_reset_journal(buffer);
+	}
+
+	buffer->file_size = size;
+	buffer->reopen_pending = 0;
+
+	return 0;
+}
+
+int buffer_is_loaded(struct buffer *buffer)
+{
+	return buffer && !buffer->unloaded;
+}
+
+/* the amount of memory that the contents of the buffer take */
+size_t buffer_get_memory(struct buffer *buffer)
+{
+	return buffer && !buffer->unloaded ? buffer->size : 0;
+}
+
+const char* buffer_get_path(struct buffer *buffer)
+{
+	return buffer ? file_get_path(buffer->file) : NULL;
+}
+
+static int _buffer_save(struct buffer *buffer, const int force)
 {
 	int err;
 
@@ -165,15 +644,39 @@ int buffer_save(struct buffer *buffer)
 		return 0;
 	}
 
-	err = file_write(buffer->file, buffer->data);
+	/*
+	 * Don't clobber changes that another program made since we last
+	 * read or wrote the file, unless the caller insists.
+	 */
+	if (!force && (buffer->stale || file_is_modified(buffer->file) > 0)) {
+		buffer->stale = 1;
+		return -ESTALE;
+	}
+
+	err = file_write(buffer->file, buffer->data, buffer->size);
 
 	if (!err) {
 		buffer->dirty = 0;
+		buffer->stale = 0;
+		buffer->file_size = buffer->size;
+
+		/* the edits in the journal are on disk now */
+		_buffer_reset_journal(buffer);
 	}
 
 	return err;
 }
 
+int buffer_save(struct buffer *buffer)
+{
+	return _buffer_save(buffer, 0);
+}
+
+int buffer_save_force(struct buffer *buffer)
+{
+	return _buffer_save(buffer, 1);
+}
+
 int buffer_append(struct buffer *buffer, char chr)
 {
 	char *new_data;
@@ -183,6 +686,10 @@ int buffer_append(struct buffer *buffer, char chr)
 		return(-EINVAL);
 	}
 
+	if(_buffer_own_data(buffer) < 0) {
+		return(-ENOMEM);
+	}
+
 	new_size = buffer->size + 1;
 	new_data = malloc(new_size);
 
@@ -195,6 +702,9 @@ int buffer_append(struct buffer *buffer, char chr)
 
 	free(buffer->data);
 
+	_buffer_journal(buffer, buffer->size, 0, &chr, 1);
+	_buffer_changed(buffer, buffer->size, 0, 1, chr == '\n');
+
 	buffer->data = new_data;
 	buffer->size = new_size;
 	buffer->dirty = 1;
@@ -212,69 +722,6 @@ size_t buffer_get_size(struct buffer *buffer)
 	return(buffer->size);
 }
 
-static int _get_snippet_extent(struct buffer *buffer, const int start, const int lines,
-			       const char **snip_start, const char **snip_end)
-{
-	struct telex_error *errors;
-	struct telex *start_telex;
-	struct telex *end_telex;
-	const char *start_ptr;
-	const char *end_ptr;
-	char telex_str[16];
-	int error;
-
-	if(!buffer || !snip_start || !snip_end) {
-		return(-EINVAL);
-	}
-
-        error = 0;
-	start_telex = NULL;
-	end_telex = NULL;
-
-	snprintf(telex_str, sizeof(telex_str), ":%d", start);
-	if (telex_parse(&start_telex, telex_str, &errors) < 0) {
-		fprintf(stderr, "Could not parse telex \"%s\"\n", telex_str);
-		error = -EINVAL;
-		goto cleanup;
-	}
-
-	snprintf(telex_str, sizeof(telex_str), ":%d", start + lines);
-	if (telex_parse(&end_telex, telex_str, &errors) < 0) {
-		fprintf(stderr, "Could not parse telex \"%s\"\n", telex_str);
-		error = -EINVAL;
-		goto cleanup;
-	}
-
-	if (!(start_ptr = telex_lookup(start_telex, buffer->data, buffer->size, buffer->data))) {
-		fprintf(stderr, "Could not lookup start\n");
-		error = -ERANGE;
-		goto cleanup;
-	}
-
-	if (!(end_ptr = telex_lookup(end_telex, buffer->data, buffer->size, buffer->data))) {
-		/*
-		 * The specified line is behind the end of the buffer, so we
-		 * limit the snippet to the end of the buffer.
-		 */
-		end_ptr = buffer->data + buffer->size;
-	}
-
-cleanup:
-	if (error == 0) {
-		*snip_start = start_ptr;
-		*snip_end = end_ptr;
-	}
-
-	if (start_telex) {
-		telex_free(&start_telex);
-	}
-	if (end_telex) {
-		telex_free(&end_telex);
-	}
-
-	return error;
-}
-
 int snippet_new(struct snippet **snippet)
 {
 	struct snippet *snip;
@@ -319,16 +766,35 @@ struct line* snippet_get_first_line(struct snippet *snippet)
 	return(snippet ? snippet->first_line : NULL);
 }
 
-int snippet_new_from_string(struct snippet **snippet, const char *str,
-			    const size_t len, const int first_line,
-			    const char *sel_start, const char *sel_end)
+static int _snippet_append(struct snippet *snip, struct line *line,
+			   const char *sel_start, const char *sel_end)
 {
-	struct snippet *snip;
-	const char *pos;
-	int cur_line;
+	if(sel_start >= line->data && sel_start < line->data + line->len) {
+		snippet_set_selection_start(snip, line, sel_start);
+	}
 
-	if(!snippet || !str) {
-		return(-EINVAL);
+	if(sel_end >= line->data && sel_end < line->data + line->len) {
+		snippet_set_selection_end(snip, line, sel_end);
+	}
+
+	if(snippet_append_line(snip, line) < 0) {
+		line_free(&line);
+		return(-EINVAL);
+	}
+
+	return(0);
+}
+
+int snippet_new_from_string(struct snippet **snippet, const char *str,
+			    const size_t len, const int first_line,
+			    const char *sel_start, const char *sel_end)
+{
+	struct snippet *snip;
+	const char *pos;
+	int cur_line;
+
+	if(!snippet || !str) {
+		return(-EINVAL);
 	}
 
 	if(snippet_new(&snip) < 0) {
@@ -338,28 +804,19 @@ int snippet_new_from_string(struct snippet **snippet, const char *str,
 	pos = str;
 	cur_line = first_line;
 
-	while(pos < str + len && *pos) {
+	while(pos < str + len) {
 		struct line *line;
-		const char *line_start;
-		int line_len;
-
-		if(line_new(&line, cur_line, pos) < 0) {
-			break;
-		}
+		const char *newline;
+		size_t line_len;
 
-		line_len = line_get_length(line);
-		line_start = line_get_data(line);
-
-		if(sel_start >= pos && sel_start < pos + line_len) {
-			snippet_set_selection_start(snip, line, sel_start - pos + line_start);
-		}
+		newline = memchr(pos, '\n', str + len - pos);
+		line_len = newline ? newline + 1 - pos : str + len - pos;
 
-		if(sel_end >= pos && sel_end < pos + line_len) {
-			snippet_set_selection_end(snip, line, sel_end - pos + line_start);
+		if(line_new(&line, cur_line, pos, line_len) < 0) {
+			break;
 		}
 
-		if(snippet_append_line(snip, line) < 0) {
-			line_free(&line);
+		if(_snippet_append(snip, line, sel_start, sel_end) < 0) {
 			break;
 		}
 
@@ -392,49 +849,210 @@ int snippet_free(struct snippet **snippet)
 	return(0);
 }
 
+/* find the first fold that ends behind `offset' */
+static int _buffer_find_fold(struct buffer *buffer, const size_t offset)
+{
+	int lo;
+	int hi;
+
+	lo = 0;
+	hi = buffer->num_folds;
+
+	while(lo < hi) {
+		int mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if(buffer->folds[mid].end <= offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return(lo);
+}
+
+/*
+ * The lines of the snippet are looked up in the line index rather than by
+ * searching the data for newlines, so that lines that are very long don't
+ * have to be searched every time they are shown. Folded lines are skipped
+ * without looking at them at all.
+ */
 int buffer_get_snippet(struct buffer *buffer, const int start, const int lines,
 		       const char *sel_start, const char *sel_end,
 		       struct snippet **snippet)
 {
 	struct snippet *snip;
-	const char *snip_start;
-	const char *snip_end;
+	size_t offset;
+	int line;
 	int err;
 
-	snip_start = NULL;
-	snip_end = NULL;
+	if(!buffer || !snippet) {
+		return(-EINVAL);
+	}
 
-	err = _get_snippet_extent(buffer, start, lines, &snip_start, &snip_end);
-	if(err < 0) {
+	if((err = lineindex_get_offset(buffer->lines, buffer->data, buffer->size,
+				       start, &offset)) < 0) {
+		fprintf(stderr, "Could not lookup start\n");
+		return(err);
+	}
+
+	line = start;
+
+	/* a snippet that starts inside of a fold starts with the fold */
+	if(buffer->num_folds > 0 && offset < buffer->size) {
+		int fold;
+
+		if((fold = _buffer_find_fold(buffer, offset)) < buffer->num_folds &&
+		   buffer->folds[fold].start < offset) {
+			offset = buffer->folds[fold].start;
+			line = lineindex_get_line(buffer->lines, buffer->data, buffer->size, offset);
+		}
+	}
+
+	if(snippet_new(&snip) < 0) {
+		return(-ENOMEM);
+	}
+
+	for(; line < start + lines && offset < buffer->size; ) {
+		struct line *cur;
+		size_t next;
+		int fold;
+
+		/* a fold is a single line of the snippet, no matter how many it hides */
+		if((fold = _buffer_find_fold(buffer, offset)) < buffer->num_folds &&
+		   buffer->folds[fold].start == offset) {
+			if(line_new(&cur, line, buffer->data + offset,
+				    buffer->folds[fold].end - offset) < 0) {
+				break;
+			}
+
+			cur->folded = _buffer_fold_lines(buffer, &buffer->folds[fold]);
+			next = buffer->folds[fold].end;
+		} else {
+			if(lineindex_get_offset(buffer->lines, buffer->data, buffer->size,
+						line + 1, &next) < 0) {
+				next = buffer->size;
+			}
+
+			if(line_new(&cur, line, buffer->data + offset, next - offset) < 0) {
+				break;
+			}
+		}
+
+		line += cur->folded ? cur->folded : 1;
+
+		if(_snippet_append(snip, cur, sel_start, sel_end) < 0) {
+			break;
+		}
+
+		offset = next;
+	}
+
+	*snippet = snip;
+	return(0);
+}
+
+/*
+ * Get a snippet of the lines with the numbers in `numbers', which have to
+ * be in order but don't have to follow one another.
+ */
+int buffer_get_snippet_lines(struct buffer *buffer, const int *numbers, const int num,
+			     const char *sel_start, const char *sel_end,
+			     struct snippet **snippet)
+{
+	struct snippet *snip;
+	int err;
+	int i;
+
+	if(!buffer || (num > 0 && !numbers) || !snippet) {
+		return(-EINVAL);
+	}
+
+	if((err = snippet_new(&snip)) < 0) {
 		return(err);
 	}
-	err = snippet_new_from_string(&snip, snip_start, snip_end - snip_start, start,
-				      sel_start, sel_end);
+
+	for(i = 0; i < num; i++) {
+		struct line *cur;
+		size_t offset;
+		size_t next;
+
+		/* lines behind the end of the buffer are left out */
+		if(lineindex_get_offset(buffer->lines, buffer->data, buffer->size,
+					numbers[i], &offset) < 0 || offset >= buffer->size) {
+			break;
+		}
+
+		if(lineindex_get_offset(buffer->lines, buffer->data, buffer->size,
+					numbers[i] + 1, &next) < 0) {
+			next = buffer->size;
+		}
+
+		if((err = line_new(&cur, numbers[i], buffer->data + offset, next - offset)) < 0) {
+			break;
+		}
+
+		/* the line is freed if it can't be appended */
+		if((err = _snippet_append(snip, cur, sel_start, sel_end)) < 0) {
+			break;
+		}
+	}
+
 	if(err < 0) {
+		snippet_free(&snip);
 		return(err);
 	}
 
 	*snippet = snip;
-
 	return(0);
 }
 
-int buffer_get_line_at(struct buffer *buffer, const char *pos)
+int buffer_get_line_range(struct buffer *buffer, const size_t offset, int *line,
+			  size_t *start, size_t *len)
 {
-	const char *cur;
-	int line;
+	size_t first;
+	size_t next;
+	int no;
+	int err;
 
-	if(pos < buffer->data || pos > buffer->data + buffer->size) {
+	if(!buffer || !line || !start || !len) {
+		return(-EINVAL);
+	}
+
+	if(offset >= buffer->size) {
 		return(-ERANGE);
 	}
 
-	for(line = 1, cur = buffer->data; *cur && cur < pos; cur++) {
-		if(*cur == '\n') {
-			line++;
-		}
+	if((no = lineindex_get_line(buffer->lines, buffer->data, buffer->size, offset)) < 0) {
+		return(no);
 	}
 
-	return(line);
+	if((err = lineindex_get_offset(buffer->lines, buffer->data, buffer->size,
+				       no, &first)) < 0) {
+		return(err);
+	}
+
+	if(lineindex_get_offset(buffer->lines, buffer->data, buffer->size, no + 1, &next) < 0) {
+		next = buffer->size;
+	}
+
+	*line = no;
+	*start = first;
+	*len = next - first;
+
+	return(0);
+}
+
+int buffer_get_line_at(struct buffer *buffer, const char *pos)
+{
+	if(pos < buffer->data || pos > buffer->data + buffer->size) {
+		return(-ERANGE);
+	}
+
+	return(lineindex_get_line(buffer->lines, buffer->data, buffer->size,
+				  pos - buffer->data));
 }
 
 int buffer_get_col_at(struct buffer *buffer, const char *pos)
@@ -495,50 +1113,65 @@ const char *snippet_get_selection_end(struct snippet *snip)
 	return(snip->sel_end.pos);
 }
 
-int buffer_get_snippet_telex(struct buffer *buffer, struct telex *start, struct telex *end,
-			     const int lines, struct snippet **snippet)
+int buffer_get_selection(struct buffer *buffer, struct telex *start, struct telex *end,
+			 const char **start_pos, const char **end_pos)
 {
-	const char *start_pos;
-	const char *end_pos;
-	int start_line;
-	int end_line;
-	int center_line;
-	int err;
+	const char *from;
+	const char *to;
 
 	/* end may be NULL */
-	if(!buffer || !start || !snippet) {
+	if(!buffer || !start || !start_pos || !end_pos) {
 		return(-EINVAL);
 	}
 
-	end_pos = NULL;
-	start_pos = telex_lookup(start, buffer->data, buffer->size, buffer->data);
+	to = NULL;
+	from = telex_lookup(start, buffer->data, buffer->size, buffer->data);
 
-	if(!start_pos) {
+	if(!from) {
 		return(-ERANGE);
 	}
 
 	if(end) {
-		end_pos = telex_lookup(end, buffer->data, buffer->size, telex_is_relative(end) ? start_pos : buffer->data);
+		to = telex_lookup(end, buffer->data, buffer->size, telex_is_relative(end) ? from : buffer->data);
 
-		if(end_pos < start_pos) {
+		if(to && to < from) {
 			const char *swap;
 
-			swap = end_pos;
-			end_pos = start_pos;
-			start_pos = swap;
+			swap = to;
+			to = from;
+			from = swap;
 		}
 	}
 
-	if(!end_pos) {
-		end_pos = start_pos + 1;
-		end_line = buffer_get_line_at(buffer, end_pos);
-	} else {
-		end_line = buffer_get_line_at(buffer, end_pos);
+	if(!to || from == to) {
+		to = from + 1;
+	}
 
-		if(start_pos == end_pos) {
-			end_pos++;
-		}
+	*start_pos = from;
+	*end_pos = to;
+
+	return(0);
+}
+
+int buffer_get_snippet_telex(struct buffer *buffer, struct telex *start, struct telex *end,
+			     const int lines, struct snippet **snippet)
+{
+	const char *start_pos;
+	const char *end_pos;
+	int start_line;
+	int end_line;
+	int center_line;
+	int err;
+
+	if(!snippet) {
+		return(-EINVAL);
+	}
+
+	if((err = buffer_get_selection(buffer, start, end, &start_pos, &end_pos)) < 0) {
+		return(err);
 	}
+
+	end_line = buffer_get_line_at(buffer, end_pos);
 	start_line = buffer_get_line_at(buffer, start_pos);
 	center_line = start_line + (end_line - start_line) / 2;
 
@@ -568,33 +1201,9 @@ int buffer_get_snippet_telex(struct buffer *buffer, struct telex *start, struct
 	return(0);
 }
 
-static int _linelen(const char *str)
-{
-	int n;
-
-	if(!str) {
-		return(-EINVAL);
-	}
-
-	n = 0;
-
-	while(*str) {
-		n++;
-
-		if(*str == '\n') {
-			break;
-		}
-
-		str++;
-	}
-
-	return(n);
-}
-
-int line_new(struct line **line, int no, const char *str)
+int line_new(struct line **line, int no, const char *str, const size_t len)
 {
 	struct line *l;
-	int len;
 
 	if(!line || !str) {
 		return(-EINVAL);
@@ -606,19 +1215,11 @@ int line_new(struct line **line, int no, const char *str)
 		return(-ENOMEM);
 	}
 
-	len = _linelen(str);
-	l->data = malloc(len + 1);
-
-	if(!l->data) {
-		free(l);
-		return(-ENOMEM);
-	}
-
-	memcpy(l->data, str, len);
-	l->data[len] = 0;
+	l->next = NULL;
+	l->data = str;
 	l->no = no;
 	l->len = len;
-	l->source = str;
+	l->folded = 0;
 
 	*line = l;
 
@@ -631,9 +1232,6 @@ int line_free(struct line **line)
 		return(-EINVAL);
 	}
 
-	if((*line)->data) {
-		free((*line)->data);
-	}
 	free(*line);
 
 	*line = NULL;
@@ -649,6 +1247,16 @@ int line_get_number(struct line *line)
 	return(line->no);
 }
 
+/* the number of lines that are folded into this one, or 0 */
+int line_get_folded(struct line *line)
+{
+	if(!line) {
+		return(-EINVAL);
+	}
+
+	return(line->folded);
+}
+
 const char* line_get_data(struct line *line)
 {
 	if(!line) {
@@ -667,6 +1275,11 @@ int line_get_length(struct line *line)
 	return(line->len);
 }
 
+const char* line_get_source(struct line *line)
+{
+	return(line ? line->data : NULL);
+}
+
 struct line* line_get_next(struct line *line)
 {
 	return(line ? line->next : NULL);
@@ -771,21 +1384,24 @@ int buffer_get_substring(struct buffer *buffer, struct telex *src_start, struct
 	return 0;
 }
 
-int buffer_insert(struct buffer *buffer, const char *insertion, struct telex *start, const char **new_end)
+int buffer_insert(struct buffer *buffer, const char *insertion, const size_t insertion_len,
+		  struct telex *start, const char **new_end)
 {
 	const char *insertion_pos;
-	size_t insertion_len;
 	size_t insertion_offset;
 	size_t suffix_len;
 	char *new_data;
 	size_t new_size;
 
+	if (_buffer_own_data(buffer) < 0) {
+		return -ENOMEM;
+	}
+
 	if (_buffer_lookup_telex(buffer, start, &insertion_pos) < 0) {
 		return -ERANGE;
 	}
 
 	insertion_offset = (size_t)(insertion_pos - buffer->data);
-	insertion_len = strlen(insertion);
 	suffix_len = buffer->size - insertion_offset;
 	new_size = buffer->size + insertion_len;
 
@@ -802,6 +1418,9 @@ int buffer_insert(struct buffer *buffer, const char *insertion, struct telex *st
 
 	buffer->data = new_data;
 	buffer->size = new_size;
+	_buffer_changed(buffer, insertion_offset, 0, insertion_len,
+			_buffer_count_lines(insertion, insertion_len));
+	_buffer_journal(buffer, insertion_offset, 0, insertion, insertion_len);
 
 	if (new_end) {
 		*new_end = new_data + insertion_offset + insertion_len;
@@ -812,8 +1431,8 @@ int buffer_insert(struct buffer *buffer, const char *insertion, struct telex *st
 	return 0;
 }
 
-int buffer_overwrite(struct buffer *buffer, const char *insertion, struct telex *start, struct telex *end,
-	const char **new_end)
+int buffer_overwrite(struct buffer *buffer, const char *insertion, const size_t insertion_len,
+		     struct telex *start, struct telex *end, const char **new_end)
 {
 	const char *dst_start;
 	const char *dst_end;
@@ -822,9 +1441,15 @@ int buffer_overwrite(struct buffer *buffer, const char *insertion, struct telex
 	ssize_t src_size;
 	ssize_t dst_size;
 	ssize_t required_space;
+	ssize_t replaced;
+	long lines;
 
 	/* if end was specified, overwrite only from start to end, otherwise overwrite as much as needed */
 
+	if (_buffer_own_data(buffer) < 0) {
+		return -ENOMEM;
+	}
+
 	if (_buffer_lookup_telex(buffer, start, &dst_start) < 0) {
 		return -ERANGE;
 	}
@@ -837,10 +1462,15 @@ int buffer_overwrite(struct buffer *buffer, const char *insertion, struct telex
 
 	offset_start = (ssize_t)(dst_start - buffer->data);
 	offset_end = (ssize_t)(dst_end - buffer->data);
-	src_size = (ssize_t)strlen(insertion);
+	src_size = (ssize_t)insertion_len;
 	dst_size = (ssize_t)(dst_end - dst_start);
 	required_space = src_size - dst_size;
 
+	/* without an end, only as many bytes as necessary are overwritten */
+	replaced = (end || src_size > dst_size) ? dst_size : src_size;
+	lines = _buffer_count_lines(insertion, src_size) -
+		_buffer_count_lines(dst_start, replaced);
+
 	if (required_space > 0 || (required_space < 0 && end)) {
 		char *new_data;
 
@@ -860,6 +1490,9 @@ int buffer_overwrite(struct buffer *buffer, const char *insertion, struct telex
 
 	memcpy(buffer->data + offset_start, insertion, src_size);
 
+	_buffer_changed(buffer, offset_start, replaced, src_size, lines);
+	_buffer_journal(buffer, offset_start, replaced, insertion, src_size);
+
 	if (new_end) {
 		*new_end = buffer->data + offset_start + src_size;
 	}
@@ -879,11 +1512,16 @@ int buffer_erase(struct buffer *buffer, struct telex *start, struct telex *end)
 	size_t offset_start;
 	size_t offset_end;
 	size_t trailer_size;
+	long lines;
 
 	if (!buffer || !start) {
 		return -EINVAL;
 	}
 
+	if (_buffer_own_data(buffer) < 0) {
+		return -ENOMEM;
+	}
+
 	if (_buffer_lookup_telex(buffer, start, &erase_start) < 0) {
 		return -ERANGE;
 	}
@@ -906,6 +1544,7 @@ int buffer_erase(struct buffer *buffer, struct telex *start, struct telex *end)
 	offset_end = (size_t)(erase_end - buffer->data);
 	erase_size = offset_end - offset_start;
 	trailer_size = buffer->size - offset_end;
+	lines = _buffer_count_lines(erase_start, erase_size);
 
 	memmove(buffer->data + offset_start,
 		buffer->data + offset_end,
@@ -925,7 +1564,759 @@ int buffer_erase(struct buffer *buffer, struct telex *start, struct telex *end)
 		buffer->data = new_data;
 		buffer->size = new_size;
 	}
+	_buffer_changed(buffer, offset_start, erase_size, 0, -lines);
+	_buffer_journal(buffer, offset_start, erase_size, NULL, 0);
+	buffer->dirty = 1;
+
+	return 0;
+}
+
+int buffer_splice(struct buffer *buffer, const size_t offset, const size_t len,
+		  const char *data, const size_t data_len)
+{
+	size_t new_size;
+	long lines;
+
+	if (!buffer || (!data && data_len > 0)) {
+		return -EINVAL;
+	}
+
+	if (offset > buffer->size || len > buffer->size - offset) {
+		return -ERANGE;
+	}
+
+	if (_buffer_own_data(buffer) < 0) {
+		return -ENOMEM;
+	}
+
+	new_size = buffer->size - len + data_len;
+	lines = _buffer_count_lines(data, data_len) -
+		_buffer_count_lines(buffer->data + offset, len);
+
+	if (data_len > len) {
+		char *new_data;
+
+		if (!(new_data = realloc(buffer->data, new_size + 1))) {
+			return -ENOMEM;
+		}
+
+		buffer->data = new_data;
+	}
+
+	memmove(buffer->data + offset + data_len,
+		buffer->data + offset + len,
+		buffer->size - offset - len);
+
+	if (data_len > 0) {
+		memcpy(buffer->data + offset, data, data_len);
+	}
+
+	buffer->data[new_size] = 0;
+	buffer->size = new_size;
 	buffer->dirty = 1;
 
+	_buffer_changed(buffer, offset, len, data_len, lines);
+	_buffer_journal(buffer, offset, len, data, data_len);
+
+	return 0;
+}
+
+unsigned long buffer_get_generation(struct buffer *buffer)
+{
+	return buffer ? buffer->generation : 0;
+}
+
+/*
+ * Determine the range of the buffer that was affected by the edits made
+ * after `since'. Offsets are those of the current contents. If an edit
+ * changed the size of the buffer, everything behind it moved, so the
+ * range extends to the end of the buffer. If the edits are too old to be
+ * remembered, the entire buffer is reported as damaged.
+ */
+int buffer_get_damage(struct buffer *buffer, const unsigned long since,
+		      size_t *start, size_t *end)
+{
+	unsigned long generation;
+	size_t damage_start;
+	size_t damage_end;
+
+	if (!buffer || !start || !end) {
+		return -EINVAL;
+	}
+
+	if (since == buffer->generation) {
+		*start = 0;
+		*end = 0;
+		return 0;
+	}
+
+	if (since > buffer->generation || buffer->generation - since > BUFFER_EDIT_HISTORY) {
+		*start = 0;
+		*end = SIZE_MAX;
+		return 1;
+	}
+
+	damage_start = SIZE_MAX;
+	damage_end = 0;
+
+	for (generation = since + 1; generation <= buffer->generation; generation++) {
+		struct buffer_edit *edit;
+
+		edit = &buffer->edits[generation % BUFFER_EDIT_HISTORY];
+
+		if (edit->offset < damage_start) {
+			damage_start = edit->offset;
+		}
+
+		if (edit->len != edit->data_len) {
+			damage_end = SIZE_MAX;
+		} else if (edit->offset + edit->data_len > damage_end) {
+			damage_end = edit->offset + edit->data_len;
+		}
+	}
+
+	*start = damage_start;
+	*end = damage_end;
+	return 1;
+}
+
+/*
+ * Follow the range [start, start + len) through the edits that were made
+ * after `since'. If none of the edits touched the contents of the range,
+ * the range's current start is stored in `new_start'. Inserting right in
+ * front of a range doesn't touch it, it only moves it.
+ */
+int buffer_map_range(struct buffer *buffer, const unsigned long since,
+		     const size_t start, const size_t len, size_t *new_start)
+{
+	unsigned long generation;
+	size_t cur;
+
+	if (!buffer || !new_start) {
+		return -EINVAL;
+	}
+
+	if (since > buffer->generation || buffer->generation - since > BUFFER_EDIT_HISTORY) {
+		return -ERANGE;
+	}
+
+	cur = start;
+
+	for (generation = since + 1; generation <= buffer->generation; generation++) {
+		struct buffer_edit *edit;
+
+		edit = &buffer->edits[generation % BUFFER_EDIT_HISTORY];
+
+		if (edit->len > 0 ? (edit->offset < cur + len && edit->offset + edit->len > cur) :
+		    (edit->offset > cur && edit->offset < cur + len)) {
+			return -ESTALE;
+		}
+
+		if (edit->offset + edit->len <= cur) {
+			cur = cur - edit->len + edit->data_len;
+		}
+	}
+
+	*new_start = cur;
 	return 0;
 }
+
+/*
+ * Get the range of the current contents that the edits made after `since'
+ * wrote to, and how many lines they added, or removed if negative. The
+ * contents in front of `start' are unchanged, and what follows `end' was
+ * at most moved.
+ */
+int buffer_get_edits(struct buffer *buffer, const unsigned long since,
+		     size_t *start, size_t *end, long *lines)
+{
+	unsigned long generation;
+
+	if (!buffer || !start || !end || !lines) {
+		return -EINVAL;
+	}
+
+	if (since > buffer->generation || buffer->generation - since > BUFFER_EDIT_HISTORY) {
+		return -ERANGE;
+	}
+
+	*start = 0;
+	*end = 0;
+	*lines = 0;
+
+	for (generation = since + 1; generation <= buffer->generation; generation++) {
+		struct buffer_edit *edit;
+
+		edit = &buffer->edits[generation % BUFFER_EDIT_HISTORY];
+
+		if (generation == since + 1) {
+			*start = edit->offset;
+			*end = edit->offset + edit->data_len;
+			*lines = edit->lines;
+			continue;
+		}
+
+		/* move what was edited before along with this edit */
+		if (*start >= edit->offset + edit->len) {
+			*start = *start - edit->len + edit->data_len;
+		} else if (*start > edit->offset) {
+			*start = edit->offset;
+		}
+
+		if (*end >= edit->offset + edit->len) {
+			*end = *end - edit->len + edit->data_len;
+		} else if (*end > edit->offset) {
+			*end = edit->offset + edit->data_len;
+		}
+
+		if (edit->offset < *start) {
+			*start = edit->offset;
+		}
+		if (edit->offset + edit->data_len > *end) {
+			*end = edit->offset + edit->data_len;
+		}
+
+		*lines += edit->lines;
+	}
+
+	return since == buffer->generation ? 0 : 1;
+}
+
+static int _buffer_add_fold(struct buffer *buffer, const size_t start, const size_t end,
+			    const int lines)
+{
+	int first;
+	int last;
+
+	if (lines < 1 || start >= end) {
+		return -EINVAL;
+	}
+
+	if (buffer->num_folds == buffer->max_folds) {
+		struct buffer_fold *folds;
+		int max;
+
+		max = buffer->max_folds ? buffer->max_folds * 2 : BUFFER_INIT_FOLDS;
+
+		if (!(folds = realloc(buffer->folds, max * sizeof(*folds)))) {
+			return -ENOMEM;
+		}
+
+		buffer->folds = folds;
+		buffer->max_folds = max;
+	}
+
+	/* the new fold takes the place of the ones it overlaps */
+	first = _buffer_find_fold(buffer, start);
+
+	for (last = first; last < buffer->num_folds && buffer->folds[last].start < end; last++);
+
+	memmove(buffer->folds + first + 1, buffer->folds + last,
+		(buffer->num_folds - last) * sizeof(*buffer->folds));
+	buffer->num_folds += 1 - (last - first);
+
+	buffer->folds[first].start = start;
+	buffer->folds[first].end = end;
+	buffer->folds[first].newlines = lines - (buffer->data[end - 1] != '\n');
+	buffer->fold_generation++;
+
+	return 0;
+}
+
+/*
+ * Fold the lines that the bytes from `start' to `end' are on, so that they
+ * are shown as a single line.
+ */
+int buffer_fold(struct buffer *buffer, const size_t start, const size_t end)
+{
+	size_t first_start;
+	size_t last_start;
+	size_t len;
+	int first;
+	int last;
+	int err;
+
+	if (!buffer || start >= end || start >= buffer->size) {
+		return -EINVAL;
+	}
+
+	if ((err = buffer_get_line_range(buffer, start, &first, &first_start, &len)) < 0 ||
+	    (err = buffer_get_line_range(buffer, (end < buffer->size ? end : buffer->size) - 1,
+					 &last, &last_start, &len)) < 0) {
+		return err;
+	}
+
+	return _buffer_add_fold(buffer, first_start, last_start + len, last - first + 1);
+}
+
+static size_t _buffer_indent(const char *data, const size_t len, int *blank)
+{
+	size_t indent;
+	size_t i;
+
+	for (i = 0, indent = 0; i < len && (data[i] == ' ' || data[i] == '\t'); i++) {
+		indent += data[i] == '\t' ? config.tab_width - indent % config.tab_width : 1;
+	}
+
+	*blank = i == len || data[i] == '\n';
+	return indent;
+}
+
+/*
+ * Fold the lines that follow the line at `offset' and are indented deeper
+ * than it, along with the blank lines among them.
+ */
+int buffer_fold_block(struct buffer *buffer, const size_t offset)
+{
+	const char *data;
+	size_t indent;
+	size_t start;
+	size_t end;
+	size_t pos;
+	size_t len;
+	int lines;
+	int line;
+	int blank;
+	int err;
+
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	if ((err = buffer_get_line_range(buffer, offset, &line, &start, &len)) < 0) {
+		return err;
+	}
+
+	data = buffer->data;
+	indent = _buffer_indent(data + start, len, &blank);
+	start += len;
+
+	for (pos = start, end = start, lines = 0, line = 0; pos < buffer->size; pos += len) {
+		const char *eol;
+		size_t cur;
+
+		eol = memchr(data + pos, '\n', buffer->size - pos);
+		len = eol ? (size_t)(eol - data) + 1 - pos : buffer->size - pos;
+		cur = _buffer_indent(data + pos, len, &blank);
+		line++;
+
+		if (blank) {
+			continue;
+		}
+
+		if (cur <= indent) {
+			break;
+		}
+
+		end = pos + len;
+		lines = line;
+	}
+
+	if (lines == 0) {
+		return -ENOENT;
+	}
+
+	return _buffer_add_fold(buffer, start, end, lines);
+}
+
+/* show the lines of the fold at `offset' again */
+int buffer_unfold(struct buffer *buffer, const size_t offset)
+{
+	int fold;
+
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	fold = _buffer_find_fold(buffer, offset);
+
+	if (fold == buffer->num_folds || buffer->folds[fold].start > offset) {
+		return -ENOENT;
+	}
+
+	memmove(buffer->folds + fold, buffer->folds + fold + 1,
+		(buffer->num_folds - fold - 1) * sizeof(*buffer->folds));
+	buffer->num_folds--;
+	buffer->fold_generation++;
+
+	return 0;
+}
+
+/* get the fold that the byte at `offset' is in */
+int buffer_get_fold(struct buffer *buffer, const size_t offset, size_t *start, size_t *end,
+		    int *lines)
+{
+	int fold;
+
+	if (!buffer || !start || !end || !lines) {
+		return -EINVAL;
+	}
+
+	fold = _buffer_find_fold(buffer, offset);
+
+	if (fold == buffer->num_folds || buffer->folds[fold].start > offset) {
+		return -ENOENT;
+	}
+
+	*start = buffer->folds[fold].start;
+	*end = buffer->folds[fold].end;
+	*lines = _buffer_fold_lines(buffer, &buffer->folds[fold]);
+
+	return 0;
+}
+
+/* changes whenever lines are folded or unfolded */
+unsigned long buffer_get_fold_generation(struct buffer *buffer)
+{
+	return buffer ? buffer->fold_generation : 0;
+}
+
+int buffer_set_journal(struct buffer *buffer, struct journal *journal)
+{
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	buffer->journal = journal;
+	return 0;
+}
+
+int buffer_watch(struct buffer *buffer)
+{
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	return file_watch(buffer->file);
+}
+
+int buffer_follow(struct buffer *buffer)
+{
+	int err;
+
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	buffer->follow = 1;
+
+	if ((err = file_watch(buffer->file)) == -EALREADY) {
+		err = 0;
+	}
+
+	return err;
+}
+
+int buffer_get_watch_fd(struct buffer *buffer)
+{
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	return file_get_watch_fd(buffer->file);
+}
+
+int buffer_is_stale(struct buffer *buffer)
+{
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	return buffer->stale;
+}
+
+/*
+ * Compare the file contents in [offset, offset + len) with the buffer
+ * contents at `data', one block at a time, and return the number of
+ * leading bytes that are the same in both.
+ */
+static int _buffer_match_forward(struct buffer *buffer, char *block, const char *data,
+				 const size_t offset, const size_t len, size_t *matched)
+{
+	size_t done;
+	int err;
+
+	for (done = 0; done < len; ) {
+		size_t chunk;
+		size_t read_len;
+		size_t same;
+
+		chunk = len - done < BUFFER_RELOAD_BLOCK_SIZE ? len - done : BUFFER_RELOAD_BLOCK_SIZE;
+
+		if ((err = file_read_at(buffer->file, offset + done, block, chunk, &read_len)) < 0) {
+			return err;
+		}
+
+		if (read_len == chunk && memcmp(block, data + done, chunk) == 0) {
+			done += chunk;
+			continue;
+		}
+
+		for (same = 0; same < read_len && block[same] == data[done + same]; same++);
+		done += same;
+		break;
+	}
+
+	*matched = done;
+	return 0;
+}
+
+/*
+ * Same as _buffer_match_forward(), but compares the ranges that end at
+ * `offset + len' and `data + len' respectively, walking backwards.
+ */
+static int _buffer_match_backward(struct buffer *buffer, char *block, const char *data,
+				  const size_t offset, const size_t len, size_t *matched)
+{
+	size_t done;
+	int err;
+
+	for (done = 0; done < len; ) {
+		size_t chunk;
+		size_t read_len;
+		size_t same;
+
+		chunk = len - done < BUFFER_RELOAD_BLOCK_SIZE ? len - done : BUFFER_RELOAD_BLOCK_SIZE;
+
+		if ((err = file_read_at(buffer->file, offset + len - done - chunk,
+					block, chunk, &read_len)) < 0) {
+			return err;
+		}
+
+		if (read_len != chunk) {
+			break;
+		}
+
+		if (memcmp(block, data + len - done - chunk, chunk) == 0) {
+			done += chunk;
+			continue;
+		}
+
+		for (same = 0;
+		     same < chunk && block[chunk - same - 1] == data[len - done - same - 1];
+		     same++);
+		done += same;
+		break;
+	}
+
+	*matched = done;
+	return 0;
+}
+
+/*
+ * Bring the buffer in sync with the file, replacing only the range that
+ * differs. Since the buffer is unmodified, its contents are exactly what
+ * was on disk, so we find the longest common prefix and suffix and read
+ * only what lies between them. Everything before the changed range,
+ * including the line index entries, stays untouched.
+ */
+static int _buffer_reload(struct buffer *buffer)
+{
+	size_t new_size;
+	size_t old_size;
+	size_t common;
+	size_t prefix;
+	size_t suffix;
+	size_t old_middle;
+	size_t new_middle;
+	size_t read_len;
+	long old_lines;
+	char *block;
+	int err;
+
+	if ((err = file_get_size(buffer->file, &new_size)) < 0) {
+		return err;
+	}
+
+	if (!(block = malloc(BUFFER_RELOAD_BLOCK_SIZE))) {
+		return -ENOMEM;
+	}
+
+	old_size = buffer->size;
+	common = old_size < new_size ? old_size : new_size;
+	prefix = 0;
+	suffix = 0;
+
+	if ((err = _buffer_match_forward(buffer, block, buffer->data,
+					 0, common, &prefix)) < 0 ||
+	    (err = _buffer_match_backward(buffer, block, buffer->data + old_size - (common - prefix),
+					  new_size - (common - prefix), common - prefix,
+					  &suffix)) < 0) {
+		free(block);
+		return err;
+	}
+
+	free(block);
+
+	old_middle = old_size - prefix - suffix;
+	new_middle = new_size - prefix - suffix;
+
+	if (old_middle == 0 && new_middle == 0) {
+		file_update_stamp(buffer->file);
+		_buffer_reset_journal(buffer);
+		return 0;
+	}
+
+	if ((err = _buffer_own_data(buffer)) < 0) {
+		return err;
+	}
+
+	old_lines = _buffer_count_lines(buffer->data + prefix, old_middle);
+
+	if (new_middle > old_middle) {
+		char *new_data;
+
+		if (!(new_data = realloc(buffer->data, new_size + 1))) {
+			return -ENOMEM;
+		}
+
+		buffer->data = new_data;
+	}
+
+	memmove(buffer->data + prefix + new_middle,
+		buffer->data + prefix + old_middle,
+		suffix);
+
+	if ((err = file_read_at(buffer->file, prefix, buffer->data + prefix,
+				new_middle, &read_len)) < 0 ||
+	    read_len != new_middle) {
+		/* the buffer no longer matches anything, start over */
+		_buffer_changed(buffer, 0, buffer->size, 0,
+				-_buffer_count_lines(buffer->data, buffer->size));
+		buffer->size = 0;
+		buffer->file_size = 0;
+		return err < 0 ? err : -EIO;
+	}
+
+	if (new_middle < old_middle) {
+		char *new_data;
+
+		/* if this fails we simply keep the bigger allocation */
+		if ((new_data = realloc(buffer->data, new_size + 1))) {
+			buffer->data = new_data;
+		}
+	}
+
+	buffer->data[new_size] = 0;
+	buffer->size = new_size;
+	buffer->file_size = new_size;
+	buffer->stale = 0;
+	_buffer_changed(buffer, prefix, old_middle, new_middle,
+			_buffer_count_lines(buffer->data + prefix, new_middle) - old_lines);
+	file_update_stamp(buffer->file);
+	_buffer_reset_journal(buffer);
+
+	return 1;
+}
+
+static int _buffer_read_appended(struct buffer *buffer, const size_t file_size)
+{
+	size_t appended;
+	size_t read_len;
+	char *new_data;
+	int err;
+
+	appended = file_size - buffer->file_size;
+
+	if ((err = _buffer_own_data(buffer)) < 0) {
+		return err;
+	}
+
+	if (!(new_data = realloc(buffer->data, buffer->size + appended + 1))) {
+		return -ENOMEM;
+	}
+
+	buffer->data = new_data;
+
+	if ((err = file_read_at(buffer->file, buffer->file_size,
+				buffer->data + buffer->size, appended, &read_len)) < 0) {
+		buffer->data[buffer->size] = 0;
+		return err;
+	}
+
+	/*
+	 * Only the new bytes are read, and since the line index only records
+	 * lines up to the position it has scanned, invalidating it at the old
+	 * end doesn't cost anything; it picks up the new lines when they are
+	 * looked up.
+	 */
+	if (read_len > 0) {
+		_buffer_changed(buffer, buffer->size, 0, read_len,
+				_buffer_count_lines(buffer->data + buffer->size, read_len));
+	}
+
+	buffer->size += read_len;
+	buffer->file_size += read_len;
+	buffer->data[buffer->size] = 0;
+	file_update_stamp(buffer->file);
+	_buffer_reset_journal(buffer);
+
+	return read_len > 0;
+}
+
+int buffer_refresh(struct buffer *buffer)
+{
+	size_t file_size;
+	int events;
+	int err;
+
+	if (!buffer) {
+		return -EINVAL;
+	}
+
+	if (file_get_watch_fd(buffer->file) < 0) {
+		/* not watched, so all we can do is look at the file's stamp */
+		events = file_is_modified(buffer->file) > 0 ? FILE_EVENT_MODIFIED : 0;
+	} else if ((err = file_get_events(buffer->file, &events)) < 0) {
+		return err;
+	} else if ((events & FILE_EVENT_MODIFIED) && file_is_modified(buffer->file) == 0) {
+		/* we are told about our own writes, too, but they updated the stamp */
+		events &= ~FILE_EVENT_MODIFIED;
+	}
+
+	if (buffer->dirty) {
+		/* don't mix changes on disk with changes of the user */
+		if (events) {
+			buffer->stale = 1;
+			return -EBUSY;
+		}
+
+		return 0;
+	}
+
+	if (events & FILE_EVENT_REPLACED) {
+		buffer->reopen_pending = 1;
+	}
+
+	if (buffer->reopen_pending) {
+		/*
+		 * The file was rotated, removed, or replaced by a program that
+		 * saves by renaming. Follow the path rather than the inode, but
+		 * keep the old contents until a new file shows up.
+		 */
+		if ((err = file_reopen(buffer->file)) < 0) {
+			return err == -ENOENT ? 0 : err;
+		}
+
+		buffer->reopen_pending = 0;
+		return _buffer_reload(buffer);
+	}
+
+	if (!(events & FILE_EVENT_MODIFIED)) {
+		return 0;
+	}
+
+	if ((err = file_get_size(buffer->file, &file_size)) < 0) {
+		return err;
+	}
+
+	/*
+	 * When following, the file is expected to only grow, so we don't
+	 * bother comparing what we already have.
+	 */
+	if (buffer->follow && file_size > buffer->file_size) {
+		return _buffer_read_appended(buffer, file_size);
+	}
+
+	return _buffer_reload(buffer);
+}
@@ -3,39 +3,87 @@
 
 #include <telex/telex.h>
 
+#define BUFFER_EDIT_HISTORY 64
+
 struct buffer;
 struct snippet;
 struct line;
+struct journal;
 
 int buffer_open(struct buffer **buffer, const char *path, const int readonly);
 int buffer_close(struct buffer **buffer);
 int buffer_save(struct buffer *buffer);
+int buffer_save_force(struct buffer *buffer);
 int buffer_append(struct buffer *buffer, char chr);
+int buffer_unload(struct buffer *buffer);
+int buffer_load(struct buffer *buffer);
+int buffer_is_loaded(struct buffer *buffer);
+size_t buffer_get_memory(struct buffer *buffer);
+const char* buffer_get_path(struct buffer *buffer);
 const char* buffer_get_data(struct buffer *buffer);
 size_t buffer_get_size(struct buffer *buffer);
 
 int buffer_clone(struct buffer *src, struct buffer **dst);
+int buffer_snapshot(struct buffer *src, struct buffer **dst);
+int buffer_adopt_index(struct buffer *buffer, struct buffer *snapshot,
+		       const unsigned long generation);
+size_t buffer_get_indexed(struct buffer *buffer);
+
+int buffer_watch(struct buffer *buffer);
+int buffer_follow(struct buffer *buffer);
+int buffer_get_watch_fd(struct buffer *buffer);
+int buffer_refresh(struct buffer *buffer);
+int buffer_is_stale(struct buffer *buffer);
 
 int buffer_get_line_at(struct buffer *buffer, const char *pos);
+int buffer_get_line_range(struct buffer *buffer, const size_t offset, int *line,
+			  size_t *start, size_t *len);
 int buffer_get_snippet(struct buffer *buffer, const int start, const int lines,
 		       const char *sel_start, const char *sel_end,
 		       struct snippet **snippet);
+int buffer_get_snippet_lines(struct buffer *buffer, const int *numbers, const int num,
+			     const char *sel_start, const char *sel_end,
+			     struct snippet **snippet);
+int buffer_get_selection(struct buffer *buffer, struct telex *start, struct telex *end,
+			 const char **start_pos, const char **end_pos);
 int buffer_get_snippet_telex(struct buffer *buffer, struct telex *start, struct telex *end,
 			     const int lines, struct snippet **snippet);
 
 int buffer_get_substring(struct buffer *buffer, struct telex *src_start, struct telex *src_end,
 			 const char **substring, size_t *substring_length);
 
-int buffer_insert(struct buffer *buffer, const char *insertion, struct telex *start, const char **new_end);
-int buffer_overwrite(struct buffer *buffer, const char *insertion, struct telex *start, struct telex *end,
-		     const char **new_end);
+int buffer_insert(struct buffer *buffer, const char *insertion, const size_t insertion_len,
+		  struct telex *start, const char **new_end);
+int buffer_overwrite(struct buffer *buffer, const char *insertion, const size_t insertion_len,
+		     struct telex *start, struct telex *end, const char **new_end);
 int buffer_erase(struct buffer *buffer, struct telex *start, struct telex *end);
+int buffer_splice(struct buffer *buffer, const size_t offset, const size_t len,
+		  const char *data, const size_t data_len);
+
+unsigned long buffer_get_generation(struct buffer *buffer);
+int buffer_get_damage(struct buffer *buffer, const unsigned long since,
+		      size_t *start, size_t *end);
+int buffer_get_edits(struct buffer *buffer, const unsigned long since,
+		     size_t *start, size_t *end, long *lines);
+int buffer_map_range(struct buffer *buffer, const unsigned long since,
+		     const size_t start, const size_t len, size_t *new_start);
+
+int buffer_fold(struct buffer *buffer, const size_t start, const size_t end);
+int buffer_fold_block(struct buffer *buffer, const size_t offset);
+int buffer_unfold(struct buffer *buffer, const size_t offset);
+int buffer_get_fold(struct buffer *buffer, const size_t offset, size_t *start, size_t *end,
+		    int *lines);
+unsigned long buffer_get_fold_generation(struct buffer *buffer);
+
+int buffer_set_journal(struct buffer *buffer, struct journal *journal);
 
-int          line_new(struct line **line, int no, const char *str);
+int          line_new(struct line **line, int no, const char *str, const size_t len);
 int          line_free(struct line**);
 int          line_get_number(struct line*);
 int          line_get_length(struct line*);
+int          line_get_folded(struct line*);
 const char*  line_get_data(struct line*);
+const char*  line_get_source(struct line*);
 struct line* line_get_next(struct line*);
 
 int snippet_new(struct snippet**);
@@ -156,16 +156,8 @@ static int _cmdbox_blank(struct widget *widget)
 	}
 
 	for (y = 0; y < widget->height; y++) {
-		int x;
-
-		for (x = 0; x < widget->width; x++) {
-			mvwaddch(widget->window,
-				 widget->y + y, widget->x + x,
-				 ' ');
-		}
-
-		mvchgat(widget->y + y, widget->x, widget->width,
-			0, UI_COLOR_COMMAND, NULL);
+		display_fill(widget->display, widget->x, widget->y + y,
+			     widget->width, ' ', UI_COLOR_COMMAND);
 	}
 
 	return 0;
@@ -268,10 +260,10 @@ static int _cmdbox_redraw(struct widget *widget)
 				  strlen(line_data) - box->viewport.x,
 				  box->print_buffer,
 				  widget->width);
-		mvwprintw(widget->window, widget->y + y, widget->x,
-			  "%.*s", widget->width, line_data);
-		fprintf(stderr, "mvwprintw(%p, %d, %d, \"%%.*s\", %d, \"%s\");\n", (void*)widget->window, widget->y + y, widget->x, widget->width,
-			line_data + box->viewport.x);
+		display_put(widget->display, widget->x, widget->y + y,
+			    line_data, widget->width, UI_COLOR_DEFAULT);
+		fprintf(stderr, "display_put(%p, %d, %d, \"%s\", %d, %d);\n", (void*)widget->display, widget->x, widget->y + y,
+			line_data + box->viewport.x, widget->width, UI_COLOR_DEFAULT);
 
 		if (y == box->cursor.y) {
 			real_cursor_x = _get_real_cursor_pos(line_data, box->cursor.x) - box->viewport.x;
@@ -304,8 +296,8 @@ static int _cmdbox_redraw(struct widget *widget)
 		}
 	}
 
-	move(widget->y + box->cursor.y - box->viewport.y,
-	     widget->x + real_cursor_x);
+	display_move(widget->display, widget->x + real_cursor_x,
+		     widget->y + box->cursor.y - box->viewport.y);
 
 	return(0);
 }
@@ -366,16 +358,43 @@ static int _cmdbox_key_pressed(struct widget *widget, void *user_data, void *eve
 			_box_set_cursor(box, 0);
 			break;
 
-		case KEYCODE_F1:
 		case KEYCODE_F2:
+			widget_emit_signal(widget, "fold_requested", NULL);
+			break;
+
 		case KEYCODE_F3:
+			widget_emit_signal(widget, "unfold_requested", NULL);
+			break;
+
 		case KEYCODE_F4:
+			widget_emit_signal(widget, "hex_toggled", NULL);
+			break;
+
 		case KEYCODE_F5:
+			widget_emit_signal(widget, "columns_toggled", box->buffer);
+			break;
+
 		case KEYCODE_F6:
+			widget_emit_signal(widget, "field_requested", box->buffer);
+			break;
+
 		case KEYCODE_F7:
+			widget_emit_signal(widget, "json_toggled", NULL);
+			break;
+
 		case KEYCODE_F8:
+			widget_emit_signal(widget, "json_fold_toggled", NULL);
+			break;
+
 		case KEYCODE_F9:
+			widget_emit_signal(widget, "diff_toggled", NULL);
+			break;
+
 		case KEYCODE_F10:
+			widget_emit_signal(widget, "snapshot_diff_toggled", NULL);
+			break;
+
+		case KEYCODE_F1:
 		case KEYCODE_F11:
 		case KEYCODE_F12:
 			break;
@@ -454,6 +473,38 @@ static int _cmdbox_key_pressed(struct widget *widget, void *user_data, void *eve
 		case 'N':
 			widget_emit_signal(widget, "oinsert_requested", box->buffer);
 			break;
+
+		case 'W':
+			widget_emit_signal(widget, "wrap_toggled", NULL);
+			break;
+
+		case 'K':
+			widget_emit_signal(widget, "scroll_left_requested", NULL);
+			break;
+
+		case 'L':
+			widget_emit_signal(widget, "scroll_right_requested", NULL);
+			break;
+
+		case 'T':
+			widget_emit_signal(widget, "split_requested", NULL);
+			break;
+
+		case 'U':
+			widget_emit_signal(widget, "unsplit_requested", NULL);
+			break;
+
+		case 'O':
+			widget_emit_signal(widget, "focus_next_requested", NULL);
+			break;
+
+		case 'G':
+			widget_emit_signal(widget, "buffer_switch_requested", box->buffer);
+			break;
+
+		case 'Y':
+			widget_emit_signal(widget, "grep_requested", box->buffer);
+			break;
 		}
 	}
 
@@ -501,6 +552,23 @@ int cmdbox_new(struct cmdbox **cmdbox)
 	widget_add_signal((struct widget*)box, "save_requested");
 	widget_add_signal((struct widget*)box, "erase_requested");
 	widget_add_signal((struct widget*)box, "quit_requested");
+	widget_add_signal((struct widget*)box, "wrap_toggled");
+	widget_add_signal((struct widget*)box, "scroll_left_requested");
+	widget_add_signal((struct widget*)box, "scroll_right_requested");
+	widget_add_signal((struct widget*)box, "split_requested");
+	widget_add_signal((struct widget*)box, "unsplit_requested");
+	widget_add_signal((struct widget*)box, "focus_next_requested");
+	widget_add_signal((struct widget*)box, "buffer_switch_requested");
+	widget_add_signal((struct widget*)box, "grep_requested");
+	widget_add_signal((struct widget*)box, "fold_requested");
+	widget_add_signal((struct widget*)box, "unfold_requested");
+	widget_add_signal((struct widget*)box, "hex_toggled");
+	widget_add_signal((struct widget*)box, "columns_toggled");
+	widget_add_signal((struct widget*)box, "field_requested");
+	widget_add_signal((struct widget*)box, "json_toggled");
+	widget_add_signal((struct widget*)box, "json_fold_toggled");
+	widget_add_signal((struct widget*)box, "diff_toggled");
+	widget_add_signal((struct widget*)box, "snapshot_diff_toggled");
 
 	*cmdbox = box;
 
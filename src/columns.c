@@ -0,0 +1,418 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "columns.h"
+#include "buffer.h"
+
+/* must be a power of two */
+#define COLUMNS_CACHE_LINES   256
+#define COLUMNS_SAMPLE_LINES  100
+#define COLUMNS_MAX_WIDTH     32
+#define COLUMNS_DEFAULT_WIDTH 8
+#define COLUMNS_INIT_FIELDS   16
+#define COLUMNS_SEPARATOR_WIDTH ((int)sizeof(COLUMNS_SEPARATOR) - 1)
+
+struct columns_line {
+	size_t offset;
+	size_t len;
+	int valid;
+
+	struct columns_field *fields;
+	int num_fields;
+	int max_fields;
+};
+
+/*
+ * The fields of a line are found with memchr(), which looks at many bytes
+ * at a time, and quotes are only looked at in fields that start with one.
+ * The fields of the lines that were shown recently are kept in a small
+ * cache, so a frame only has to split the lines that scrolled into view.
+ * Since the cache only ever holds lines that were on the screen, it is
+ * simply dropped when the buffer changes. The widths of the columns are
+ * estimated from the first lines of the buffer, so that the table doesn't
+ * change its shape while scrolling.
+ */
+struct columns {
+	struct buffer *buffer;
+	unsigned long generation;
+
+	/* 0 if it is to be guessed from the first line */
+	char fixed_delimiter;
+	char delimiter;
+
+	int *widths;
+	int num_widths;
+
+	struct columns_line cache[COLUMNS_CACHE_LINES];
+};
+
+int columns_new(struct columns **columns, const char delimiter)
+{
+	struct columns *cols;
+
+	if(!columns || delimiter == '"' || delimiter == '\n') {
+		return(-EINVAL);
+	}
+
+	if(!(cols = calloc(1, sizeof(*cols)))) {
+		return(-ENOMEM);
+	}
+
+	cols->fixed_delimiter = delimiter;
+	cols->delimiter = delimiter ? delimiter : ',';
+
+	*columns = cols;
+	return(0);
+}
+
+int columns_free(struct columns **columns)
+{
+	int i;
+
+	if(!columns || !*columns) {
+		return(-EINVAL);
+	}
+
+	for(i = 0; i < COLUMNS_CACHE_LINES; i++) {
+		free((*columns)->cache[i].fields);
+	}
+
+	free((*columns)->widths);
+	free(*columns);
+	*columns = NULL;
+
+	return(0);
+}
+
+static int _columns_add_field(struct columns_line *line, const size_t start, const size_t len)
+{
+	if(line->num_fields == line->max_fields) {
+		struct columns_field *fields;
+		int max;
+
+		max = line->max_fields ? line->max_fields * 2 : COLUMNS_INIT_FIELDS;
+
+		if(!(fields = realloc(line->fields, max * sizeof(*fields)))) {
+			return(-ENOMEM);
+		}
+
+		line->fields = fields;
+		line->max_fields = max;
+	}
+
+	line->fields[line->num_fields].start = start;
+	line->fields[line->num_fields].len = len;
+	line->num_fields++;
+
+	return(0);
+}
+
+/*
+ * Split the `len' bytes at `data' into fields. A field that starts with a
+ * quote ends at the first delimiter after the closing quote, where two
+ * quotes in a row don't close it. Quoted newlines are not supported, since
+ * the columns are shown one line at a time.
+ */
+static int _columns_split(struct columns *columns, const char *data, size_t len,
+			  struct columns_line *line)
+{
+	const char *end;
+	size_t pos;
+	int err;
+
+	line->num_fields = 0;
+
+	if(len > 0 && data[len - 1] == '\n') {
+		len--;
+	}
+
+	if(len > 0 && data[len - 1] == '\r') {
+		len--;
+	}
+
+	pos = 0;
+
+	do {
+		size_t from;
+		size_t field_end;
+
+		from = pos;
+
+		if(pos < len && data[pos] == '"') {
+			const char *quote;
+
+			for(pos++; (quote = memchr(data + pos, '"', len - pos)); ) {
+				pos = quote - data + 1;
+
+				if(pos == len || data[pos] != '"') {
+					break;
+				}
+
+				pos++;
+			}
+
+			if(!quote) {
+				pos = len;
+			}
+		}
+
+		end = memchr(data + pos, columns->delimiter, len - pos);
+		field_end = end ? (size_t)(end - data) : len;
+
+		if((err = _columns_add_field(line, from, field_end - from)) < 0) {
+			return(err);
+		}
+
+		pos = field_end + 1;
+	} while(end);
+
+	return(0);
+}
+
+static char _columns_guess_delimiter(const char *data, const size_t size)
+{
+	static const char candidates[] = { '\t', ',', ';', '|' };
+	const char *eol;
+	size_t len;
+	size_t best;
+	char delimiter;
+	int i;
+
+	eol = memchr(data, '\n', size);
+	len = eol ? (size_t)(eol - data) : size;
+	delimiter = ',';
+	best = 0;
+
+	for(i = 0; i < (int)sizeof(candidates); i++) {
+		const char *pos;
+		size_t count;
+
+		for(count = 0, pos = data;
+		    (pos = memchr(pos, candidates[i], len - (pos - data))); pos++) {
+			count++;
+		}
+
+		if(count > best) {
+			best = count;
+			delimiter = candidates[i];
+		}
+	}
+
+	return(delimiter);
+}
+
+static int _columns_set_width(struct columns *columns, const int field, const int width)
+{
+	if(field >= columns->num_widths) {
+		int *widths;
+
+		if(!(widths = realloc(columns->widths, (field + 1) * sizeof(*widths)))) {
+			return(-ENOMEM);
+		}
+
+		memset(widths + columns->num_widths, 0,
+		       (field + 1 - columns->num_widths) * sizeof(*widths));
+		columns->widths = widths;
+		columns->num_widths = field + 1;
+	}
+
+	if(width > columns->widths[field]) {
+		columns->widths[field] = width;
+	}
+
+	return(0);
+}
+
+/* estimate the widths of the columns from the first lines of the buffer */
+static int _columns_sample(struct columns *columns, struct buffer *buffer)
+{
+	struct columns_line line;
+	const char *data;
+	size_t offset;
+	size_t size;
+	int lines;
+	int err;
+	int i;
+
+	data = buffer_get_data(buffer);
+	size = buffer_get_size(buffer);
+	columns->num_widths = 0;
+	memset(&line, 0, sizeof(line));
+	err = 0;
+
+	for(offset = 0, lines = 0; offset < size && lines < COLUMNS_SAMPLE_LINES; lines++) {
+		const char *eol;
+		size_t len;
+
+		eol = memchr(data + offset, '\n', size - offset);
+		len = eol ? (size_t)(eol - data) + 1 - offset : size - offset;
+
+		if((err = _columns_split(columns, data + offset, len, &line)) < 0) {
+			break;
+		}
+
+		for(i = 0; i < line.num_fields; i++) {
+			size_t width;
+
+			width = line.fields[i].len < COLUMNS_MAX_WIDTH ?
+				line.fields[i].len : COLUMNS_MAX_WIDTH;
+
+			if((err = _columns_set_width(columns, i, width > 0 ? width : 1)) < 0) {
+				break;
+			}
+		}
+
+		offset += len;
+	}
+
+	free(line.fields);
+	return(err);
+}
+
+static void _columns_flush(struct columns *columns)
+{
+	int i;
+
+	for(i = 0; i < COLUMNS_CACHE_LINES; i++) {
+		columns->cache[i].valid = 0;
+	}
+}
+
+/* bring the columns up to date with the contents of `buffer' */
+int columns_update(struct columns *columns, struct buffer *buffer)
+{
+	int err;
+
+	if(!columns || !buffer) {
+		return(-EINVAL);
+	}
+
+	if(columns->buffer == buffer &&
+	   columns->generation == buffer_get_generation(buffer)) {
+		return(0);
+	}
+
+	_columns_flush(columns);
+	err = 0;
+
+	/* an empty buffer has nothing to estimate the widths from, yet */
+	if(columns->buffer != buffer || columns->num_widths == 0) {
+		if(!columns->fixed_delimiter) {
+			columns->delimiter = _columns_guess_delimiter(buffer_get_data(buffer),
+								      buffer_get_size(buffer));
+		}
+
+		err = _columns_sample(columns, buffer);
+	}
+
+	columns->buffer = err < 0 ? NULL : buffer;
+	columns->generation = buffer_get_generation(buffer);
+
+	return(err);
+}
+
+/*
+ * Get the fields of the line of `len' bytes at `offset'. The fields stay
+ * valid until the buffer changes or the fields of another line are asked
+ * for.
+ */
+int columns_get_fields(struct columns *columns, struct buffer *buffer, const size_t offset,
+		       const size_t len, const struct columns_field **fields, int *num)
+{
+	struct columns_line *line;
+	int err;
+
+	if(!columns || !buffer || !fields || !num) {
+		return(-EINVAL);
+	}
+
+	if(offset > buffer_get_size(buffer) || len > buffer_get_size(buffer) - offset) {
+		return(-ERANGE);
+	}
+
+	if((err = columns_update(columns, buffer)) < 0) {
+		return(err);
+	}
+
+	line = &columns->cache[(offset * 0x9e3779b97f4a7c15ULL >> 32) & (COLUMNS_CACHE_LINES - 1)];
+
+	if(!line->valid || line->offset != offset || line->len != len) {
+		line->valid = 0;
+
+		if((err = _columns_split(columns, buffer_get_data(buffer) + offset, len, line)) < 0) {
+			return(err);
+		}
+
+		line->offset = offset;
+		line->len = len;
+		line->valid = 1;
+	}
+
+	*fields = line->fields;
+	*num = line->num_fields;
+
+	return(0);
+}
+
+/* get the index of the field that the byte at `offset' is in */
+int columns_find_field(struct columns *columns, struct buffer *buffer, const size_t offset)
+{
+	const struct columns_field *fields;
+	size_t start;
+	size_t len;
+	int field;
+	int line;
+	int num;
+	int err;
+
+	if(!columns || !buffer) {
+		return(-EINVAL);
+	}
+
+	if((err = buffer_get_line_range(buffer, offset, &line, &start, &len)) < 0 ||
+	   (err = columns_get_fields(columns, buffer, start, len, &fields, &num)) < 0) {
+		return(err);
+	}
+
+	for(field = 0; field + 1 < num && fields[field + 1].start <= offset - start; field++);
+
+	return(field);
+}
+
+/* the number of cells that the field is shown in */
+int columns_get_width(struct columns *columns, const int field)
+{
+	if(!columns || field < 0) {
+		return(-EINVAL);
+	}
+
+	return(field < columns->num_widths ? columns->widths[field] : COLUMNS_DEFAULT_WIDTH);
+}
+
+/* the cell that the field starts at, counted from the start of the table */
+int columns_get_x(struct columns *columns, const int field)
+{
+	int x;
+	int i;
+
+	if(!columns || field < 0) {
+		return(-EINVAL);
+	}
+
+	for(x = 0, i = 0; i < field; i++) {
+		x += columns_get_width(columns, i) + COLUMNS_SEPARATOR_WIDTH;
+	}
+
+	return(x);
+}
+
+/* the number of columns in the lines that the widths were estimated from */
+int columns_get_count(struct columns *columns)
+{
+	return(columns ? columns->num_widths : 0);
+}
+
+char columns_get_delimiter(struct columns *columns)
+{
+	return(columns ? columns->delimiter : 0);
+}
@@ -0,0 +1,35 @@
+#ifndef E_COLUMNS_H
+#define E_COLUMNS_H
+
+#include <stddef.h>
+
+struct buffer;
+struct columns;
+
+/* what the fields are separated by on the screen */
+#define COLUMNS_SEPARATOR " | "
+
+/* a field of a line, relative to the start of the line, without the delimiter */
+struct columns_field {
+	size_t start;
+	size_t len;
+};
+
+/*
+ * The fields of the lines of a CSV or TSV buffer. Views that have columns
+ * set on them show each line as a row of a table, with the fields lined
+ * up. The fields of a line are only looked for when it is shown.
+ */
+int columns_new(struct columns **columns, const char delimiter);
+int columns_free(struct columns **columns);
+
+int columns_update(struct columns *columns, struct buffer *buffer);
+int columns_get_fields(struct columns *columns, struct buffer *buffer, const size_t offset,
+		       const size_t len, const struct columns_field **fields, int *num);
+int columns_find_field(struct columns *columns, struct buffer *buffer, const size_t offset);
+int columns_get_width(struct columns *columns, const int field);
+int columns_get_x(struct columns *columns, const int field);
+int columns_get_count(struct columns *columns);
+char columns_get_delimiter(struct columns *columns);
+
+#endif /* E_COLUMNS_H */
@@ -2,5 +2,23 @@
 
 struct config config = {
 	.file_default_mode = CONFIG_FILE_DEFAULT_MODE,
-	.tab_width = CONFIG_DEFAULT_TAB_WIDTH
+	.tab_width = CONFIG_DEFAULT_TAB_WIDTH,
+	.follow_interval = CONFIG_DEFAULT_FOLLOW_INTERVAL,
+	.journal_interval = CONFIG_DEFAULT_JOURNAL_INTERVAL,
+	.line_index_cache = CONFIG_DEFAULT_LINE_INDEX_CACHE,
+	.line_index_cache_min = CONFIG_DEFAULT_LINE_INDEX_CACHE_MIN,
+	.line_index_cache_max_size = CONFIG_DEFAULT_LINE_INDEX_CACHE_MAX_SIZE,
+	.line_index_cache_max_age = CONFIG_DEFAULT_LINE_INDEX_CACHE_MAX_AGE,
+	.line_index_stride = CONFIG_DEFAULT_LINE_INDEX_STRIDE,
+	.line_index_max_size = CONFIG_DEFAULT_LINE_INDEX_MAX_SIZE,
+	.max_fps = CONFIG_DEFAULT_MAX_FPS,
+	.layout_cache_lines = CONFIG_DEFAULT_LAYOUT_CACHE_LINES,
+	.layout_long_line = CONFIG_DEFAULT_LAYOUT_LONG_LINE,
+	.wrap_lines = CONFIG_DEFAULT_WRAP_LINES,
+	.vt_display = CONFIG_DEFAULT_VT_DISPLAY,
+	.syntax = CONFIG_DEFAULT_SYNTAX,
+	.worker_threads = CONFIG_DEFAULT_WORKER_THREADS,
+	.analysis_delay = CONFIG_DEFAULT_ANALYSIS_DELAY,
+	.analysis_max_size = CONFIG_DEFAULT_ANALYSIS_MAX_SIZE,
+	.buffer_memory_limit = CONFIG_DEFAULT_BUFFER_MEMORY_LIMIT
 };
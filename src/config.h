@@ -1,12 +1,50 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 #define CONFIG_FILE_DEFAULT_MODE 0600
 #define CONFIG_DEFAULT_TAB_WIDTH 8
+#define CONFIG_DEFAULT_FOLLOW_INTERVAL 1000
+#define CONFIG_DEFAULT_JOURNAL_INTERVAL 500
+#define CONFIG_DEFAULT_LINE_INDEX_CACHE 1
+#define CONFIG_DEFAULT_LINE_INDEX_CACHE_MIN (8 * 1024 * 1024)
+#define CONFIG_DEFAULT_LINE_INDEX_CACHE_MAX_SIZE (256 * 1024 * 1024)
+#define CONFIG_DEFAULT_LINE_INDEX_CACHE_MAX_AGE (30 * 24 * 60 * 60)
+#define CONFIG_DEFAULT_LINE_INDEX_STRIDE 16
+#define CONFIG_DEFAULT_LINE_INDEX_MAX_SIZE (32 * 1024 * 1024)
+#define CONFIG_DEFAULT_MAX_FPS 0
+#define CONFIG_DEFAULT_LAYOUT_CACHE_LINES 4096
+#define CONFIG_DEFAULT_LAYOUT_LONG_LINE (64 * 1024)
+#define CONFIG_DEFAULT_WRAP_LINES 1
+#define CONFIG_DEFAULT_VT_DISPLAY 0
+#define CONFIG_DEFAULT_SYNTAX 0
+#define CONFIG_DEFAULT_WORKER_THREADS 2
+#define CONFIG_DEFAULT_ANALYSIS_DELAY 250
+#define CONFIG_DEFAULT_ANALYSIS_MAX_SIZE (64 * 1024 * 1024)
+#define CONFIG_DEFAULT_BUFFER_MEMORY_LIMIT (512 * 1024 * 1024)
 
 struct config {
 	int file_default_mode;
 	int tab_width;
+	int follow_interval;
+	int journal_interval;
+	int line_index_cache;
+	size_t line_index_cache_min;
+	size_t line_index_cache_max_size;
+	int line_index_cache_max_age;
+	int line_index_stride;
+	size_t line_index_max_size;
+	int max_fps;
+	int layout_cache_lines;
+	size_t layout_long_line;
+	int wrap_lines;
+	int vt_display;
+	int syntax;
+	int worker_threads;
+	int analysis_delay;
+	size_t analysis_max_size;
+	size_t buffer_memory_limit;
 };
 
 #ifndef __E_CONFIG
@@ -6,6 +6,11 @@ int _container_add(struct container *container, struct widget *widget)
 	return(-ENOSYS);
 }
 
+int _container_remove(struct container *container, struct widget *widget)
+{
+	return(-ENOSYS);
+}
+
 int container_init(struct container *container)
 {
 	int err;
@@ -18,6 +23,7 @@ int container_init(struct container *container)
 
 	if(!err) {
 		container->add = _container_add;
+		container->remove = _container_remove;
 	}
 
 	return(err);
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "display.h"
+
+/*
+ * Draws on a curses window. Curses keeps its own idea of what is on the
+ * screen and works out what to send when the window is refreshed, so
+ * this display does not know how many cells changed or how many bytes
+ * went out.
+ */
+struct curses_display {
+	struct display _parent;
+
+	WINDOW *window;
+};
+
+static int _curses_display_put(struct display *display, const int x, const int y,
+			       const char *str, const int len, const int color)
+{
+	WINDOW *window;
+
+	window = ((struct curses_display*)display)->window;
+
+	wattr_on(window, COLOR_PAIR(color), NULL);
+	mvwaddnstr(window, y, x, str, len);
+	wattr_off(window, COLOR_PAIR(color), NULL);
+
+	return(0);
+}
+
+static int _curses_display_fill(struct display *display, const int x, const int y,
+				const int width, const char chr, const int color)
+{
+	WINDOW *window;
+
+	window = ((struct curses_display*)display)->window;
+	mvwhline(window, y, x, (unsigned char)chr | COLOR_PAIR(color), width);
+
+	return(0);
+}
+
+static int _curses_display_recolor(struct display *display, const int x, const int y,
+				   const int width, const int color)
+{
+	WINDOW *window;
+
+	window = ((struct curses_display*)display)->window;
+	mvwchgat(window, y, x, width, 0, color, NULL);
+
+	return(0);
+}
+
+static int _curses_display_scroll(struct display *display, const int top,
+				  const int bottom, const int dist)
+{
+	WINDOW *window;
+
+	window = ((struct curses_display*)display)->window;
+
+	wsetscrreg(window, top, bottom);
+	scrollok(window, TRUE);
+	wscrl(window, dist);
+	scrollok(window, FALSE);
+	wsetscrreg(window, 0, display->height - 1);
+
+	return(0);
+}
+
+static int _curses_display_move(struct display *display, const int x, const int y)
+{
+	wmove(((struct curses_display*)display)->window, y, x);
+	return(0);
+}
+
+static int _curses_display_set_colors(struct display *display, const int color,
+				      const int fg, const int bg)
+{
+	return(init_pair(color, fg, bg) == OK ? 0 : -EINVAL);
+}
+
+static int _curses_display_resize(struct display *display, const int width,
+				  const int height)
+{
+	if(resizeterm(height, width) != OK) {
+		return(-EIO);
+	}
+
+	getmaxyx(((struct curses_display*)display)->window,
+		 display->height, display->width);
+
+	return(0);
+}
+
+static int _curses_display_flush(struct display *display)
+{
+	wrefresh(((struct curses_display*)display)->window);
+	return(0);
+}
+
+static int _curses_display_free(struct display *display)
+{
+	memset(display, 0, sizeof(struct curses_display));
+	free(display);
+
+	return(0);
+}
+
+/* curses has to be initialized already, and it is left to the caller to end it */
+int display_curses_new(struct display **display, WINDOW *window)
+{
+	struct curses_display *disp;
+
+	if(!display || !window) {
+		return(-EINVAL);
+	}
+
+	if(!(disp = malloc(sizeof(*disp)))) {
+		return(-ENOMEM);
+	}
+
+	memset(disp, 0, sizeof(*disp));
+	disp->window = window;
+	getmaxyx(window, disp->_parent.height, disp->_parent.width);
+
+	disp->_parent.put = _curses_display_put;
+	disp->_parent.fill = _curses_display_fill;
+	disp->_parent.recolor = _curses_display_recolor;
+	disp->_parent.scroll_region = _curses_display_scroll;
+	disp->_parent.set_cursor = _curses_display_move;
+	disp->_parent.set_colors = _curses_display_set_colors;
+	disp->_parent.resize = _curses_display_resize;
+	disp->_parent.flush = _curses_display_flush;
+	disp->_parent.free = _curses_display_free;
+
+	*display = (struct display*)disp;
+	return(0);
+}
@@ -0,0 +1,962 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "diff.h"
+#include "buffer.h"
+
+#define DIFF_INIT_ENTRIES 256
+/* the most lines that the exact search adds and removes in a region */
+#define DIFF_MAX_COST     1024
+/* how deep regions are split at lines that are unique on both sides */
+#define DIFF_MAX_DEPTH    64
+
+#define DIFF_FNV_OFFSET   14695981039346656037ULL
+#define DIFF_FNV_PRIME    1099511628211ULL
+
+struct diff_line {
+	size_t offset;
+	size_t len;
+	unsigned long long hash;
+};
+
+struct diff_lines {
+	struct diff_line *lines;
+	int num;
+	int max;
+	/* lines that have the same id are equal, unless they aren't in the base */
+	/* lines that have the same id are equal */
+	int *ids;
+};
+
+struct diff_pair {
+	int old;
+	int new;
+};
+
+/*
+ * Each line is hashed once and given a number, so that lines are compared
+ * as integers after that. The lines of the base are numbered when the diff
+ * is made, so that lines with the same contents have the same number, and
+ * the lines of the buffer are given the number of the base line that they
+ * are equal to. Lines of the buffer that aren't in the base all share one
+ * number that no base line has, since they can't be matched with anything
+ * anyway. When the buffer changes, only the lines that the edits touched
+ * are hashed and looked up again, and only the part of the sides between
+ * the matched lines around them is compared again.
+ *
+ * Lines that the two sides start and end with are skipped right away, which
+ * is all it takes for most edits. What is left is split at the lines that
+ * appear exactly once on both sides and in the same order (as patience
+ * diff does), and the pieces are searched for the fewest lines that have
+ * to be added and removed (as Myers' algorithm does). Pieces that would
+ * take more than DIFF_MAX_COST changes are taken as replaced in full.
+ */
+struct diff {
+	struct buffer *base;
+	struct buffer *buffer;
+	unsigned long generation;
+	size_t size;
+
+	struct diff_lines sides[DIFF_SIDES];
+	int num_ids;
+
+	/* the first base line with each contents, by hash */
+	int *table;
+	size_t mask;
+
+	/* how often each id appears in a region, and where */
+	int *counts[DIFF_SIDES];
+	int *where[DIFF_SIDES];
+
+	struct diff_hunk *hunks;
+	int num_hunks;
+	int max_hunks;
+
+	/* the first lines that are neither matched nor in a hunk */
+	int next[DIFF_SIDES];
+};
+
+static int _diff_lines_reserve(struct diff_lines *side, const int num)
+{
+	struct diff_line *lines;
+	int *ids;
+	int max;
+
+	if(num <= side->max) {
+		return(0);
+	}
+
+	for(max = side->max ? side->max : DIFF_INIT_ENTRIES; max < num; max *= 2);
+
+	if(!(lines = realloc(side->lines, max * sizeof(*lines)))) {
+		return(-ENOMEM);
+	}
+
+	side->lines = lines;
+
+	if(!(ids = realloc(side->ids, max * sizeof(*ids)))) {
+		return(-ENOMEM);
+	}
+
+	side->ids = ids;
+	side->max = max;
+
+	return(0);
+}
+
+/* add the lines between `offset' and `end' of `data' to the end of `side' */
+static int _diff_split(struct diff_lines *side, const char *data, size_t offset,
+		       const size_t end)
+{
+	while(offset < end) {
+		unsigned long long hash;
+		unsigned long long word;
+		const char *eol;
+		size_t len;
+		size_t i;
+		int err;
+
+		eol = memchr(data + offset, '\n', end - offset);
+		len = eol ? (size_t)(eol - data) + 1 - offset : end - offset;
+
+		/* eight bytes at a time, like FNV-1a does with one */
+		for(hash = DIFF_FNV_OFFSET ^ len, i = 0; i + sizeof(word) <= len; i += sizeof(word)) {
+			memcpy(&word, data + offset + i, sizeof(word));
+			hash = (hash ^ word) * DIFF_FNV_PRIME;
+			hash ^= hash >> 32;
+		}
+
+		for( ; i < len; i++) {
+			hash = (hash ^ (unsigned char)data[offset + i]) * DIFF_FNV_PRIME;
+		}
+
+		if((err = _diff_lines_reserve(side, side->num + 1)) < 0) {
+			return(err);
+		}
+
+		side->lines[side->num].offset = offset;
+		side->lines[side->num].len = len;
+		side->lines[side->num].hash = hash;
+		side->num++;
+
+		offset += len;
+	}
+
+	return(0);
+}
+
+/* the slot of the table that holds the base line equal to `line', or would */
+static size_t _diff_lookup(struct diff *diff, const char *data, const struct diff_line *line)
+{
+	const struct diff_line *base_lines;
+	const char *base_data;
+	size_t slot;
+
+	base_lines = diff->sides[DIFF_OLD].lines;
+	base_data = buffer_get_data(diff->base);
+
+	for(slot = line->hash & diff->mask; diff->table[slot] >= 0;
+	    slot = (slot + 1) & diff->mask) {
+		const struct diff_line *other;
+
+		other = &base_lines[diff->table[slot]];
+
+		if(other->hash == line->hash && other->len == line->len &&
+		   memcmp(base_data + other->offset, data + line->offset, line->len) == 0) {
+			break;
+		}
+	}
+
+	return(slot);
+}
+
+/* number the lines of the base, so that equal lines have the same id */
+static int _diff_intern_base(struct diff *diff)
+{
+	struct diff_lines *lines;
+	const char *data;
+	int side;
+	int i;
+
+	lines = &diff->sides[DIFF_OLD];
+	data = buffer_get_data(diff->base);
+
+	for(diff->mask = 1; diff->mask < 2 * (size_t)lines->num; diff->mask <<= 1);
+
+	if(!(diff->table = malloc(diff->mask * sizeof(*diff->table)))) {
+		return(-ENOMEM);
+	}
+
+	memset(diff->table, 0xff, diff->mask * sizeof(*diff->table));
+	diff->mask--;
+	diff->num_ids = 0;
+
+	for(i = 0; i < lines->num; i++) {
+		size_t slot;
+
+		slot = _diff_lookup(diff, data, &lines->lines[i]);
+
+		if(diff->table[slot] < 0) {
+			diff->table[slot] = i;
+			lines->ids[i] = diff->num_ids++;
+		} else {
+			lines->ids[i] = lines->ids[diff->table[slot]];
+		}
+	}
+
+	/* one more for the lines that are only in the buffer */
+	for(side = 0; side < DIFF_SIDES; side++) {
+		diff->counts[side] = calloc(diff->num_ids + 1, sizeof(*diff->counts[side]));
+		diff->where[side] = malloc((diff->num_ids + 1) * sizeof(*diff->where[side]));
+
+		if(!diff->counts[side] || !diff->where[side]) {
+			return(-ENOMEM);
+		}
+	}
+
+	return(0);
+}
+
+/* give the lines of the buffer from `from' to `to' the ids of the equal base lines */
+static void _diff_intern(struct diff *diff, const int from, const int to)
+{
+	struct diff_lines *lines;
+	const char *data;
+	int i;
+
+	lines = &diff->sides[DIFF_NEW];
+	data = buffer_get_data(diff->buffer);
+
+	for(i = from; i < to; i++) {
+		size_t slot;
+
+		slot = _diff_lookup(diff, data, &lines->lines[i]);
+		lines->ids[i] = diff->table[slot] < 0 ? diff->num_ids :
+			diff->sides[DIFF_OLD].ids[diff->table[slot]];
+	}
+}
+
+int diff_new(struct diff **diff, struct buffer *base)
+{
+	struct diff *dif;
+	int err;
+
+	if(!diff || !base) {
+		return(-EINVAL);
+	}
+
+	if(!(dif = calloc(1, sizeof(*dif)))) {
+		return(-ENOMEM);
+	}
+
+	dif->base = base;
+
+	/* the base never changes, so its lines are only found once */
+	if((err = _diff_split(&dif->sides[DIFF_OLD], buffer_get_data(base), 0,
+			      buffer_get_size(base))) < 0 ||
+	   (err = _diff_lines_reserve(&dif->sides[DIFF_OLD], 1)) < 0 ||
+	   (err = _diff_intern_base(dif)) < 0) {
+		/* the base stays with the caller if there is no diff */
+		dif->base = NULL;
+		diff_free(&dif);
+		return(err);
+	}
+
+	*diff = dif;
+
+	return(0);
+}
+
+/* the base, which the diff took over, is closed along with it */
+int diff_free(struct diff **diff)
+{
+	int side;
+
+	if(!diff || !*diff) {
+		return(-EINVAL);
+	}
+
+	for(side = 0; side < DIFF_SIDES; side++) {
+		free((*diff)->sides[side].lines);
+		free((*diff)->sides[side].ids);
+		free((*diff)->counts[side]);
+		free((*diff)->where[side]);
+	}
+
+	free((*diff)->table);
+	free((*diff)->hunks);
+
+	buffer_close(&(*diff)->base);
+
+	free(*diff);
+	*diff = NULL;
+
+	return(0);
+}
+
+static const char* _diff_get_data(struct diff *diff, const int side)
+{
+	return(buffer_get_data(side == DIFF_OLD ? diff->base : diff->buffer));
+}
+
+/* the index of the first line of `side' that ends behind `offset' */
+static int _diff_find(struct diff_lines *lines, const size_t offset)
+{
+	int lo;
+	int hi;
+
+	lo = 0;
+	hi = lines->num;
+
+	while(lo < hi) {
+		int mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if(lines->lines[mid].offset + lines->lines[mid].len <= offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return(lo);
+}
+
+/*
+ * Find the lines of the buffer again where the edits since the last update
+ * changed it, between `start' and `end'. The lines in front of them are
+ * kept, and the ones behind them are only moved. The lines from `first' to
+ * `last' are replaced by `num' lines.
+ */
+static int _diff_resplit(struct diff *diff, struct buffer *buffer, const size_t start,
+			 const size_t end, int *first, int *last, int *num)
+{
+	struct diff_lines *lines;
+	struct diff_lines fresh;
+	const char *data;
+	const char *eol;
+	size_t size;
+	size_t from;
+	size_t to;
+	long delta;
+	int from_line;
+	int to_line;
+	int err;
+	int i;
+
+	lines = &diff->sides[DIFF_NEW];
+	data = buffer_get_data(buffer);
+	size = buffer_get_size(buffer);
+	delta = (long)size - (long)diff->size;
+
+	/* a last line without a newline is changed by what is appended to it */
+	from_line = _diff_find(lines, start);
+
+	if(from_line == lines->num && from_line > 0 &&
+	   data[lines->lines[from_line - 1].offset + lines->lines[from_line - 1].len - 1] != '\n') {
+		from_line--;
+	}
+
+	from = from_line < lines->num ? lines->lines[from_line].offset : diff->size;
+	eol = end < size ? memchr(data + end, '\n', size - end) : NULL;
+	to = eol ? (size_t)(eol - data) + 1 : size;
+
+	/* the lines up to `to' were the ones up to `to - delta' before */
+	to_line = _diff_find(lines, to - delta);
+
+	memset(&fresh, 0, sizeof(fresh));
+
+	if((err = _diff_split(&fresh, data, from, to)) < 0 ||
+	   (err = _diff_lines_reserve(lines, lines->num - (to_line - from_line) + fresh.num + 1)) < 0) {
+		free(fresh.lines);
+		free(fresh.ids);
+		return(err);
+	}
+
+	memmove(lines->lines + from_line + fresh.num, lines->lines + to_line,
+		(lines->num - to_line) * sizeof(*lines->lines));
+	memmove(lines->ids + from_line + fresh.num, lines->ids + to_line,
+		(lines->num - to_line) * sizeof(*lines->ids));
+
+	if(fresh.num > 0) {
+		memcpy(lines->lines + from_line, fresh.lines, fresh.num * sizeof(*fresh.lines));
+	}
+
+	lines->num += fresh.num - (to_line - from_line);
+
+	for(i = from_line + fresh.num; i < lines->num; i++) {
+		lines->lines[i].offset += delta;
+	}
+
+	free(fresh.lines);
+	free(fresh.ids);
+
+	_diff_intern(diff, from_line, from_line + fresh.num);
+
+	*first = from_line;
+	*last = to_line;
+	*num = fresh.num;
+
+	return(0);
+}
+
+/* everything in front of the lines `old' and `new' that isn't matched was changed */
+static int _diff_match(struct diff *diff, const int old, const int new)
+{
+	struct diff_hunk *hunk;
+
+	if(old == diff->next[DIFF_OLD] && new == diff->next[DIFF_NEW]) {
+		diff->next[DIFF_OLD]++;
+		diff->next[DIFF_NEW]++;
+		return(0);
+	}
+
+	if(diff->num_hunks == diff->max_hunks) {
+		struct diff_hunk *hunks;
+		int max;
+
+		max = diff->max_hunks ? diff->max_hunks * 2 : DIFF_INIT_ENTRIES;
+
+		if(!(hunks = realloc(diff->hunks, max * sizeof(*hunks)))) {
+			return(-ENOMEM);
+		}
+
+		diff->hunks = hunks;
+		diff->max_hunks = max;
+	}
+
+	hunk = &diff->hunks[diff->num_hunks++];
+	hunk->old_line = diff->next[DIFF_OLD] + 1;
+	hunk->old_lines = old - diff->next[DIFF_OLD];
+	hunk->new_line = diff->next[DIFF_NEW] + 1;
+	hunk->new_lines = new - diff->next[DIFF_NEW];
+
+	diff->next[DIFF_OLD] = old + 1;
+	diff->next[DIFF_NEW] = new + 1;
+
+	return(0);
+}
+
+/*
+ * Find the fewest changes that turn the old lines from `a0' to `a1' into
+ * the new ones from `b0' to `b1', and match the lines that are left. The
+ * furthest reaching path of each diagonal is kept for every number of
+ * changes, so the path can be followed back from the end.
+ */
+static int _diff_myers(struct diff *diff, const int a0, const int a1, const int b0, const int b1)
+{
+	struct diff_pair *matches;
+	const int *a;
+	const int *b;
+	int *trace;
+	int *v;
+	int limit;
+	int found;
+	int num;
+	int err;
+	int n;
+	int m;
+	int d;
+	int k;
+	int x;
+	int y;
+
+	a = diff->sides[DIFF_OLD].ids + a0;
+	b = diff->sides[DIFF_NEW].ids + b0;
+	n = a1 - a0;
+	m = b1 - b0;
+	limit = n + m < DIFF_MAX_COST ? n + m : DIFF_MAX_COST;
+
+	v = calloc(2 * limit + 3, sizeof(*v));
+	trace = malloc((size_t)(limit + 1) * (limit + 1) * sizeof(*trace));
+	matches = malloc((n < m ? n : m) * sizeof(*matches) + 1);
+
+	if(!v || !trace || !matches) {
+		free(v);
+		free(trace);
+		free(matches);
+		return(-ENOMEM);
+	}
+
+	/* v[k] is where the path on diagonal k (x - y) got to */
+	v += limit + 1;
+	found = 0;
+
+	for(d = 0; d <= limit && !found; d++) {
+		for(k = -d; k <= d; k += 2) {
+			if(k == -d || (k != d && v[k - 1] < v[k + 1])) {
+				x = v[k + 1];
+			} else {
+				x = v[k - 1] + 1;
+			}
+
+			for(y = x - k; x < n && y < m && a[x] == b[y]; x++, y++);
+
+			v[k] = x;
+
+			if(x >= n && y >= m) {
+				found = 1;
+			}
+		}
+
+		/* the paths after `d' changes start at trace[d * d] */
+		memcpy(trace + d * d, v - d, (2 * d + 1) * sizeof(*v));
+	}
+
+	num = 0;
+
+	if(found) {
+		x = n;
+		y = m;
+
+		for(d--; d > 0; d--) {
+			const int *prev;
+			int px;
+			int pk;
+
+			prev = trace + (d - 1) * (d - 1) + d - 1;
+			k = x - y;
+			pk = (k == -d || (k != d && prev[k - 1] < prev[k + 1])) ? k + 1 : k - 1;
+			px = prev[pk];
+
+			for( ; x > px && y > px - pk; x--, y--) {
+				matches[num].old = x - 1;
+				matches[num].new = y - 1;
+				num++;
+			}
+
+			x = px;
+			y = px - pk;
+		}
+
+		for( ; x > 0 && y > 0; x--, y--) {
+			matches[num].old = x - 1;
+			matches[num].new = y - 1;
+			num++;
+		}
+	}
+
+	for(err = 0; num > 0 && !err; num--) {
+		err = _diff_match(diff, a0 + matches[num - 1].old, b0 + matches[num - 1].new);
+	}
+
+	free(v - limit - 1);
+	free(trace);
+	free(matches);
+
+	return(err);
+}
+
+/*
+ * Find the lines that appear exactly once between `a0' and `a1' as well as
+ * between `b0' and `b1', and keep the longest run of them that is in the
+ * same order on both sides.
+ */
+static int _diff_anchors(struct diff *diff, const int a0, const int a1, const int b0, const int b1,
+			 struct diff_pair **anchors, int *num)
+{
+	struct diff_pair *pairs;
+	const int *a;
+	const int *b;
+	int *tails;
+	int *prev;
+	int num_pairs;
+	int len;
+	int i;
+
+	a = diff->sides[DIFF_OLD].ids;
+	b = diff->sides[DIFF_NEW].ids;
+
+	for(i = a0; i < a1; i++) {
+		diff->counts[DIFF_OLD][a[i]]++;
+		diff->where[DIFF_OLD][a[i]] = i;
+	}
+
+	for(i = b0; i < b1; i++) {
+		diff->counts[DIFF_NEW][b[i]]++;
+		diff->where[DIFF_NEW][b[i]] = i;
+	}
+
+	pairs = malloc((a1 - a0) * sizeof(*pairs));
+	tails = malloc((a1 - a0) * sizeof(*tails));
+	prev = malloc((a1 - a0) * sizeof(*prev));
+	num_pairs = 0;
+
+	for(i = a0; pairs && i < a1; i++) {
+		if(diff->counts[DIFF_OLD][a[i]] == 1 && diff->counts[DIFF_NEW][a[i]] == 1) {
+			pairs[num_pairs].old = i;
+			pairs[num_pairs].new = diff->where[DIFF_NEW][a[i]];
+			num_pairs++;
+		}
+	}
+
+	for(i = a0; i < a1; i++) {
+		diff->counts[DIFF_OLD][a[i]] = 0;
+	}
+
+	for(i = b0; i < b1; i++) {
+		diff->counts[DIFF_NEW][b[i]] = 0;
+	}
+
+	if(!pairs || !tails || !prev) {
+		free(pairs);
+		free(tails);
+		free(prev);
+		return(-ENOMEM);
+	}
+
+	/* the longest increasing run of new lines, by patience sorting */
+	for(len = 0, i = 0; i < num_pairs; i++) {
+		int lo;
+		int hi;
+
+		for(lo = 0, hi = len; lo < hi; ) {
+			int mid;
+
+			mid = lo + (hi - lo) / 2;
+
+			if(pairs[tails[mid]].new < pairs[i].new) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		prev[i] = lo > 0 ? tails[lo - 1] : -1;
+		tails[lo] = i;
+
+		if(lo == len) {
+			len++;
+		}
+	}
+
+	/* the run is collected back to front, in the place of the tails */
+	for(i = len > 0 ? tails[len - 1] : -1, *num = len; i >= 0; i = prev[i]) {
+		tails[--len] = i;
+	}
+
+	for(i = 0; i < *num; i++) {
+		pairs[i] = pairs[tails[i]];
+	}
+
+	free(tails);
+	free(prev);
+
+	*anchors = pairs;
+	return(0);
+}
+
+static int _diff_region(struct diff *diff, int a0, int a1, int b0, int b1, const int depth);
+
+/* match the lines between the anchors, and then the anchors themselves */
+static int _diff_split_region(struct diff *diff, int a0, const int a1, int b0, const int b1,
+			      const int depth)
+{
+	struct diff_pair *anchors;
+	int num;
+	int err;
+	int i;
+
+	if(depth >= DIFF_MAX_DEPTH) {
+		return(_diff_myers(diff, a0, a1, b0, b1));
+	}
+
+	if((err = _diff_anchors(diff, a0, a1, b0, b1, &anchors, &num)) < 0) {
+		return(err);
+	}
+
+	if(num == 0) {
+		free(anchors);
+		return(_diff_myers(diff, a0, a1, b0, b1));
+	}
+
+	for(i = 0; i < num && !err; i++) {
+		if(!(err = _diff_region(diff, a0, anchors[i].old, b0, anchors[i].new, depth + 1))) {
+			err = _diff_match(diff, anchors[i].old, anchors[i].new);
+		}
+
+		a0 = anchors[i].old + 1;
+		b0 = anchors[i].new + 1;
+	}
+
+	free(anchors);
+
+	return(err ? err : _diff_region(diff, a0, a1, b0, b1, depth + 1));
+}
+
+static int _diff_region(struct diff *diff, int a0, int a1, int b0, int b1, const int depth)
+{
+	const int *a;
+	const int *b;
+	int common;
+	int err;
+	int i;
+
+	a = diff->sides[DIFF_OLD].ids;
+	b = diff->sides[DIFF_NEW].ids;
+	err = 0;
+
+	for( ; a0 < a1 && b0 < b1 && a[a0] == b[b0] && !err; a0++, b0++) {
+		err = _diff_match(diff, a0, b0);
+	}
+
+	for(common = 0; a0 < a1 && b0 < b1 && a[a1 - 1] == b[b1 - 1]; a1--, b1--) {
+		common++;
+	}
+
+	/* lines that are only on one side can't be matched */
+	if(!err && a0 < a1 && b0 < b1) {
+		err = _diff_split_region(diff, a0, a1, b0, b1, depth);
+	}
+
+	for(i = 0; i < common && !err; i++) {
+		err = _diff_match(diff, a1 + i, b1 + i);
+	}
+
+	return(err);
+}
+
+/*
+ * Compare the sides again from the matched lines in front of the lines
+ * from `first' to `last' of the buffer, which were replaced by `num' lines,
+ * to the matched lines behind them. The hunks outside of that still hold.
+ */
+static int _diff_rematch(struct diff *diff, const int first, const int last, const int num)
+{
+	struct diff_hunk *tail;
+	int num_tail;
+	int before;
+	int after;
+	int shift;
+	int a0;
+	int a1;
+	int b0;
+	int b1;
+	int err;
+	int i;
+
+	/* the hunks that end in front of the edited lines, and what they remove */
+	for(before = 0, shift = 0; before < diff->num_hunks; before++) {
+		struct diff_hunk *hunk;
+
+		hunk = &diff->hunks[before];
+
+		if(hunk->new_line - 1 + hunk->new_lines >= first) {
+			break;
+		}
+
+		shift += hunk->old_lines - hunk->new_lines;
+	}
+
+	b0 = first;
+	b1 = last;
+	a0 = first + shift;
+
+	/* the hunks that touch the edited lines are made again */
+	for(after = before; after < diff->num_hunks; after++) {
+		struct diff_hunk *hunk;
+
+		hunk = &diff->hunks[after];
+
+		if(hunk->new_line - 1 > b1) {
+			break;
+		}
+
+		if(hunk->new_line - 1 < b0) {
+			b0 = hunk->new_line - 1;
+			a0 = hunk->old_line - 1;
+		}
+
+		if(hunk->new_line - 1 + hunk->new_lines > b1) {
+			b1 = hunk->new_line - 1 + hunk->new_lines;
+		}
+
+		shift += hunk->old_lines - hunk->new_lines;
+	}
+
+	a1 = b1 + shift;
+	b1 += num - (last - first);
+	num_tail = diff->num_hunks - after;
+
+	if(!(tail = malloc(num_tail * sizeof(*tail) + 1))) {
+		return(-ENOMEM);
+	}
+
+	if(num_tail > 0) {
+		memcpy(tail, diff->hunks + after, num_tail * sizeof(*tail));
+	}
+
+	diff->num_hunks = before;
+	diff->next[DIFF_OLD] = a0;
+	diff->next[DIFF_NEW] = b0;
+
+	/* the lines at `a1' and `b1' are matched, unless they are the ends */
+	err = _diff_region(diff, a0, a1, b0, b1, 0);
+
+	if(!err) {
+		err = _diff_match(diff, a1, b1);
+	}
+
+	for(i = 0; i < num_tail && !err; i++) {
+		tail[i].new_line += num - (last - first);
+
+		if(diff->num_hunks == diff->max_hunks) {
+			struct diff_hunk *hunks;
+
+			if(!(hunks = realloc(diff->hunks, (diff->max_hunks + num_tail) * sizeof(*hunks)))) {
+				err = -ENOMEM;
+				break;
+			}
+
+			diff->hunks = hunks;
+			diff->max_hunks += num_tail;
+		}
+
+		diff->hunks[diff->num_hunks++] = tail[i];
+	}
+
+	free(tail);
+	return(err);
+}
+
+/* compare `buffer' with the base again, if it changed since the last time */
+int diff_update(struct diff *diff, struct buffer *buffer)
+{
+	size_t start;
+	size_t end;
+	long lines;
+	int first;
+	int last;
+	int num;
+	int err;
+
+	if(!diff || !buffer) {
+		return(-EINVAL);
+	}
+
+	if(diff->buffer == buffer && diff->generation == buffer_get_generation(buffer)) {
+		return(0);
+	}
+
+	if(diff->buffer == buffer &&
+	   buffer_get_edits(buffer, diff->generation, &start, &end, &lines) >= 0) {
+		if((err = _diff_resplit(diff, buffer, start, end, &first, &last, &num)) == 0) {
+			err = _diff_rematch(diff, first, last, num);
+		}
+	} else {
+		/* the lines are compared with the lines of the buffer from here on */
+		diff->buffer = buffer;
+		diff->sides[DIFF_NEW].num = 0;
+		diff->num_hunks = 0;
+		diff->next[DIFF_OLD] = 0;
+		diff->next[DIFF_NEW] = 0;
+
+		/* what follows the last match is matched with what follows the ends */
+		if((err = _diff_split(&diff->sides[DIFF_NEW], buffer_get_data(buffer), 0,
+				      buffer_get_size(buffer))) == 0 &&
+		   (err = _diff_lines_reserve(&diff->sides[DIFF_NEW], 1)) == 0) {
+			_diff_intern(diff, 0, diff->sides[DIFF_NEW].num);
+
+			if((err = _diff_region(diff, 0, diff->sides[DIFF_OLD].num,
+					       0, diff->sides[DIFF_NEW].num, 0)) == 0) {
+				err = _diff_match(diff, diff->sides[DIFF_OLD].num,
+						  diff->sides[DIFF_NEW].num);
+			}
+		}
+	}
+
+	if(err < 0) {
+		diff->buffer = NULL;
+		diff->num_hunks = 0;
+		return(err);
+	}
+
+	diff->size = buffer_get_size(buffer);
+	diff->generation = buffer_get_generation(buffer);
+	return(0);
+}
+
+int diff_get_hunks(struct diff *diff, const struct diff_hunk **hunks, int *num)
+{
+	if(!diff || !hunks || !num) {
+		return(-EINVAL);
+	}
+
+	*hunks = diff->hunks;
+	*num = diff->num_hunks;
+
+	return(0);
+}
+
+/* the index of the first hunk that starts on new line `new_line' or behind it */
+int diff_find(struct diff *diff, const int new_line)
+{
+	int lo;
+	int hi;
+
+	if(!diff) {
+		return(-EINVAL);
+	}
+
+	lo = 0;
+	hi = diff->num_hunks;
+
+	while(lo < hi) {
+		int mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if(diff->hunks[mid].new_line < new_line) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return(lo);
+}
+
+int diff_get_count(struct diff *diff, const diff_side_t side)
+{
+	if(!diff || side < 0 || side >= DIFF_SIDES) {
+		return(-EINVAL);
+	}
+
+	return(diff->sides[side].num);
+}
+
+/* get a line of either side, without its newline */
+int diff_get_line(struct diff *diff, const diff_side_t side, const int line,
+		  const char **data, size_t *len)
+{
+	struct diff_line *dline;
+
+	if(!diff || side < 0 || side >= DIFF_SIDES || !data || !len) {
+		return(-EINVAL);
+	}
+
+	if(line < 1 || line > diff->sides[side].num || (side == DIFF_NEW && !diff->buffer)) {
+		return(-ERANGE);
+	}
+
+	dline = &diff->sides[side].lines[line - 1];
+	*data = _diff_get_data(diff, side) + dline->offset;
+	*len = dline->len;
+
+	if(*len > 0 && (*data)[*len - 1] == '\n') {
+		(*len)--;
+	}
+
+	return(0);
+}
+
+/* the line that the byte at `offset' is on */
+int diff_find_line(struct diff *diff, const diff_side_t side, const size_t offset)
+{
+	if(!diff || side < 0 || side >= DIFF_SIDES) {
+		return(-EINVAL);
+	}
+
+	return(_diff_find(&diff->sides[side], offset) + 1);
+}
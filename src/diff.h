@@ -0,0 +1,43 @@
+#ifndef E_DIFF_H
+#define E_DIFF_H
+
+#include <stddef.h>
+
+struct buffer;
+struct diff;
+
+typedef enum {
+	DIFF_OLD = 0,
+	DIFF_NEW,
+	DIFF_SIDES
+} diff_side_t;
+
+/*
+ * The lines from `old_line' on that were replaced by the ones from
+ * `new_line' on. Either of them may be empty. Lines are counted from 1.
+ */
+struct diff_hunk {
+	int old_line;
+	int old_lines;
+	int new_line;
+	int new_lines;
+};
+
+/*
+ * The lines that differ between a buffer and an older version of it, which
+ * is either the file on disk or a copy that was made earlier. Views that
+ * have a diff set on them show the lines that were removed along with the
+ * ones that were added.
+ */
+int diff_new(struct diff **diff, struct buffer *base);
+int diff_free(struct diff **diff);
+
+int diff_update(struct diff *diff, struct buffer *buffer);
+int diff_get_hunks(struct diff *diff, const struct diff_hunk **hunks, int *num);
+int diff_find(struct diff *diff, const int new_line);
+int diff_get_count(struct diff *diff, const diff_side_t side);
+int diff_get_line(struct diff *diff, const diff_side_t side, const int line,
+		  const char **data, size_t *len);
+int diff_find_line(struct diff *diff, const diff_side_t side, const size_t offset);
+
+#endif /* E_DIFF_H */
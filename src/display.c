@@ -0,0 +1,194 @@
+#include <string.h>
+#include <errno.h>
+#include "display.h"
+
+/*
+ * The display functions check and clip what they are asked to draw, so
+ * that the backends only ever see coordinates that are on the display.
+ */
+int display_free(struct display **display)
+{
+	int err;
+
+	if(!display || !*display) {
+		return(-EINVAL);
+	}
+
+	err = (*display)->free(*display);
+	*display = NULL;
+
+	return(err);
+}
+
+int display_get_size(struct display *display, int *width, int *height)
+{
+	if(!display || !width || !height) {
+		return(-EINVAL);
+	}
+
+	*width = display->width;
+	*height = display->height;
+
+	return(0);
+}
+
+static int _display_clip(struct display *display, const int x, const int y, int *width)
+{
+	if(x < 0 || y < 0 || x >= display->width || y >= display->height) {
+		return(-EOVERFLOW);
+	}
+
+	/* a negative width means until the end of the row */
+	if(*width < 0 || *width > display->width - x) {
+		*width = display->width - x;
+	}
+
+	return(0);
+}
+
+int display_put(struct display *display, const int x, const int y,
+		const char *str, const int len, const int color)
+{
+	int width;
+	int err;
+
+	if(!display || !str) {
+		return(-EINVAL);
+	}
+
+	width = len;
+
+	if((err = _display_clip(display, x, y, &width)) < 0) {
+		return(err);
+	}
+
+	display->stats.drawn += width;
+	return(display->put(display, x, y, str, width, color));
+}
+
+int display_fill(struct display *display, const int x, const int y,
+		 const int width, const char chr, const int color)
+{
+	int w;
+	int err;
+
+	if(!display) {
+		return(-EINVAL);
+	}
+
+	w = width;
+
+	if((err = _display_clip(display, x, y, &w)) < 0) {
+		return(err);
+	}
+
+	display->stats.drawn += w;
+	return(display->fill(display, x, y, w, chr, color));
+}
+
+int display_recolor(struct display *display, const int x, const int y,
+		    const int width, const int color)
+{
+	int w;
+	int err;
+
+	if(!display) {
+		return(-EINVAL);
+	}
+
+	w = width;
+
+	if((err = _display_clip(display, x, y, &w)) < 0) {
+		return(err);
+	}
+
+	display->stats.drawn += w;
+	return(display->recolor(display, x, y, w, color));
+}
+
+/*
+ * Move the rows from `top' through `bottom' up by `dist' rows, or down if
+ * `dist' is negative. The rows that are uncovered are blank.
+ */
+int display_scroll(struct display *display, const int top, const int bottom,
+		   const int dist)
+{
+	if(!display) {
+		return(-EINVAL);
+	}
+
+	if(top < 0 || bottom >= display->height || top > bottom) {
+		return(-EOVERFLOW);
+	}
+
+	if(dist == 0) {
+		return(0);
+	}
+
+	return(display->scroll_region(display, top, bottom, dist));
+}
+
+int display_move(struct display *display, const int x, const int y)
+{
+	if(!display) {
+		return(-EINVAL);
+	}
+
+	if(x < 0 || y < 0 || x >= display->width || y >= display->height) {
+		return(-EOVERFLOW);
+	}
+
+	return(display->set_cursor(display, x, y));
+}
+
+int display_set_colors(struct display *display, const int color, const int fg, const int bg)
+{
+	if(!display || color <= 0) {
+		return(-EINVAL);
+	}
+
+	return(display->set_colors(display, color, fg, bg));
+}
+
+int display_resize(struct display *display, const int width, const int height)
+{
+	if(!display || width <= 0 || height <= 0) {
+		return(-EINVAL);
+	}
+
+	if(width == display->width && height == display->height) {
+		return(0);
+	}
+
+	return(display->resize(display, width, height));
+}
+
+int display_flush(struct display *display)
+{
+	if(!display) {
+		return(-EINVAL);
+	}
+
+	display->stats.frames++;
+	return(display->flush(display));
+}
+
+int display_get_stats(struct display *display, struct display_stats *stats)
+{
+	if(!display || !stats) {
+		return(-EINVAL);
+	}
+
+	*stats = display->stats;
+	return(0);
+}
+
+int display_reset_stats(struct display *display)
+{
+	if(!display) {
+		return(-EINVAL);
+	}
+
+	memset(&display->stats, 0, sizeof(display->stats));
+	return(0);
+}
@@ -0,0 +1,72 @@
+#ifndef E_DISPLAY_H
+#define E_DISPLAY_H
+
+#include <ncurses.h>
+
+/*
+ * A display is what widgets draw on: a grid of cells that each show one
+ * character in one of the UI's color pairs. Nothing that was drawn is
+ * shown before the display is flushed.
+ *
+ * The curses display draws on a curses window. The grid display only
+ * keeps the cells in memory, so the UI can be driven and looked at
+ * without a terminal, and it works out what a terminal would have been
+ * sent for every frame. The VT display is a grid display that sends it.
+ *
+ * Colors are set up with display_set_colors(), using curses' COLOR_*
+ * numbers. Color 0 is the terminal's default.
+ */
+struct display_stats {
+	unsigned long frames;
+	unsigned long drawn;   /* cells that widgets drew */
+	unsigned long changed; /* cells that looked different when flushed */
+	unsigned long bytes;   /* what the terminal was (or would be) sent */
+};
+
+struct display {
+	int width;
+	int height;
+	struct display_stats stats;
+
+	int (*put)(struct display*, const int x, const int y,
+		   const char *str, const int len, const int color);
+	int (*fill)(struct display*, const int x, const int y,
+		    const int width, const char chr, const int color);
+	int (*recolor)(struct display*, const int x, const int y,
+		       const int width, const int color);
+	int (*scroll_region)(struct display*, const int top, const int bottom, const int dist);
+	int (*set_cursor)(struct display*, const int x, const int y);
+	int (*set_colors)(struct display*, const int color, const int fg, const int bg);
+	int (*resize)(struct display*, const int width, const int height);
+	int (*flush)(struct display*);
+	int (*free)(struct display*);
+};
+
+int display_curses_new(struct display **display, WINDOW *window);
+int display_grid_new(struct display **display, const int width, const int height);
+int display_vt_new(struct display **display, const int fd, const int width,
+		   const int height);
+int display_free(struct display **display);
+
+int display_get_size(struct display *display, int *width, int *height);
+int display_put(struct display *display, const int x, const int y,
+		const char *str, const int len, const int color);
+int display_fill(struct display *display, const int x, const int y,
+		 const int width, const char chr, const int color);
+int display_recolor(struct display *display, const int x, const int y,
+		    const int width, const int color);
+int display_scroll(struct display *display, const int top, const int bottom,
+		   const int dist);
+int display_move(struct display *display, const int x, const int y);
+int display_set_colors(struct display *display, const int color, const int fg, const int bg);
+int display_resize(struct display *display, const int width, const int height);
+int display_flush(struct display *display);
+
+int display_get_stats(struct display *display, struct display_stats *stats);
+int display_reset_stats(struct display *display);
+
+int display_grid_get_cell(struct display *display, const int x, const int y,
+			  char *chr, int *color);
+int display_grid_get_row(struct display *display, const int y, char *dst, const int size);
+
+#endif /* E_DISPLAY_H */
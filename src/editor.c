@@ -1,18 +1,68 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
 #include <telex/telex.h>
 #include "editor.h"
 #include "buffer.h"
 #include "string.h"
 #include "multistring.h"
+#include "journal.h"
+#include "config.h"
+#include "worker.h"
+#include "analysis.h"
+#include "filter.h"
+#include "columns.h"
+#include "json.h"
+#include "diff.h"
+#include "highlight.h"
 #include "ui.h"
 
+#define EDITOR_MAX_VIEWS 3
+
 /* FIXME: Variables should be stored in a hashmap once we have one */
 struct variable {
 	struct variable *next;
 	char *name;
 	char *value;
+	size_t value_len;
+};
+
+/*
+ * The views of the buffer each have their own selection. The selection of
+ * the view that has the focus is kept in `sel_start' and `sel_end' of the
+ * editor, and only stored here while the view doesn't have the focus.
+ */
+struct editor_view {
+	struct textview *textview;
+	struct telex *sel_start;
+	struct telex *sel_end;
+	struct filter *filter;
+	struct columns *columns;
+	struct json *json;
+	struct diff *diff;
+};
+
+/*
+ * An open file and the views that show it. Only the views of the buffer
+ * that is shown are in the vbox. The others keep their layouts, syntax
+ * highlights and selections until their buffer is shown again, while the
+ * contents of the buffer may be unloaded to save memory.
+ */
+struct editor_buffer {
+	struct editor_buffer *next;
+	struct buffer *buffer;
+	struct journal *journal;
+	int readonly;
+	int follow;
+	unsigned long used;
+
+	/* views that aren't split off are hidden */
+	struct editor_view views[EDITOR_MAX_VIEWS];
+	int focus;
 };
 
 struct editor {
@@ -21,17 +71,678 @@ struct editor {
 	struct textview *edit;
 	struct cmdbox *cmdbox;
 
+	/* `buffer' and `journal' are those of the buffer that is shown */
+	struct editor_buffer *buffers;
+	struct editor_buffer *current;
+	unsigned long clock;
+
 	struct buffer *buffer;
+	struct journal *journal;
 
 	struct telex *sel_start;
 	struct telex *sel_end;
 
 	struct variable *variables;
 
-	int readonly;
 	int running;
+	int force_save;
+
+	struct timespec last_frame;
+
+	/*
+	 * Whole-buffer analysis runs on the workers, on a snapshot that is
+	 * taken once the buffer hasn't changed for a moment.
+	 */
+	struct worker_pool *workers;
+	struct analysis *analysis;
+	unsigned long analysed;
+	int analysis_stale;
+	struct timespec analysis_due;
 };
 
+static void _editor_invalidate_analysis(struct editor *editor);
+static int _editor_refresh(struct editor *editor);
+
+static int _wrap_toggled(struct widget *widget,
+			 void *user_data,
+			 void *data)
+{
+	struct editor *editor;
+
+	editor = (struct editor*)user_data;
+
+	return textview_set_wrap(editor->edit, !textview_get_wrap(editor->edit));
+}
+
+static int _hex_toggled(struct widget *widget,
+			void *user_data,
+			void *data)
+{
+	struct editor *editor;
+
+	editor = (struct editor*)user_data;
+
+	return textview_set_hex(editor->edit, !textview_get_hex(editor->edit));
+}
+
+static int _scroll_requested(struct editor *editor, const int direction)
+{
+	int cols;
+
+	/* half a screen at a time, so there's something to keep track of */
+	cols = ((struct widget*)editor->edit)->width / 2;
+
+	return textview_scroll_horizontal(editor->edit, direction * (cols > 0 ? cols : 1));
+}
+
+static int _scroll_left_requested(struct widget *widget,
+				  void *user_data,
+				  void *data)
+{
+	return _scroll_requested((struct editor*)user_data, -1);
+}
+
+static int _scroll_right_requested(struct widget *widget,
+				   void *user_data,
+				   void *data)
+{
+	return _scroll_requested((struct editor*)user_data, +1);
+}
+
+static int _editor_num_views(struct editor *editor)
+{
+	int num;
+	int i;
+
+	for(num = 0, i = 0; i < EDITOR_MAX_VIEWS; i++) {
+		if(widget_is_visible((struct widget*)editor->current->views[i].textview)) {
+			num++;
+		}
+	}
+
+	return(num);
+}
+
+/* give the focus to another view, which brings its selection along */
+static void _editor_focus(struct editor *editor, const int view)
+{
+	if(view == editor->current->focus) {
+		return;
+	}
+
+	editor->current->views[editor->current->focus].sel_start = editor->sel_start;
+	editor->current->views[editor->current->focus].sel_end = editor->sel_end;
+	textview_set_info(editor->edit, NULL);
+
+	editor->current->focus = view;
+	editor->edit = editor->current->views[view].textview;
+	editor->sel_start = editor->current->views[view].sel_start;
+	editor->sel_end = editor->current->views[view].sel_end;
+	editor->current->views[view].sel_start = NULL;
+	editor->current->views[view].sel_end = NULL;
+
+	/* the matches that are counted are those of the selection */
+	_editor_invalidate_analysis(editor);
+}
+
+static int _split_requested(struct widget *widget,
+			    void *user_data,
+			    void *data)
+{
+	struct editor *editor;
+	struct textview *view;
+	int i;
+
+	editor = (struct editor*)user_data;
+
+	for(i = 0; i < EDITOR_MAX_VIEWS; i++) {
+		if(!widget_is_visible((struct widget*)editor->current->views[i].textview)) {
+			break;
+		}
+	}
+
+	if(i == EDITOR_MAX_VIEWS || !editor->buffer) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return 0;
+	}
+
+	/* the new view starts out where the focused one is */
+	view = editor->current->views[i].textview;
+	textview_share(view, editor->edit);
+	textview_set_tail(view, editor->current->follow);
+	widget_set_visible((struct widget*)view, TRUE);
+
+	_editor_focus(editor, i);
+
+	widget_resize((struct widget*)editor->window);
+	return 0;
+}
+
+static int _unsplit_requested(struct widget *widget,
+			      void *user_data,
+			      void *data)
+{
+	struct editor_view *view;
+	struct editor *editor;
+	int next;
+
+	editor = (struct editor*)user_data;
+
+	if(_editor_num_views(editor) < 2) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return 0;
+	}
+
+	view = &editor->current->views[editor->current->focus];
+
+	for(next = (editor->current->focus + 1) % EDITOR_MAX_VIEWS;
+	    !widget_is_visible((struct widget*)editor->current->views[next].textview);
+	    next = (next + 1) % EDITOR_MAX_VIEWS);
+
+	_editor_focus(editor, next);
+
+	/* the selection and the ways the closed view showed the buffer are gone */
+	textview_set_selection(view->textview, NULL, NULL);
+	telex_free(&view->sel_start);
+	telex_free(&view->sel_end);
+
+	if(view->filter) {
+		textview_set_filter(view->textview, NULL);
+		filter_free(&view->filter);
+	}
+
+	if(view->columns) {
+		textview_set_columns(view->textview, NULL);
+		columns_free(&view->columns);
+	}
+
+	if(view->json) {
+		textview_set_json(view->textview, NULL);
+		json_free(&view->json);
+	}
+
+	if(view->diff) {
+		textview_set_diff(view->textview, NULL);
+		diff_free(&view->diff);
+	}
+
+	widget_set_visible((struct widget*)view->textview, FALSE);
+	widget_resize((struct widget*)editor->window);
+
+	return 0;
+}
+
+static int _focus_next_requested(struct widget *widget,
+				 void *user_data,
+				 void *data)
+{
+	struct editor *editor;
+	int next;
+
+	editor = (struct editor*)user_data;
+
+	for(next = (editor->current->focus + 1) % EDITOR_MAX_VIEWS;
+	    !widget_is_visible((struct widget*)editor->current->views[next].textview);
+	    next = (next + 1) % EDITOR_MAX_VIEWS);
+
+	_editor_focus(editor, next);
+	widget_redraw((struct widget*)editor->window);
+
+	return 0;
+}
+
+static struct editor_buffer* _editor_find_buffer(struct editor *editor, const char *path);
+static int _editor_show(struct editor *editor, struct editor_buffer *eb);
+
+/*
+ * Open the file that was typed into the cmdbox, or show the next buffer
+ * if nothing was typed.
+ */
+static int _buffer_switch_requested(struct widget *widget,
+				    void *user_data,
+				    void *data)
+{
+	struct editor_buffer *next;
+	struct editor *editor;
+	char *path;
+	int err;
+
+	editor = (struct editor*)user_data;
+
+	if (cmdbox_get_length(editor->cmdbox) > 0) {
+		if (!(path = multistring_get_data((struct multistring*)data))) {
+			return -ENOMEM;
+		}
+
+		err = editor_open(editor, path, editor->current->readonly);
+		free(path);
+	} else {
+		if (!(next = editor->current->next)) {
+			next = editor->buffers;
+		}
+
+		err = _editor_show(editor, next);
+	}
+
+	if (err < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+	} else {
+		cmdbox_clear(editor->cmdbox);
+	}
+
+	return 0;
+}
+
+/*
+ * Show only the lines that contain the text in the cmdbox in the focused
+ * view. With an empty cmdbox, the view shows all lines again, around the
+ * selection, so that a match can be seen in its context.
+ */
+static int _grep_requested(struct widget *widget,
+			   void *user_data,
+			   void *data)
+{
+	struct editor_view *view;
+	struct editor *editor;
+	struct filter *filter;
+	char *pattern;
+	int err;
+
+	editor = (struct editor*)user_data;
+	view = &editor->current->views[editor->current->focus];
+	filter = NULL;
+
+	if (cmdbox_get_length(editor->cmdbox) > 0) {
+		if (!(pattern = multistring_get_data((struct multistring*)data))) {
+			return -ENOMEM;
+		}
+
+		err = filter_new(&filter, pattern, strlen(pattern));
+		free(pattern);
+
+		if (err < 0) {
+			cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+			return err;
+		}
+	}
+
+	textview_set_filter(view->textview, filter);
+
+	if (view->filter) {
+		filter_free(&view->filter);
+	}
+
+	view->filter = filter;
+	cmdbox_clear(editor->cmdbox);
+
+	return 0;
+}
+
+/*
+ * Fold the selected lines, or the lines below the start of the selection
+ * that are indented deeper than it if there is no end.
+ */
+static int _fold_requested(struct widget *widget,
+			   void *user_data,
+			   void *data)
+{
+	struct editor *editor;
+	const char *start;
+	const char *end;
+	const char *base;
+	int err;
+
+	editor = (struct editor*)user_data;
+
+	if (!editor->sel_start) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return -EINVAL;
+	}
+
+	if ((err = buffer_get_selection(editor->buffer, editor->sel_start, editor->sel_end,
+					&start, &end)) == 0) {
+		base = buffer_get_data(editor->buffer);
+
+		if (editor->sel_end) {
+			err = buffer_fold(editor->buffer, start - base, end - base);
+		} else {
+			err = buffer_fold_block(editor->buffer, start - base);
+		}
+	}
+
+	if (err < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	widget_redraw((struct widget*)editor->window);
+	return 0;
+}
+
+/*
+ * Unfold the fold at the start of the selection, or the one right below
+ * the line it is on, which is where a block was folded.
+ */
+static int _unfold_requested(struct widget *widget,
+			     void *user_data,
+			     void *data)
+{
+	struct editor *editor;
+	const char *start;
+	const char *end;
+	size_t offset;
+	size_t line_start;
+	size_t len;
+	int line;
+	int err;
+
+	editor = (struct editor*)user_data;
+
+	if (!editor->sel_start) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return -EINVAL;
+	}
+
+	if ((err = buffer_get_selection(editor->buffer, editor->sel_start, NULL,
+					&start, &end)) == 0) {
+		offset = start - buffer_get_data(editor->buffer);
+
+		if ((err = buffer_unfold(editor->buffer, offset)) == -ENOENT &&
+		    (err = buffer_get_line_range(editor->buffer, offset, &line,
+						 &line_start, &len)) == 0) {
+			err = buffer_unfold(editor->buffer, line_start + len);
+		}
+	}
+
+	if (err < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	widget_redraw((struct widget*)editor->window);
+	return 0;
+}
+
+/*
+ * Show the focused view as a table, with the fields separated by the
+ * character in the cmdbox, or by a guessed one if it is empty. If the view
+ * is a table already, it is shown as text again.
+ */
+static int _columns_toggled(struct widget *widget,
+			    void *user_data,
+			    void *data)
+{
+	struct editor_view *view;
+	struct editor *editor;
+	struct columns *columns;
+	char delimiter;
+	char *text;
+	int err;
+
+	editor = (struct editor*)user_data;
+	view = &editor->current->views[editor->current->focus];
+
+	if (view->columns) {
+		textview_set_columns(view->textview, NULL);
+		columns_free(&view->columns);
+		return 0;
+	}
+
+	delimiter = 0;
+
+	if (cmdbox_get_length(editor->cmdbox) > 0) {
+		if (!(text = multistring_get_data((struct multistring*)data))) {
+			return -ENOMEM;
+		}
+
+		if (strcmp(text, "tab") == 0) {
+			delimiter = '\t';
+		} else if (strlen(text) == 1) {
+			delimiter = text[0];
+		}
+
+		free(text);
+
+		if (!delimiter) {
+			cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+			return -EINVAL;
+		}
+	}
+
+	if ((err = columns_new(&columns, delimiter)) < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	view->columns = columns;
+	textview_set_columns(view->textview, columns);
+	cmdbox_clear(editor->cmdbox);
+
+	return 0;
+}
+
+/*
+ * Select the field with the number in the cmdbox, counted from 1, on the
+ * line that the selection starts on.
+ */
+static int _field_requested(struct widget *widget,
+			    void *user_data,
+			    void *data)
+{
+	const struct columns_field *fields;
+	struct editor_view *view;
+	struct editor *editor;
+	struct telex *start;
+	struct telex *end;
+	const char *sel_start;
+	const char *sel_end;
+	const char *base;
+	size_t line_start;
+	size_t len;
+	char *text;
+	int field;
+	int line;
+	int num;
+	int err;
+
+	editor = (struct editor*)user_data;
+	view = &editor->current->views[editor->current->focus];
+
+	if (!view->columns || !editor->sel_start || cmdbox_get_length(editor->cmdbox) == 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return -EINVAL;
+	}
+
+	if (!(text = multistring_get_data((struct multistring*)data))) {
+		return -ENOMEM;
+	}
+
+	field = atoi(text);
+	free(text);
+
+	base = buffer_get_data(editor->buffer);
+
+	if ((err = buffer_get_selection(editor->buffer, editor->sel_start, NULL,
+					&sel_start, &sel_end)) < 0 ||
+	    (err = buffer_get_line_range(editor->buffer, sel_start - base, &line,
+					 &line_start, &len)) < 0 ||
+	    (err = columns_get_fields(view->columns, editor->buffer, line_start, len,
+				      &fields, &num)) < 0 ||
+	    (err = field < 1 || field > num ? -ERANGE : 0) < 0 ||
+	    (err = telex_rlookup(&start, base, base + line_start + fields[field - 1].start)) < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	end = NULL;
+
+	if (fields[field - 1].len > 0 &&
+	    telex_rlookup(&end, base, base + line_start + fields[field - 1].start +
+			  fields[field - 1].len) < 0) {
+		end = NULL;
+	}
+
+	textview_set_selection(editor->edit, start, end);
+	telex_free(&editor->sel_start);
+	telex_free(&editor->sel_end);
+	editor->sel_start = start;
+	editor->sel_end = end;
+
+	_editor_invalidate_analysis(editor);
+	cmdbox_clear(editor->cmdbox);
+
+	return 0;
+}
+
+/*
+ * Show the focused view as pretty-printed JSON, or as text again if it is
+ * shown that way already.
+ */
+static int _json_toggled(struct widget *widget,
+			 void *user_data,
+			 void *data)
+{
+	struct editor_view *view;
+	struct editor *editor;
+	struct json *json;
+	int err;
+
+	editor = (struct editor*)user_data;
+	view = &editor->current->views[editor->current->focus];
+
+	if (view->json) {
+		textview_set_json(view->textview, NULL);
+		json_free(&view->json);
+		return 0;
+	}
+
+	if ((err = json_new(&json)) < 0) {
+		return err;
+	}
+
+	if ((err = json_update(json, editor->buffer)) < 0) {
+		json_free(&json);
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	view->json = json;
+	textview_set_json(view->textview, json);
+
+	return 0;
+}
+
+/* fold the object or array that the selection starts in, or unfold it */
+static int _json_fold_toggled(struct widget *widget,
+			      void *user_data,
+			      void *data)
+{
+	struct editor_view *view;
+	struct editor *editor;
+	const char *sel_start;
+	const char *sel_end;
+	int err;
+
+	editor = (struct editor*)user_data;
+	view = &editor->current->views[editor->current->focus];
+
+	if (!view->json || !editor->sel_start) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return -EINVAL;
+	}
+
+	if ((err = buffer_get_selection(editor->buffer, editor->sel_start, NULL,
+					&sel_start, &sel_end)) < 0 ||
+	    (err = json_toggle(view->json, editor->buffer,
+			       sel_start - buffer_get_data(editor->buffer))) < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	return widget_redraw((struct widget*)view->textview);
+}
+
+/* show the focused view as a diff against `base', which the diff takes over */
+static int _editor_show_diff(struct editor *editor, struct buffer *base)
+{
+	struct editor_view *view;
+	struct diff *diff;
+	int err;
+
+	view = &editor->current->views[editor->current->focus];
+
+	if ((err = diff_new(&diff, base)) < 0) {
+		buffer_close(&base);
+		return err;
+	}
+
+	if ((err = diff_update(diff, editor->buffer)) < 0) {
+		diff_free(&diff);
+		return err;
+	}
+
+	view->diff = diff;
+	textview_set_diff(view->textview, diff);
+
+	return 0;
+}
+
+/* show what changed since the file was last read or written */
+static int _diff_toggled(struct widget *widget,
+			 void *user_data,
+			 void *data)
+{
+	struct editor_view *view;
+	struct editor *editor;
+	struct buffer *base;
+	int err;
+
+	editor = (struct editor*)user_data;
+	view = &editor->current->views[editor->current->focus];
+
+	if (view->diff) {
+		textview_set_diff(view->textview, NULL);
+		diff_free(&view->diff);
+		return 0;
+	}
+
+	if ((err = buffer_open(&base, buffer_get_path(editor->buffer), 1)) < 0 ||
+	    (err = _editor_show_diff(editor, base)) < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	return 0;
+}
+
+/* show what changed since now, so that the edits that follow can be seen */
+static int _snapshot_diff_toggled(struct widget *widget,
+				  void *user_data,
+				  void *data)
+{
+	struct editor_view *view;
+	struct editor *editor;
+	struct buffer *base;
+	int err;
+
+	editor = (struct editor*)user_data;
+	view = &editor->current->views[editor->current->focus];
+
+	if (view->diff) {
+		textview_set_diff(view->textview, NULL);
+		diff_free(&view->diff);
+		return 0;
+	}
+
+	if ((err = buffer_clone(editor->buffer, &base)) < 0 ||
+	    (err = _editor_show_diff(editor, base)) < 0) {
+		cmdbox_highlight(editor->cmdbox, UI_COLOR_DELETION, 0, -1);
+		return err;
+	}
+
+	return 0;
+}
+
 struct variable* _editor_find_variable(struct editor *editor, const char *name);
 
 static int _cmdbox_set_text_from_telex(struct cmdbox *box, struct telex *telex)
@@ -92,6 +803,7 @@ static int _selection_start_change(struct widget *widget,
 		_cmdbox_set_text_from_telex(box, editor->sel_start);
 		textview_set_selection_start(editor->edit, NULL);
 		telex_free(&editor->sel_start);
+		_editor_invalidate_analysis(editor);
 		return 0;
 	}
 
@@ -118,6 +830,7 @@ static int _selection_start_change(struct widget *widget,
 			editor->sel_start = telex;
 
 			textview_set_selection_start(editor->edit, telex);
+			_editor_invalidate_analysis(editor);
 			cmdbox_clear(box);
 		}
 	}
@@ -154,6 +867,7 @@ static int _selection_end_change(struct widget *widget,
 		_cmdbox_set_text_from_telex(box, editor->sel_end);
 		textview_set_selection_end(editor->edit, NULL);
 		telex_free(&editor->sel_end);
+		_editor_invalidate_analysis(editor);
 		return 0;
 	}
 
@@ -180,6 +894,7 @@ static int _selection_end_change(struct widget *widget,
 			editor->sel_end = telex;
 
 			textview_set_selection_end(editor->edit, telex);
+			_editor_invalidate_analysis(editor);
 			cmdbox_clear(box);
 		}
 	}
@@ -233,8 +948,8 @@ static int _oinsert_requested(struct widget *widget,
 	}
 
 	insertion = cmdbox_get_text(box);
-	if ((err = buffer_overwrite(editor->buffer, insertion, editor->sel_start,
-				    editor->sel_end, &new_pos)) < 0) {
+	if ((err = buffer_overwrite(editor->buffer, insertion, strlen(insertion),
+				    editor->sel_start, editor->sel_end, &new_pos)) < 0) {
 		cmdbox_highlight(box, UI_COLOR_DELETION, 0, -1);
 	} else {
 		_advance_selection(editor, new_pos);
@@ -274,7 +989,8 @@ static int _insert_requested(struct widget *widget,
 	}
 
 	insertion = cmdbox_get_text(box);
-	if ((err = buffer_insert(editor->buffer, insertion, editor->sel_start, &new_pos)) < 0) {
+	if ((err = buffer_insert(editor->buffer, insertion, strlen(insertion),
+				 editor->sel_start, &new_pos)) < 0) {
 		fprintf(stderr, "Could not insert text: %s [%d]\n", strerror(-err), -err);
 	} else {
 		/* Advance selection so the user can insert more text */
@@ -298,6 +1014,7 @@ static int _write_requested(struct widget *widget,
 	char *var_name;
 	const char *var_value;
 	const char *new_pos;
+	size_t var_len;
 	int err;
 
 	box = (struct cmdbox*)widget;
@@ -316,12 +1033,13 @@ static int _write_requested(struct widget *widget,
 	}
 
 	var_name = cmdbox_get_text(box);
-	if (editor_get_var(editor, var_name, &var_value) < 0) {
+	if (editor_get_var(editor, var_name, &var_value, &var_len) < 0) {
 		fprintf(stderr, "No variable \"%s\"\n", var_name);
 		cmdbox_highlight(box, UI_COLOR_DELETION, 0, strlen(var_name));
 	} else {
 		fprintf(stderr, "Inserting variable \"%s\" into buffer\n", var_name);
-		if ((err = buffer_insert(editor->buffer, var_value, editor->sel_start, &new_pos)) < 0) {
+		if ((err = buffer_insert(editor->buffer, var_value, var_len,
+					 editor->sel_start, &new_pos)) < 0) {
 			fprintf(stderr, "Could not insert variable \"%s\": %s [%d]\n",
 				var_name, strerror(-err), -err);
 			cmdbox_highlight(box, UI_COLOR_DELETION, 0, -1);
@@ -371,14 +1089,15 @@ static int _read_requested(struct widget *widget,
 					&substring, &substring_len)) < 0) {
 		cmdbox_highlight(box, UI_COLOR_DELETION, 0, -1);
 	} else {
-		fprintf(stderr, "Setting variable \"%s\" to \"%s\"\n", var, substring);
+		fprintf(stderr, "Setting variable \"%s\" to %zu bytes\n", var, substring_len);
 
-		if ((err = editor_set_var(editor, var, substring)) < 0) {
-			free((void*)substring);
+		if ((err = editor_set_var(editor, var, substring, substring_len)) < 0) {
 			cmdbox_highlight(box, UI_COLOR_DELETION, 0, -1);
 		} else {
 			cmdbox_clear(box);
 		}
+
+		free((void*)substring);
 	}
 
 	free(var);
@@ -397,7 +1116,20 @@ static int _save_requested(struct widget *widget,
 	box = (struct cmdbox*)widget;
 	editor = (struct editor*)user_data;
 
-	if ((err = buffer_save(editor->buffer)) < 0) {
+	/*
+	 * If the file was changed by someone else, the first save request
+	 * only warns the user; saving again overwrites the file anyways.
+	 */
+	if (editor->force_save) {
+		err = buffer_save_force(editor->buffer);
+	} else {
+		err = buffer_save(editor->buffer);
+	}
+
+	editor->force_save = err == -ESTALE;
+
+	if (err < 0) {
+		fprintf(stderr, "Could not save buffer: %s [%d]\n", strerror(-err), -err);
 		cmdbox_highlight(box, UI_COLOR_DELETION, 0, -1);
 		return err;
 	}
@@ -460,13 +1192,32 @@ int _variable_free(struct variable **var)
 	return 0;
 }
 
-struct variable* _variable_new(const char *name, const char *value)
+int _variable_set(struct variable *var, const char *value, const size_t len)
+{
+	char *value_dup;
+
+	/* values may contain NUL bytes, but they are terminated anyway */
+	if (!(value_dup = malloc(len + 1))) {
+		return -ENOMEM;
+	}
+
+	memcpy(value_dup, value, len);
+	value_dup[len] = 0;
+
+	free(var->value);
+	var->value = value_dup;
+	var->value_len = len;
+
+	return 0;
+}
+
+struct variable* _variable_new(const char *name, const char *value, const size_t len)
 {
 	struct variable *var;
 
 	if ((var = calloc(1, sizeof(*var)))) {
 		if (!(var->name = strdup(name)) ||
-		    !(var->value = strdup(value))) {
+		    _variable_set(var, value, len) < 0) {
 			_variable_free(&var);
 		}
 	}
@@ -474,72 +1225,296 @@ struct variable* _variable_new(const char *name, const char *value)
 	return var;
 }
 
-int _variable_set(struct variable *var, const char *value)
+int editor_set_var(struct editor *editor, const char *name, const char *value,
+		   const size_t len)
 {
-	char *value_dup;
+	struct variable *var;
 
-	if (!(value_dup = strdup(value))) {
+	if ((var = _editor_find_variable(editor, name))) {
+		return _variable_set(var, value, len);
+	}
+
+	if (!(var = _variable_new(name, value, len))) {
 		return -ENOMEM;
 	}
 
-	free(var->value);
-	var->value = value_dup;
+	var->next = editor->variables;
+	editor->variables = var;
 
 	return 0;
 }
 
-int editor_set_var(struct editor *editor, const char *name, const char *value)
+int editor_get_var(struct editor *editor, const char *name, const char **value,
+		   size_t *len)
 {
 	struct variable *var;
 
-	if ((var = _editor_find_variable(editor, name))) {
-		return _variable_set(var, value);
+	if (!(var = _editor_find_variable(editor, name))) {
+		return -ENOENT;
 	}
 
-	if (!(var = _variable_new(name, value))) {
-		return -ENOMEM;
+	*value = var->value;
+	*len = var->value_len;
+	return 0;
+}
+
+static int _cmdbox_quit_requested(struct widget *widget, void *user_data, void *data)
+{
+	return editor_quit((struct editor*)user_data);
+}
+
+/*
+ * All views of a buffer are created up front, so that they are above the
+ * cmdbox in the vbox, but only the first one is shown until the user
+ * splits it.
+ */
+static int _editor_buffer_new(struct editor *editor, struct editor_buffer **eb)
+{
+	struct editor_buffer *entry;
+	struct editor_buffer **last;
+	int err;
+	int i;
+
+	if(!(entry = calloc(1, sizeof(*entry)))) {
+		return(-ENOMEM);
 	}
 
-	var->next = editor->variables;
-	editor->variables = var;
+	for(i = 0; i < EDITOR_MAX_VIEWS; i++) {
+		if((err = textview_new(&(entry->views[i].textview))) < 0) {
+			while(--i >= 0) {
+				widget_free((struct widget*)entry->views[i].textview);
+			}
 
-	return 0;
+			free(entry);
+			return(err);
+		}
+
+		widget_set_visible((struct widget*)entry->views[i].textview, i == 0);
+	}
+
+	/* buffers are cycled through in the order they were opened */
+	for(last = &editor->buffers; *last; last = &(*last)->next);
+	*last = entry;
+
+	*eb = entry;
+	return(0);
+}
+
+/*
+ * The views must not be in the vbox anymore, and the selection of the
+ * focused view must have been put back into its slot.
+ */
+static void _editor_buffer_free(struct editor *editor, struct editor_buffer *eb)
+{
+	struct editor_buffer **prev;
+	int i;
+
+	for(prev = &editor->buffers; *prev && *prev != eb; prev = &(*prev)->next);
+
+	if(*prev) {
+		*prev = eb->next;
+	}
+
+	for(i = 0; i < EDITOR_MAX_VIEWS; i++) {
+		if(eb->views[i].textview) {
+			widget_free((struct widget*)eb->views[i].textview);
+		}
+
+		telex_free(&eb->views[i].sel_start);
+		telex_free(&eb->views[i].sel_end);
+
+		if(eb->views[i].filter) {
+			filter_free(&eb->views[i].filter);
+		}
+
+		if(eb->views[i].columns) {
+			columns_free(&eb->views[i].columns);
+		}
+
+		if(eb->views[i].json) {
+			json_free(&eb->views[i].json);
+		}
+
+		if(eb->views[i].diff) {
+			diff_free(&eb->views[i].diff);
+		}
+	}
+
+	if(eb->buffer) {
+		buffer_close(&eb->buffer);
+	}
+
+	/* the journal doesn't outlive a clean exit */
+	if(eb->journal) {
+		journal_discard(&eb->journal);
+	}
+
+	free(eb);
 }
 
-int editor_get_var(struct editor *editor, const char *name, const char **value)
-{
-	struct variable *var;
+/*
+ * The same file can be opened through different paths, or through a link,
+ * so files are told apart by their device and inode. Files that don't
+ * exist yet can only be told apart by their paths.
+ */
+static struct editor_buffer* _editor_find_buffer(struct editor *editor, const char *path)
+{
+	struct editor_buffer *eb;
+	struct stat info;
+	int exists;
+
+	exists = stat(path, &info) == 0;
+
+	for(eb = editor->buffers; eb; eb = eb->next) {
+		struct stat other;
+
+		if(!eb->buffer) {
+			continue;
+		}
+
+		if(strcmp(buffer_get_path(eb->buffer), path) == 0) {
+			break;
+		}
+
+		if(exists && stat(buffer_get_path(eb->buffer), &other) == 0 &&
+		   other.st_dev == info.st_dev && other.st_ino == info.st_ino) {
+			break;
+		}
+	}
+
+	return(eb);
+}
+
+/*
+ * Unload the contents of the least recently shown buffers until the loaded
+ * ones fit into the memory limit. Buffers with unsaved changes, or changes
+ * on disk that were not read yet, can't be unloaded and are skipped.
+ */
+static void _editor_evict(struct editor *editor)
+{
+	struct editor_buffer *victim;
+	struct editor_buffer *eb;
+	unsigned long floor;
+	size_t total;
+
+	for(total = 0, eb = editor->buffers; eb; eb = eb->next) {
+		total += buffer_get_memory(eb->buffer);
+	}
+
+	for(floor = 0; total > config.buffer_memory_limit; floor = victim->used) {
+		size_t size;
+
+		victim = NULL;
+
+		for(eb = editor->buffers; eb; eb = eb->next) {
+			if(eb != editor->current && eb->used > floor &&
+			   buffer_get_memory(eb->buffer) > 0 &&
+			   (!victim || eb->used < victim->used)) {
+				victim = eb;
+			}
+		}
+
+		if(!victim) {
+			break;
+		}
+
+		size = buffer_get_memory(victim->buffer);
+
+		if(buffer_unload(victim->buffer) == 0) {
+			total -= size;
+		}
+	}
+}
+
+/*
+ * Put the views of another buffer into the vbox. The views that are taken
+ * out keep everything they cached, so switching back is cheap unless the
+ * buffer was unloaded in the meantime.
+ */
+static int _editor_show(struct editor *editor, struct editor_buffer *eb)
+{
+	struct editor_buffer *old;
+	int err;
+	int i;
+
+	old = editor->current;
+
+	if(eb == old) {
+		return(0);
+	}
+
+	if(eb->buffer && !buffer_is_loaded(eb->buffer) &&
+	   (err = buffer_load(eb->buffer)) < 0) {
+		return(err);
+	}
+
+	if(old) {
+		old->views[old->focus].sel_start = editor->sel_start;
+		old->views[old->focus].sel_end = editor->sel_end;
+		textview_set_info(editor->edit, NULL);
+
+		/* edits that are only in memory stay there while the buffer is hidden */
+		if(old->journal && journal_flush(old->journal) == 0) {
+			journal_sync(old->journal);
+		}
+
+		for(i = 0; i < EDITOR_MAX_VIEWS; i++) {
+			container_remove((struct container*)editor->vbox,
+					 (struct widget*)old->views[i].textview);
+		}
+	}
+
+	for(i = 0; i < EDITOR_MAX_VIEWS; i++) {
+		if((err = container_add((struct container*)editor->vbox,
+					(struct widget*)eb->views[i].textview)) < 0) {
+			return(err);
+		}
+	}
 
-	if (!(var = _editor_find_variable(editor, name))) {
-		return -ENOENT;
+	editor->current = eb;
+	editor->buffer = eb->buffer;
+	editor->journal = eb->journal;
+	editor->edit = eb->views[eb->focus].textview;
+	editor->sel_start = eb->views[eb->focus].sel_start;
+	editor->sel_end = eb->views[eb->focus].sel_end;
+	eb->views[eb->focus].sel_start = NULL;
+	eb->views[eb->focus].sel_end = NULL;
+	eb->used = ++editor->clock;
+	editor->force_save = FALSE;
+
+	/* the analysis of the old buffer is no use, and the new one has none yet */
+	_editor_invalidate_analysis(editor);
+	editor->analysis_stale = TRUE;
+	memset(&editor->analysis_due, 0, sizeof(editor->analysis_due));
+
+	if(old) {
+		_editor_refresh(editor);
+		_editor_evict(editor);
 	}
 
-	*value = var->value;
-	return 0;
-}
+	widget_resize((struct widget*)editor->window);
+	widget_redraw((struct widget*)editor->window);
 
-static int _cmdbox_quit_requested(struct widget *widget, void *user_data, void *data)
-{
-	return editor_quit((struct editor*)user_data);
+	return(0);
 }
 
 static int _editor_init_ui(struct editor *editor)
 {
+	struct editor_buffer *eb;
 	int err;
 
 	if(!editor) {
 		return(-EINVAL);
 	} else if((err = window_new(&(editor->window))) < 0) {
 		return(err);
-	} else if((err = vbox_new(&(editor->vbox), 4)) < 0) {
+	} else if((err = vbox_new(&(editor->vbox), EDITOR_MAX_VIEWS + 1)) < 0) {
 		return(err);
 	} else if((err = container_add((struct container*)editor->window,
 				       (struct widget*)editor->vbox)) < 0) {
 		return(err);
-	} else if((err = textview_new(&(editor->edit))) < 0) {
+	} else if((err = _editor_buffer_new(editor, &eb)) < 0) {
 		return(err);
-	} else if((err = container_add((struct container*)editor->vbox,
-				       (struct widget*)editor->edit)) < 0) {
+	} else if((err = _editor_show(editor, eb)) < 0) {
 		return(err);
 	} else if((err = cmdbox_new(&(editor->cmdbox))) < 0) {
 		return(err);
@@ -591,6 +1566,91 @@ static int _editor_init_ui(struct editor *editor)
 					     _erase_requested,
 					     editor)) < 0) {
 		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "wrap_toggled",
+					     _wrap_toggled,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "scroll_left_requested",
+					     _scroll_left_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "scroll_right_requested",
+					     _scroll_right_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "split_requested",
+					     _split_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "unsplit_requested",
+					     _unsplit_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "focus_next_requested",
+					     _focus_next_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "buffer_switch_requested",
+					     _buffer_switch_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "grep_requested",
+					     _grep_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "fold_requested",
+					     _fold_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "unfold_requested",
+					     _unfold_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "hex_toggled",
+					     _hex_toggled,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "columns_toggled",
+					     _columns_toggled,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "field_requested",
+					     _field_requested,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "json_toggled",
+					     _json_toggled,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "json_fold_toggled",
+					     _json_fold_toggled,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "diff_toggled",
+					     _diff_toggled,
+					     editor)) < 0) {
+		return err;
+	} else if ((err = widget_add_handler((struct widget*)editor->cmdbox,
+					     "snapshot_diff_toggled",
+					     _snapshot_diff_toggled,
+					     editor)) < 0) {
+		return err;
 	}
 
 	widget_resize((struct widget*)editor->window);
@@ -599,51 +1659,450 @@ static int _editor_init_ui(struct editor *editor)
 	return(0);
 }
 
+static int _editor_open_journal(struct editor_buffer *eb, const char *path)
+{
+	int err;
+
+	if ((err = journal_open(&eb->journal, path)) < 0) {
+		fprintf(stderr, "Could not open journal: %s [%d]\n", strerror(-err), -err);
+		return err;
+	}
+
+	/* the edits from a previous session are applied before new ones are recorded */
+	if ((err = journal_replay(eb->journal, eb->buffer)) > 0) {
+		fprintf(stderr, "Recovered %d edits from journal\n", err);
+	} else if (err < 0) {
+		fprintf(stderr, "Could not replay journal: %s [%d]\n", strerror(-err), -err);
+	}
+
+	return buffer_set_journal(eb->buffer, eb->journal);
+}
+
+/*
+ * Open a file in a new buffer and show it. If the file is open already,
+ * its buffer is shown instead.
+ */
 int editor_open(struct editor *editor, const char *path, const int readonly)
 {
+	struct editor_buffer *eb;
 	int err;
 
 	if(!editor || !path) {
 		return(-EINVAL);
 	}
 
-	if(editor->buffer) {
-		return(-EALREADY);
+	if((eb = _editor_find_buffer(editor, path))) {
+		return(_editor_show(editor, eb));
+	}
+
+	/* the buffer that the editor starts out with is empty until now */
+	if(editor->current->buffer) {
+		if((err = _editor_buffer_new(editor, &eb)) < 0) {
+			return(err);
+		}
+	} else {
+		eb = editor->current;
 	}
 
-	err = buffer_open(&(editor->buffer), path, readonly);
+	err = buffer_open(&(eb->buffer), path, readonly);
 
 	if(err < 0) {
+		if(eb != editor->current) {
+			_editor_buffer_free(editor, eb);
+		}
+
 		return(err);
 	}
 
-	editor->readonly = readonly;
+	eb->readonly = readonly;
 
-	err = textview_set_buffer(editor->edit, editor->buffer);
+	if (!readonly) {
+		_editor_open_journal(eb, path);
+	}
 
-	if(err < 0) {
+	/* without a watch, changes on disk are still caught when saving */
+	if ((err = buffer_watch(eb->buffer)) < 0) {
+		fprintf(stderr, "Could not watch file: %s [%d]\n", strerror(-err), -err);
+	}
+
+	/* the other views get the buffer when they are split off */
+	if((err = textview_set_buffer(eb->views[0].textview, eb->buffer)) < 0) {
 		return(err);
 	}
 
+	if(eb == editor->current) {
+		editor->buffer = eb->buffer;
+		editor->journal = eb->journal;
+
+		/* the first analysis doesn't have to wait for anything */
+		editor->analysis_stale = TRUE;
+	} else if((err = _editor_show(editor, eb)) < 0) {
+		return(err);
+	}
+
+	_editor_evict(editor);
 	widget_redraw((struct widget*)editor->window);
 
 	return(0);
 }
 
-int editor_run(struct editor *editor)
+int editor_follow(struct editor *editor)
+{
+	int err;
+	int i;
+
+	if (!editor) {
+		return -EINVAL;
+	}
+
+	if (!editor->buffer) {
+		return -EBADFD;
+	}
+
+	/*
+	 * If the file can't be watched, we still follow it, we'll just
+	 * have to check it periodically.
+	 */
+	if ((err = buffer_follow(editor->buffer)) < 0) {
+		fprintf(stderr, "Could not watch file: %s [%d]\n", strerror(-err), -err);
+	}
+
+	editor->current->follow = TRUE;
+
+	for (i = 0; i < EDITOR_MAX_VIEWS; i++) {
+		textview_set_tail(editor->current->views[i].textview, TRUE);
+	}
+
+	widget_redraw((struct widget*)editor->window);
+
+	return 0;
+}
+
+static int _editor_refresh(struct editor *editor)
+{
+	int err;
+
+	if ((err = buffer_refresh(editor->buffer)) > 0) {
+		widget_redraw((struct widget*)editor->window);
+	} else if (err == -EBUSY) {
+		fprintf(stderr, "File changed on disk, but buffer has unsaved changes\n");
+	} else if (err < 0) {
+		fprintf(stderr, "Could not refresh buffer: %s [%d]\n", strerror(-err), -err);
+	}
+
+	return err;
+}
+
+static int _editor_ms_until(const struct timespec *when)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (when->tv_sec - now.tv_sec) * 1000 + (when->tv_nsec - now.tv_nsec) / 1000000;
+
+	return ms > 0 ? (int)ms : 0;
+}
+
+/*
+ * The results of the current analysis no longer match what is shown. It
+ * is cancelled right away, but a new one is only started after a while,
+ * so that typing doesn't start one analysis per key.
+ */
+static void _editor_invalidate_analysis(struct editor *editor)
 {
+	long nsec;
+
+	if (editor->analysis) {
+		analysis_cancel(&editor->analysis);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &editor->analysis_due);
+	nsec = editor->analysis_due.tv_nsec + (long)config.analysis_delay * 1000000;
+	editor->analysis_due.tv_sec += nsec / 1000000000;
+	editor->analysis_due.tv_nsec = nsec % 1000000000;
+	editor->analysis_stale = TRUE;
+}
+
+static void _editor_analysis_done(struct analysis *analysis, const analysis_task_t task,
+				  void *user_data)
+{
+	const struct analysis_stats *stats;
+	struct editor *editor;
+	unsigned char *states;
+	char info[128];
+	int num_states;
+
+	editor = (struct editor*)user_data;
+
+	switch (task) {
+	case ANALYSIS_INDEX:
+		buffer_adopt_index(editor->buffer, analysis_get_snapshot(analysis),
+				   analysis_get_generation(analysis));
+		break;
+
+	case ANALYSIS_HIGHLIGHT:
+		if (analysis_take_states(analysis, &states, &num_states) == 0) {
+			highlight_set_states(textview_get_highlight(editor->edit), editor->buffer,
+					     analysis_get_generation(analysis), states, num_states);
+		}
+		break;
+
+	case ANALYSIS_STATS:
+		stats = analysis_get_stats(analysis);
+
+		if (editor->sel_start && editor->sel_end) {
+			snprintf(info, sizeof(info), "%zu matches  %zu lines  %zu words  %zu bytes",
+				 stats->hits, stats->lines, stats->words, stats->bytes);
+		} else {
+			snprintf(info, sizeof(info), "%zu lines  %zu words  %zu bytes",
+				 stats->lines, stats->words, stats->bytes);
+		}
+
+		textview_set_info(editor->edit, info);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void _editor_start_analysis(struct editor *editor)
+{
+	const char *sel_from;
+	const char *sel_to;
+	size_t pattern_start;
+	size_t pattern_len;
+	char info[64];
+	size_t size;
+	int tasks;
+	int err;
+
+	size = buffer_get_size(editor->buffer);
+	editor->analysed = buffer_get_generation(editor->buffer);
+	editor->analysis_stale = FALSE;
+
+	/*
+	 * The snapshot shares the contents with the buffer, and the next edit
+	 * copies them if the analysis is still running. Above this size, the
+	 * copy would stall the editor for longer than the analysis is worth.
+	 */
+	if (size > config.analysis_max_size) {
+		snprintf(info, sizeof(info), "%zu bytes", size);
+		textview_set_info(editor->edit, info);
+		return;
+	}
+
+	tasks = ANALYSIS_TASK(ANALYSIS_STATS);
+
+	if (buffer_get_indexed(editor->buffer) < size) {
+		tasks |= ANALYSIS_TASK(ANALYSIS_INDEX);
+	}
+
+	if (textview_get_highlight(editor->edit)) {
+		tasks |= ANALYSIS_TASK(ANALYSIS_HIGHLIGHT);
+	}
+
+	/* the selected text is what we count the occurrences of */
+	pattern_start = 0;
+	pattern_len = 0;
+
+	if (editor->sel_start && editor->sel_end &&
+	    buffer_get_selection(editor->buffer, editor->sel_start, editor->sel_end,
+				 &sel_from, &sel_to) == 0) {
+		pattern_start = sel_from - buffer_get_data(editor->buffer);
+		pattern_len = sel_to - sel_from;
+	}
+
+	if ((err = analysis_start(&editor->analysis, editor->workers, editor->buffer, tasks,
+				  pattern_start, pattern_len, _editor_analysis_done, editor)) < 0) {
+		fprintf(stderr, "Could not start analysis: %s [%d]\n", strerror(-err), -err);
+	}
+}
+
+/*
+ * Restart the analysis if the buffer changed. This only ever submits
+ * work, the results are picked up whenever the workers are done.
+ */
+static void _editor_update_analysis(struct editor *editor)
+{
+	if (!editor->workers || !editor->buffer) {
+		return;
+	}
+
+	if (!editor->analysis_stale && editor->analysed != buffer_get_generation(editor->buffer)) {
+		_editor_invalidate_analysis(editor);
+	}
+
+	if (editor->analysis_stale && _editor_ms_until(&editor->analysis_due) == 0) {
+		_editor_start_analysis(editor);
+	}
+}
+
+static void _editor_collect_analysis(struct editor *editor)
+{
+	ui_freeze();
+	worker_pool_collect(editor->workers);
+	ui_thaw();
+
+	display_flush(((struct widget*)editor->window)->display);
+}
+
+static int _editor_get_timeout(struct editor *editor)
+{
+	int timeout;
+	int sync;
+
+	/*
+	 * When following, wake up periodically even if the file is watched,
+	 * since a rotated file may not exist yet when the rotation is noticed.
+	 */
+	timeout = editor->current->follow ? config.follow_interval : -1;
+	sync = editor->journal ? journal_get_timeout(editor->journal) : -1;
+
+	if (sync >= 0 && (timeout < 0 || sync < timeout)) {
+		timeout = sync;
+	}
+
+	if (editor->workers && editor->analysis_stale) {
+		sync = _editor_ms_until(&editor->analysis_due);
+
+		if (timeout < 0 || sync < timeout) {
+			timeout = sync;
+		}
+	}
+
+	return timeout;
+}
+
+static int _editor_wait_input(struct editor *editor)
+{
+	struct pollfd fds[3];
+	int ready;
+	int err;
+
+	/*
+	 * Write whatever was journaled while handling the last input, but
+	 * leave syncing it to the disk for when the user pauses.
+	 */
+	if (editor->journal && (err = journal_flush(editor->journal)) < 0) {
+		fprintf(stderr, "Could not write journal: %s [%d]\n", strerror(-err), -err);
+	}
+
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = buffer_get_watch_fd(editor->buffer);
+	fds[1].events = POLLIN;
+	fds[2].fd = editor->workers ? worker_pool_get_fd(editor->workers) : -1;
+	fds[2].events = POLLIN;
+
+	/* poll() ignores the descriptors that are negative */
+	while ((ready = poll(fds, 3, _editor_get_timeout(editor))) >= 0) {
+		if (editor->journal && journal_get_timeout(editor->journal) == 0 &&
+		    (err = journal_sync(editor->journal)) < 0) {
+			fprintf(stderr, "Could not sync journal: %s [%d]\n", strerror(-err), -err);
+		}
+
+		if ((ready == 0 && editor->current->follow) || fds[1].revents) {
+			_editor_refresh(editor);
+		}
+
+		if (fds[2].revents) {
+			_editor_collect_analysis(editor);
+		}
+
+		_editor_update_analysis(editor);
+
+		if (fds[0].revents) {
+			break;
+		}
+	}
+
+	/* EINTR most likely means SIGWINCH, which getch() needs to see */
+	return 0;
+}
+
+static void _editor_handle_input(struct editor *editor, const int event)
+{
+	if (event == KEY_RESIZE) {
+		window_adjust_size(editor->window);
+	} else {
+		widget_input((struct widget*)editor->window, event);
+	}
+}
+
+/*
+ * Handle everything the user typed (or pasted) so far, without waiting
+ * for more and without redrawing in between.
+ */
+static int _editor_drain_input(struct editor *editor)
+{
+	int events;
 	int event;
 
+	nodelay(stdscr, TRUE);
+
+	for (events = 0; editor->running && (event = getch()) != ERR; events++) {
+		_editor_handle_input(editor, event);
+	}
+
+	nodelay(stdscr, FALSE);
+
+	return events;
+}
+
+static int _editor_get_frame_delay(struct editor *editor)
+{
+	struct timespec now;
+	long elapsed;
+	long interval;
+
+	if (config.max_fps <= 0) {
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - editor->last_frame.tv_sec) * 1000 +
+		(now.tv_nsec - editor->last_frame.tv_nsec) / 1000000;
+	interval = 1000 / config.max_fps;
+
+	return elapsed < interval ? (int)(interval - elapsed) : 0;
+}
+
+/*
+ * If frames are limited, keep handling input that arrives until the next
+ * frame is due, so that a slow paste doesn't cause a redraw per chunk.
+ */
+static void _editor_throttle(struct editor *editor)
+{
+	struct pollfd fds;
+	int delay;
+
+	fds.fd = STDIN_FILENO;
+	fds.events = POLLIN;
+
+	while (editor->running && (delay = _editor_get_frame_delay(editor)) > 0 &&
+	       poll(&fds, 1, delay) > 0) {
+		_editor_drain_input(editor);
+	}
+}
+
+int editor_run(struct editor *editor)
+{
 	editor->running = TRUE;
 
 	while (editor->running) {
-		event = getch();
+		_editor_wait_input(editor);
 
-		if(event == KEY_RESIZE) {
-			window_adjust_size(editor->window);
-		} else {
-			widget_input((struct widget*)editor->window, event);
-		}
+		/* no matter how much input there is, we only draw once */
+		ui_freeze();
+		_editor_drain_input(editor);
+		_editor_throttle(editor);
+		_editor_update_analysis(editor);
+		ui_thaw();
+
+		display_flush(((struct widget*)editor->window)->display);
+		clock_gettime(CLOCK_MONOTONIC, &editor->last_frame);
 	}
 
 	return 0;
@@ -681,6 +2140,12 @@ int editor_new(struct editor **editor)
 		return(err);
 	}
 
+	/* without workers, the editor works all the same, it just knows less */
+	if(config.worker_threads > 0 &&
+	   (err = worker_pool_new(&edit->workers, config.worker_threads)) < 0) {
+		fprintf(stderr, "Could not start workers: %s [%d]\n", strerror(-err), -err);
+	}
+
 	*editor = edit;
 	return(0);
 }
@@ -691,6 +2156,15 @@ int editor_free(struct editor **editor)
 		return(-ENOMEM);
 	}
 
+	/* this waits for the workers, but they were asked to stop */
+	if((*editor)->analysis) {
+		analysis_cancel(&((*editor)->analysis));
+	}
+
+	if((*editor)->workers) {
+		worker_pool_free(&((*editor)->workers));
+	}
+
 	if((*editor)->window) {
 		/*
 		 * Because of the order in which functions are called during
@@ -699,8 +2173,24 @@ int editor_free(struct editor **editor)
 		widget_free((struct widget*)(*editor)->window);
 	}
 
-	if((*editor)->buffer) {
-		buffer_close(&((*editor)->buffer));
+	/* the views of the buffer that is shown went with the window */
+	if((*editor)->current) {
+		struct editor_buffer *current;
+		int i;
+
+		current = (*editor)->current;
+
+		for(i = 0; i < EDITOR_MAX_VIEWS; i++) {
+			current->views[i].textview = NULL;
+		}
+
+		current->views[current->focus].sel_start = (*editor)->sel_start;
+		current->views[current->focus].sel_end = (*editor)->sel_end;
+	}
+
+	/* the user quit on purpose, so there is nothing to recover */
+	while((*editor)->buffers) {
+		_editor_buffer_free(*editor, (*editor)->buffers);
 	}
 
 	return(0);
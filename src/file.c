@@ -4,6 +4,8 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include "file.h"
 #include "config.h"
 
@@ -12,8 +14,22 @@ struct file {
 	char *path;
 	int refs;
 	int readonly;
+
+	int watch_fd;
+	int watch_wd;
+
+	/* identity of the file contents we last read or wrote */
+	struct {
+		dev_t dev;
+		ino_t ino;
+		off_t size;
+		struct timespec mtime;
+	} stamp;
 };
 
+#define FILE_WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | \
+			 IN_MOVE_SELF | IN_DELETE_SELF)
+
 static int _file_alloc(struct file **file)
 {
 	struct file *f;
@@ -31,12 +47,19 @@ static int _file_alloc(struct file **file)
 	memset(f, 0, sizeof(*f));
 	f->fd = -1;
 	f->refs = 1;
+	f->watch_fd = -1;
+	f->watch_wd = -1;
 
 	*file = f;
 
 	return(0);
 }
 
+/*
+ * Drop a reference to the file. Buffers that were cloned from one another
+ * share the file, so the descriptors are only closed along with the last
+ * reference.
+ */
 static int _file_free(struct file **file)
 {
 	if(!file || !*file) {
@@ -44,15 +67,23 @@ static int _file_free(struct file **file)
 	}
 
 	if(--(*file)->refs == 0) {
+		if((*file)->fd >= 0 && close((*file)->fd) < 0) {
+			perror("close");
+		}
+
+		if((*file)->watch_fd >= 0) {
+			close((*file)->watch_fd);
+		}
+
 		if((*file)->path) {
 			free((*file)->path);
 		}
 
 		memset(*file, 0, sizeof(**file));
 		free(*file);
-		*file = NULL;
 	}
 
+	*file = NULL;
 	return(0);
 }
 
@@ -105,6 +136,49 @@ static int _file_open_path(struct file *file, const char *path, const int readon
 	return(0);
 }
 
+int file_update_stamp(struct file *file)
+{
+	struct stat info;
+
+	if(!file) {
+		return(-EINVAL);
+	}
+
+	if(fstat(file->fd, &info) < 0) {
+		return(-errno);
+	}
+
+	file->stamp.dev = info.st_dev;
+	file->stamp.ino = info.st_ino;
+	file->stamp.size = info.st_size;
+	file->stamp.mtime = info.st_mtim;
+
+	return(0);
+}
+
+int file_is_modified(struct file *file)
+{
+	struct stat info;
+
+	if(!file || !file->path) {
+		return(-EINVAL);
+	}
+
+	/*
+	 * Look at the path rather than the descriptor, since the file may
+	 * have been replaced by another program saving it.
+	 */
+	if(stat(file->path, &info) < 0) {
+		return(errno == ENOENT ? 1 : -errno);
+	}
+
+	return(info.st_dev != file->stamp.dev ||
+	       info.st_ino != file->stamp.ino ||
+	       info.st_size != file->stamp.size ||
+	       info.st_mtim.tv_sec != file->stamp.mtime.tv_sec ||
+	       info.st_mtim.tv_nsec != file->stamp.mtime.tv_nsec);
+}
+
 int file_open(struct file **file, const char *path, const int readonly)
 {
 	struct file *f;
@@ -127,21 +201,7 @@ int file_open(struct file **file, const char *path, const int readonly)
 
 int file_close(struct file **file)
 {
-	if(!file || !*file) {
-		return(-EINVAL);
-	}
-
-	if((*file)->fd >= 0) {
-		if(close((*file)->fd) < 0) {
-			perror("close");
-		}
-
-		(*file)->fd = -1;
-	}
-
-	_file_free(file);
-
-	return(0);
+	return(_file_free(file));
 }
 
 int file_get_size(struct file *file, size_t *size)
@@ -217,9 +277,8 @@ int file_read(struct file *file, char **dst, size_t *size)
 	err = 0;
 	readerr = 0;
 
-        if(read(file->fd, data, file_size) < 0) {
-		readerr = -errno;
-	} else {
+	/* read() may return less than asked for, more so on large files */
+	if((readerr = file_read_at(file, 0, data, file_size, &file_size)) == 0) {
 		data[file_size] = 0;
 	}
 
@@ -246,19 +305,22 @@ int file_read(struct file *file, char **dst, size_t *size)
 		if(size) {
 			*size = file_size;
 		}
+
+		file_update_stamp(file);
 	}
 
 	return(err);
 }
 
-int file_write(struct file *file, const char *data)
+/*
+ * Replace the contents of the file with the `len' bytes at `data', which
+ * may contain anything, including NUL bytes.
+ */
+int file_write(struct file *file, const char *data, const size_t len)
 {
-	off_t prev_pos;
-	int err;
+	size_t done;
 
-	err = 0;
-
-	if(!file || !data) {
+	if(!file || (len && !data)) {
 		return(-EINVAL);
 	}
 
@@ -266,35 +328,218 @@ int file_write(struct file *file, const char *data)
 		return(-EBADFD);
 	}
 
-	prev_pos = lseek(file->fd, 0, SEEK_CUR);
+	for(done = 0; done < len; ) {
+		ssize_t chunk;
 
-	if(prev_pos < 0) {
-		return(-errno);
+		chunk = pwrite(file->fd, data + done, len - done, done);
+
+		if(chunk < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			return(-errno);
+		}
+
+		done += chunk;
 	}
 
-	if(lseek(file->fd, 0, SEEK_SET) < 0) {
+	/* a file that was longer than the data would keep its old end */
+	if(ftruncate(file->fd, len) < 0) {
 		return(-errno);
 	}
 
-	if(write(file->fd, data, strlen(data)) < 0) {
-		err = -errno;
+	file_update_stamp(file);
+	return(0);
+}
+
+int file_ref(struct file *file)
+{
+	if(!file) {
+		return(-EINVAL);
 	}
 
-	if(lseek(file->fd, prev_pos, SEEK_SET) < 0) {
-		if(!err) {
-			err = -errno;
+	file->refs++;
+	return(0);
+}
+
+int file_read_at(struct file *file, const size_t offset, char *dst, const size_t len,
+		 size_t *read_len)
+{
+	size_t done;
+
+	if(!file || !dst || !read_len) {
+		return(-EINVAL);
+	}
+
+	if(file->fd < 0) {
+		return(-EBADFD);
+	}
+
+	for(done = 0; done < len; ) {
+		ssize_t chunk;
+
+		chunk = pread(file->fd, dst + done, len - done, offset + done);
+
+		if(chunk < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			return(-errno);
+		} else if(chunk == 0) {
+			break;
 		}
+
+		done += chunk;
+	}
+
+	*read_len = done;
+	return(0);
+}
+
+static int _file_add_watch(struct file *file)
+{
+	file->watch_wd = inotify_add_watch(file->watch_fd, file->path, FILE_WATCH_MASK);
+
+	if(file->watch_wd < 0) {
+		return(-errno);
+	}
+
+	return(0);
+}
+
+int file_watch(struct file *file)
+{
+	int err;
+
+	if(!file || !file->path) {
+		return(-EINVAL);
+	}
+
+	if(file->watch_fd >= 0) {
+		return(-EALREADY);
+	}
+
+	file->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if(file->watch_fd < 0) {
+		return(-errno);
+	}
+
+	if((err = _file_add_watch(file)) < 0) {
+		close(file->watch_fd);
+		file->watch_fd = -1;
 	}
 
 	return(err);
 }
 
-int file_ref(struct file *file)
+int file_get_watch_fd(struct file *file)
 {
 	if(!file) {
 		return(-EINVAL);
 	}
 
-	file->refs++;
+	return(file->watch_fd);
+}
+
+int file_get_events(struct file *file, int *events)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int ev;
+
+	if(!file || !events) {
+		return(-EINVAL);
+	}
+
+	if(file->watch_fd < 0) {
+		return(-EBADFD);
+	}
+
+	ev = 0;
+
+	while(1) {
+		const struct inotify_event *event;
+		ssize_t len;
+		char *pos;
+
+		len = read(file->watch_fd, buffer, sizeof(buffer));
+
+		if(len < 0) {
+			if(errno == EINTR) {
+				continue;
+			} else if(errno != EAGAIN) {
+				return(-errno);
+			}
+
+			break;
+		}
+
+		for(pos = buffer; pos < buffer + len; pos += sizeof(*event) + event->len) {
+			event = (const struct inotify_event*)pos;
+
+			if(event->mask & (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE)) {
+				ev |= FILE_EVENT_MODIFIED;
+			}
+			if(event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+				ev |= FILE_EVENT_REPLACED;
+			}
+		}
+	}
+
+	*events = ev;
+	return(0);
+}
+
+int file_reopen(struct file *file)
+{
+	int fd;
+
+	if(!file || !file->path) {
+		return(-EINVAL);
+	}
+
+	/*
+	 * Open the path first, so that we keep the old file if the new one
+	 * does not exist (yet), as is the case while a log is being rotated.
+	 */
+	fd = open(file->path, file->readonly ? O_RDONLY : (O_RDWR | O_CREAT),
+		  config.file_default_mode);
+
+	if(fd < 0) {
+		return(-errno);
+	}
+
+	if(file->fd >= 0) {
+		close(file->fd);
+	}
+
+	file->fd = fd;
+
+	if(file->watch_fd >= 0) {
+		if(file->watch_wd >= 0) {
+			/* fails harmlessly if the kernel already removed the watch */
+			inotify_rm_watch(file->watch_fd, file->watch_wd);
+		}
+
+		return(_file_add_watch(file));
+	}
+
+	return(0);
+}
+
+const char* file_get_path(struct file *file)
+{
+	return(file ? file->path : NULL);
+}
+
+int file_get_mtime(struct file *file, struct timespec *mtime)
+{
+	if(!file || !mtime) {
+		return(-EINVAL);
+	}
+
+	*mtime = file->stamp.mtime;
 	return(0);
 }
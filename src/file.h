@@ -1,14 +1,30 @@
 #ifndef E_FILE_H
 #define E_FILE_H
 
+#include <time.h>
+
 struct file;
 
+#define FILE_EVENT_MODIFIED (1 << 0)
+#define FILE_EVENT_REPLACED (1 << 1)
+
 int file_open(struct file **file, const char *path, const int readonly);
 int file_close(struct file **file);
 
 int file_get_size(struct file *file, size_t *size);
 int file_read(struct file *file, char **dst, size_t *size);
-int file_write(struct file *file, const char *data);
+int file_write(struct file *file, const char *data, const size_t len);
 int file_ref(struct file *file);
+int file_read_at(struct file *file, const size_t offset, char *dst, const size_t len,
+		 size_t *read_len);
+int file_reopen(struct file *file);
+int file_update_stamp(struct file *file);
+int file_is_modified(struct file *file);
+const char* file_get_path(struct file *file);
+int file_get_mtime(struct file *file, struct timespec *mtime);
+
+int file_watch(struct file *file);
+int file_get_watch_fd(struct file *file);
+int file_get_events(struct file *file, int *events);
 
 #endif /* E_FILE_H */
@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "filter.h"
+#include "buffer.h"
+
+#define FILTER_INIT_LINES 1024
+
+struct filter_lines {
+	int *lines;
+	int num;
+	int max;
+};
+
+/*
+ * A filter finds its lines in a single pass over the buffer that looks for
+ * the pattern with memmem() and counts the newlines in between with
+ * memchr(), both of which look at many bytes at a time. After that, only
+ * the lines that were edited are searched again. The matches in front of
+ * them stay where they are and the ones behind them are moved by the
+ * number of lines that the edits added or removed, so appending to a log
+ * that is being followed only searches what was appended.
+ */
+struct filter {
+	struct buffer *buffer;
+	unsigned long generation;
+
+	char *pattern;
+	size_t pattern_len;
+
+	/* the numbers of the lines that contain the pattern, in order */
+	struct filter_lines matches;
+};
+
+int filter_new(struct filter **filter, const char *pattern, const size_t pattern_len)
+{
+	struct filter *flt;
+
+	if(!filter || !pattern || pattern_len == 0) {
+		return(-EINVAL);
+	}
+
+	if(!(flt = calloc(1, sizeof(*flt)))) {
+		return(-ENOMEM);
+	}
+
+	/* terminated, so it can be shown */
+	if(!(flt->pattern = malloc(pattern_len + 1))) {
+		free(flt);
+		return(-ENOMEM);
+	}
+
+	memcpy(flt->pattern, pattern, pattern_len);
+	flt->pattern[pattern_len] = 0;
+	flt->pattern_len = pattern_len;
+
+	*filter = flt;
+	return(0);
+}
+
+int filter_free(struct filter **filter)
+{
+	if(!filter || !*filter) {
+		return(-EINVAL);
+	}
+
+	free((*filter)->matches.lines);
+	free((*filter)->pattern);
+	free(*filter);
+	*filter = NULL;
+
+	return(0);
+}
+
+static int _filter_lines_reserve(struct filter_lines *fl, const int num)
+{
+	int *lines;
+	int max;
+
+	if(num <= fl->max) {
+		return(0);
+	}
+
+	for(max = fl->max ? fl->max : FILTER_INIT_LINES; max < num; max *= 2);
+
+	if(!(lines = realloc(fl->lines, max * sizeof(*lines)))) {
+		return(-ENOMEM);
+	}
+
+	fl->lines = lines;
+	fl->max = max;
+
+	return(0);
+}
+
+static int _filter_count_lines(const char *data, const char *end)
+{
+	int lines;
+
+	for(lines = 0; data < end && (data = memchr(data, '\n', end - data)); data++) {
+		lines++;
+	}
+
+	return(lines);
+}
+
+/*
+ * Add the lines between `data' and `data' + `size' that contain the
+ * pattern to `found'. The data has to start at the beginning of `line'.
+ */
+static int _filter_scan(struct filter *filter, const char *data, const size_t size,
+			int line, struct filter_lines *found)
+{
+	const char *end;
+	const char *pos;
+	const char *hit;
+	int err;
+
+	end = data + size;
+
+	for(pos = data; pos < end; pos++, line++) {
+		if(!(hit = memmem(pos, end - pos, filter->pattern, filter->pattern_len))) {
+			break;
+		}
+
+		line += _filter_count_lines(pos, hit);
+
+		if((err = _filter_lines_reserve(found, found->num + 1)) < 0) {
+			return(err);
+		}
+
+		found->lines[found->num++] = line;
+
+		/* the rest of the line doesn't have to be searched */
+		if(!(pos = memchr(hit, '\n', end - hit))) {
+			break;
+		}
+	}
+
+	return(0);
+}
+
+static int _filter_rescan(struct filter *filter, struct buffer *buffer)
+{
+	filter->matches.num = 0;
+
+	return(_filter_scan(filter, buffer_get_data(buffer), buffer_get_size(buffer),
+			    1, &filter->matches));
+}
+
+/*
+ * Like buffer_get_line_range(), but the end of the buffer is on the line
+ * that would follow a last newline, or on the last line if there is none.
+ */
+static int _filter_line_range(struct buffer *buffer, const size_t offset, int *line,
+			      size_t *start, size_t *len)
+{
+	size_t size;
+	int err;
+
+	size = buffer_get_size(buffer);
+
+	if(offset < size) {
+		return(buffer_get_line_range(buffer, offset, line, start, len));
+	}
+
+	if(size == 0) {
+		return(-ERANGE);
+	}
+
+	if((err = buffer_get_line_range(buffer, size - 1, line, start, len)) < 0) {
+		return(err);
+	}
+
+	if(buffer_get_data(buffer)[size - 1] == '\n') {
+		(*line)++;
+		*start = size;
+		*len = 0;
+	}
+
+	return(0);
+}
+
+/*
+ * Search the lines that the edits since the last update touched again, and
+ * renumber the matches behind them.
+ */
+static int _filter_apply_edits(struct filter *filter, struct buffer *buffer)
+{
+	struct filter_lines found;
+	size_t first_start;
+	size_t last_start;
+	size_t start;
+	size_t end;
+	size_t len;
+	long lines;
+	int first;
+	int last;
+	int from;
+	int to;
+	int err;
+	int i;
+
+	if((err = buffer_get_edits(buffer, filter->generation, &start, &end, &lines)) <= 0) {
+		return(err < 0 ? _filter_rescan(filter, buffer) : 0);
+	}
+
+	if(_filter_line_range(buffer, start, &first, &first_start, &len) < 0 ||
+	   _filter_line_range(buffer, end, &last, &last_start, &len) < 0) {
+		filter->matches.num = 0;
+		return(0);
+	}
+
+	memset(&found, 0, sizeof(found));
+
+	if((err = _filter_scan(filter, buffer_get_data(buffer) + first_start,
+			       last_start + len - first_start, first, &found)) < 0) {
+		free(found.lines);
+		return(err);
+	}
+
+	/* the matches from `from' to `to' were on the lines that were edited */
+	from = filter_find(filter, first);
+	to = filter_find(filter, last - lines + 1);
+
+	if(to < from) {
+		to = from;
+	}
+
+	if((err = _filter_lines_reserve(&filter->matches,
+					filter->matches.num - (to - from) + found.num)) < 0) {
+		free(found.lines);
+		return(err);
+	}
+
+	memmove(filter->matches.lines + from + found.num, filter->matches.lines + to,
+		(filter->matches.num - to) * sizeof(*filter->matches.lines));
+	memcpy(filter->matches.lines + from, found.lines, found.num * sizeof(*found.lines));
+	filter->matches.num += found.num - (to - from);
+
+	for(i = from + found.num; i < filter->matches.num; i++) {
+		filter->matches.lines[i] += lines;
+	}
+
+	free(found.lines);
+	return(0);
+}
+
+/* bring the matches up to date with the contents of `buffer' */
+int filter_update(struct filter *filter, struct buffer *buffer)
+{
+	int err;
+
+	if(!filter || !buffer) {
+		return(-EINVAL);
+	}
+
+	if(filter->buffer != buffer) {
+		err = _filter_rescan(filter, buffer);
+	} else if(filter->generation != buffer_get_generation(buffer)) {
+		err = _filter_apply_edits(filter, buffer);
+	} else {
+		return(0);
+	}
+
+	filter->buffer = err < 0 ? NULL : buffer;
+	filter->generation = buffer_get_generation(buffer);
+
+	return(err);
+}
+
+const char* filter_get_pattern(struct filter *filter)
+{
+	return(filter ? filter->pattern : NULL);
+}
+
+int filter_get_count(struct filter *filter)
+{
+	return(filter ? filter->matches.num : 0);
+}
+
+const int* filter_get_lines(struct filter *filter)
+{
+	return(filter ? filter->matches.lines : NULL);
+}
+
+/* the index of the first match on `line' or behind it */
+int filter_find(struct filter *filter, const int line)
+{
+	int lo;
+	int hi;
+
+	if(!filter) {
+		return(-EINVAL);
+	}
+
+	lo = 0;
+	hi = filter->matches.num;
+
+	while(lo < hi) {
+		int mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if(filter->matches.lines[mid] < line) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return(lo);
+}
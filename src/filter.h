@@ -0,0 +1,22 @@
+#ifndef E_FILTER_H
+#define E_FILTER_H
+
+#include <stddef.h>
+
+struct buffer;
+struct filter;
+
+/*
+ * The lines of a buffer that contain a pattern, by their line numbers.
+ * Views show only these lines while a filter is set on them.
+ */
+int filter_new(struct filter **filter, const char *pattern, const size_t pattern_len);
+int filter_free(struct filter **filter);
+
+int filter_update(struct filter *filter, struct buffer *buffer);
+const char* filter_get_pattern(struct filter *filter);
+int filter_get_count(struct filter *filter);
+const int* filter_get_lines(struct filter *filter);
+int filter_find(struct filter *filter, const int line);
+
+#endif /* E_FILTER_H */
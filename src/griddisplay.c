@@ -0,0 +1,658 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "display.h"
+
+#define GRID_DISPLAY_MAX_COLORS 16
+#define GRID_DISPLAY_INIT_OUTPUT 4096
+#define GRID_DISPLAY_MIN_ERASE   4
+
+/*
+ * Keeps the cells in memory, along with the cells that were there when
+ * the display was last flushed. Flushing compares the two, row by row,
+ * and works out the VT100/xterm sequences that get a terminal from one
+ * to the other: a cursor movement to every run of changed cells that the
+ * cursor isn't already at, a color change wherever the color is not the
+ * one that was last used, and the characters themselves. Scrolling moves
+ * the cells that are shown, too, using the terminal's scroll regions.
+ *
+ * The grid display throws the sequences away once they are counted. The
+ * VT display sends them to a terminal, all of a frame in one write().
+ */
+struct grid_display {
+	struct display _parent;
+
+	char *chars;
+	unsigned char *colors;
+	char *shown_chars;
+	unsigned char *shown_colors;
+
+	int cursor_x;
+	int cursor_y;
+	int shown_x;
+	int shown_y;
+	int shown_color;
+	int shown_valid;
+
+	struct {
+		short fg;
+		short bg;
+	} pairs[GRID_DISPLAY_MAX_COLORS];
+
+	int fd;
+	char *output;
+	size_t output_len;
+	size_t output_size;
+};
+
+static int _grid_display_alloc(struct grid_display *grid, const int width, const int height)
+{
+	size_t cells;
+	char *chars;
+	unsigned char *colors;
+	char *shown_chars;
+	unsigned char *shown_colors;
+
+	cells = (size_t)width * height;
+	chars = malloc(cells);
+	colors = malloc(cells);
+	shown_chars = malloc(cells);
+	shown_colors = malloc(cells);
+
+	if(!chars || !colors || !shown_chars || !shown_colors) {
+		free(chars);
+		free(colors);
+		free(shown_chars);
+		free(shown_colors);
+		return(-ENOMEM);
+	}
+
+	free(grid->chars);
+	free(grid->colors);
+	free(grid->shown_chars);
+	free(grid->shown_colors);
+
+	memset(chars, ' ', cells);
+	memset(colors, 0, cells);
+
+	grid->chars = chars;
+	grid->colors = colors;
+	grid->shown_chars = shown_chars;
+	grid->shown_colors = shown_colors;
+	grid->_parent.width = width;
+	grid->_parent.height = height;
+
+	grid->cursor_x = 0;
+	grid->cursor_y = 0;
+
+	/* nobody knows what's on the terminal, so the next flush clears it */
+	grid->shown_valid = 0;
+
+	return(0);
+}
+
+static void _grid_display_emit(struct grid_display *grid, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(grid->output + grid->output_len,
+			grid->output_size - grid->output_len, fmt, args);
+	va_end(args);
+
+	if(len < 0) {
+		return;
+	}
+
+	if(grid->output_len + len >= grid->output_size) {
+		size_t size;
+		char *output;
+
+		for(size = grid->output_size; grid->output_len + len >= size; size *= 2);
+
+		if(!(output = realloc(grid->output, size))) {
+			return;
+		}
+
+		grid->output = output;
+		grid->output_size = size;
+
+		va_start(args, fmt);
+		vsnprintf(grid->output + grid->output_len,
+			  grid->output_size - grid->output_len, fmt, args);
+		va_end(args);
+	}
+
+	grid->output_len += len;
+}
+
+/* control characters would do things to the terminal */
+static void _grid_display_emit_char(struct grid_display *grid, const char chr)
+{
+	char out;
+
+	out = (chr >= 0 && chr < 0x20) || chr == 0x7f ? '?' : chr;
+
+	if(grid->output_len + 1 >= grid->output_size) {
+		_grid_display_emit(grid, "%c", out);
+		return;
+	}
+
+	grid->output[grid->output_len++] = out;
+}
+
+static void _grid_display_emit_color(struct grid_display *grid, const int color)
+{
+	if(color == grid->shown_color) {
+		return;
+	}
+
+	if(color > 0 && color < GRID_DISPLAY_MAX_COLORS && grid->pairs[color].fg >= 0) {
+		_grid_display_emit(grid, "\033[0;%d;%dm",
+				   30 + grid->pairs[color].fg, 40 + grid->pairs[color].bg);
+	} else {
+		_grid_display_emit(grid, "\033[0m");
+	}
+
+	grid->shown_color = color;
+}
+
+static int _grid_display_put(struct display *display, const int x, const int y,
+			     const char *str, const int len, const int color)
+{
+	struct grid_display *grid;
+	size_t cell;
+	int i;
+
+	grid = (struct grid_display*)display;
+	cell = (size_t)y * display->width + x;
+
+	/* like curses, stop at the end of the string */
+	for(i = 0; i < len && str[i]; i++) {
+		grid->chars[cell + i] = str[i];
+	}
+
+	memset(grid->colors + cell, color, i);
+
+	return(0);
+}
+
+static int _grid_display_fill(struct display *display, const int x, const int y,
+			      const int width, const char chr, const int color)
+{
+	struct grid_display *grid;
+	size_t cell;
+
+	grid = (struct grid_display*)display;
+	cell = (size_t)y * display->width + x;
+
+	memset(grid->chars + cell, chr, width);
+	memset(grid->colors + cell, color, width);
+
+	return(0);
+}
+
+static int _grid_display_recolor(struct display *display, const int x, const int y,
+				 const int width, const int color)
+{
+	struct grid_display *grid;
+
+	grid = (struct grid_display*)display;
+	memset(grid->colors + (size_t)y * display->width + x, color, width);
+
+	return(0);
+}
+
+static void _grid_scroll_cells(char *chars, unsigned char *colors, const int width,
+			       const int top, const int bottom, const int dist)
+{
+	int rows;
+	int keep;
+	int blank;
+
+	rows = bottom - top + 1;
+	keep = rows - (dist < 0 ? -dist : dist);
+
+	if(keep < 0) {
+		keep = 0;
+	}
+
+	if(dist > 0) {
+		memmove(chars + (size_t)top * width, chars + (size_t)(top + rows - keep) * width,
+			(size_t)keep * width);
+		memmove(colors + (size_t)top * width, colors + (size_t)(top + rows - keep) * width,
+			(size_t)keep * width);
+		blank = top + keep;
+	} else {
+		memmove(chars + (size_t)(top + rows - keep) * width, chars + (size_t)top * width,
+			(size_t)keep * width);
+		memmove(colors + (size_t)(top + rows - keep) * width, colors + (size_t)top * width,
+			(size_t)keep * width);
+		blank = top;
+	}
+
+	memset(chars + (size_t)blank * width, ' ', (size_t)(rows - keep) * width);
+	memset(colors + (size_t)blank * width, 0, (size_t)(rows - keep) * width);
+}
+
+static int _grid_display_scroll(struct display *display, const int top,
+				const int bottom, const int dist)
+{
+	struct grid_display *grid;
+
+	grid = (struct grid_display*)display;
+
+	_grid_scroll_cells(grid->chars, grid->colors, display->width, top, bottom, dist);
+
+	if(!grid->shown_valid) {
+		return(0);
+	}
+
+	_grid_scroll_cells(grid->shown_chars, grid->shown_colors, display->width,
+			   top, bottom, dist);
+
+	/* the rows that scroll in take the current background color */
+	_grid_display_emit_color(grid, 0);
+	_grid_display_emit(grid, "\033[%d;%dr\033[%d%c\033[r", top + 1, bottom + 1,
+			   dist < 0 ? -dist : dist, dist > 0 ? 'S' : 'T');
+
+	/* setting the scroll region moves the cursor home */
+	grid->shown_x = 0;
+	grid->shown_y = 0;
+
+	return(0);
+}
+
+static int _grid_display_move(struct display *display, const int x, const int y)
+{
+	struct grid_display *grid;
+
+	grid = (struct grid_display*)display;
+	grid->cursor_x = x;
+	grid->cursor_y = y;
+
+	return(0);
+}
+
+static int _grid_display_set_colors(struct display *display, const int color,
+				    const int fg, const int bg)
+{
+	struct grid_display *grid;
+
+	grid = (struct grid_display*)display;
+
+	if(color <= 0 || color >= GRID_DISPLAY_MAX_COLORS ||
+	   fg < 0 || fg > 7 || bg < 0 || bg > 7) {
+		return(-EINVAL);
+	}
+
+	grid->pairs[color].fg = fg;
+	grid->pairs[color].bg = bg;
+
+	/* cells in that color look different now */
+	grid->shown_valid = 0;
+
+	return(0);
+}
+
+static int _grid_display_resize(struct display *display, const int width,
+				const int height)
+{
+	/* a resized terminal is redrawn from scratch */
+	return(_grid_display_alloc((struct grid_display*)display, width, height));
+}
+
+/*
+ * Move the terminal's cursor, the cheapest way there is. If it's on the
+ * same row and not far behind, the cells in between are sent again rather
+ * than moving over them, as long as that doesn't need a different color.
+ */
+static void _grid_display_goto(struct grid_display *grid, const int x, const int y)
+{
+	size_t row;
+	int absolute;
+	int forward;
+	int i;
+
+	if(grid->shown_x == x && grid->shown_y == y) {
+		return;
+	}
+
+	row = (size_t)y * grid->_parent.width;
+	absolute = snprintf(NULL, 0, "\033[%d;%dH", y + 1, x + 1);
+	forward = x > 0 ? snprintf(NULL, 0, "\033[%dC", x) : 0;
+
+	if(grid->shown_y == y && grid->shown_x >= 0 && grid->shown_x < x) {
+		if(x - grid->shown_x < absolute) {
+			for(i = grid->shown_x; i < x && grid->shown_colors[row + i] == grid->shown_color; i++);
+
+			if(i == x) {
+				for(i = grid->shown_x; i < x; i++) {
+					_grid_display_emit_char(grid, grid->shown_chars[row + i]);
+				}
+
+				grid->shown_x = x;
+				return;
+			}
+		}
+
+		forward = snprintf(NULL, 0, "\033[%dC", x - grid->shown_x);
+
+		if(forward < absolute) {
+			_grid_display_emit(grid, "\033[%dC", x - grid->shown_x);
+			grid->shown_x = x;
+			return;
+		}
+	} else if(grid->shown_y + 1 == y && 2 + forward < absolute) {
+		/* the row below isn't at the bottom of a scroll region, so this won't scroll */
+		_grid_display_emit(grid, "\r\n");
+
+		if(x > 0) {
+			_grid_display_emit(grid, "\033[%dC", x);
+		}
+
+		grid->shown_x = x;
+		grid->shown_y = y;
+		return;
+	}
+
+	_grid_display_emit(grid, "\033[%d;%dH", y + 1, x + 1);
+	grid->shown_x = x;
+	grid->shown_y = y;
+}
+
+static void _grid_display_clear(struct grid_display *grid)
+{
+	size_t cells;
+
+	cells = (size_t)grid->_parent.width * grid->_parent.height;
+
+	grid->shown_color = -1;
+	_grid_display_emit_color(grid, 0);
+	_grid_display_emit(grid, "\033[H\033[2J");
+
+	memset(grid->shown_chars, ' ', cells);
+	memset(grid->shown_colors, 0, cells);
+	grid->shown_x = 0;
+	grid->shown_y = 0;
+	grid->shown_valid = 1;
+}
+
+static int _grid_display_write(struct grid_display *grid)
+{
+	size_t done;
+
+	for(done = 0; done < grid->output_len; ) {
+		ssize_t len;
+
+		if((len = write(grid->fd, grid->output + done, grid->output_len - done)) < 0) {
+			if(errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+
+			return(-errno);
+		}
+
+		done += len;
+	}
+
+	return(0);
+}
+
+/* where the blanks at the end of a row start, if they are all the same color */
+static int _grid_display_get_blank(struct grid_display *grid, const size_t row)
+{
+	int i;
+
+	for(i = grid->_parent.width; i > 0 && grid->chars[row + i - 1] == ' ' &&
+		    grid->colors[row + i - 1] == grid->colors[row + grid->_parent.width - 1]; i--);
+
+	return(i);
+}
+
+/* the terminal fills erased cells with the current background color */
+static void _grid_display_erase(struct grid_display *grid, const int x, const int y)
+{
+	size_t row;
+	int i;
+
+	row = (size_t)y * grid->_parent.width;
+
+	_grid_display_goto(grid, x, y);
+	_grid_display_emit_color(grid, grid->colors[row + x]);
+	_grid_display_emit(grid, "\033[K");
+
+	for(i = x; i < grid->_parent.width; i++) {
+		if(grid->shown_chars[row + i] != ' ' ||
+		   grid->shown_colors[row + i] != grid->colors[row + x]) {
+			grid->shown_chars[row + i] = ' ';
+			grid->shown_colors[row + i] = grid->colors[row + x];
+			grid->_parent.stats.changed++;
+		}
+	}
+}
+
+static int _grid_display_flush(struct display *display)
+{
+	struct grid_display *grid;
+	size_t cell;
+	int err;
+	int y;
+
+	grid = (struct grid_display*)display;
+
+	if(!grid->shown_valid) {
+		_grid_display_clear(grid);
+	}
+
+	for(y = 0, cell = 0; y < display->height; y++, cell += display->width) {
+		int blank;
+		int x;
+
+		if(memcmp(grid->chars + cell, grid->shown_chars + cell, display->width) == 0 &&
+		   memcmp(grid->colors + cell, grid->shown_colors + cell, display->width) == 0) {
+			continue;
+		}
+
+		blank = _grid_display_get_blank(grid, cell);
+
+		for(x = 0; x < display->width; x++) {
+			if(grid->chars[cell + x] == grid->shown_chars[cell + x] &&
+			   grid->colors[cell + x] == grid->shown_colors[cell + x]) {
+				continue;
+			}
+
+			/* blanks at the end of the row are cheaper to erase than to send */
+			if(x >= blank && display->width - x >= GRID_DISPLAY_MIN_ERASE) {
+				_grid_display_erase(grid, x, y);
+				break;
+			}
+
+			_grid_display_goto(grid, x, y);
+			_grid_display_emit_color(grid, grid->colors[cell + x]);
+			_grid_display_emit_char(grid, grid->chars[cell + x]);
+
+			grid->shown_chars[cell + x] = grid->chars[cell + x];
+			grid->shown_colors[cell + x] = grid->colors[cell + x];
+			display->stats.changed++;
+
+			/* the terminal does not move the cursor past the last column */
+			grid->shown_x = x + 1 < display->width ? x + 1 : -1;
+		}
+	}
+
+	_grid_display_goto(grid, grid->cursor_x, grid->cursor_y);
+
+	display->stats.bytes += grid->output_len;
+	err = grid->fd >= 0 ? _grid_display_write(grid) : 0;
+	grid->output_len = 0;
+
+	return(err);
+}
+
+static int _grid_display_free(struct display *display)
+{
+	struct grid_display *grid;
+
+	grid = (struct grid_display*)display;
+
+	if(grid->fd >= 0) {
+		/* leave the terminal the way we found it */
+		grid->output_len = 0;
+		grid->shown_color = -1;
+		_grid_display_emit_color(grid, 0);
+		_grid_display_write(grid);
+	}
+
+	free(grid->chars);
+	free(grid->colors);
+	free(grid->shown_chars);
+	free(grid->shown_colors);
+	free(grid->output);
+	memset(grid, 0, sizeof(*grid));
+	free(grid);
+
+	return(0);
+}
+
+static int _grid_display_new(struct display **display, const int fd,
+			     const int width, const int height)
+{
+	struct grid_display *grid;
+	int err;
+	int i;
+
+	if(!(grid = malloc(sizeof(*grid)))) {
+		return(-ENOMEM);
+	}
+
+	memset(grid, 0, sizeof(*grid));
+
+	if(!(grid->output = malloc(GRID_DISPLAY_INIT_OUTPUT))) {
+		free(grid);
+		return(-ENOMEM);
+	}
+
+	grid->output_size = GRID_DISPLAY_INIT_OUTPUT;
+
+	if((err = _grid_display_alloc(grid, width, height)) < 0) {
+		free(grid->output);
+		free(grid);
+		return(err);
+	}
+
+	for(i = 0; i < GRID_DISPLAY_MAX_COLORS; i++) {
+		grid->pairs[i].fg = -1;
+		grid->pairs[i].bg = -1;
+	}
+
+	grid->fd = fd;
+
+	grid->_parent.put = _grid_display_put;
+	grid->_parent.fill = _grid_display_fill;
+	grid->_parent.recolor = _grid_display_recolor;
+	grid->_parent.scroll_region = _grid_display_scroll;
+	grid->_parent.set_cursor = _grid_display_move;
+	grid->_parent.set_colors = _grid_display_set_colors;
+	grid->_parent.resize = _grid_display_resize;
+	grid->_parent.flush = _grid_display_flush;
+	grid->_parent.free = _grid_display_free;
+
+	*display = (struct display*)grid;
+	return(0);
+}
+
+int display_grid_new(struct display **display, const int width, const int height)
+{
+	if(!display || width <= 0 || height <= 0) {
+		return(-EINVAL);
+	}
+
+	return(_grid_display_new(display, -1, width, height));
+}
+
+/*
+ * The terminal has to be set up already. Curses does that, since it is
+ * still what reads the keyboard. If no size is given, the terminal is
+ * asked for it.
+ */
+int display_vt_new(struct display **display, const int fd, const int width,
+		   const int height)
+{
+	struct winsize wsize;
+
+	if(!display || fd < 0 || width < 0 || height < 0) {
+		return(-EINVAL);
+	}
+
+	if(width > 0 && height > 0) {
+		return(_grid_display_new(display, fd, width, height));
+	}
+
+	if(ioctl(fd, TIOCGWINSZ, &wsize) < 0) {
+		return(-errno);
+	}
+
+	if(wsize.ws_col == 0 || wsize.ws_row == 0) {
+		return(-ENOTTY);
+	}
+
+	return(_grid_display_new(display, fd, wsize.ws_col, wsize.ws_row));
+}
+
+/* the cell as it was drawn, whether or not the display was flushed since */
+int display_grid_get_cell(struct display *display, const int x, const int y,
+			  char *chr, int *color)
+{
+	struct grid_display *grid;
+	size_t cell;
+
+	if(!display || display->put != _grid_display_put) {
+		return(-EINVAL);
+	}
+
+	if(x < 0 || y < 0 || x >= display->width || y >= display->height) {
+		return(-EOVERFLOW);
+	}
+
+	grid = (struct grid_display*)display;
+	cell = (size_t)y * display->width + x;
+
+	if(chr) {
+		*chr = grid->chars[cell];
+	}
+
+	if(color) {
+		*color = grid->colors[cell];
+	}
+
+	return(0);
+}
+
+/* copies the characters of a row into a string, cutting it short if needed */
+int display_grid_get_row(struct display *display, const int y, char *dst, const int size)
+{
+	struct grid_display *grid;
+	int len;
+
+	if(!display || display->put != _grid_display_put || !dst || size <= 0) {
+		return(-EINVAL);
+	}
+
+	if(y < 0 || y >= display->height) {
+		return(-EOVERFLOW);
+	}
+
+	grid = (struct grid_display*)display;
+	len = display->width < size - 1 ? display->width : size - 1;
+
+	memcpy(dst, grid->chars + (size_t)y * display->width, len);
+	dst[len] = 0;
+
+	return(len);
+}
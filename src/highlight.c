@@ -0,0 +1,536 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include "highlight.h"
+#include "buffer.h"
+#include "span.h"
+#include "ui.h"
+
+#define HIGHLIGHT_INIT_STATES 1024
+#define HIGHLIGHT_LEX_BATCH   4096
+
+/*
+ * The lexer only has to remember one thing from one line to the next,
+ * namely whether a line starts inside a comment.
+ */
+typedef enum {
+	HIGHLIGHT_STATE_NORMAL = 0,
+	HIGHLIGHT_STATE_COMMENT
+} highlight_state_t;
+
+/*
+ * The highlighter keeps the state of the lexer at the start of every line
+ * it has seen, so lexing can start right at the lines that are shown. An
+ * edit only makes the states behind the edited lines uncertain: they are
+ * moved along with the lines they belong to, and once the lexer arrives
+ * at one of them in the same state, the remaining ones are known to be
+ * right, too. Only the lines in between are lexed again.
+ */
+struct highlight {
+	struct buffer *buffer;
+	unsigned long generation;
+
+	/* states[n] is the state at the start of line n + 1 */
+	unsigned char *states;
+	int num_states;
+	int max_states;
+
+	/* the lines from `tail' to `tail_end' keep their states if the lexer agrees */
+	int tail;
+	int tail_end;
+
+	/* the spans of the lines from `first_line' to `last_line' */
+	struct spans *spans;
+	int first_line;
+	int last_line;
+
+	/* folded lines don't have spans */
+	unsigned long fold_generation;
+};
+
+static const char *_keywords[] = {
+	"auto", "break", "case", "char", "const", "continue", "default", "do",
+	"double", "else", "enum", "extern", "float", "for", "goto", "if",
+	"inline", "int", "long", "register", "restrict", "return", "short",
+	"signed", "sizeof", "static", "struct", "switch", "typedef", "union",
+	"unsigned", "void", "volatile", "while", NULL
+};
+
+int highlight_new(struct highlight **highlight)
+{
+	struct highlight *hl;
+
+	if(!highlight) {
+		return(-EINVAL);
+	}
+
+	if(!(hl = calloc(1, sizeof(*hl)))) {
+		return(-ENOMEM);
+	}
+
+	if(spans_new(&hl->spans) < 0) {
+		free(hl);
+		return(-ENOMEM);
+	}
+
+	*highlight = hl;
+	return(0);
+}
+
+int highlight_free(struct highlight **highlight)
+{
+	if(!highlight || !*highlight) {
+		return(-EINVAL);
+	}
+
+	spans_free(&(*highlight)->spans);
+	free((*highlight)->states);
+	free(*highlight);
+	*highlight = NULL;
+
+	return(0);
+}
+
+struct spans* highlight_get_spans(struct highlight *highlight)
+{
+	return(highlight ? highlight->spans : NULL);
+}
+
+static int _highlight_reserve(struct highlight *hl, const int num)
+{
+	unsigned char *states;
+	int max;
+
+	if(num <= hl->max_states) {
+		return(0);
+	}
+
+	for(max = hl->max_states ? hl->max_states : HIGHLIGHT_INIT_STATES; max < num; max *= 2);
+
+	if(!(states = realloc(hl->states, max))) {
+		return(-ENOMEM);
+	}
+
+	hl->states = states;
+	hl->max_states = max;
+
+	return(0);
+}
+
+static int _is_keyword(const char *word, const size_t len)
+{
+	int i;
+
+	for(i = 0; _keywords[i]; i++) {
+		if(strncmp(_keywords[i], word, len) == 0 && !_keywords[i][len]) {
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+static int _is_word(const char chr)
+{
+	return(isalnum((unsigned char)chr) || chr == '_');
+}
+
+/*
+ * Find the end of a comment that started before `start', or the end of
+ * the line if it doesn't end on this line.
+ */
+static size_t _comment_end(const char *data, const size_t start, const size_t len, int *state)
+{
+	size_t i;
+
+	for(i = start; i + 1 < len; i++) {
+		if(data[i] == '*' && data[i + 1] == '/') {
+			*state = HIGHLIGHT_STATE_NORMAL;
+			return(i + 2);
+		}
+	}
+
+	*state = HIGHLIGHT_STATE_COMMENT;
+	return(len);
+}
+
+/*
+ * Lex a line that starts in `state' and return the state that the next
+ * line starts in. If `spans' is not NULL, the tokens that are colored are
+ * added to it; `offset' is the position of the line in the buffer.
+ */
+static int _highlight_lex_line(const char *data, size_t len, int state,
+			       struct spans *spans, const size_t offset)
+{
+	size_t i;
+
+	if(len > 0 && data[len - 1] == '\n') {
+		len--;
+	}
+
+	if(state == HIGHLIGHT_STATE_COMMENT) {
+		i = _comment_end(data, 0, len, &state);
+
+		if(spans) {
+			spans_add(spans, offset, i, UI_COLOR_COMMENT);
+		}
+	} else {
+		for(i = 0; i < len && (data[i] == ' ' || data[i] == '\t'); i++);
+
+		/* a line that starts with a `#' is a preprocessor line or a comment */
+		if(i < len && data[i] == '#') {
+			if(spans) {
+				spans_add(spans, offset + i, len - i, UI_COLOR_COMMENT);
+			}
+
+			return(state);
+		}
+	}
+
+	while(i < len) {
+		size_t start;
+		int color;
+
+		start = i;
+
+		if(data[i] == '/' && i + 1 < len && data[i + 1] == '*') {
+			i = _comment_end(data, i + 2, len, &state);
+			color = UI_COLOR_COMMENT;
+		} else if(data[i] == '/' && i + 1 < len && data[i + 1] == '/') {
+			i = len;
+			color = UI_COLOR_COMMENT;
+		} else if(data[i] == '"' || data[i] == '\'') {
+			for(i++; i < len && data[i] != data[start]; i++) {
+				if(data[i] == '\\') {
+					i++;
+				}
+			}
+
+			i = i < len ? i + 1 : len;
+			color = UI_COLOR_STRING;
+		} else if(isdigit((unsigned char)data[i])) {
+			while(i < len && (_is_word(data[i]) || data[i] == '.')) {
+				i++;
+			}
+
+			color = UI_COLOR_NUMBER;
+		} else if(_is_word(data[i])) {
+			while(i < len && _is_word(data[i])) {
+				i++;
+			}
+
+			color = _is_keyword(data + start, i - start) ? UI_COLOR_KEYWORD : 0;
+		} else {
+			i++;
+			color = 0;
+		}
+
+		if(spans && color) {
+			spans_add(spans, offset + start, i - start, color);
+		}
+	}
+
+	return(state);
+}
+
+static int _highlight_line_at(struct buffer *buffer, size_t offset)
+{
+	size_t start;
+	size_t len;
+	int line;
+
+	if(buffer_get_size(buffer) == 0) {
+		return(1);
+	}
+
+	if(offset >= buffer_get_size(buffer)) {
+		offset = buffer_get_size(buffer) - 1;
+	}
+
+	if(buffer_get_line_range(buffer, offset, &line, &start, &len) < 0) {
+		return(1);
+	}
+
+	return(line);
+}
+
+static int _highlight_line_offset(struct buffer *buffer, const int line, size_t *offset)
+{
+	struct snippet *snip;
+	struct line *first;
+	int err;
+
+	if((err = buffer_get_snippet(buffer, line, 1, NULL, NULL, &snip)) < 0) {
+		return(err);
+	}
+
+	if((first = snippet_get_first_line(snip))) {
+		*offset = line_get_source(first) - buffer_get_data(buffer);
+	} else {
+		err = -ENOENT;
+	}
+
+	snippet_free(&snip);
+	return(err);
+}
+
+/*
+ * Forget the states of the lines that were edited, and move the states
+ * behind them to where their lines are now.
+ */
+static void _highlight_apply_edits(struct highlight *hl, struct buffer *buffer)
+{
+	size_t start;
+	size_t end;
+	long lines;
+	int first;
+	int last;
+	int old;
+	int err;
+
+	err = buffer_get_edits(buffer, hl->generation, &start, &end, &lines);
+	hl->generation = buffer_get_generation(buffer);
+	hl->first_line = 0;
+	hl->tail = 0;
+
+	if(err < 0) {
+		hl->num_states = 1;
+		return;
+	}
+
+	if(err == 0) {
+		return;
+	}
+
+	first = _highlight_line_at(buffer, start);
+	last = _highlight_line_at(buffer, end);
+
+	/* the line after the last edited one used to be line `old' + 1 */
+	old = last - lines;
+
+	if(old >= first && old < hl->num_states &&
+	   _highlight_reserve(hl, last + hl->num_states - old) == 0) {
+		memmove(hl->states + last, hl->states + old, hl->num_states - old);
+		hl->tail = last + 1;
+		hl->tail_end = last + hl->num_states - old;
+	}
+
+	if(hl->num_states > first) {
+		hl->num_states = first;
+	}
+}
+
+/*
+ * Bring the spans of the lines from `first_line' to `last_line' up to date.
+ * The range of the buffer whose highlights changed, other than through
+ * edits, is stored in `changed_start' and `changed_end'.
+ */
+int highlight_update(struct highlight *highlight, struct buffer *buffer,
+		     const int first_line, const int last_line,
+		     size_t *changed_start, size_t *changed_end)
+{
+	const char *data;
+	size_t fold_end;
+	size_t offset;
+	size_t size;
+	int line;
+	int err;
+
+	if(!highlight || !buffer || first_line < 1 || !changed_start || !changed_end) {
+		return(-EINVAL);
+	}
+
+	*changed_start = 0;
+	*changed_end = 0;
+
+	if(!highlight->states && (err = _highlight_reserve(highlight, 1)) < 0) {
+		return(err);
+	}
+
+	if(highlight->buffer != buffer) {
+		highlight->buffer = buffer;
+		highlight->generation = buffer_get_generation(buffer);
+		highlight->num_states = 1;
+		highlight->first_line = 0;
+		highlight->tail = 0;
+	} else if(highlight->generation != buffer_get_generation(buffer)) {
+		_highlight_apply_edits(highlight, buffer);
+	}
+
+	if(highlight->first_line == first_line && highlight->last_line == last_line &&
+	   highlight->fold_generation == buffer_get_fold_generation(buffer)) {
+		return(0);
+	}
+
+	highlight->states[0] = HIGHLIGHT_STATE_NORMAL;
+	line = highlight->num_states < first_line ? highlight->num_states : first_line;
+	spans_clear(highlight->spans);
+
+	if((err = _highlight_line_offset(buffer, line, &offset)) < 0) {
+		/* the buffer doesn't have that many lines */
+		return(err == -ENOENT || err == -ERANGE ? 0 : err);
+	}
+	data = buffer_get_data(buffer);
+	size = buffer_get_size(buffer);
+
+	fold_end = 0;
+
+	for( ; line <= last_line && offset < size; line++) {
+		const char *eol;
+		size_t fold_start;
+		size_t len;
+		int lines;
+		int state;
+
+		/*
+		 * Folded lines aren't shown, so they are lexed only to get the
+		 * state they end in, and once that is known they are skipped.
+		 */
+		if(offset >= fold_end &&
+		   buffer_get_fold(buffer, offset, &fold_start, &fold_end, &lines) == 0 &&
+		   fold_start == offset && line + lines - 1 < highlight->num_states) {
+			offset = fold_end;
+			line += lines - 1;
+			continue;
+		}
+
+		eol = memchr(data + offset, '\n', size - offset);
+		len = eol ? (size_t)(eol - data) + 1 - offset : size - offset;
+
+		state = _highlight_lex_line(data + offset, len, highlight->states[line - 1],
+					    line >= first_line && offset >= fold_end ?
+					    highlight->spans : NULL, offset);
+		offset += len;
+
+		if(line < highlight->num_states) {
+			continue;
+		}
+
+		if(highlight->tail && line + 1 >= highlight->tail &&
+		   line + 1 <= highlight->tail_end && highlight->states[line] == state) {
+			/* the lexer is back in step, so the rest is still right */
+			highlight->num_states = highlight->tail_end;
+			highlight->tail = 0;
+			continue;
+		}
+
+		if((err = _highlight_reserve(highlight, line + 1)) < 0) {
+			return(err);
+		}
+
+		highlight->states[line] = state;
+		highlight->num_states = line + 1;
+
+		/* the line that follows may start in a different state than it was drawn in */
+		if(line + 1 >= first_line && line + 1 <= last_line && offset < size) {
+			if(*changed_start == *changed_end) {
+				*changed_start = offset;
+			}
+
+			*changed_end = offset + 1;
+		}
+	}
+
+	/* states that weren't confirmed are only guesses */
+	highlight->tail = 0;
+	highlight->first_line = first_line;
+	highlight->last_line = last_line;
+	highlight->fold_generation = buffer_get_fold_generation(buffer);
+
+	return(0);
+}
+
+/*
+ * Determine the states of all lines in `data', for example on a snapshot
+ * of a buffer, without involving a highlighter. This may take a while on
+ * large files, so `cancel' is checked every now and then. The states are
+ * stored in a newly allocated array in `states'.
+ */
+int highlight_lex(const char *data, const size_t size, atomic_int *cancel,
+		  unsigned char **states, int *num_states)
+{
+	struct highlight hl;
+	size_t offset;
+	int line;
+	int err;
+
+	if(!data || !states || !num_states) {
+		return(-EINVAL);
+	}
+
+	memset(&hl, 0, sizeof(hl));
+
+	if((err = _highlight_reserve(&hl, 1)) < 0) {
+		return(err);
+	}
+
+	hl.states[0] = HIGHLIGHT_STATE_NORMAL;
+
+	for(line = 1, offset = 0; offset < size; line++) {
+		const char *eol;
+		size_t len;
+		int state;
+
+		if(line % HIGHLIGHT_LEX_BATCH == 0 && cancel &&
+		   atomic_load_explicit(cancel, memory_order_relaxed)) {
+			free(hl.states);
+			return(-ECANCELED);
+		}
+
+		eol = memchr(data + offset, '\n', size - offset);
+		len = eol ? (size_t)(eol - data) + 1 - offset : size - offset;
+
+		state = _highlight_lex_line(data + offset, len, hl.states[line - 1], NULL, offset);
+		offset += len;
+
+		if((err = _highlight_reserve(&hl, line + 1)) < 0) {
+			free(hl.states);
+			return(err);
+		}
+
+		hl.states[line] = state;
+	}
+
+	*states = hl.states;
+	*num_states = line;
+
+	return(0);
+}
+
+/*
+ * Take over the states that highlight_lex() determined on a snapshot that
+ * was taken at `generation'. They are only used if the buffer did not
+ * change since and they cover more lines than the highlighter knows. The
+ * states are freed either way.
+ */
+int highlight_set_states(struct highlight *highlight, struct buffer *buffer,
+			 const unsigned long generation, unsigned char *states,
+			 const int num_states)
+{
+	if(!highlight || !buffer || !states || num_states < 1) {
+		free(states);
+		return(-EINVAL);
+	}
+
+	if(highlight->buffer != buffer || highlight->generation != generation ||
+	   buffer_get_generation(buffer) != generation) {
+		free(states);
+		return(-ESTALE);
+	}
+
+	if(num_states <= highlight->num_states) {
+		free(states);
+		return(-EALREADY);
+	}
+
+	/* lines that were lexed already agree with the new states */
+	free(highlight->states);
+	highlight->states = states;
+	highlight->num_states = num_states;
+	highlight->max_states = num_states;
+	highlight->tail = 0;
+
+	return(0);
+}
@@ -0,0 +1,25 @@
+#ifndef E_HIGHLIGHT_H
+#define E_HIGHLIGHT_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+struct buffer;
+struct spans;
+struct highlight;
+
+int highlight_new(struct highlight **highlight);
+int highlight_free(struct highlight **highlight);
+
+int highlight_update(struct highlight *highlight, struct buffer *buffer,
+		     const int first_line, const int last_line,
+		     size_t *changed_start, size_t *changed_end);
+struct spans* highlight_get_spans(struct highlight *highlight);
+
+int highlight_lex(const char *data, const size_t size, atomic_int *cancel,
+		  unsigned char **states, int *num_states);
+int highlight_set_states(struct highlight *highlight, struct buffer *buffer,
+			 const unsigned long generation, unsigned char *states,
+			 const int num_states);
+
+#endif /* E_HIGHLIGHT_H */
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include "buffer.h"
+#include "highlight.h"
+#include "span.h"
+
+#define DEFAULT_KEYS  2000
+#define VIEW_LINES    50
+
+static const char *_lines[] = {
+	"/*\n",
+	" * A comment that spans\n",
+	" * several lines.\n",
+	" */\n",
+	"static int count(const char *str, int len) /* counts */\n",
+	"{\n",
+	"\tint i = 0x10; // a \"string\" in a comment\n",
+	"\treturn(strlen(\"text /* not a comment */\") + 'x' + 42);\n",
+	"}\n",
+	"#include <stdio.h>\n"
+};
+
+static double _now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return(now.tv_sec + now.tv_nsec / 1e9);
+}
+
+static int _make_file(const char *path, const int lines)
+{
+	FILE *file;
+	int i;
+
+	if(!(file = fopen(path, "w"))) {
+		return(-errno);
+	}
+
+	for(i = 0; i < lines; i++) {
+		fputs(_lines[i % (sizeof(_lines) / sizeof(*_lines))], file);
+	}
+
+	fclose(file);
+	return(0);
+}
+
+static int _view(struct highlight *highlight, struct buffer *buffer, const size_t cursor)
+{
+	size_t start;
+	size_t end;
+	int line;
+
+	if(buffer_get_line_range(buffer, cursor, &line, &start, &end) < 0) {
+		return(-ERANGE);
+	}
+
+	line = line > VIEW_LINES / 2 ? line - VIEW_LINES / 2 : 1;
+	return(highlight_update(highlight, buffer, line, line + VIEW_LINES - 1, &start, &end));
+}
+
+/*
+ * The highlighter that followed the edits has to come to the same result
+ * as one that starts from scratch.
+ */
+static int _check(struct highlight *highlight, struct buffer *buffer, const size_t cursor)
+{
+	const struct span *expected;
+	const struct span *actual;
+	struct highlight *fresh;
+	int num;
+	int err;
+	int i;
+
+	if((err = highlight_new(&fresh)) < 0) {
+		return(err);
+	}
+
+	_view(fresh, buffer, cursor);
+	num = spans_get_range(highlight_get_spans(fresh), 0, SIZE_MAX, &expected);
+
+	if(spans_get_range(highlight_get_spans(highlight), 0, SIZE_MAX, &actual) != num) {
+		err = -EIO;
+	}
+
+	for(i = 0; i < num && !err; i++) {
+		if(expected[i].offset != actual[i].offset || expected[i].len != actual[i].len ||
+		   expected[i].color != actual[i].color) {
+			err = -EIO;
+		}
+	}
+
+	highlight_free(&fresh);
+	return(err);
+}
+
+/*
+ * Type into the middle of the file, with the view following the cursor,
+ * and occasionally open or close a comment, which changes how all of
+ * the following lines are highlighted.
+ */
+static int _bench(const char *path, const int lines, const int keys)
+{
+	struct highlight *highlight;
+	struct buffer *buffer;
+	size_t cursor;
+	double start;
+	double first;
+	double typed;
+	int err;
+	int i;
+
+	if((err = _make_file(path, lines)) < 0 ||
+	   (err = buffer_open(&buffer, path, 0)) < 0) {
+		return(err);
+	}
+
+	if((err = highlight_new(&highlight)) < 0) {
+		buffer_close(&buffer);
+		return(err);
+	}
+
+	srand(1);
+	cursor = buffer_get_size(buffer) / 2;
+
+	/* the first time, everything in front of the view is lexed */
+	start = _now();
+	_view(highlight, buffer, cursor);
+	first = _now() - start;
+
+	typed = 0;
+
+	for(i = 0; i < keys && !err; i++) {
+		const char *text;
+
+		switch(i % 500) {
+		case 100:
+			text = "/*";
+			break;
+
+		case 300:
+			text = "*/";
+			break;
+
+		default:
+			text = rand() % 16 == 0 ? "\n" : "x";
+			break;
+		}
+
+		if((err = buffer_splice(buffer, cursor, 0, text, strlen(text))) < 0) {
+			break;
+		}
+
+		cursor += strlen(text);
+
+		/* only the highlighter is timed, not the edit */
+		start = _now();
+		err = _view(highlight, buffer, cursor);
+		typed += _now() - start;
+	}
+
+	if(!err && (err = _check(highlight, buffer, cursor)) < 0) {
+		fprintf(stderr, "%d lines: highlights differ from a fresh start\n", lines);
+	}
+
+	printf("%8d lines: first view %8.3f ms, %6.0f ns/key\n",
+	       lines, first * 1e3, typed * 1e9 / keys);
+
+	highlight_free(&highlight);
+	buffer_close(&buffer);
+	unlink(path);
+
+	return(err);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path;
+	int lines;
+	int keys;
+	int err;
+
+	path = argc > 1 ? argv[1] : "highlight_bench.txt";
+	keys = argc > 2 ? atoi(argv[2]) : DEFAULT_KEYS;
+
+	for(lines = 10000; lines <= 1000000; lines *= 10) {
+		if((err = _bench(path, lines, keys)) < 0) {
+			fprintf(stderr, "bench: %s\n", strerror(-err));
+			return(1);
+		}
+	}
+
+	return(0);
+}
@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include "editor.h"
+
+#define DEFAULT_KEYS  50000
+#define BENCH_WIDTH   300
+#define BENCH_HEIGHT  100
+#define KEY_QUIT      17 /* ^Q */
+
+static double _now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return(now.tv_sec + now.tv_nsec / 1e9);
+}
+
+static int _make_file(const char *path)
+{
+	FILE *file;
+	int i;
+
+	if(!(file = fopen(path, "w"))) {
+		return(-errno);
+	}
+
+	for(i = 0; i < 1000; i++) {
+		fprintf(file, "line %d\tof the file that the editor shows while typing\n", i);
+	}
+
+	fclose(file);
+	return(0);
+}
+
+/*
+ * The editor runs on the slave side of a pseudo terminal, so the benchmark
+ * doesn't need a terminal. What it draws is read from the master side and
+ * thrown away.
+ */
+static int _open_terminal(int *master)
+{
+	struct termios attrs;
+	struct winsize size;
+	int slave;
+	int null;
+
+	if((*master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 ||
+	   grantpt(*master) < 0 || unlockpt(*master) < 0 ||
+	   (slave = open(ptsname(*master), O_RDWR | O_NOCTTY)) < 0) {
+		return(-errno);
+	}
+
+	/* in raw mode from the start, so nothing is echoed or buffered by line */
+	tcgetattr(slave, &attrs);
+	cfmakeraw(&attrs);
+	tcsetattr(slave, TCSANOW, &attrs);
+
+	size.ws_col = BENCH_WIDTH;
+	size.ws_row = BENCH_HEIGHT;
+	size.ws_xpixel = 0;
+	size.ws_ypixel = 0;
+	ioctl(*master, TIOCSWINSZ, &size);
+
+	if((null = open("/dev/null", O_WRONLY)) < 0) {
+		return(-errno);
+	}
+
+	dup2(slave, STDIN_FILENO);
+	dup2(slave, STDOUT_FILENO);
+	dup2(null, STDERR_FILENO);
+	close(slave);
+	close(null);
+
+	return(0);
+}
+
+static pid_t _start_reading(const int master)
+{
+	char buffer[4096];
+	pid_t pid;
+
+	if((pid = fork()) != 0) {
+		return(pid);
+	}
+
+	/* reading fails once the editor has closed the terminal */
+	close(STDIN_FILENO);
+	close(STDOUT_FILENO);
+
+	while(read(master, buffer, sizeof(buffer)) > 0);
+	_exit(0);
+}
+
+/* type like someone pasting a large block of text into the command box */
+static pid_t _start_typing(const int master, const int keys)
+{
+	char chunk[4096];
+	pid_t pid;
+	int sent;
+
+	if((pid = fork()) != 0) {
+		return(pid);
+	}
+
+	for(sent = 0; sent < keys; ) {
+		int len;
+		int i;
+
+		len = keys - sent < sizeof(chunk) ? keys - sent : sizeof(chunk);
+
+		for(i = 0; i < len; i++) {
+			chunk[i] = 'a' + (sent + i) % 26;
+		}
+
+		if((len = write(master, chunk, len)) < 0) {
+			_exit(1);
+		}
+
+		sent += len;
+	}
+
+	chunk[0] = KEY_QUIT;
+	write(master, chunk, 1);
+	_exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct editor *editor;
+	const char *path;
+	FILE *report;
+	double start;
+	double elapsed;
+	pid_t typist;
+	pid_t reader;
+	int master;
+	int keys;
+	int err;
+
+	path = argc > 1 ? argv[1] : "input_bench.txt";
+	keys = argc > 2 ? atoi(argv[2]) : DEFAULT_KEYS;
+
+	if(!(report = fdopen(dup(STDOUT_FILENO), "w"))) {
+		return(1);
+	}
+
+	setenv("TERM", "xterm", 0);
+
+	if((err = _make_file(path)) < 0 ||
+	   (err = _open_terminal(&master)) < 0) {
+		fprintf(report, "setup: %s\n", strerror(-err));
+		return(1);
+	}
+
+	reader = _start_reading(master);
+
+	if((err = editor_new(&editor)) < 0 ||
+	   (err = editor_open(editor, path, 1)) < 0) {
+		fprintf(report, "editor: %s\n", strerror(-err));
+		return(1);
+	}
+
+	typist = _start_typing(master, keys);
+
+	start = _now();
+	editor_run(editor);
+	elapsed = _now() - start;
+
+	editor_free(&editor);
+	waitpid(typist, NULL, 0);
+
+	/* closing the terminal makes the reader stop */
+	close(STDIN_FILENO);
+	close(STDOUT_FILENO);
+	close(master);
+	waitpid(reader, NULL, 0);
+	unlink(path);
+
+	fprintf(report, "keys:    %d\n", keys);
+	fprintf(report, "time:    %.3f s\n", elapsed);
+	fprintf(report, "rate:    %.0f keys/s\n", keys / elapsed);
+	fclose(report);
+
+	return(0);
+}
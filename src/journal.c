@@ -0,0 +1,642 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "buffer.h"
+#include "config.h"
+
+#define JOURNAL_MAGIC       "EJNL"
+#define JOURNAL_VERSION     1
+#define JOURNAL_SUFFIX      ".ejournal"
+#define JOURNAL_PENDING_MAX (64 * 1024)
+
+/*
+ * The journal is a header that identifies the state of the file that the
+ * edits were made on, followed by one record per edit. Each edit is
+ * stored as a splice, i.e. "replace `len' bytes at `offset' with
+ * `data_len' bytes of data", with the numbers encoded as varints and a
+ * checksum at the end so that a record that was only partially written
+ * when we crashed can be detected.
+ */
+struct journal_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+};
+
+struct journal {
+	int fd;
+	char *path;
+	char *file_path;
+
+	/* records that were not written yet */
+	char *pending;
+	size_t pending_len;
+	size_t pending_size;
+
+	/* records that were written, but not synced */
+	int unsynced;
+	struct timespec first_unsynced;
+
+	/* end of the records that were in the journal when it was opened */
+	off_t replay_end;
+};
+
+static uint32_t _journal_checksum(const unsigned char *data, const size_t len)
+{
+	uint32_t hash;
+	size_t i;
+
+	/* FNV-1a */
+	for(hash = 2166136261u, i = 0; i < len; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return(hash);
+}
+
+static size_t _varint_encode(unsigned char *dst, uint64_t value)
+{
+	size_t len;
+
+	for(len = 0; value >= 0x80; len++) {
+		dst[len] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+
+	dst[len++] = value;
+	return(len);
+}
+
+static int _varint_decode(const unsigned char **src, const unsigned char *end, uint64_t *value)
+{
+	const unsigned char *pos;
+	uint64_t val;
+	int shift;
+
+	for(pos = *src, val = 0, shift = 0; pos < end && shift < 64; pos++, shift += 7) {
+		val |= (uint64_t)(*pos & 0x7f) << shift;
+
+		if(!(*pos & 0x80)) {
+			*src = pos + 1;
+			*value = val;
+			return(0);
+		}
+	}
+
+	return(-EBADMSG);
+}
+
+static long _elapsed_ms(const struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return((now.tv_sec - since->tv_sec) * 1000 +
+	       (now.tv_nsec - since->tv_nsec) / 1000000);
+}
+
+static char* _journal_path(const char *path)
+{
+	const char *base;
+	char *jpath;
+	size_t len;
+
+	base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+
+	/* "dir/" + "." + "name" + suffix */
+	len = (base - path) + 1 + strlen(base) + strlen(JOURNAL_SUFFIX) + 1;
+
+	if((jpath = malloc(len))) {
+		snprintf(jpath, len, "%.*s.%s%s", (int)(base - path), path, base, JOURNAL_SUFFIX);
+	}
+
+	return(jpath);
+}
+
+static int _journal_make_header(struct journal *journal, struct journal_header *header)
+{
+	struct stat info;
+
+	memset(header, 0, sizeof(*header));
+
+	if(stat(journal->file_path, &info) < 0) {
+		return(-errno);
+	}
+
+	memcpy(header->magic, JOURNAL_MAGIC, sizeof(header->magic));
+	header->version = JOURNAL_VERSION;
+	header->size = info.st_size;
+	header->mtime_sec = info.st_mtim.tv_sec;
+	header->mtime_nsec = info.st_mtim.tv_nsec;
+
+	return(0);
+}
+
+static int _journal_write(struct journal *journal, const void *data, const size_t len)
+{
+	size_t done;
+
+	for(done = 0; done < len; ) {
+		ssize_t written;
+
+		written = write(journal->fd, (const char*)data + done, len - done);
+
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			return(-errno);
+		}
+
+		done += written;
+	}
+
+	return(0);
+}
+
+static int _journal_write_header(struct journal *journal)
+{
+	struct journal_header header;
+	int err;
+
+	if((err = _journal_make_header(journal, &header)) < 0) {
+		return(err);
+	}
+
+	if(ftruncate(journal->fd, 0) < 0) {
+		return(-errno);
+	}
+
+	if((err = _journal_write(journal, &header, sizeof(header))) < 0) {
+		return(err);
+	}
+
+	if(fdatasync(journal->fd) < 0) {
+		return(-errno);
+	}
+
+	journal->replay_end = sizeof(header);
+	return(0);
+}
+
+/*
+ * Check if the journal was written for the file as it is on disk now. If
+ * the file was changed since, the recorded offsets are meaningless.
+ */
+static int _journal_check_header(struct journal *journal)
+{
+	struct journal_header expected;
+	struct journal_header header;
+	ssize_t len;
+	int err;
+
+	if((err = _journal_make_header(journal, &expected)) < 0) {
+		return(err);
+	}
+
+	len = pread(journal->fd, &header, sizeof(header), 0);
+
+	if(len < 0) {
+		return(-errno);
+	}
+
+	if(len != sizeof(header) || memcmp(&header, &expected, sizeof(header)) != 0) {
+		return(-ESTALE);
+	}
+
+	return(0);
+}
+
+static int _journal_free(struct journal **journal)
+{
+	if((*journal)->fd >= 0) {
+		close((*journal)->fd);
+	}
+
+	free((*journal)->pending);
+	free((*journal)->path);
+	free((*journal)->file_path);
+	free(*journal);
+	*journal = NULL;
+
+	return(0);
+}
+
+int journal_open(struct journal **journal, const char *path)
+{
+	struct journal *jnl;
+	off_t size;
+	int err;
+
+	if(!journal || !path) {
+		return(-EINVAL);
+	}
+
+	if(!(jnl = calloc(1, sizeof(*jnl)))) {
+		return(-ENOMEM);
+	}
+
+	jnl->fd = -1;
+
+	if(!(jnl->path = _journal_path(path)) ||
+	   !(jnl->file_path = strdup(path))) {
+		_journal_free(&jnl);
+		return(-ENOMEM);
+	}
+
+	jnl->fd = open(jnl->path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+		       config.file_default_mode);
+
+	if(jnl->fd < 0) {
+		err = -errno;
+		_journal_free(&jnl);
+		return(err);
+	}
+
+	if((size = lseek(jnl->fd, 0, SEEK_END)) < 0) {
+		err = -errno;
+	} else if(size > 0 && (err = _journal_check_header(jnl)) == 0) {
+		jnl->replay_end = size;
+	} else {
+		if(size > 0) {
+			char old_path[strlen(jnl->path) + 5];
+
+			/* don't throw away edits we can't replay; the user may want them */
+			snprintf(old_path, sizeof(old_path), "%s.old", jnl->path);
+			fprintf(stderr, "Journal does not match %s, moving it to %s\n",
+				path, old_path);
+			rename(jnl->path, old_path);
+
+			close(jnl->fd);
+			jnl->fd = open(jnl->path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+				       config.file_default_mode);
+
+			if(jnl->fd < 0) {
+				err = -errno;
+				_journal_free(&jnl);
+				return(err);
+			}
+		}
+
+		err = _journal_write_header(jnl);
+	}
+
+	if(err < 0) {
+		_journal_free(&jnl);
+		return(err);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &jnl->first_unsynced);
+	*journal = jnl;
+
+	return(0);
+}
+
+int journal_close(struct journal **journal)
+{
+	if(!journal || !*journal) {
+		return(-EINVAL);
+	}
+
+	journal_sync(*journal);
+	return(_journal_free(journal));
+}
+
+int journal_discard(struct journal **journal)
+{
+	if(!journal || !*journal) {
+		return(-EINVAL);
+	}
+
+	if(unlink((*journal)->path) < 0) {
+		perror("unlink");
+	}
+
+	return(_journal_free(journal));
+}
+
+struct splice {
+	size_t offset;
+	size_t len;
+	char *data;
+	size_t data_len;
+	size_t data_size;
+};
+
+/*
+ * Try to merge the edit described by the arguments into `pending'. This
+ * works if the edit touches the data that `pending' inserted, which is the
+ * case for typing and deleting at the cursor, so long streams of small
+ * edits collapse into one splice and replay doesn't move the tail of the
+ * buffer around once per keystroke.
+ */
+static int _splice_merge(struct splice *pending, const size_t offset, const size_t len,
+			 const char *data, const size_t data_len)
+{
+	size_t rel;
+	size_t covered;
+	size_t new_len;
+
+	if(offset < pending->offset || offset > pending->offset + pending->data_len) {
+		return(-ERANGE);
+	}
+
+	rel = offset - pending->offset;
+	covered = pending->data_len - rel < len ? pending->data_len - rel : len;
+	new_len = pending->data_len - covered + data_len;
+
+	if(new_len > pending->data_size) {
+		char *new_data;
+		size_t new_size;
+
+		for(new_size = pending->data_size ? pending->data_size : 64;
+		    new_size < new_len; new_size *= 2);
+
+		if(!(new_data = realloc(pending->data, new_size))) {
+			return(-ENOMEM);
+		}
+
+		pending->data = new_data;
+		pending->data_size = new_size;
+	}
+
+	memmove(pending->data + rel + data_len,
+		pending->data + rel + covered,
+		pending->data_len - rel - covered);
+	memcpy(pending->data + rel, data, data_len);
+
+	/* whatever wasn't covered by the pending data was in the original text */
+	pending->len += len - covered;
+	pending->data_len = new_len;
+
+	return(0);
+}
+
+static int _splice_apply(struct splice *pending, struct buffer *buffer)
+{
+	int err;
+
+	err = buffer_splice(buffer, pending->offset, pending->len,
+			    pending->data, pending->data_len);
+
+	pending->offset = 0;
+	pending->len = 0;
+	pending->data_len = 0;
+
+	return(err);
+}
+
+int journal_replay(struct journal *journal, struct buffer *buffer)
+{
+	const unsigned char *pos;
+	const unsigned char *end;
+	unsigned char *records;
+	struct splice pending;
+	int have_pending;
+	size_t size;
+	ssize_t len;
+	int replayed;
+	int err;
+
+	if(!journal || !buffer) {
+		return(-EINVAL);
+	}
+
+	if(journal->replay_end <= sizeof(struct journal_header)) {
+		return(0);
+	}
+
+	size = journal->replay_end - sizeof(struct journal_header);
+
+	if(!(records = malloc(size))) {
+		return(-ENOMEM);
+	}
+
+	len = pread(journal->fd, records, size, sizeof(struct journal_header));
+
+	if(len < 0) {
+		err = -errno;
+		free(records);
+		return(err);
+	}
+
+	memset(&pending, 0, sizeof(pending));
+	have_pending = 0;
+	replayed = 0;
+	err = 0;
+
+	for(pos = records, end = records + len; pos < end; ) {
+		const unsigned char *record;
+		uint64_t offset;
+		uint64_t del_len;
+		uint64_t data_len;
+		uint32_t checksum;
+
+		record = pos;
+
+		if(_varint_decode(&pos, end, &offset) < 0 ||
+		   _varint_decode(&pos, end, &del_len) < 0 ||
+		   _varint_decode(&pos, end, &data_len) < 0 ||
+		   data_len + sizeof(checksum) > (uint64_t)(end - pos)) {
+			break;
+		}
+
+		memcpy(&checksum, pos + data_len, sizeof(checksum));
+
+		if(checksum != _journal_checksum(record, pos + data_len - record)) {
+			break;
+		}
+
+		if(!have_pending ||
+		   _splice_merge(&pending, offset, del_len, (const char*)pos, data_len) < 0) {
+			if(have_pending && (err = _splice_apply(&pending, buffer)) < 0) {
+				break;
+			}
+
+			pending.offset = offset;
+			pending.len = 0;
+			pending.data_len = 0;
+			have_pending = 1;
+
+			if((err = _splice_merge(&pending, offset, del_len,
+						(const char*)pos, data_len)) < 0) {
+				break;
+			}
+		}
+
+		pos += data_len + sizeof(checksum);
+		replayed++;
+	}
+
+	if(!err && have_pending) {
+		err = _splice_apply(&pending, buffer);
+	}
+
+	/*
+	 * A record that was torn during a crash ends the journal. Drop it,
+	 * otherwise new records would be appended behind garbage.
+	 */
+	if(pos < end) {
+		fprintf(stderr, "Journal is damaged after %d records\n", replayed);
+
+		if(ftruncate(journal->fd, sizeof(struct journal_header) + (pos - records)) < 0) {
+			perror("ftruncate");
+		}
+	}
+
+	free(pending.data);
+	free(records);
+
+	return(err < 0 ? err : replayed);
+}
+
+int journal_record(struct journal *journal, const size_t offset, const size_t len,
+		   const char *data, const size_t data_len)
+{
+	unsigned char *record;
+	size_t record_len;
+	size_t required;
+	uint32_t checksum;
+
+	if(!journal || (!data && data_len > 0)) {
+		return(-EINVAL);
+	}
+
+	/* three varints of at most 10 bytes each, the data, and the checksum */
+	required = journal->pending_len + 30 + data_len + sizeof(checksum);
+
+	if(required > journal->pending_size) {
+		char *new_pending;
+		size_t new_size;
+
+		for(new_size = journal->pending_size ? journal->pending_size : 4096;
+		    new_size < required; new_size *= 2);
+
+		if(!(new_pending = realloc(journal->pending, new_size))) {
+			return(-ENOMEM);
+		}
+
+		journal->pending = new_pending;
+		journal->pending_size = new_size;
+	}
+
+	if(!journal->unsynced && journal->pending_len == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &journal->first_unsynced);
+	}
+
+	record = (unsigned char*)journal->pending + journal->pending_len;
+	record_len = _varint_encode(record, offset);
+	record_len += _varint_encode(record + record_len, len);
+	record_len += _varint_encode(record + record_len, data_len);
+
+	if(data_len > 0) {
+		memcpy(record + record_len, data, data_len);
+		record_len += data_len;
+	}
+
+	checksum = _journal_checksum(record, record_len);
+	memcpy(record + record_len, &checksum, sizeof(checksum));
+	record_len += sizeof(checksum);
+
+	journal->pending_len += record_len;
+
+	if(journal->pending_len >= JOURNAL_PENDING_MAX) {
+		return(journal_flush(journal));
+	}
+
+	return(0);
+}
+
+int journal_flush(struct journal *journal)
+{
+	int err;
+
+	if(!journal) {
+		return(-EINVAL);
+	}
+
+	if(journal->pending_len == 0) {
+		return(0);
+	}
+
+	/*
+	 * Once written, the records survive the editor crashing or being
+	 * killed, only a crash of the system can still take them away.
+	 */
+	if((err = _journal_write(journal, journal->pending, journal->pending_len)) < 0) {
+		return(err);
+	}
+
+	journal->pending_len = 0;
+	journal->unsynced = 1;
+
+	return(0);
+}
+
+int journal_sync(struct journal *journal)
+{
+	int err;
+
+	if(!journal) {
+		return(-EINVAL);
+	}
+
+	if((err = journal_flush(journal)) < 0 ||
+	   (journal->unsynced && fdatasync(journal->fd) < 0 && (err = -errno))) {
+		/* try again after another interval instead of right away */
+		clock_gettime(CLOCK_MONOTONIC, &journal->first_unsynced);
+		return(err);
+	}
+
+	journal->unsynced = 0;
+	return(0);
+}
+
+int journal_reset(struct journal *journal)
+{
+	if(!journal) {
+		return(-EINVAL);
+	}
+
+	journal->pending_len = 0;
+	journal->unsynced = 0;
+
+	return(_journal_write_header(journal));
+}
+
+int journal_get_timeout(struct journal *journal)
+{
+	long elapsed;
+
+	if(!journal) {
+		return(-EINVAL);
+	}
+
+	if(!journal->unsynced && journal->pending_len == 0) {
+		return(-1);
+	}
+
+	/*
+	 * Edits are synced in groups: the first edit after a sync starts the
+	 * clock and everything that comes in until it runs out is synced at once.
+	 */
+	elapsed = _elapsed_ms(&journal->first_unsynced);
+
+	if(elapsed >= config.journal_interval) {
+		return(0);
+	}
+
+	return((int)(config.journal_interval - elapsed));
+}
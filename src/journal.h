@@ -0,0 +1,21 @@
+#ifndef E_JOURNAL_H
+#define E_JOURNAL_H
+
+#include <stddef.h>
+
+struct journal;
+struct buffer;
+
+int journal_open(struct journal **journal, const char *path);
+int journal_close(struct journal **journal);
+int journal_discard(struct journal **journal);
+
+int journal_replay(struct journal *journal, struct buffer *buffer);
+int journal_record(struct journal *journal, const size_t offset, const size_t len,
+		   const char *data, const size_t data_len);
+int journal_flush(struct journal *journal);
+int journal_sync(struct journal *journal);
+int journal_reset(struct journal *journal);
+int journal_get_timeout(struct journal *journal);
+
+#endif /* E_JOURNAL_H */
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include "buffer.h"
+#include "journal.h"
+
+#define DEFAULT_EDITS     100000
+#define DEFAULT_FILE_SIZE (4 * 1024 * 1024)
+
+static double _now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return(now.tv_sec + now.tv_nsec / 1e9);
+}
+
+static int _make_file(const char *path, const size_t size)
+{
+	FILE *file;
+	size_t i;
+
+	if(!(file = fopen(path, "w"))) {
+		return(-errno);
+	}
+
+	for(i = 0; i < size; i++) {
+		fputc(i % 72 == 71 ? '\n' : 'a' + i % 26, file);
+	}
+
+	fclose(file);
+	return(0);
+}
+
+/*
+ * Simulate a user typing: mostly single characters at a cursor, with the
+ * occasional backspace and a jump to a different place every now and then.
+ */
+static int _record_edits(struct buffer *buffer, const int edits)
+{
+	size_t cursor;
+	int i;
+
+	srand(1);
+	cursor = buffer_get_size(buffer) / 2;
+
+	for(i = 0; i < edits; i++) {
+		char chr;
+		int err;
+
+		if(i % 200 == 0) {
+			cursor = rand() % buffer_get_size(buffer);
+		}
+
+		if(rand() % 10 == 0 && cursor > 0) {
+			err = buffer_splice(buffer, --cursor, 1, NULL, 0);
+		} else {
+			chr = rand() % 16 == 0 ? '\n' : 'A' + rand() % 26;
+			err = buffer_splice(buffer, cursor++, 0, &chr, 1);
+		}
+
+		if(err < 0) {
+			return(err);
+		}
+	}
+
+	return(0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct journal *journal;
+	struct buffer *expected;
+	struct buffer *buffer;
+	const char *path;
+	double start;
+	double record_time;
+	double sync_time;
+	double replay_time;
+	int edits;
+	int err;
+
+	path = argc > 1 ? argv[1] : "journal_bench.txt";
+	edits = argc > 2 ? atoi(argv[2]) : DEFAULT_EDITS;
+
+	if((err = _make_file(path, DEFAULT_FILE_SIZE)) < 0 ||
+	   (err = buffer_open(&expected, path, 0)) < 0 ||
+	   (err = journal_open(&journal, path)) < 0) {
+		fprintf(stderr, "setup: %s\n", strerror(-err));
+		return(1);
+	}
+
+	buffer_set_journal(expected, journal);
+
+	start = _now();
+	err = _record_edits(expected, edits);
+	record_time = _now() - start;
+
+	start = _now();
+	journal_close(&journal);
+	sync_time = _now() - start;
+
+	if(err < 0) {
+		fprintf(stderr, "record: %s\n", strerror(-err));
+		return(1);
+	}
+
+	/* this is what editor_open() does after a crash */
+	if((err = buffer_open(&buffer, path, 0)) < 0 ||
+	   (err = journal_open(&journal, path)) < 0) {
+		fprintf(stderr, "reopen: %s\n", strerror(-err));
+		return(1);
+	}
+
+	start = _now();
+	err = journal_replay(journal, buffer);
+	replay_time = _now() - start;
+
+	if(err != edits) {
+		fprintf(stderr, "replayed %d of %d edits\n", err, edits);
+	}
+
+	if(buffer_get_size(buffer) != buffer_get_size(expected) ||
+	   memcmp(buffer_get_data(buffer), buffer_get_data(expected),
+		  buffer_get_size(expected)) != 0) {
+		fprintf(stderr, "replayed buffer differs from the original\n");
+		err = -EIO;
+	}
+
+	printf("edits:  %d\n", edits);
+	printf("record: %.3f ms (%.0f ns/edit)\n", record_time * 1e3, record_time * 1e9 / edits);
+	printf("sync:   %.3f ms\n", sync_time * 1e3);
+	printf("replay: %.3f ms (%.0f ns/edit)\n", replay_time * 1e3, replay_time * 1e9 / edits);
+
+	journal_discard(&journal);
+	buffer_close(&buffer);
+	buffer_close(&expected);
+	unlink(path);
+
+	return(err < 0 ? 1 : 0);
+}
@@ -0,0 +1,1028 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "json.h"
+#include "buffer.h"
+#include "ui.h"
+
+/* objects and arrays that are at least this long are in the index */
+#define JSON_MIN_SPAN      1024
+/* a row is marked at least every so many bytes */
+#define JSON_MARK_INTERVAL 4096
+#define JSON_INIT_ENTRIES  256
+#define JSON_INDENT        2
+
+#define JSON_FOLDED_OBJECT "{...}"
+#define JSON_FOLDED_ARRAY  "[...]"
+
+typedef enum {
+	JSON_OTHER = 0,
+	JSON_SPACE,
+	JSON_OPEN,
+	JSON_CLOSE,
+	JSON_QUOTE,
+	JSON_COMMA,
+	JSON_COLON
+} json_class_t;
+
+static const unsigned char _json_class[256] = {
+	[' '] = JSON_SPACE,
+	['\t'] = JSON_SPACE,
+	['\n'] = JSON_SPACE,
+	['\r'] = JSON_SPACE,
+	['{'] = JSON_OPEN,
+	['['] = JSON_OPEN,
+	['}'] = JSON_CLOSE,
+	[']'] = JSON_CLOSE,
+	['"'] = JSON_QUOTE,
+	[','] = JSON_COMMA,
+	[':'] = JSON_COLON
+};
+
+#define CLASS(c) (_json_class[(unsigned char)(c)])
+
+struct json_span {
+	size_t open;
+	size_t close;
+};
+
+struct json_spans {
+	struct json_span *spans;
+	int num;
+	int max;
+};
+
+/*
+ * The index is built in a single pass over the buffer that only stops at
+ * structural characters and skips over strings with memchr(). It is kept
+ * sparse: only objects and arrays that are large enough to be worth it are
+ * in it, and a row is marked, together with its depth, every few kilobytes.
+ * Everything else is found by scanning from the closest mark or from the
+ * bracket at hand, which never means looking at more than a few kilobytes
+ * for a row. The index is simply built again when the buffer changes.
+ */
+struct json {
+	struct buffer *buffer;
+	unsigned long generation;
+
+	/* what indexing the buffer failed with, so it isn't tried again */
+	int error;
+
+	/* the large objects and arrays, ordered by where they start and end */
+	struct json_spans by_open;
+	struct json_spans by_close;
+
+	/* the folded objects and arrays, ordered by where they start */
+	struct json_spans folds;
+
+	struct json_row *marks;
+	int num_marks;
+	int max_marks;
+};
+
+int json_new(struct json **json)
+{
+	if(!json) {
+		return(-EINVAL);
+	}
+
+	if(!(*json = calloc(1, sizeof(**json)))) {
+		return(-ENOMEM);
+	}
+
+	return(0);
+}
+
+int json_free(struct json **json)
+{
+	if(!json || !*json) {
+		return(-EINVAL);
+	}
+
+	free((*json)->by_open.spans);
+	free((*json)->by_close.spans);
+	free((*json)->folds.spans);
+	free((*json)->marks);
+	free(*json);
+	*json = NULL;
+
+	return(0);
+}
+
+static int _json_spans_add(struct json_spans *spans, const int at, const size_t open,
+			   const size_t close)
+{
+	if(spans->num == spans->max) {
+		struct json_span *resized;
+		int max;
+
+		max = spans->max ? spans->max * 2 : JSON_INIT_ENTRIES;
+
+		if(!(resized = realloc(spans->spans, max * sizeof(*resized)))) {
+			return(-ENOMEM);
+		}
+
+		spans->spans = resized;
+		spans->max = max;
+	}
+
+	memmove(spans->spans + at + 1, spans->spans + at,
+		(spans->num - at) * sizeof(*spans->spans));
+	spans->spans[at].open = open;
+	spans->spans[at].close = close;
+	spans->num++;
+
+	return(0);
+}
+
+/* the index of the first span that starts (or ends) at `offset' or behind it */
+static int _json_spans_find(const struct json_spans *spans, const size_t offset, const int by_close)
+{
+	int lo;
+	int hi;
+
+	lo = 0;
+	hi = spans->num;
+
+	while(lo < hi) {
+		int mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if((by_close ? spans->spans[mid].close : spans->spans[mid].open) < offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return(lo);
+}
+
+static int _json_add_mark(struct json *json, const size_t offset, const int depth)
+{
+	if(json->num_marks > 0 &&
+	   offset < json->marks[json->num_marks - 1].start + JSON_MARK_INTERVAL) {
+		return(0);
+	}
+
+	if(json->num_marks == json->max_marks) {
+		struct json_row *marks;
+		int max;
+
+		max = json->max_marks ? json->max_marks * 2 : JSON_INIT_ENTRIES;
+
+		if(!(marks = realloc(json->marks, max * sizeof(*marks)))) {
+			return(-ENOMEM);
+		}
+
+		json->marks = marks;
+		json->max_marks = max;
+	}
+
+	json->marks[json->num_marks].start = offset;
+	json->marks[json->num_marks].depth = depth;
+	json->num_marks++;
+
+	return(0);
+}
+
+static size_t _json_skip_space(const char *data, const size_t size, size_t pos)
+{
+	while(pos < size && CLASS(data[pos]) == JSON_SPACE) {
+		pos++;
+	}
+
+	return(pos);
+}
+
+static size_t _json_skip_literal(const char *data, const size_t size, size_t pos)
+{
+	while(pos < size && CLASS(data[pos]) == JSON_OTHER) {
+		pos++;
+	}
+
+	return(pos);
+}
+
+/* the number of backslashes right in front of `pos', but not before `start' */
+static size_t _json_count_escapes(const char *data, const size_t start, const size_t pos)
+{
+	size_t escapes;
+
+	for(escapes = 0; pos - escapes > start && data[pos - escapes - 1] == '\\'; escapes++);
+
+	return(escapes);
+}
+
+/* move `pos' from the quote that opens a string to the byte behind the one that closes it */
+static int _json_skip_string(const char *data, const size_t size, size_t *pos)
+{
+	const char *quote;
+	size_t from;
+
+	for(from = *pos + 1; (quote = memchr(data + from, '"', size - from));
+	    from = quote - data + 1) {
+		if(_json_count_escapes(data, *pos + 1, quote - data) % 2 == 0) {
+			*pos = quote - data + 1;
+			return(0);
+		}
+	}
+
+	return(-EBADMSG);
+}
+
+/*
+ * Find the quote that opens the string that is closed by the quote at
+ * `quote'. Quotes in a string are always escaped, so this is the first
+ * quote in front of it that isn't.
+ */
+static size_t _json_string_start(const char *data, size_t quote)
+{
+	const char *prev;
+
+	while(quote > 0 && (prev = memrchr(data, '"', quote))) {
+		quote = prev - data;
+
+		if(_json_count_escapes(data, 0, quote) % 2 == 0) {
+			return(quote);
+		}
+	}
+
+	return(0);
+}
+
+/* the last byte in front of `pos' that isn't whitespace */
+static int _json_prev_token(const char *data, size_t pos, size_t *prev)
+{
+	while(pos > 0) {
+		if(CLASS(data[--pos]) != JSON_SPACE) {
+			*prev = pos;
+			return(0);
+		}
+	}
+
+	return(-ENOENT);
+}
+
+static int _json_index(struct json *json, const char *data, const size_t size)
+{
+	size_t *stack;
+	size_t pos;
+	int row_expected;
+	int max_depth;
+	int depth;
+	int empty;
+	int err;
+
+	stack = NULL;
+	max_depth = 0;
+	depth = 0;
+	row_expected = 1;
+	empty = 0;
+	err = 0;
+
+	for(pos = 0; pos < size && !err; ) {
+		json_class_t class;
+
+		class = CLASS(data[pos]);
+
+		if(class == JSON_SPACE) {
+			pos++;
+			continue;
+		}
+
+		if(class == JSON_OTHER || class == JSON_QUOTE || class == JSON_OPEN) {
+			if(row_expected && (err = _json_add_mark(json, pos, depth)) < 0) {
+				break;
+			}
+
+			row_expected = 0;
+			empty = 0;
+		}
+
+		switch(class) {
+		case JSON_OPEN:
+			if(depth == max_depth) {
+				size_t *resized;
+
+				max_depth = max_depth ? max_depth * 2 : JSON_INIT_ENTRIES;
+
+				if(!(resized = realloc(stack, max_depth * sizeof(*stack)))) {
+					err = -ENOMEM;
+					break;
+				}
+
+				stack = resized;
+			}
+
+			stack[depth++] = pos++;
+			row_expected = 1;
+			empty = 1;
+			break;
+
+		case JSON_CLOSE:
+			if(depth == 0 || (data[stack[depth - 1]] == '{') != (data[pos] == '}')) {
+				err = -EBADMSG;
+				break;
+			}
+
+			depth--;
+
+			/* empty objects and arrays are closed on the row that opens them */
+			if(!empty && (err = _json_add_mark(json, pos, depth)) < 0) {
+				break;
+			}
+
+			if(pos - stack[depth] >= JSON_MIN_SPAN &&
+			   (err = _json_spans_add(&json->by_close, json->by_close.num,
+						  stack[depth], pos)) < 0) {
+				break;
+			}
+
+			pos++;
+			row_expected = depth == 0;
+			empty = 0;
+			break;
+
+		case JSON_QUOTE:
+			err = _json_skip_string(data, size, &pos);
+			row_expected = depth == 0;
+			break;
+
+		case JSON_COMMA:
+			pos++;
+			row_expected = 1;
+			break;
+
+		case JSON_COLON:
+			pos++;
+			break;
+
+		default:
+			pos = _json_skip_literal(data, size, pos);
+			row_expected = depth == 0;
+			break;
+		}
+	}
+
+	free(stack);
+
+	if(!err && depth > 0) {
+		err = -EBADMSG;
+	}
+
+	return(err);
+}
+
+static int _json_compare_open(const void *a, const void *b)
+{
+	const struct json_span *left;
+	const struct json_span *right;
+
+	left = (const struct json_span*)a;
+	right = (const struct json_span*)b;
+
+	return(left->open < right->open ? -1 : left->open > right->open);
+}
+
+/* bring the index up to date with `buffer', which has to hold JSON */
+int json_update(struct json *json, struct buffer *buffer)
+{
+	struct json_spans *by_open;
+	int err;
+
+	if(!json || !buffer) {
+		return(-EINVAL);
+	}
+
+	if(json->buffer == buffer && json->generation == buffer_get_generation(buffer)) {
+		return(json->error);
+	}
+
+	/* the folds would be at the wrong places after an edit */
+	json->by_open.num = 0;
+	json->by_close.num = 0;
+	json->folds.num = 0;
+	json->num_marks = 0;
+	json->buffer = buffer;
+	json->generation = buffer_get_generation(buffer);
+	json->error = 0;
+
+	if((err = _json_index(json, buffer_get_data(buffer), buffer_get_size(buffer))) < 0) {
+		json->num_marks = 0;
+		json->error = err;
+		return(err);
+	}
+
+	by_open = &json->by_open;
+
+	if(by_open->max < json->by_close.num) {
+		struct json_span *spans;
+
+		if(!(spans = realloc(by_open->spans, json->by_close.num * sizeof(*spans)))) {
+			json->num_marks = 0;
+			json->buffer = NULL;
+			return(-ENOMEM);
+		}
+
+		by_open->spans = spans;
+		by_open->max = json->by_close.num;
+	}
+
+	if(json->by_close.num > 0) {
+		memcpy(by_open->spans, json->by_close.spans,
+		       json->by_close.num * sizeof(*by_open->spans));
+		qsort(by_open->spans, json->by_close.num, sizeof(*by_open->spans),
+		      _json_compare_open);
+	}
+
+	by_open->num = json->by_close.num;
+	return(0);
+}
+
+/* find the bracket that closes the object or array opened at `open' */
+static int _json_match(struct json *json, const char *data, const size_t size,
+		       const size_t open, size_t *close)
+{
+	size_t pos;
+	int depth;
+	int i;
+
+	i = _json_spans_find(&json->by_open, open, 0);
+
+	if(i < json->by_open.num && json->by_open.spans[i].open == open) {
+		*close = json->by_open.spans[i].close;
+		return(0);
+	}
+
+	for(pos = open, depth = 0; pos < size; ) {
+		switch(CLASS(data[pos])) {
+		case JSON_OPEN:
+			depth++;
+			pos++;
+			break;
+
+		case JSON_CLOSE:
+			if(--depth == 0) {
+				*close = pos;
+				return(0);
+			}
+
+			pos++;
+			break;
+
+		case JSON_QUOTE:
+			if(_json_skip_string(data, size, &pos) < 0) {
+				return(-EBADMSG);
+			}
+			break;
+
+		default:
+			pos++;
+			break;
+		}
+	}
+
+	return(-EBADMSG);
+}
+
+/* find the bracket that opens the object or array closed at `close' */
+static int _json_match_back(struct json *json, const char *data, const size_t close,
+			    size_t *open)
+{
+	size_t pos;
+	int depth;
+	int i;
+
+	i = _json_spans_find(&json->by_close, close, 1);
+
+	if(i < json->by_close.num && json->by_close.spans[i].close == close) {
+		*open = json->by_close.spans[i].open;
+		return(0);
+	}
+
+	for(pos = close, depth = 0; ; pos--) {
+		switch(CLASS(data[pos])) {
+		case JSON_CLOSE:
+			depth++;
+			break;
+
+		case JSON_OPEN:
+			if(--depth == 0) {
+				*open = pos;
+				return(0);
+			}
+			break;
+
+		case JSON_QUOTE:
+			pos = _json_string_start(data, pos);
+			break;
+
+		default:
+			break;
+		}
+
+		if(pos == 0) {
+			return(-EBADMSG);
+		}
+	}
+}
+
+static int _json_is_folded(struct json *json, const size_t open)
+{
+	int i;
+
+	i = _json_spans_find(&json->folds, open, 0);
+
+	return(i < json->folds.num && json->folds.spans[i].open == open);
+}
+
+/* the value of the row that starts at `start', which is behind the key, if any */
+static size_t _json_row_value(const char *data, const size_t size, const size_t start)
+{
+	size_t pos;
+
+	pos = start;
+
+	if(data[start] != '"' || _json_skip_string(data, size, &pos) < 0) {
+		return(start);
+	}
+
+	pos = _json_skip_space(data, size, pos);
+
+	if(pos < size && data[pos] == ':') {
+		return(_json_skip_space(data, size, pos + 1));
+	}
+
+	return(start);
+}
+
+/* the start of the row of the value at `value', which is where its key is */
+static size_t _json_row_start(const char *data, const size_t value)
+{
+	size_t pos;
+
+	if(_json_prev_token(data, value, &pos) < 0 || data[pos] != ':' ||
+	   _json_prev_token(data, pos, &pos) < 0 || data[pos] != '"') {
+		return(value);
+	}
+
+	return(_json_string_start(data, pos));
+}
+
+/* the byte behind the value at `value', and whether it is the first of an expanded one */
+static int _json_value_end(struct json *json, const char *data, const size_t size,
+			   const size_t value, const int expand, size_t *end)
+{
+	size_t pos;
+	int err;
+
+	if(value >= size) {
+		*end = size;
+		return(0);
+	}
+
+	pos = value;
+
+	switch(CLASS(data[pos])) {
+	case JSON_QUOTE:
+		err = _json_skip_string(data, size, &pos);
+		break;
+
+	case JSON_OPEN:
+		pos = _json_skip_space(data, size, pos + 1);
+
+		if(pos < size && CLASS(data[pos]) == JSON_CLOSE) {
+			pos++;
+			err = 0;
+		} else if(expand && !_json_is_folded(json, value)) {
+			err = 1;
+		} else if(!(err = _json_match(json, data, size, value, &pos))) {
+			pos++;
+		}
+		break;
+
+	default:
+		pos = _json_skip_literal(data, size, pos);
+		err = 0;
+		break;
+	}
+
+	*end = pos;
+	return(err);
+}
+
+/* the start of the row that follows a value or bracket that ends at `end' */
+static size_t _json_skip_comma(const char *data, const size_t size, const size_t end)
+{
+	size_t pos;
+
+	pos = _json_skip_space(data, size, end);
+
+	if(pos < size && data[pos] == ',') {
+		pos = _json_skip_space(data, size, pos + 1);
+	}
+
+	return(pos);
+}
+
+/* move to the next row, stepping into folded objects and arrays if `expand' is 2 */
+static int _json_step(struct json *json, const char *data, const size_t size,
+		      struct json_row *row, const int expand)
+{
+	size_t value;
+	size_t end;
+	size_t pos;
+	int err;
+
+	if(CLASS(data[row->start]) == JSON_CLOSE) {
+		end = row->start + 1;
+	} else {
+		value = _json_row_value(data, size, row->start);
+
+		if(expand == 2 && value < size && CLASS(data[value]) == JSON_OPEN) {
+			pos = _json_skip_space(data, size, value + 1);
+			err = pos < size && CLASS(data[pos]) != JSON_CLOSE;
+			end = err ? pos : pos + 1;
+		} else if((err = _json_value_end(json, data, size, value, expand, &end)) < 0) {
+			return(err);
+		}
+
+		if(err > 0) {
+			row->start = _json_skip_space(data, size, end);
+			row->depth++;
+			return(row->start < size ? 0 : -ENOENT);
+		}
+	}
+
+	pos = _json_skip_comma(data, size, end);
+
+	if(pos >= size) {
+		return(-ENOENT);
+	}
+
+	/* only when the buffer isn't quite JSON */
+	if(pos <= row->start) {
+		return(-EBADMSG);
+	}
+
+	if(CLASS(data[pos]) == JSON_CLOSE) {
+		row->depth--;
+	}
+
+	row->start = pos;
+	return(0);
+}
+
+/* the row that `offset' is on, as if nothing was folded */
+static int _json_find_raw(struct json *json, const char *data, const size_t size,
+			  const size_t offset, struct json_row *row)
+{
+	struct json_row next;
+	int lo;
+	int hi;
+
+	if(json->num_marks == 0) {
+		return(-ENOENT);
+	}
+
+	/* the last mark at or in front of `offset' */
+	lo = 0;
+	hi = json->num_marks - 1;
+
+	while(lo < hi) {
+		int mid;
+
+		mid = hi - (hi - lo) / 2;
+
+		if(json->marks[mid].start <= offset) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	*row = json->marks[lo];
+	next = *row;
+
+	while(_json_step(json, data, size, &next, 2) == 0 && next.start <= offset) {
+		*row = next;
+	}
+
+	return(0);
+}
+
+/* find the row of the pretty-printed view that shows the byte at `offset' */
+int json_find_row(struct json *json, struct buffer *buffer, const size_t offset,
+		  struct json_row *row)
+{
+	const char *data;
+	size_t open;
+	size_t size;
+	int err;
+	int i;
+
+	if(!json || !buffer || !row) {
+		return(-EINVAL);
+	}
+
+	if((err = json_update(json, buffer)) < 0) {
+		return(err);
+	}
+
+	data = buffer_get_data(buffer);
+	size = buffer_get_size(buffer);
+
+	/* the outermost fold around `offset' hides it */
+	for(i = 0; i < json->folds.num && json->folds.spans[i].open <= offset; i++) {
+		if(json->folds.spans[i].close >= offset) {
+			return(_json_find_raw(json, data, size, json->folds.spans[i].open, row));
+		}
+	}
+
+	if((err = _json_find_raw(json, data, size, offset, row)) < 0) {
+		return(err);
+	}
+
+	/* behind a folded one, but still on the row of its closing bracket */
+	if(CLASS(data[row->start]) == JSON_CLOSE &&
+	   _json_match_back(json, data, row->start, &open) == 0 && _json_is_folded(json, open)) {
+		return(_json_find_raw(json, data, size, open, row));
+	}
+
+	return(0);
+}
+
+int json_next_row(struct json *json, struct buffer *buffer, struct json_row *row)
+{
+	struct json_row next;
+	int err;
+
+	if(!json || !buffer || !row) {
+		return(-EINVAL);
+	}
+
+	if((err = json_update(json, buffer)) < 0) {
+		return(err);
+	}
+
+	next = *row;
+
+	if((err = _json_step(json, buffer_get_data(buffer), buffer_get_size(buffer),
+			     &next, 1)) < 0) {
+		return(err);
+	}
+
+	*row = next;
+	return(0);
+}
+
+int json_prev_row(struct json *json, struct buffer *buffer, struct json_row *row)
+{
+	const char *data;
+	size_t open;
+	size_t pos;
+	size_t end;
+	int depth;
+	int err;
+
+	if(!json || !buffer || !row) {
+		return(-EINVAL);
+	}
+
+	if((err = json_update(json, buffer)) < 0) {
+		return(err);
+	}
+
+	data = buffer_get_data(buffer);
+
+	if(_json_prev_token(data, row->start, &pos) < 0) {
+		return(-ENOENT);
+	}
+
+	/* the first member of an object, or element of an array */
+	if(CLASS(data[pos]) == JSON_OPEN) {
+		row->start = _json_row_start(data, pos);
+		row->depth--;
+		return(0);
+	}
+
+	depth = CLASS(data[row->start]) == JSON_CLOSE ? row->depth + 1 : row->depth;
+
+	if(data[pos] == ',' && _json_prev_token(data, pos, &pos) < 0) {
+		return(-ENOENT);
+	}
+
+	/* `pos' is the last byte of the value in front */
+	switch(CLASS(data[pos])) {
+	case JSON_CLOSE:
+		if((err = _json_match_back(json, data, pos, &open)) < 0) {
+			return(err);
+		}
+
+		end = _json_skip_space(data, pos, open + 1);
+
+		if(end < pos && !_json_is_folded(json, open)) {
+			row->start = pos;
+		} else {
+			row->start = _json_row_start(data, open);
+		}
+		break;
+
+	case JSON_QUOTE:
+		row->start = _json_row_start(data, _json_string_start(data, pos));
+		break;
+
+	default:
+		while(pos > 0 && CLASS(data[pos - 1]) == JSON_OTHER) {
+			pos--;
+		}
+
+		row->start = _json_row_start(data, pos);
+		break;
+	}
+
+	row->depth = depth;
+	return(0);
+}
+
+struct json_writer {
+	char *chars;
+	unsigned char *colors;
+	int width;
+	int x;
+};
+
+static void _json_put(struct json_writer *writer, const char *str, const size_t len,
+		      const ui_color_t color)
+{
+	size_t i;
+
+	for(i = 0; i < len && writer->x < writer->width; i++, writer->x++) {
+		writer->chars[writer->x] = UI_CELL_CHAR(str[i]);
+		writer->colors[writer->x] = color;
+	}
+}
+
+/*
+ * Format a row into `width' cells. Only as much of the row as fits is
+ * looked at, except that the end of its value has to be found to tell if
+ * a comma follows it.
+ */
+int json_format_row(struct json *json, struct buffer *buffer, const struct json_row *row,
+		    char *chars, unsigned char *colors, const int width)
+{
+	struct json_writer writer;
+	const char *data;
+	size_t value;
+	size_t size;
+	size_t end;
+	size_t len;
+	int depth;
+	int err;
+
+	if(!json || !buffer || !row || !chars || !colors || width < 0) {
+		return(-EINVAL);
+	}
+
+	if((err = json_update(json, buffer)) < 0) {
+		return(err);
+	}
+
+	data = buffer_get_data(buffer);
+	size = buffer_get_size(buffer);
+
+	if(row->start >= size) {
+		return(-ERANGE);
+	}
+
+	writer.chars = chars;
+	writer.colors = colors;
+	writer.width = width;
+	writer.x = 0;
+
+	for(depth = 0; depth < row->depth; depth++) {
+		_json_put(&writer, "        ", JSON_INDENT, UI_COLOR_NORMAL);
+	}
+
+	if(CLASS(data[row->start]) == JSON_CLOSE) {
+		_json_put(&writer, data + row->start, 1, UI_COLOR_NORMAL);
+		end = row->start + 1;
+	} else {
+		value = _json_row_value(data, size, row->start);
+
+		if(value != row->start) {
+			end = row->start;
+			_json_skip_string(data, size, &end);
+			_json_put(&writer, data + row->start, end - row->start, UI_COLOR_KEYWORD);
+			_json_put(&writer, ": ", 2, UI_COLOR_NORMAL);
+		}
+
+		if((err = _json_value_end(json, data, size, value, 1, &end)) < 0) {
+			return(err);
+		}
+
+		len = end - value;
+
+		if(err > 0) {
+			/* the members follow on rows of their own */
+			_json_put(&writer, data + value, 1, UI_COLOR_NORMAL);
+			return(writer.x);
+		} else if(value < size && CLASS(data[value]) == JSON_OPEN) {
+			if(_json_is_folded(json, value)) {
+				_json_put(&writer, data[value] == '{' ? JSON_FOLDED_OBJECT : JSON_FOLDED_ARRAY,
+					  sizeof(JSON_FOLDED_OBJECT) - 1, UI_COLOR_LINES);
+			} else {
+				_json_put(&writer, data + value, 1, UI_COLOR_NORMAL);
+				_json_put(&writer, data + end - 1, 1, UI_COLOR_NORMAL);
+			}
+		} else if(value < size) {
+			_json_put(&writer, data + value, len,
+				  data[value] == '"' ? UI_COLOR_STRING : UI_COLOR_NUMBER);
+		}
+	}
+
+	end = _json_skip_space(data, size, end);
+
+	if(end < size && data[end] == ',') {
+		_json_put(&writer, ",", 1, UI_COLOR_NORMAL);
+	}
+
+	return(writer.x);
+}
+
+/*
+ * Fold the object or array on the row at `offset', or unfold it if it is
+ * folded. On a row that doesn't open one, the one that it is in is folded.
+ */
+int json_toggle(struct json *json, struct buffer *buffer, const size_t offset)
+{
+	struct json_row row;
+	const char *data;
+	size_t value;
+	size_t close;
+	size_t size;
+	size_t pos;
+	int depth;
+	int err;
+	int i;
+
+	if(!json || !buffer) {
+		return(-EINVAL);
+	}
+
+	if((err = json_find_row(json, buffer, offset, &row)) < 0) {
+		return(err);
+	}
+
+	data = buffer_get_data(buffer);
+	size = buffer_get_size(buffer);
+
+	if(CLASS(data[row.start]) == JSON_CLOSE) {
+		if((err = _json_match_back(json, data, row.start, &value)) < 0) {
+			return(err);
+		}
+	} else {
+		value = _json_row_value(data, size, row.start);
+	}
+
+	if(value < size && CLASS(data[value]) == JSON_OPEN && _json_is_folded(json, value)) {
+		i = _json_spans_find(&json->folds, value, 0);
+		json->folds.num--;
+		memmove(json->folds.spans + i, json->folds.spans + i + 1,
+			(json->folds.num - i) * sizeof(*json->folds.spans));
+		return(0);
+	}
+
+	/* there is nothing to fold in empty ones */
+	if(value < size && CLASS(data[value]) == JSON_OPEN) {
+		pos = _json_skip_space(data, size, value + 1);
+
+		if(pos >= size || CLASS(data[pos]) == JSON_CLOSE) {
+			value = size;
+		}
+	} else {
+		value = size;
+	}
+
+	/* the row that opens the object or array around the row */
+	for(depth = row.depth; value == size && row.depth >= depth; ) {
+		if(json_prev_row(json, buffer, &row) < 0) {
+			return(-ENOTDIR);
+		}
+
+		if(row.depth < depth) {
+			value = _json_row_value(data, size, row.start);
+		}
+	}
+
+	i = _json_spans_find(&json->folds, value, 0);
+
+	if((err = _json_match(json, data, size, value, &close)) < 0) {
+		return(err);
+	}
+
+	return(_json_spans_add(&json->folds, i, value, close));
+}
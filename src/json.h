@@ -0,0 +1,35 @@
+#ifndef E_JSON_H
+#define E_JSON_H
+
+#include <stddef.h>
+
+struct buffer;
+struct json;
+
+/*
+ * A row of the pretty-printed view. It starts with the key of a member,
+ * with a value, or with the bracket that closes an object or array.
+ */
+struct json_row {
+	size_t start;
+	int depth;
+};
+
+/*
+ * The structure of a JSON buffer, for showing it pretty-printed with
+ * objects and arrays that can be folded. The pretty-printed text is never
+ * made; rows are formatted straight from the buffer when they are shown.
+ */
+int json_new(struct json **json);
+int json_free(struct json **json);
+
+int json_update(struct json *json, struct buffer *buffer);
+int json_find_row(struct json *json, struct buffer *buffer, const size_t offset,
+		  struct json_row *row);
+int json_next_row(struct json *json, struct buffer *buffer, struct json_row *row);
+int json_prev_row(struct json *json, struct buffer *buffer, struct json_row *row);
+int json_format_row(struct json *json, struct buffer *buffer, const struct json_row *row,
+		    char *chars, unsigned char *colors, const int width);
+int json_toggle(struct json *json, struct buffer *buffer, const size_t offset);
+
+#endif /* E_JSON_H */
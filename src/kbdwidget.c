@@ -20,6 +20,8 @@ static int _kbd_handler_pgdn(struct kbd_widget *kbd, const int event);
 static int _kbd_handler_ins(struct kbd_widget *kbd, const int event);
 static int _kbd_handler_del(struct kbd_widget *kbd, const int event);
 static int _kbd_handler_fn(struct kbd_widget *kbd, const int event);
+static int _kbd_handler_fn_csi(struct kbd_widget *kbd, const int event);
+static int _kbd_handler_fn_end(struct kbd_widget *kbd, const int event);
 
 static int _kbd_handler_single(struct kbd_widget *kbd, const int event)
 {
@@ -145,7 +147,7 @@ static int _kbd_handler_triple(struct kbd_widget *kbd, const int event)
 		next_handler = _kbd_handler_pgdn;
 		break;
 
-	case 50: /* Ins */
+	case 50: /* Ins, F9 to F12 */
 		next_handler = _kbd_handler_ins;
 		break;
 
@@ -153,6 +155,10 @@ static int _kbd_handler_triple(struct kbd_widget *kbd, const int event)
 		next_handler = _kbd_handler_del;
 		break;
 
+	case 49: /* F5 to F8 */
+		next_handler = _kbd_handler_fn_csi;
+		break;
+
 	default:
 		break;
 	}
@@ -180,11 +186,33 @@ static int _kbd_handler_pgdn(struct kbd_widget *kbd, const int event)
 	return event == 126 ? 0 : -EINVAL;
 }
 
+/* Ins is ESC [ 2 ~, and F9 to F12 start the same way */
 static int _kbd_handler_ins(struct kbd_widget *kbd, const int event)
 {
-	kbd->_key_handler = _kbd_handler_single;
+	int err;
 
-	return event == 126 ? 0 : -EINVAL;
+	err = 0;
+
+	switch (event) {
+	case 48: /* F9 */
+	case 49: /* F10 */
+		kbd->_pending_key = KEYCODE_F9 + event - 48;
+		kbd->_key_handler = _kbd_handler_fn_end;
+		break;
+
+	case 51: /* F11 */
+	case 52: /* F12 */
+		kbd->_pending_key = KEYCODE_F11 + event - 51;
+		kbd->_key_handler = _kbd_handler_fn_end;
+		break;
+
+	default:
+		kbd->_key_handler = _kbd_handler_single;
+		err = event == 126 ? 0 : -EINVAL;
+		break;
+	}
+
+	return err;
 }
 
 static int _kbd_handler_del(struct kbd_widget *kbd, const int event)
@@ -232,6 +260,50 @@ static int _kbd_handler_fn(struct kbd_widget *kbd, const int event)
 	return err;
 }
 
+static int _kbd_handler_fn_csi(struct kbd_widget *kbd, const int event)
+{
+	int err;
+
+	err = 0;
+
+	switch (event) {
+	case 53: /* F5 */
+		kbd->_pending_key = KEYCODE_F5;
+		kbd->_key_handler = _kbd_handler_fn_end;
+		break;
+
+	case 55: /* F6 */
+	case 56: /* F7 */
+	case 57: /* F8 */
+		kbd->_pending_key = KEYCODE_F6 + event - 55;
+		kbd->_key_handler = _kbd_handler_fn_end;
+		break;
+
+	default:
+		kbd->_key_handler = _kbd_handler_single;
+		err = -EINVAL;
+		break;
+	}
+
+	return err;
+}
+
+static int _kbd_handler_fn_end(struct kbd_widget *kbd, const int event)
+{
+	struct key_event key;
+
+	kbd->_key_handler = _kbd_handler_single;
+
+	if (event != 126) {
+		return -EINVAL;
+	}
+
+	key.keycode = kbd->_pending_key;
+	key.modifier = KEYMOD_NONE;
+
+	return widget_emit_signal((struct widget*)kbd, "key_pressed", &key);
+}
+
 static int _kbd_widget_input(struct kbd_widget *kbd, const int event)
 {
 	if (!kbd) {
@@ -46,6 +46,7 @@ struct kbd_widget {
 	struct widget _parent;
 
 	int (*_key_handler)(struct kbd_widget*, const int);
+	int _pending_key;
 };
 
 int kbd_widget_init(struct kbd_widget *kbd);
@@ -0,0 +1,686 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "layout.h"
+#include "buffer.h"
+#include "config.h"
+
+#define LAYOUT_INIT_ROWS 4
+
+/*
+ * The layout cache remembers where lines wrap and how their tabs expand.
+ * Entries are identified by the offset and length of the line they
+ * describe, and they are only valid for the generation of the buffer
+ * they were computed for. When the buffer changes, each entry is moved
+ * along with the edits that happened in front of it, and only entries of
+ * lines whose contents were touched are dropped, so an edit costs a new
+ * layout for the lines it affects and nothing else.
+ */
+struct layout_entry {
+	size_t offset;
+	size_t len;
+	unsigned long used;
+	struct layout_line line;
+};
+
+/*
+ * Views of the same buffer that lay it out alike can share a layout, so
+ * each of them holds a reference. Every view brings the cache up to date
+ * once per frame, so with `refs' views, entries that were used within the
+ * last `refs' updates are still in use.
+ */
+struct layout {
+	int refs;
+	int width;
+	int tab_width;
+	int wrap;
+
+	struct buffer *buffer;
+	unsigned long generation;
+	unsigned long frame;
+
+	struct layout_entry *entries;
+	size_t num_entries;
+	size_t max_entries;
+
+	/* open addressing, holds entry index + 1, or 0 if the slot is free */
+	size_t *table;
+	size_t table_size;
+
+	/* for lines that don't fit into the cache */
+	struct layout_entry scratch;
+
+	/* folded lines take a single row, whatever is in them */
+	struct layout_line fold;
+};
+
+static size_t _layout_hash(const size_t offset)
+{
+	return(offset * 0x9e3779b97f4a7c15ULL);
+}
+
+static void _layout_line_clear(struct layout_line *line)
+{
+	free(line->rows);
+	memset(line, 0, sizeof(*line));
+}
+
+int layout_new(struct layout **layout)
+{
+	struct layout *lay;
+
+	if(!layout) {
+		return(-EINVAL);
+	}
+
+	if(!(lay = calloc(1, sizeof(*lay)))) {
+		return(-ENOMEM);
+	}
+
+	lay->max_entries = config.layout_cache_lines > 0 ? config.layout_cache_lines : 1;
+
+	for(lay->table_size = 1; lay->table_size < lay->max_entries * 2; lay->table_size <<= 1);
+
+	lay->entries = calloc(lay->max_entries, sizeof(*lay->entries));
+	lay->table = calloc(lay->table_size, sizeof(*lay->table));
+
+	if(!lay->entries || !lay->table) {
+		free(lay->entries);
+		free(lay->table);
+		free(lay);
+		return(-ENOMEM);
+	}
+
+	lay->refs = 1;
+	lay->width = 1;
+	lay->tab_width = 1;
+	lay->wrap = 1;
+
+	*layout = lay;
+	return(0);
+}
+
+static void _layout_flush(struct layout *layout)
+{
+	size_t i;
+
+	for(i = 0; i < layout->num_entries; i++) {
+		_layout_line_clear(&layout->entries[i].line);
+	}
+
+	layout->num_entries = 0;
+	memset(layout->table, 0, layout->table_size * sizeof(*layout->table));
+}
+
+int layout_ref(struct layout *layout)
+{
+	if(!layout) {
+		return(-EINVAL);
+	}
+
+	layout->refs++;
+	return(0);
+}
+
+int layout_get_refs(struct layout *layout)
+{
+	return(layout ? layout->refs : 0);
+}
+
+/* drop a reference, and free the layout if it was the last one */
+int layout_free(struct layout **layout)
+{
+	if(!layout || !*layout) {
+		return(-EINVAL);
+	}
+
+	if(--(*layout)->refs > 0) {
+		*layout = NULL;
+		return(0);
+	}
+
+	_layout_flush(*layout);
+	_layout_line_clear(&(*layout)->scratch.line);
+	free((*layout)->entries);
+	free((*layout)->table);
+	free(*layout);
+	*layout = NULL;
+
+	return(0);
+}
+
+/* whether the layout already lays out lines for these settings */
+int layout_is_configured(struct layout *layout, const int width, const int tab_width,
+			 const int wrap)
+{
+	if(!layout) {
+		return(0);
+	}
+
+	return((width > 0 ? width : 1) == layout->width &&
+	       (tab_width > 0 ? tab_width : 1) == layout->tab_width &&
+	       !wrap == !layout->wrap);
+}
+
+int layout_configure(struct layout *layout, const int width, const int tab_width,
+		     const int wrap)
+{
+	if(!layout) {
+		return(-EINVAL);
+	}
+
+	if(!layout_is_configured(layout, width, tab_width, wrap)) {
+		_layout_flush(layout);
+		layout->width = width > 0 ? width : 1;
+		layout->tab_width = tab_width > 0 ? tab_width : 1;
+		layout->wrap = wrap;
+	}
+
+	return(0);
+}
+
+static void _layout_insert_hash(struct layout *layout, const size_t index)
+{
+	size_t mask;
+	size_t slot;
+
+	mask = layout->table_size - 1;
+
+	for(slot = _layout_hash(layout->entries[index].offset) & mask;
+	    layout->table[slot];
+	    slot = (slot + 1) & mask);
+
+	layout->table[slot] = index + 1;
+}
+
+static void _layout_rehash(struct layout *layout)
+{
+	size_t i;
+
+	memset(layout->table, 0, layout->table_size * sizeof(*layout->table));
+
+	for(i = 0; i < layout->num_entries; i++) {
+		_layout_insert_hash(layout, i);
+	}
+}
+
+/*
+ * Drop the entries that `keep' returns false for, and fill the holes with
+ * entries from the end of the array.
+ */
+static void _layout_compact(struct layout *layout,
+			    int (*keep)(struct layout*, struct layout_entry*))
+{
+	size_t i;
+
+	for(i = 0; i < layout->num_entries; ) {
+		if(keep(layout, &layout->entries[i])) {
+			i++;
+			continue;
+		}
+
+		_layout_line_clear(&layout->entries[i].line);
+		layout->entries[i] = layout->entries[--layout->num_entries];
+		memset(&layout->entries[layout->num_entries], 0, sizeof(*layout->entries));
+	}
+
+	_layout_rehash(layout);
+}
+
+static int _layout_follow_edits(struct layout *layout, struct layout_entry *entry)
+{
+	return(buffer_map_range(layout->buffer, layout->generation,
+				entry->offset, entry->len, &entry->offset) == 0);
+}
+
+static int _layout_used_recently(struct layout *layout, struct layout_entry *entry)
+{
+	return(entry->used + layout->refs >= layout->frame);
+}
+
+/*
+ * Bring the cache up to date with the buffer. This should be called once
+ * before the lines of a frame are looked up.
+ */
+int layout_update(struct layout *layout, struct buffer *buffer)
+{
+	unsigned long generation;
+
+	if(!layout || !buffer) {
+		return(-EINVAL);
+	}
+
+	generation = buffer_get_generation(buffer);
+	layout->frame++;
+
+	if(buffer != layout->buffer) {
+		_layout_flush(layout);
+	} else if(generation != layout->generation) {
+		_layout_compact(layout, _layout_follow_edits);
+	}
+
+	layout->buffer = buffer;
+	layout->generation = generation;
+
+	return(0);
+}
+
+static int _layout_add_row(struct layout_line *line, int *max_rows,
+			   const size_t offset, const int indent)
+{
+	struct layout_row *row;
+
+	if(line->num_rows == *max_rows) {
+		struct layout_row *rows;
+		int new_max;
+
+		new_max = *max_rows ? *max_rows * 2 : LAYOUT_INIT_ROWS;
+
+		if(!(rows = realloc(line->rows, new_max * sizeof(*rows)))) {
+			return(-ENOMEM);
+		}
+
+		line->rows = rows;
+		*max_rows = new_max;
+	}
+
+	row = &line->rows[line->num_rows++];
+	row->offset = offset;
+	row->indent = indent;
+	row->width = indent;
+
+	return(0);
+}
+
+/*
+ * Lay out a line without looking at anything but its last byte, so that
+ * the cost doesn't depend on the length of the line. When wrapping, rows
+ * are full when they have `width' bytes, and the newline gets a row of its
+ * own if the last row is full. Otherwise, a line is a single row.
+ */
+static void _layout_compute_fixed(struct layout *layout, const char *data, const size_t len,
+				  struct layout_line *line)
+{
+	size_t chars;
+
+	line->plain = 0;
+
+	if(!layout->wrap) {
+		line->num_rows = 1;
+		line->stride = len > 0 ? len : 1;
+		return;
+	}
+
+	chars = len > 0 && data[len - 1] == '\n' ? len - 1 : len;
+	line->stride = layout->width;
+	line->num_rows = chars > 0 ? (chars + layout->width - 1) / layout->width : 1;
+
+	if(chars > 0 && chars < len && chars % layout->width == 0) {
+		line->num_rows++;
+	}
+}
+
+/*
+ * Lay out a line the same way it is drawn: a row is full when it has
+ * `width' columns, and tabs advance to the next tab stop counted from the
+ * start of the row. A character that doesn't fit starts a new row, and
+ * so does the newline if the row is full.
+ */
+static int _layout_compute(struct layout *layout, const char *data, const size_t len,
+			   struct layout_line *line)
+{
+	struct layout_row *row;
+	int max_rows;
+	size_t i;
+	int col;
+
+	_layout_line_clear(line);
+	line->len = len;
+
+	if(!layout->wrap || len > config.layout_long_line) {
+		_layout_compute_fixed(layout, data, len, line);
+		return(0);
+	}
+
+	max_rows = 0;
+	line->plain = 1;
+
+	if(_layout_add_row(line, &max_rows, 0, 0) < 0) {
+		return(-ENOMEM);
+	}
+
+	for(col = 0, i = 0; i < len; i++) {
+		unsigned char chr;
+
+		chr = (unsigned char)data[i];
+
+		if(chr == '\t') {
+			int cols;
+
+			line->plain = 0;
+			cols = layout->tab_width - col % layout->tab_width;
+
+			while(cols > 0) {
+				int step;
+
+				if(col >= layout->width) {
+					if(_layout_add_row(line, &max_rows, i + 1, cols) < 0) {
+						return(-ENOMEM);
+					}
+
+					col = 0;
+				}
+
+				step = cols < layout->width - col ? cols : layout->width - col;
+				col += step;
+				cols -= step;
+				line->rows[line->num_rows - 1].width = col;
+			}
+
+			continue;
+		}
+
+		if(col >= layout->width) {
+			if(_layout_add_row(line, &max_rows, i, 0) < 0) {
+				return(-ENOMEM);
+			}
+
+			col = 0;
+		}
+
+		if(chr == '\n') {
+			break;
+		}
+
+		if(chr < 0x20 || chr >= 0x7f) {
+			line->plain = 0;
+		}
+
+		row = &line->rows[line->num_rows - 1];
+		row->width = ++col;
+	}
+
+	return(0);
+}
+
+static struct layout_entry* _layout_lookup(struct layout *layout, const size_t offset,
+					   const size_t len)
+{
+	size_t mask;
+	size_t slot;
+
+	mask = layout->table_size - 1;
+
+	for(slot = _layout_hash(offset) & mask; layout->table[slot]; slot = (slot + 1) & mask) {
+		struct layout_entry *entry;
+
+		entry = &layout->entries[layout->table[slot] - 1];
+
+		if(entry->offset == offset && entry->len == len) {
+			return(entry);
+		}
+	}
+
+	return(NULL);
+}
+
+static struct layout_entry* _layout_new_entry(struct layout *layout)
+{
+	if(layout->num_entries == layout->max_entries) {
+		_layout_compact(layout, _layout_used_recently);
+
+		/* everything is in use, so this line won't be cached */
+		if(layout->num_entries == layout->max_entries) {
+			return(&layout->scratch);
+		}
+	}
+
+	return(&layout->entries[layout->num_entries++]);
+}
+
+static int _layout_is_fold(struct buffer *buffer, const size_t offset, const size_t len)
+{
+	size_t start;
+	size_t end;
+	int lines;
+
+	return(buffer_get_fold(buffer, offset, &start, &end, &lines) == 0 &&
+	       start == offset && end - start == len);
+}
+
+/*
+ * Like buffer_get_line_range(), except that the lines of a fold are a
+ * single line, so moving across a fold doesn't look at what is in it.
+ */
+static int _layout_get_line_range(struct buffer *buffer, const size_t offset,
+				  int *line, size_t *start, size_t *len)
+{
+	size_t fold_start;
+	size_t fold_end;
+	int lines;
+
+	if(buffer_get_fold(buffer, offset, &fold_start, &fold_end, &lines) < 0) {
+		return(buffer_get_line_range(buffer, offset, line, start, len));
+	}
+
+	*start = fold_start;
+	*len = fold_end - fold_start;
+
+	return(buffer_get_line_range(buffer, fold_start, line, &fold_start, &fold_end));
+}
+
+int layout_get_line(struct layout *layout, struct buffer *buffer,
+		    const size_t offset, const size_t len,
+		    const struct layout_line **line)
+{
+	struct layout_entry *entry;
+	const char *data;
+	int err;
+
+	if(!layout || !buffer || !line) {
+		return(-EINVAL);
+	}
+
+	if(offset > buffer_get_size(buffer) || len > buffer_get_size(buffer) - offset) {
+		return(-ERANGE);
+	}
+
+	if(buffer != layout->buffer || buffer_get_generation(buffer) != layout->generation) {
+		layout_update(layout, buffer);
+	}
+
+	if(_layout_is_fold(buffer, offset, len)) {
+		layout->fold.num_rows = 1;
+		layout->fold.len = len;
+		layout->fold.stride = len;
+		*line = &layout->fold;
+		return(0);
+	}
+
+	if(!(entry = _layout_lookup(layout, offset, len))) {
+		data = buffer_get_data(buffer);
+		entry = _layout_new_entry(layout);
+
+		if((err = _layout_compute(layout, data + offset, len, &entry->line)) < 0) {
+			if(entry != &layout->scratch) {
+				_layout_line_clear(&entry->line);
+				layout->num_entries--;
+			}
+
+			return(err);
+		}
+
+		entry->offset = offset;
+		entry->len = len;
+
+		if(entry != &layout->scratch) {
+			_layout_insert_hash(layout, entry - layout->entries);
+		}
+	}
+
+	entry->used = layout->frame;
+	*line = &entry->line;
+
+	return(0);
+}
+
+int layout_line_get_row(const struct layout_line *line, const int row,
+			struct layout_row *dst)
+{
+	size_t end;
+
+	if(!line || !dst || row < 0 || row >= line->num_rows) {
+		return(-EINVAL);
+	}
+
+	if(!line->stride) {
+		*dst = line->rows[row];
+		return(0);
+	}
+
+	dst->offset = row * line->stride;
+	dst->indent = 0;
+
+	end = dst->offset + line->stride < line->len ? dst->offset + line->stride : line->len;
+
+	if(end > dst->offset && end == line->len) {
+		end--;
+	}
+
+	dst->width = end > dst->offset ? (int)(end - dst->offset) : 0;
+
+	return(0);
+}
+
+/* get the row that shows the byte at `offset' of the line */
+int layout_line_find_row(const struct layout_line *line, const size_t offset)
+{
+	int row;
+
+	if(!line) {
+		return(-EINVAL);
+	}
+
+	if(line->stride) {
+		row = offset / line->stride;
+		return(row < line->num_rows ? row : line->num_rows - 1);
+	}
+
+	for(row = line->num_rows - 1; row > 0 && line->rows[row].offset > offset; row--);
+
+	return(row);
+}
+
+/*
+ * Get the visual row that shows the byte at `offset'. Offsets behind the
+ * last byte are in the last row of the buffer.
+ */
+int layout_get_pos(struct layout *layout, struct buffer *buffer, const size_t offset,
+		   struct layout_pos *pos)
+{
+	const struct layout_line *line;
+	size_t size;
+	size_t off;
+	int err;
+
+	if(!layout || !buffer || !pos) {
+		return(-EINVAL);
+	}
+
+	size = buffer_get_size(buffer);
+
+	if(size == 0) {
+		return(-ENOENT);
+	}
+
+	off = offset < size ? offset : size - 1;
+
+	if((err = _layout_get_line_range(buffer, off, &pos->line, &pos->offset, &pos->len)) < 0 ||
+	   (err = layout_get_line(layout, buffer, pos->offset, pos->len, &line)) < 0) {
+		return(err);
+	}
+
+	pos->row = layout_line_find_row(line, off - pos->offset);
+
+	return(0);
+}
+
+static int _layout_move_down(struct layout *layout, struct buffer *buffer,
+			     struct layout_pos *pos, const int rows)
+{
+	const struct layout_line *line;
+	size_t size;
+	int moved;
+	int err;
+
+	size = buffer_get_size(buffer);
+
+	for(moved = 0; moved < rows; moved++) {
+		if((err = layout_get_line(layout, buffer, pos->offset, pos->len, &line)) < 0) {
+			return(err);
+		}
+
+		if(pos->row + 1 < line->num_rows) {
+			pos->row++;
+			continue;
+		}
+
+		if(pos->offset + pos->len >= size ||
+		   (err = _layout_get_line_range(buffer, pos->offset + pos->len, &pos->line,
+						  &pos->offset, &pos->len)) < 0) {
+			break;
+		}
+
+		pos->row = 0;
+	}
+
+	return(moved);
+}
+
+static int _layout_move_up(struct layout *layout, struct buffer *buffer,
+			   struct layout_pos *pos, const int rows)
+{
+	const struct layout_line *line;
+	int moved;
+	int err;
+
+	for(moved = 0; moved < rows; moved++) {
+		if(pos->row > 0) {
+			pos->row--;
+			continue;
+		}
+
+		if(pos->offset == 0) {
+			break;
+		}
+
+		if((err = _layout_get_line_range(buffer, pos->offset - 1, &pos->line,
+						  &pos->offset, &pos->len)) < 0 ||
+		   (err = layout_get_line(layout, buffer, pos->offset, pos->len, &line)) < 0) {
+			return(err);
+		}
+
+		pos->row = line->num_rows - 1;
+	}
+
+	return(moved);
+}
+
+/*
+ * Move a position by a number of visual rows, up if `rows' is negative.
+ * Returns how many rows the position was moved, which is less than asked
+ * for if it ran into the start or the end of the buffer.
+ */
+int layout_move(struct layout *layout, struct buffer *buffer, struct layout_pos *pos,
+		const int rows)
+{
+	if(!layout || !buffer || !pos) {
+		return(-EINVAL);
+	}
+
+	if(rows < 0) {
+		return(_layout_move_up(layout, buffer, pos, -rows));
+	}
+
+	return(_layout_move_down(layout, buffer, pos, rows));
+}
@@ -0,0 +1,66 @@
+#ifndef E_LAYOUT_H
+#define E_LAYOUT_H
+
+#include <stddef.h>
+
+struct buffer;
+struct layout;
+
+/* where a visual row of a line starts, and how many columns it takes */
+struct layout_row {
+	size_t offset;
+	int indent;
+	int width;
+};
+
+/*
+ * The visual rows of a line. Offsets are relative to the start of the
+ * line. If a tab is split across rows, the row that follows starts with
+ * `indent' columns of the tab. A line is plain if every byte takes
+ * exactly one column.
+ *
+ * Lines that are too long to be laid out character by character, and all
+ * lines if wrapping is turned off, have a `stride' instead: row r starts
+ * at byte r * stride, and every byte takes one column, including tabs.
+ * Their rows are not stored, so use layout_line_get_row() to get them.
+ */
+struct layout_line {
+	int num_rows;
+	int plain;
+	size_t len;
+	size_t stride;
+	struct layout_row *rows;
+};
+
+/* a visual row of the buffer: the row'th row of the line at `offset' */
+struct layout_pos {
+	int line;
+	size_t offset;
+	size_t len;
+	int row;
+};
+
+int layout_new(struct layout **layout);
+int layout_free(struct layout **layout);
+int layout_ref(struct layout *layout);
+int layout_get_refs(struct layout *layout);
+
+int layout_configure(struct layout *layout, const int width, const int tab_width,
+		     const int wrap);
+int layout_is_configured(struct layout *layout, const int width, const int tab_width,
+			 const int wrap);
+int layout_update(struct layout *layout, struct buffer *buffer);
+int layout_get_line(struct layout *layout, struct buffer *buffer,
+		    const size_t offset, const size_t len,
+		    const struct layout_line **line);
+
+int layout_line_get_row(const struct layout_line *line, const int row,
+			struct layout_row *dst);
+int layout_line_find_row(const struct layout_line *line, const size_t offset);
+
+int layout_get_pos(struct layout *layout, struct buffer *buffer, const size_t offset,
+		   struct layout_pos *pos);
+int layout_move(struct layout *layout, struct buffer *buffer, struct layout_pos *pos,
+		const int rows);
+
+#endif /* E_LAYOUT_H */
@@ -0,0 +1,856 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lineindex.h"
+#include "config.h"
+
+#define LINEINDEX_INIT_SIZE     1024
+#define LINEINDEX_MAGIC         "ELIX"
+#define LINEINDEX_VERSION       2
+#define LINEINDEX_SAMPLES       16
+#define LINEINDEX_SAMPLE_SIZE   4096
+#define LINEINDEX_RECENT        64
+#define LINEINDEX_RECENT_DIST   4096
+
+/*
+ * The line index records the offset of every `stride'-th line start, so
+ * sample i is where line i * stride + 1 starts. Lines in between are found
+ * by scanning forward from the closest sample, which costs at most
+ * `stride' lines. If the samples would take more than the configured
+ * amount of memory, every other sample is dropped and the stride doubled.
+ *
+ * The index is built lazily: lookups only scan as far into the data as
+ * they need to, and `scanned' remembers how far we got, with `lines'
+ * being the number of lines that start at or before it. Appending data
+ * to the end of a buffer never invalidates anything and edits only drop
+ * the samples behind the edited offset.
+ *
+ * Positions that were looked up recently are remembered as well, and
+ * lookups start from whichever known position is closest. Scanning from
+ * the sample would otherwise mean walking over every line in between
+ * again, which is expensive if one of them is very long. A remembered
+ * position is either where a line starts, or just somewhere in the line.
+ * Only positions that took a long walk to get to are worth remembering.
+ */
+struct lineindex_pos {
+	size_t line;
+	size_t offset;
+	int start;
+	unsigned long used;
+};
+
+struct lineindex {
+	size_t *samples;
+	size_t num_samples;
+	size_t size;
+	size_t stride;
+
+	size_t lines;
+	size_t scanned;
+
+	struct lineindex_pos recent[LINEINDEX_RECENT];
+	size_t num_recent;
+	unsigned long clock;
+
+	/* if the index was loaded from the cache, `samples' points into `map' */
+	void *map;
+	size_t map_len;
+};
+
+/*
+ * Cached indices are stored as this header followed by the samples
+ * exactly as they are kept in memory, so that a cached index can be
+ * mapped and used without reading or converting anything.
+ */
+struct lineindex_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t word_size;
+	uint32_t reserved;
+	struct lineindex_key key;
+	uint64_t stride;
+	uint64_t lines;
+	uint64_t num_samples;
+};
+
+int lineindex_new(struct lineindex **index)
+{
+	struct lineindex *idx;
+
+	if(!index) {
+		return(-EINVAL);
+	}
+
+	idx = malloc(sizeof(*idx));
+
+	if(!idx) {
+		return(-ENOMEM);
+	}
+
+	memset(idx, 0, sizeof(*idx));
+	idx->samples = malloc(LINEINDEX_INIT_SIZE * sizeof(*idx->samples));
+
+	if(!idx->samples) {
+		free(idx);
+		return(-ENOMEM);
+	}
+
+	/* the first line always starts at offset 0 */
+	idx->samples[0] = 0;
+	idx->num_samples = 1;
+	idx->size = LINEINDEX_INIT_SIZE;
+	idx->stride = config.line_index_stride > 0 ? config.line_index_stride : 1;
+	idx->lines = 1;
+
+	*index = idx;
+	return(0);
+}
+
+int lineindex_free(struct lineindex **index)
+{
+	if(!index || !*index) {
+		return(-EINVAL);
+	}
+
+	if((*index)->map) {
+		munmap((*index)->map, (*index)->map_len);
+	} else {
+		free((*index)->samples);
+	}
+
+	memset(*index, 0, sizeof(**index));
+	free(*index);
+	*index = NULL;
+
+	return(0);
+}
+
+/* forget the recently used lines that start behind `offset' */
+static void _lineindex_forget(struct lineindex *index, const size_t offset)
+{
+	size_t i;
+
+	for(i = 0; i < index->num_recent; ) {
+		if(index->recent[i].offset > offset) {
+			index->recent[i] = index->recent[--index->num_recent];
+		} else {
+			i++;
+		}
+	}
+}
+
+static void _lineindex_remember(struct lineindex *index, const size_t line,
+				const size_t offset, const int start)
+{
+	struct lineindex_pos *pos;
+	size_t i;
+
+	pos = index->recent;
+
+	for(i = 0; i < index->num_recent; i++) {
+		if(index->recent[i].offset == offset) {
+			pos = &index->recent[i];
+			break;
+		}
+
+		if(index->recent[i].used < pos->used) {
+			pos = &index->recent[i];
+		}
+	}
+
+	if(i == index->num_recent && index->num_recent < LINEINDEX_RECENT) {
+		pos = &index->recent[index->num_recent++];
+	}
+
+	pos->line = line;
+	pos->offset = offset;
+	pos->start = start;
+	pos->used = ++index->clock;
+}
+
+/*
+ * Get the closest recently used position behind `pos' that is before
+ * `max_offset' and either in a line before `max_line' or the start of it.
+ */
+static struct lineindex_pos* _lineindex_get_recent(struct lineindex *index,
+						   const struct lineindex_pos *pos,
+						   const size_t max_line,
+						   const size_t max_offset)
+{
+	struct lineindex_pos *best;
+	size_t i;
+
+	best = NULL;
+
+	for(i = 0; i < index->num_recent; i++) {
+		struct lineindex_pos *cur;
+
+		cur = &index->recent[i];
+
+		if(cur->offset > max_offset || cur->line > max_line ||
+		   (cur->line == max_line && !cur->start) ||
+		   cur->offset < (best ? best->offset : pos->offset)) {
+			continue;
+		}
+
+		best = cur;
+	}
+
+	if(best) {
+		best->used = ++index->clock;
+	}
+
+	return(best);
+}
+
+int lineindex_invalidate(struct lineindex *index, const size_t offset)
+{
+	if(!index) {
+		return(-EINVAL);
+	}
+
+	_lineindex_forget(index, offset);
+
+	if(offset >= index->scanned) {
+		return(0);
+	}
+
+	while(index->num_samples > 1 && index->samples[index->num_samples - 1] > offset) {
+		index->num_samples--;
+	}
+
+	/* continue scanning from the last sample that is still valid */
+	index->scanned = index->samples[index->num_samples - 1];
+	index->lines = (index->num_samples - 1) * index->stride + 1;
+
+	return(0);
+}
+
+/* the number of bytes from the start of the data that were indexed */
+size_t lineindex_get_scanned(struct lineindex *index)
+{
+	return(index ? index->scanned : 0);
+}
+
+/*
+ * Move the samples out of the cache mapping, so they can be modified.
+ */
+static int _lineindex_unmap(struct lineindex *index)
+{
+	size_t *samples;
+	size_t size;
+
+	for(size = LINEINDEX_INIT_SIZE; size <= index->num_samples; size *= 2);
+
+	if(!(samples = malloc(size * sizeof(*samples)))) {
+		return(-ENOMEM);
+	}
+
+	memcpy(samples, index->samples, index->num_samples * sizeof(*samples));
+	munmap(index->map, index->map_len);
+
+	index->map = NULL;
+	index->map_len = 0;
+	index->samples = samples;
+	index->size = size;
+
+	return(0);
+}
+
+/*
+ * Drop every other sample and double the stride, halving the memory
+ * that is needed for the index.
+ */
+static void _lineindex_thin_out(struct lineindex *index)
+{
+	size_t i;
+
+	for(i = 0; i * 2 < index->num_samples; i++) {
+		index->samples[i] = index->samples[i * 2];
+	}
+
+	index->num_samples = i;
+	index->stride *= 2;
+
+	/* the last sample may be gone, so the lines behind it need to be rescanned */
+	index->scanned = index->samples[index->num_samples - 1];
+	index->lines = (index->num_samples - 1) * index->stride + 1;
+}
+
+static int _lineindex_add(struct lineindex *index, const size_t start)
+{
+	int err;
+
+	if(index->map && (err = _lineindex_unmap(index)) < 0) {
+		return(err);
+	}
+
+	if(index->num_samples == index->size) {
+		size_t *new_samples;
+		size_t new_size;
+
+		new_size = index->size * 2;
+
+		if(config.line_index_max_size > 0 &&
+		   new_size * sizeof(*new_samples) > config.line_index_max_size) {
+			_lineindex_thin_out(index);
+			return(-EAGAIN);
+		}
+
+		new_samples = realloc(index->samples, new_size * sizeof(*new_samples));
+
+		if(!new_samples) {
+			return(-ENOMEM);
+		}
+
+		index->samples = new_samples;
+		index->size = new_size;
+	}
+
+	index->samples[index->num_samples++] = start;
+	return(0);
+}
+
+/*
+ * Scan the data behind the last scanned position until either `limit' was
+ * reached or the index knows about `lines' lines, whichever comes first.
+ */
+static int _lineindex_scan(struct lineindex *index, const char *data, const size_t size,
+			   const size_t limit, const size_t lines)
+{
+	const char *pos;
+	const char *end;
+
+	end = data + (limit < size ? limit : size);
+	pos = data + index->scanned;
+
+	while(pos < end && index->lines < lines) {
+		const char *newline;
+
+		/* memchr() is vectorized in any libc worth its salt */
+		newline = memchr(pos, '\n', end - pos);
+
+		if(!newline) {
+			pos = end;
+			break;
+		}
+
+		pos = newline + 1;
+		index->lines++;
+
+		if((index->lines - 1) % index->stride == 0) {
+			int err;
+
+			if((err = _lineindex_add(index, pos - data)) == -EAGAIN) {
+				/* the index was thinned out and rewound to its last sample */
+				pos = data + index->scanned;
+				continue;
+			} else if(err < 0) {
+				index->lines--;
+				index->scanned = newline - data;
+				return(err);
+			}
+		}
+	}
+
+	index->scanned = pos - data;
+	return(0);
+}
+
+/*
+ * Starting at the line that starts at `offset', walk `count' lines
+ * forward and return the offset where that line starts.
+ */
+static const char* _lineindex_walk(const char *data, const size_t size,
+				   size_t offset, size_t count)
+{
+	const char *pos;
+	const char *end;
+
+	pos = data + offset;
+	end = data + size;
+
+	while(count-- > 0) {
+		if(!(pos = memchr(pos, '\n', end - pos))) {
+			return(NULL);
+		}
+
+		pos++;
+	}
+
+	return(pos);
+}
+
+int lineindex_get_line(struct lineindex *index, const char *data, const size_t size,
+		       const size_t offset)
+{
+	struct lineindex_pos *recent;
+	struct lineindex_pos start;
+	const char *line_start;
+	const char *pos;
+	const char *end;
+	size_t line;
+	size_t lo;
+	size_t hi;
+	int err;
+
+	if(!index || !data || offset > size) {
+		return(-EINVAL);
+	}
+
+	if(offset > index->scanned &&
+	   (err = _lineindex_scan(index, data, size, offset, (size_t)-1)) < 0) {
+		return(err);
+	}
+
+	/* find the last sample at or before offset */
+	lo = 0;
+	hi = index->num_samples;
+
+	while(hi - lo > 1) {
+		size_t mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if(index->samples[mid] <= offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	start.line = lo * index->stride + 1;
+	start.offset = index->samples[lo];
+	start.start = 1;
+
+	if((recent = _lineindex_get_recent(index, &start, (size_t)-1, offset))) {
+		start = *recent;
+	}
+
+	/* and count the lines between there and offset */
+	line = start.line;
+	line_start = data + start.offset;
+	end = data + offset;
+
+	for(pos = line_start; pos < end && (pos = memchr(pos, '\n', end - pos)); line_start = pos) {
+		pos++;
+		line++;
+		start.start = 1;
+	}
+
+	if(offset - start.offset >= LINEINDEX_RECENT_DIST) {
+		if(line_start != data + start.offset) {
+			_lineindex_remember(index, line, line_start - data, start.start);
+		}
+
+		if(end != line_start) {
+			_lineindex_remember(index, line, offset, 0);
+		}
+	}
+
+	return((int)line);
+}
+
+int lineindex_get_offset(struct lineindex *index, const char *data, const size_t size,
+			 const int line, size_t *offset)
+{
+	struct lineindex_pos *recent;
+	struct lineindex_pos start;
+	const char *pos;
+	size_t sample;
+	int err;
+
+	if(!index || !data || !offset || line < 1) {
+		return(-EINVAL);
+	}
+
+	if((size_t)line > index->lines &&
+	   (err = _lineindex_scan(index, data, size, size, line)) < 0) {
+		return(err);
+	}
+
+	if((size_t)line > index->lines) {
+		return(-ERANGE);
+	}
+
+	sample = (line - 1) / index->stride;
+	start.line = sample * index->stride + 1;
+	start.offset = index->samples[sample];
+	start.start = 1;
+
+	if((recent = _lineindex_get_recent(index, &start, line, size))) {
+		start = *recent;
+	}
+
+	if(!(pos = _lineindex_walk(data, size, start.offset, line - start.line))) {
+		return(-ERANGE);
+	}
+
+	if((size_t)(pos - data) - start.offset >= LINEINDEX_RECENT_DIST) {
+		_lineindex_remember(index, line, pos - data, 1);
+	}
+
+	*offset = pos - data;
+	return(0);
+}
+
+int lineindex_key_init(struct lineindex_key *key, const char *data, const size_t size,
+		       const struct timespec *mtime)
+{
+	uint64_t hash;
+	int sample;
+
+	if(!key || !data || !mtime) {
+		return(-EINVAL);
+	}
+
+	/*
+	 * Hashing everything would cost as much as building the index, so we
+	 * only hash a few blocks spread evenly over the data. Together with
+	 * size and mtime, that is enough to tell if a file was replaced.
+	 */
+	hash = 14695981039346656037ull;
+
+	for(sample = 0; sample < LINEINDEX_SAMPLES; sample++) {
+		size_t offset;
+		size_t len;
+		size_t i;
+
+		offset = size > LINEINDEX_SAMPLE_SIZE ?
+			(size - LINEINDEX_SAMPLE_SIZE) / (LINEINDEX_SAMPLES - 1) * sample : 0;
+		len = size - offset < LINEINDEX_SAMPLE_SIZE ? size - offset : LINEINDEX_SAMPLE_SIZE;
+
+		for(i = 0; i < len; i++) {
+			hash = (hash ^ (unsigned char)data[offset + i]) * 1099511628211ull;
+		}
+	}
+
+	memset(key, 0, sizeof(*key));
+	key->size = size;
+	key->mtime_sec = mtime->tv_sec;
+	key->mtime_nsec = mtime->tv_nsec;
+	key->sample_hash = hash;
+
+	return(0);
+}
+
+static int _lineindex_cache_dir(char *dst, const size_t dst_size)
+{
+	const char *base;
+	const char *suffix;
+	char *pos;
+
+	if((base = getenv("XDG_CACHE_HOME")) && *base) {
+		suffix = "e/lines";
+	} else if((base = getenv("HOME")) && *base) {
+		suffix = ".cache/e/lines";
+	} else {
+		return(-ENOENT);
+	}
+
+	if(snprintf(dst, dst_size, "%s/%s", base, suffix) >= dst_size) {
+		return(-ENAMETOOLONG);
+	}
+
+	/* mkdir -p */
+	for(pos = dst + 1; (pos = strchr(pos, '/')); pos++) {
+		*pos = 0;
+		mkdir(dst, 0700);
+		*pos = '/';
+	}
+
+	if(mkdir(dst, 0700) < 0 && errno != EEXIST) {
+		return(-errno);
+	}
+
+	return(0);
+}
+
+/*
+ * Cache files are named after a hash of the absolute path of the file
+ * they describe, since the path is what the user opens again.
+ */
+static int _lineindex_cache_path(const char *path, char *dst, const size_t dst_size)
+{
+	char *real_path;
+	uint64_t hash;
+	size_t len;
+	char *pos;
+	int err;
+
+	if((err = _lineindex_cache_dir(dst, dst_size)) < 0) {
+		return(err);
+	}
+
+	if(!(real_path = realpath(path, NULL))) {
+		return(-errno);
+	}
+
+	for(hash = 14695981039346656037ull, pos = real_path; *pos; pos++) {
+		hash = (hash ^ (unsigned char)*pos) * 1099511628211ull;
+	}
+
+	free(real_path);
+	len = strlen(dst);
+
+	if(snprintf(dst + len, dst_size - len, "/%016llx", (unsigned long long)hash) >=
+	   dst_size - len) {
+		return(-ENAMETOOLONG);
+	}
+
+	return(0);
+}
+
+struct lineindex_cache_entry {
+	char *name;
+	time_t mtime;
+	off_t size;
+};
+
+static int _lineindex_compare_entries(const void *a, const void *b)
+{
+	const struct lineindex_cache_entry *x;
+	const struct lineindex_cache_entry *y;
+
+	x = (const struct lineindex_cache_entry*)a;
+	y = (const struct lineindex_cache_entry*)b;
+
+	return(x->mtime < y->mtime ? -1 : x->mtime > y->mtime);
+}
+
+/*
+ * Remove cached indices that weren't used for longer than the configured
+ * age, and then the least recently used ones until the rest fits into the
+ * configured size. Loading an index counts as using it.
+ */
+static int _lineindex_prune_cache(void)
+{
+	struct lineindex_cache_entry *entries;
+	char dir_path[PATH_MAX];
+	struct dirent *dirent;
+	size_t num_entries;
+	size_t max_entries;
+	size_t total;
+	time_t now;
+	DIR *dir;
+	size_t i;
+	int err;
+
+	if((err = _lineindex_cache_dir(dir_path, sizeof(dir_path))) < 0) {
+		return(err);
+	}
+
+	if(!(dir = opendir(dir_path))) {
+		return(-errno);
+	}
+
+	entries = NULL;
+	num_entries = 0;
+	max_entries = 0;
+	total = 0;
+	now = time(NULL);
+	err = 0;
+
+	while((dirent = readdir(dir))) {
+		struct stat info;
+
+		if(dirent->d_name[0] == '.' ||
+		   fstatat(dirfd(dir), dirent->d_name, &info, AT_SYMLINK_NOFOLLOW) < 0 ||
+		   !S_ISREG(info.st_mode)) {
+			continue;
+		}
+
+		if(now - info.st_mtime > config.line_index_cache_max_age) {
+			unlinkat(dirfd(dir), dirent->d_name, 0);
+			continue;
+		}
+
+		if(num_entries == max_entries) {
+			struct lineindex_cache_entry *new_entries;
+
+			max_entries = max_entries ? max_entries * 2 : 16;
+
+			if(!(new_entries = realloc(entries, max_entries * sizeof(*entries)))) {
+				err = -ENOMEM;
+				break;
+			}
+
+			entries = new_entries;
+		}
+
+		if(!(entries[num_entries].name = strdup(dirent->d_name))) {
+			err = -ENOMEM;
+			break;
+		}
+
+		entries[num_entries].mtime = info.st_mtime;
+		entries[num_entries].size = info.st_size;
+		total += info.st_size;
+		num_entries++;
+	}
+
+	if(!err) {
+		qsort(entries, num_entries, sizeof(*entries), _lineindex_compare_entries);
+
+		for(i = 0; i < num_entries && total > config.line_index_cache_max_size; i++) {
+			unlinkat(dirfd(dir), entries[i].name, 0);
+			total -= entries[i].size;
+		}
+	}
+
+	for(i = 0; i < num_entries; i++) {
+		free(entries[i].name);
+	}
+
+	free(entries);
+	closedir(dir);
+
+	return(err);
+}
+
+int lineindex_load(struct lineindex *index, const char *path, const struct lineindex_key *key)
+{
+	struct lineindex_header *header;
+	char cache_path[PATH_MAX];
+	struct stat info;
+	void *map;
+	int err;
+	int fd;
+
+	if(!index || !path || !key) {
+		return(-EINVAL);
+	}
+
+	if((err = _lineindex_cache_path(path, cache_path, sizeof(cache_path))) < 0) {
+		return(err);
+	}
+
+	if((fd = open(cache_path, O_RDONLY | O_CLOEXEC)) < 0) {
+		return(-errno);
+	}
+
+	if(fstat(fd, &info) < 0) {
+		err = -errno;
+		close(fd);
+		return(err);
+	}
+
+	if(info.st_size < sizeof(*header)) {
+		close(fd);
+		return(-EBADMSG);
+	}
+
+	map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(map == MAP_FAILED) {
+		return(-errno);
+	}
+
+	header = (struct lineindex_header*)map;
+
+	if(memcmp(header->magic, LINEINDEX_MAGIC, sizeof(header->magic)) != 0 ||
+	   header->version != LINEINDEX_VERSION ||
+	   header->word_size != sizeof(size_t) ||
+	   memcmp(&header->key, key, sizeof(*key)) != 0 ||
+	   header->stride < 1 || header->num_samples < 1 ||
+	   header->lines < (header->num_samples - 1) * header->stride + 1 ||
+	   (info.st_size - sizeof(*header)) / sizeof(size_t) != header->num_samples) {
+		munmap(map, info.st_size);
+		return(-ESTALE);
+	}
+
+	if(index->map) {
+		munmap(index->map, index->map_len);
+	} else {
+		free(index->samples);
+	}
+
+	index->map = map;
+	index->map_len = info.st_size;
+	index->samples = (size_t*)(header + 1);
+	index->num_samples = header->num_samples;
+	index->size = header->num_samples;
+	index->stride = header->stride;
+	index->lines = header->lines;
+	index->scanned = key->size;
+	index->num_recent = 0;
+
+	/* the cache is pruned by when the indices were last used */
+	utimensat(AT_FDCWD, cache_path, NULL, 0);
+
+	return(0);
+}
+
+int lineindex_save(struct lineindex *index, const char *data, const size_t size,
+		   const char *path, const struct lineindex_key *key)
+{
+	struct lineindex_header header;
+	char cache_path[PATH_MAX];
+	char tmp_path[PATH_MAX + 8];
+	ssize_t len;
+	size_t payload;
+	int err;
+	int fd;
+
+	if(!index || !data || !path || !key) {
+		return(-EINVAL);
+	}
+
+	/* only a complete index is of any use to the next reader */
+	if(index->scanned < size &&
+	   (err = _lineindex_scan(index, data, size, size, (size_t)-1)) < 0) {
+		return(err);
+	}
+
+	if((err = _lineindex_cache_path(path, cache_path, sizeof(cache_path))) < 0) {
+		return(err);
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LINEINDEX_MAGIC, sizeof(header.magic));
+	header.version = LINEINDEX_VERSION;
+	header.word_size = sizeof(size_t);
+	header.key = *key;
+	header.stride = index->stride;
+	header.lines = index->lines;
+	header.num_samples = index->num_samples;
+
+	/* write a temporary file first, so readers never see a partial index */
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", cache_path, (int)getpid());
+
+	if((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+		return(-errno);
+	}
+
+	payload = index->num_samples * sizeof(*index->samples);
+	err = 0;
+
+	if((len = write(fd, &header, sizeof(header))) != sizeof(header) ||
+	   (len = write(fd, index->samples, payload)) != payload) {
+		err = len < 0 ? -errno : -EIO;
+	}
+
+	close(fd);
+
+	if(!err && rename(tmp_path, cache_path) < 0) {
+		err = -errno;
+	}
+
+	if(err < 0) {
+		unlink(tmp_path);
+		return(err);
+	}
+
+	_lineindex_prune_cache();
+	return(0);
+}
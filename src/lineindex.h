@@ -0,0 +1,34 @@
+#ifndef E_LINEINDEX_H
+#define E_LINEINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+struct lineindex;
+
+/* identifies the file contents that a cached index was built from */
+struct lineindex_key {
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t sample_hash;
+};
+
+int lineindex_new(struct lineindex **index);
+int lineindex_free(struct lineindex **index);
+
+int lineindex_invalidate(struct lineindex *index, const size_t offset);
+size_t lineindex_get_scanned(struct lineindex *index);
+int lineindex_get_line(struct lineindex *index, const char *data, const size_t size,
+		       const size_t offset);
+int lineindex_get_offset(struct lineindex *index, const char *data, const size_t size,
+			 const int line, size_t *offset);
+
+int lineindex_key_init(struct lineindex_key *key, const char *data, const size_t size,
+		       const struct timespec *mtime);
+int lineindex_load(struct lineindex *index, const char *path, const struct lineindex_key *key);
+int lineindex_save(struct lineindex *index, const char *data, const size_t size,
+		   const char *path, const struct lineindex_key *key);
+
+#endif /* E_LINEINDEX_H */
@@ -5,24 +5,31 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include "editor.h"
+#include "config.h"
 
-#define SHORTOPTS "f:hr"
+#define SHORTOPTS "dfhrst"
 
 static struct option _cmd_opts[] = {
 	{ "debug", no_argument, 0, 'd' },
+	{ "follow", no_argument, 0, 'f' },
 	{ "help", no_argument, 0, 'h' },
 	{ "readonly", no_argument, 0, 'r' },
+	{ "syntax", no_argument, 0, 's' },
+	{ "vt", no_argument, 0, 't' },
 	{ 0, 0, 0, 0 }
 };
 
 static void _print_usage(const char *argv0)
 {
-	printf("Usage: %s [OPTIONS] filename\n"
+	printf("Usage: %s [OPTIONS] filename...\n"
 	       "\n"
 	       "Options:\n"
 	       " -d  --debug         Print debug output to stderr\n"
+	       " -f  --follow        Follow the file as it grows, like tail -f\n"
 	       " -h  --help          Display this help\n"
-	       " -r  --readonly      Open file read-only\n",
+	       " -r  --readonly      Open file read-only\n"
+	       " -s  --syntax        Highlight comments, strings, keywords and numbers\n"
+	       " -t  --vt            Draw with VT100 escape sequences instead of curses\n",
 	       argv0);
 	return;
 }
@@ -54,13 +61,15 @@ static int _disable_debug_output(void)
 int main(int argc, char *argv[])
 {
 	struct editor *editor;
-	const char *filename;
 	int readonly;
+	int follow;
 	int debug;
 	int err;
+	int i;
 
-	filename = NULL;
 	readonly = 0;
+	follow = 0;
+	debug = 0;
 
 	do {
 		err = getopt_long(argc, argv, SHORTOPTS, _cmd_opts, NULL);
@@ -78,6 +87,18 @@ int main(int argc, char *argv[])
 			debug = 1;
 			break;
 
+		case 'f':
+			follow = 1;
+			break;
+
+		case 's':
+			config.syntax = 1;
+			break;
+
+		case 't':
+			config.vt_display = 1;
+			break;
+
 		case '?':
 			fprintf(stderr, "Unrecognized parameter `%s'\n", optarg);
 			return(1);
@@ -97,7 +118,6 @@ int main(int argc, char *argv[])
 		_disable_debug_output();
 	}
 
-	filename = argv[optind];
 	err = editor_new(&editor);
 
 	if(err < 0) {
@@ -105,7 +125,18 @@ int main(int argc, char *argv[])
 		return(1);
 	}
 
-	err = editor_open(editor, filename, readonly);
+	for (i = optind; !err && i < argc; i++) {
+		err = editor_open(editor, argv[i], readonly);
+
+		if(!err && follow) {
+			err = editor_follow(editor);
+		}
+	}
+
+	/* the first file is the one that is shown at first */
+	if(!err && argc - optind > 1) {
+		err = editor_open(editor, argv[optind], readonly);
+	}
 
 	if(!err) {
 		editor_run(editor);
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <ncurses.h>
+#include <telex/telex.h>
+#include "ui.h"
+#include "buffer.h"
+
+#define DEFAULT_FRAMES 2000
+#define DEFAULT_LINES  100000
+#define BENCH_WIDTH    300
+#define BENCH_HEIGHT   100
+
+static double _cpu_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return(now.tv_sec + now.tv_nsec / 1e9);
+}
+
+static int _make_file(const char *path, const int lines)
+{
+	FILE *file;
+	int i;
+
+	if(!(file = fopen(path, "w"))) {
+		return(-errno);
+	}
+
+	for(i = 0; i < lines; i++) {
+		int indent;
+
+		for(indent = i % 4; indent > 0; indent--) {
+			fputc('\t', file);
+		}
+
+		fprintf(file, "if(value_%d > limit) { result = compute(value_%d, %d); }",
+			i, i, i * 7);
+
+		/* every now and then, a line that has to be wrapped */
+		if(i % 13 == 0) {
+			int j;
+
+			for(j = 0; j < 40; j++) {
+				fprintf(file, " /* more text %d */", j);
+			}
+		}
+
+		fputc('\n', file);
+	}
+
+	fclose(file);
+	return(0);
+}
+
+struct result {
+	double time;
+	long bytes;
+	long drawn;
+	long changed;
+};
+
+/*
+ * Curses and the VT display draw into a file, so we can tell how much
+ * they sent. The grid display works out itself what it would have sent.
+ */
+struct bench {
+	struct display *display;
+	FILE *out;
+	double start;
+	struct display_stats stats;
+	long size;
+};
+
+static long _output_size(FILE *out)
+{
+	fflush(out);
+	return(ftell(out));
+}
+
+static void _bench_start(struct bench *bench)
+{
+	display_get_stats(bench->display, &bench->stats);
+	bench->size = bench->out ? _output_size(bench->out) : 0;
+	bench->start = _cpu_time();
+}
+
+static void _bench_stop(struct bench *bench, struct result *result)
+{
+	struct display_stats stats;
+
+	result->time = _cpu_time() - bench->start;
+	display_get_stats(bench->display, &stats);
+
+	result->drawn = stats.drawn - bench->stats.drawn;
+	result->changed = stats.changed - bench->stats.changed;
+
+	if(bench->out) {
+		result->bytes = _output_size(bench->out) - bench->size;
+	} else {
+		result->bytes = stats.bytes - bench->stats.bytes;
+	}
+}
+
+static int _init_curses(struct bench *bench)
+{
+	FILE *out;
+	FILE *in;
+	char size[16];
+
+	if(!(out = tmpfile()) || !(in = fopen("/dev/null", "r"))) {
+		return(-errno);
+	}
+
+	snprintf(size, sizeof(size), "%d", BENCH_HEIGHT);
+	setenv("LINES", size, 1);
+	snprintf(size, sizeof(size), "%d", BENCH_WIDTH);
+	setenv("COLUMNS", size, 1);
+	use_env(TRUE);
+
+	if(!newterm("xterm", out, in) || start_color() == ERR) {
+		return(-EIO);
+	}
+
+	idlok(stdscr, TRUE);
+	bench->out = out;
+
+	return(display_curses_new(&bench->display, stdscr));
+}
+
+static int _init_grid(struct bench *bench)
+{
+	bench->out = NULL;
+	return(display_grid_new(&bench->display, BENCH_WIDTH, BENCH_HEIGHT));
+}
+
+static int _init_vt(struct bench *bench)
+{
+	if(!(bench->out = tmpfile())) {
+		return(-errno);
+	}
+
+	return(display_vt_new(&bench->display, fileno(bench->out),
+			      BENCH_WIDTH, BENCH_HEIGHT));
+}
+
+static int _init_display(struct bench *bench, const char *backend)
+{
+	int err;
+
+	if(strcmp(backend, "curses") == 0) {
+		err = _init_curses(bench);
+	} else if(strcmp(backend, "grid") == 0) {
+		err = _init_grid(bench);
+	} else if(strcmp(backend, "vt") == 0) {
+		err = _init_vt(bench);
+	} else {
+		return(-EINVAL);
+	}
+
+	if(err < 0) {
+		return(err);
+	}
+
+	display_set_colors(bench->display, UI_COLOR_NORMAL, COLOR_BLACK, COLOR_WHITE);
+	display_set_colors(bench->display, UI_COLOR_LINES, COLOR_WHITE, COLOR_BLUE);
+	display_set_colors(bench->display, UI_COLOR_SELECTION, COLOR_WHITE, COLOR_BLUE);
+	display_set_colors(bench->display, UI_COLOR_STATUS, COLOR_BLACK, COLOR_GREEN);
+
+	return(0);
+}
+
+static int _select_line(struct textview *textview, struct telex **selection, const int line)
+{
+	struct telex_error *errors;
+	struct telex *telex;
+	char expr[32];
+	int err;
+
+	snprintf(expr, sizeof(expr), ":%d", line);
+
+	if((err = telex_parse(&telex, expr, &errors)) < 0) {
+		return(err);
+	}
+
+	textview_set_selection_start(textview, telex);
+
+	if(*selection) {
+		telex_free(selection);
+	}
+
+	*selection = telex;
+	return(0);
+}
+
+/* every frame shows different lines, so every row is painted */
+static void _bench_jump(struct textview *textview, struct telex **selection,
+			struct bench *bench, const int frames, struct result *result)
+{
+	int i;
+
+	_bench_start(bench);
+
+	for(i = 0; i < frames; i++) {
+		_select_line(textview, selection, 1000 + (i % 2000) * (BENCH_HEIGHT / 2));
+		display_flush(bench->display);
+	}
+
+	_bench_stop(bench, result);
+}
+
+/* moving the selection line by line scrolls the view by one row */
+static void _bench_scroll(struct textview *textview, struct telex **selection,
+			  struct bench *bench, const int frames, struct result *result)
+{
+	int i;
+
+	_select_line(textview, selection, 20000);
+	display_flush(bench->display);
+
+	_bench_start(bench);
+
+	for(i = 0; i < frames; i++) {
+		_select_line(textview, selection, 20001 + i);
+		display_flush(bench->display);
+	}
+
+	_bench_stop(bench, result);
+}
+
+/* typing into a line only changes the row that the line is on */
+static void _bench_type(struct textview *textview, struct buffer *buffer,
+			struct telex **selection, struct bench *bench, const int frames,
+			struct result *result)
+{
+	const char *data;
+	size_t offset;
+	int i;
+
+	_select_line(textview, selection, 5000);
+	display_flush(bench->display);
+
+	data = buffer_get_data(buffer);
+
+	for(offset = 0, i = 1; i < 5000; offset++) {
+		if(data[offset] == '\n') {
+			i++;
+		}
+	}
+
+	_bench_start(bench);
+
+	for(i = 0; i < frames; i++) {
+		buffer_splice(buffer, offset + 8, 0, "x", 1);
+		widget_redraw((struct widget*)textview);
+		display_flush(bench->display);
+	}
+
+	_bench_stop(bench, result);
+}
+
+static void _bench_idle(struct textview *textview, struct bench *bench, const int frames,
+			struct result *result)
+{
+	int i;
+
+	_bench_start(bench);
+
+	for(i = 0; i < frames; i++) {
+		widget_redraw((struct widget*)textview);
+		display_flush(bench->display);
+	}
+
+	_bench_stop(bench, result);
+}
+
+static void _print_result(const char *name, const struct result *result, const int frames)
+{
+	printf("%-8s %8.1f us/frame %8ld bytes/frame %8ld drawn/frame", name,
+	       result->time * 1e6 / frames, result->bytes / frames,
+	       result->drawn / frames);
+
+	/* curses doesn't tell which cells changed */
+	if(result->changed) {
+		printf(" %8ld changed/frame", result->changed / frames);
+	}
+
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct textview *textview;
+	struct telex *selection;
+	struct buffer *buffer;
+	struct widget *widget;
+	struct bench bench;
+	struct result jump;
+	struct result scroll;
+	struct result type;
+	struct result idle;
+	const char *path;
+	const char *backend;
+	int frames;
+	int err;
+
+	path = argc > 1 ? argv[1] : "render_bench.txt";
+	frames = argc > 2 ? atoi(argv[2]) : DEFAULT_FRAMES;
+	backend = argc > 3 ? argv[3] : "curses";
+	selection = NULL;
+
+	if((err = _init_display(&bench, backend)) == -EINVAL) {
+		fprintf(stderr, "Usage: %s [file] [frames] [curses|grid|vt]\n", argv[0]);
+		return(1);
+	}
+
+	if(err < 0 ||
+	   (err = _make_file(path, DEFAULT_LINES)) < 0 ||
+	   (err = buffer_open(&buffer, path, 0)) < 0 ||
+	   (err = textview_new(&textview)) < 0) {
+		fprintf(stderr, "setup: %s\n", strerror(-err));
+		return(1);
+	}
+
+	widget = (struct widget*)textview;
+	widget->display = bench.display;
+	widget_set_position(widget, 0, 0);
+	widget_set_size(widget, BENCH_WIDTH, BENCH_HEIGHT);
+	widget_resize(widget);
+	textview_set_buffer(textview, buffer);
+
+	_bench_jump(textview, &selection, &bench, frames, &jump);
+	_bench_scroll(textview, &selection, &bench, frames, &scroll);
+	_bench_type(textview, buffer, &selection, &bench, frames, &type);
+	_bench_idle(textview, &bench, frames, &idle);
+
+	widget_free(widget);
+	display_free(&bench.display);
+
+	if(strcmp(backend, "curses") == 0) {
+		endwin();
+	}
+
+	printf("display:  %s\n", backend);
+	printf("terminal: %dx%d\n", BENCH_WIDTH, BENCH_HEIGHT);
+	printf("frames:   %d\n", frames);
+	_print_result("jump", &jump, frames);
+	_print_result("scroll", &scroll, frames);
+	_print_result("type", &type, frames);
+	_print_result("idle", &idle, frames);
+
+	if(selection) {
+		telex_free(&selection);
+	}
+
+	buffer_close(&buffer);
+	unlink(path);
+
+	return(0);
+}
@@ -0,0 +1,1073 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <telex/telex.h>
+#include "ui.h"
+#include "buffer.h"
+#include "display.h"
+#include "filter.h"
+#include "columns.h"
+#include "json.h"
+#include "diff.h"
+#include "journal.h"
+#include "worker.h"
+#include "analysis.h"
+
+#define TEST_WIDTH  40
+#define TEST_HEIGHT 10
+#define TEST_LINES  100
+
+/*
+ * Draws a textview on a grid display and checks what ended up in the
+ * cells, and how many of them had to change from one frame to the next.
+ */
+struct test {
+	const char *path;
+	struct buffer *buffer;
+	struct display *display;
+	struct textview *textview;
+	struct telex *selection;
+	int failures;
+};
+
+#define expect(test, cond) _expect((test), (cond), #cond, __LINE__)
+
+static void _expect(struct test *test, const int cond, const char *what, const int line)
+{
+	if(!cond) {
+		fprintf(stderr, "%s:%d: expected %s\n", __FILE__, line, what);
+		test->failures++;
+	}
+}
+
+static int _make_file(const char *path)
+{
+	FILE *file;
+	int i;
+
+	if(!(file = fopen(path, "w"))) {
+		return(-errno);
+	}
+
+	for(i = 1; i <= TEST_LINES; i++) {
+		if(i == 7) {
+			/* long enough to be wrapped twice */
+			fprintf(file, "line %d %0*d\n", i, TEST_WIDTH * 2, 0);
+		} else {
+			fprintf(file, "line %d\n", i);
+		}
+	}
+
+	fclose(file);
+	return(0);
+}
+
+/* a buffer on a file of its own, next to the file that the tests share */
+static int _open_file(struct test *test, const char *suffix, const char *text,
+		      const int readonly, char *path, const size_t size, struct buffer **buffer)
+{
+	FILE *file;
+	int err;
+
+	snprintf(path, size, "%s.%s", test->path, suffix);
+
+	if(!(file = fopen(path, "w"))) {
+		return(-errno);
+	}
+
+	fputs(text, file);
+	fclose(file);
+
+	if((err = buffer_open(buffer, path, readonly)) < 0) {
+		unlink(path);
+	}
+
+	return(err);
+}
+
+static void _close_file(struct buffer **buffer, const char *path)
+{
+	buffer_close(buffer);
+	unlink(path);
+}
+
+static int _select(struct test *test, const char *expr)
+{
+	struct telex_error *errors;
+	struct telex *telex;
+	int err;
+
+	if((err = telex_parse(&telex, expr, &errors)) < 0) {
+		return(err);
+	}
+
+	textview_set_selection_start(test->textview, telex);
+
+	if(test->selection) {
+		telex_free(&test->selection);
+	}
+
+	test->selection = telex;
+	return(display_flush(test->display));
+}
+
+static int _row_is(struct test *test, const int y, const char *text)
+{
+	char row[TEST_WIDTH + 1];
+	size_t len;
+
+	display_grid_get_row(test->display, y, row, sizeof(row));
+	len = strlen(text);
+
+	/* the rest of the row has to be blank */
+	if(strncmp(row, text, len) == 0 && strspn(row + len, " ") == strlen(row + len)) {
+		return(1);
+	}
+
+	fprintf(stderr, "row %d is `%s'\n", y, row);
+	return(0);
+}
+
+static int _color_at(struct test *test, const int x, const int y)
+{
+	int color;
+
+	display_grid_get_cell(test->display, x, y, NULL, &color);
+	return(color);
+}
+
+/* the line numbers are right-aligned in a column of their own */
+static void _test_contents(struct test *test)
+{
+	_select(test, ":1");
+
+	expect(test, _row_is(test, 0, "  1 line 1"));
+	expect(test, _row_is(test, 1, "  2 line 2"));
+	expect(test, _color_at(test, 0, 0) == UI_COLOR_LINES);
+	expect(test, _color_at(test, 4, 0) == UI_COLOR_SELECTION);
+	expect(test, _color_at(test, 4, 1) == UI_COLOR_NORMAL);
+	expect(test, _row_is(test, TEST_HEIGHT - 1, "Selection [ :1 :  ]"));
+	expect(test, _color_at(test, 0, TEST_HEIGHT - 1) == UI_COLOR_STATUS);
+}
+
+/* every row of a wrapped line is numbered */
+static void _test_wrap(struct test *test)
+{
+	char row[TEST_WIDTH + 1];
+
+	_select(test, ":7");
+
+	display_grid_get_row(test->display, 4, row, sizeof(row));
+	expect(test, strncmp(row, "  7 line 7 000", 14) == 0);
+	expect(test, _color_at(test, 4, 4) == UI_COLOR_SELECTION);
+
+	display_grid_get_row(test->display, 5, row, sizeof(row));
+	expect(test, strspn(row + 4, "0") == TEST_WIDTH - 4);
+	expect(test, _color_at(test, 4, 5) == UI_COLOR_NORMAL);
+
+	expect(test, _row_is(test, 7, "  8 line 8"));
+}
+
+/* a frame that looks like the last one doesn't change any cells */
+static void _test_idle(struct test *test)
+{
+	struct display_stats stats;
+
+	_select(test, ":50");
+	display_reset_stats(test->display);
+
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+	display_get_stats(test->display, &stats);
+
+	expect(test, stats.changed == 0);
+	expect(test, stats.bytes == 0);
+}
+
+/* moving the selection by one line scrolls the rows that stay visible */
+static void _test_scroll(struct test *test)
+{
+	struct display_stats stats;
+
+	_select(test, ":50");
+	display_reset_stats(test->display);
+
+	_select(test, ":51");
+	display_get_stats(test->display, &stats);
+
+	expect(test, _row_is(test, 4, " 51 line 51"));
+	expect(test, _color_at(test, 4, 4) == UI_COLOR_SELECTION);
+
+	/* the new row, two rows changing color, and the status line */
+	expect(test, stats.changed <= 4 * TEST_WIDTH);
+}
+
+/* typing only changes the row that is typed into */
+static void _test_edit(struct test *test)
+{
+	struct display_stats stats;
+	const char *data;
+	const char *pos;
+
+	_select(test, ":50");
+	display_reset_stats(test->display);
+
+	data = buffer_get_data(test->buffer);
+	pos = strstr(data, "line 52\n");
+	buffer_splice(test->buffer, pos - data + 4, 0, "x", 1);
+
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+	display_get_stats(test->display, &stats);
+
+	expect(test, _row_is(test, 6, " 52 linex 52"));
+	expect(test, stats.changed > 0 && stats.changed <= TEST_WIDTH);
+
+	buffer_splice(test->buffer, pos - data + 4, 1, NULL, 0);
+}
+
+/* highlights are drawn below the selection, and only where they changed */
+static void _test_highlights(struct test *test)
+{
+	struct display_stats stats;
+	struct spans *spans;
+	const char *data;
+	size_t offset;
+
+	_select(test, ":50");
+	data = buffer_get_data(test->buffer);
+	offset = strstr(data, "line 51\n") - data;
+
+	if(spans_new(&spans) < 0) {
+		expect(test, !"a span list");
+		return;
+	}
+
+	/* "line" of the selected line and of the one below it */
+	spans_add(spans, offset - 8, 4, UI_COLOR_INSERTION);
+	spans_add(spans, offset, 4, UI_COLOR_INSERTION);
+	textview_set_highlights(test->textview, UI_LAYER_SEARCH, spans);
+	display_flush(test->display);
+
+	expect(test, _color_at(test, 4, 4) == UI_COLOR_SELECTION);
+	expect(test, _color_at(test, 5, 4) == UI_COLOR_INSERTION);
+	expect(test, _color_at(test, 4, 5) == UI_COLOR_INSERTION);
+	expect(test, _color_at(test, 8, 5) == UI_COLOR_NORMAL);
+
+	display_reset_stats(test->display);
+	spans_clear(spans);
+	spans_add(spans, offset, 4, UI_COLOR_INSERTION);
+	textview_restyle(test->textview, offset - 8, offset);
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+	display_get_stats(test->display, &stats);
+
+	expect(test, _color_at(test, 5, 4) == UI_COLOR_NORMAL);
+	expect(test, _color_at(test, 4, 5) == UI_COLOR_INSERTION);
+	expect(test, stats.changed > 0 && stats.changed <= TEST_WIDTH);
+
+	textview_set_highlights(test->textview, UI_LAYER_SEARCH, NULL);
+	spans_free(&spans);
+}
+
+/* opening a comment changes the colors of the lines that follow it */
+static void _test_syntax(struct test *test)
+{
+	const char *data;
+	size_t offset;
+
+	_select(test, ":50");
+	textview_set_syntax(test->textview, 1);
+	display_flush(test->display);
+
+	expect(test, _color_at(test, 9, 5) == UI_COLOR_NUMBER);
+	expect(test, _color_at(test, 4, 5) == UI_COLOR_NORMAL);
+
+	data = buffer_get_data(test->buffer);
+	offset = strstr(data, "line 51\n") - data;
+	buffer_splice(test->buffer, offset - 1, 0, "/*", 2);
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, _row_is(test, 4, " 50 line 50/*"));
+	expect(test, _color_at(test, 4, 5) == UI_COLOR_COMMENT);
+	expect(test, _color_at(test, 9, 7) == UI_COLOR_COMMENT);
+
+	buffer_splice(test->buffer, offset - 1, 2, NULL, 0);
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, _color_at(test, 4, 5) == UI_COLOR_NORMAL);
+	expect(test, _color_at(test, 9, 7) == UI_COLOR_NUMBER);
+
+	textview_set_syntax(test->textview, 0);
+	display_flush(test->display);
+
+	expect(test, _color_at(test, 9, 5) == UI_COLOR_NORMAL);
+}
+
+/* views of the same buffer only redraw what an edit changed in them */
+static void _test_split(struct test *test)
+{
+	struct display_stats stats;
+	struct telex_error *errors;
+	struct display *display;
+	struct textview *peer;
+	struct telex *telex;
+	char row[TEST_WIDTH + 1];
+	const char *data;
+	const char *pos;
+
+	if(display_grid_new(&display, TEST_WIDTH, TEST_HEIGHT) < 0 ||
+	   textview_new(&peer) < 0 || telex_parse(&telex, ":20", &errors) < 0) {
+		expect(test, !"a second view");
+		return;
+	}
+
+	_select(test, ":50");
+
+	((struct widget*)peer)->display = display;
+	widget_set_position((struct widget*)peer, 0, 0);
+	widget_set_size((struct widget*)peer, TEST_WIDTH, TEST_HEIGHT);
+	widget_resize((struct widget*)peer);
+	textview_share(peer, test->textview);
+	textview_set_selection_start(peer, telex);
+	display_flush(display);
+
+	display_grid_get_row(display, 4, row, sizeof(row));
+	expect(test, strncmp(row, " 20 line 20 ", 12) == 0);
+
+	/* the edit is only visible in the second view */
+	display_reset_stats(test->display);
+	display_reset_stats(display);
+
+	data = buffer_get_data(test->buffer);
+	pos = strstr(data, "line 20\n");
+	buffer_splice(test->buffer, pos - data + 4, 0, "y", 1);
+
+	widget_redraw((struct widget*)test->textview);
+	widget_redraw((struct widget*)peer);
+	display_flush(test->display);
+	display_flush(display);
+
+	display_get_stats(test->display, &stats);
+	expect(test, stats.changed == 0);
+
+	display_get_stats(display, &stats);
+	expect(test, stats.changed > 0 && stats.changed <= TEST_WIDTH);
+
+	display_grid_get_row(display, 4, row, sizeof(row));
+	expect(test, strncmp(row, " 20 liney 20 ", 13) == 0);
+
+	buffer_splice(test->buffer, pos - data + 4, 1, NULL, 0);
+	widget_free((struct widget*)peer);
+	telex_free(&telex);
+	display_free(&display);
+
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+	expect(test, _row_is(test, 4, " 50 line 50"));
+}
+
+static int _same_matches(struct filter *filter, struct buffer *buffer)
+{
+	struct filter *fresh;
+	int same;
+
+	if(filter_new(&fresh, filter_get_pattern(filter), strlen(filter_get_pattern(filter))) < 0 ||
+	   filter_update(fresh, buffer) < 0) {
+		return(0);
+	}
+
+	same = filter_get_count(fresh) == filter_get_count(filter) &&
+		memcmp(filter_get_lines(fresh), filter_get_lines(filter),
+		       filter_get_count(fresh) * sizeof(int)) == 0;
+
+	filter_free(&fresh);
+	return(same);
+}
+
+/* a filtered view shows the matching lines with their own numbers */
+static void _test_grep(struct test *test)
+{
+	struct filter *filter;
+	const char *data;
+	size_t size;
+	size_t pos;
+
+	if(filter_new(&filter, "line 9", 6) < 0) {
+		expect(test, !"a filter");
+		return;
+	}
+
+	_select(test, ":50");
+	textview_set_filter(test->textview, filter);
+	display_flush(test->display);
+
+	expect(test, filter_get_count(filter) == 11);
+	expect(test, _row_is(test, 0, "  9 line 9"));
+	expect(test, _row_is(test, 1, " 90 line 90"));
+	expect(test, _row_is(test, TEST_HEIGHT - 1, "Grep [ line 9 ] 11 lines  Selection [ :5"));
+
+	/* only the edited lines are searched again */
+	data = buffer_get_data(test->buffer);
+	pos = strstr(data, "line 20\n") - data;
+	buffer_splice(test->buffer, pos, 0, "line 9 ", 7);
+
+	size = buffer_get_size(test->buffer);
+	buffer_splice(test->buffer, size, 0, "line 9\nline 9\n", 14);
+
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, filter_get_count(filter) == 14);
+	expect(test, _same_matches(filter, test->buffer));
+	expect(test, _row_is(test, 1, " 20 line 9 line 20"));
+	expect(test, _row_is(test, 2, " 90 line 90"));
+
+	buffer_splice(test->buffer, size, 14, NULL, 0);
+	buffer_splice(test->buffer, pos, 7, NULL, 0);
+
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, filter_get_count(filter) == 11);
+	expect(test, _same_matches(filter, test->buffer));
+
+	textview_set_filter(test->textview, NULL);
+	filter_free(&filter);
+	display_flush(test->display);
+	expect(test, _row_is(test, 4, " 50 line 50"));
+}
+
+/* folded lines take a single row, and the fold moves along with edits */
+static void _test_fold(struct test *test)
+{
+	const char *data;
+	size_t start;
+	size_t end;
+	size_t pos;
+	int lines;
+
+	data = buffer_get_data(test->buffer);
+	start = strstr(data, "line 41\n") - data;
+	end = strstr(data, "line 51\n") - data;
+
+	expect(test, buffer_fold(test->buffer, start + 2, end - 1) == 0);
+	_select(test, ":40");
+
+	expect(test, _row_is(test, 4, " 40 line 40"));
+	expect(test, _row_is(test, 5, " 41 [+] 10 lines"));
+	expect(test, _row_is(test, 6, " 51 line 51"));
+
+	/* in front of the fold */
+	pos = strstr(data, "line 38\n") - data;
+	buffer_splice(test->buffer, pos, 0, "x ", 2);
+
+	/* inside of it */
+	data = buffer_get_data(test->buffer);
+	buffer_splice(test->buffer, strstr(data, "line 45\n") - data, 0, "line 45b\n", 9);
+
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, buffer_get_fold(test->buffer, start + 2, &start, &end, &lines) == 0);
+	expect(test, lines == 11 && end - start == 10 * 8 + 9);
+	expect(test, _row_is(test, 2, " 38 x line 38"));
+	expect(test, _row_is(test, 5, " 41 [+] 11 lines"));
+	expect(test, _row_is(test, 6, " 52 line 51"));
+
+	expect(test, buffer_unfold(test->buffer, start) == 0);
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, _row_is(test, 5, " 41 line 41"));
+	expect(test, _row_is(test, 6, " 42 line 42"));
+
+	data = buffer_get_data(test->buffer);
+	buffer_splice(test->buffer, strstr(data, "line 45b\n") - data, 9, NULL, 0);
+	buffer_splice(test->buffer, pos, 2, NULL, 0);
+}
+
+/* the hex view shows bytes, NULs included, and they are saved as they are */
+static void _test_hex(struct test *test)
+{
+	struct buffer *saved;
+
+	textview_set_hex(test->textview, 1);
+	_select(test, ":2");
+
+	/* four bytes fit into a row that is 40 cells wide */
+	expect(test, _row_is(test, 0, "00000000  6c 69 6e 65  line"));
+	expect(test, _row_is(test, 1, "00000004  20 31 0a 6c   1.l"));
+	expect(test, _row_is(test, TEST_HEIGHT - 1, "Hex [ 7 ]  Selection [ :2 :  ]"));
+	expect(test, _color_at(test, 19, 1) == UI_COLOR_SELECTION);
+
+	buffer_splice(test->buffer, 1, 0, "\0", 1);
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, _row_is(test, 0, "00000000  6c 00 69 6e  l.in"));
+	expect(test, buffer_save(test->buffer) == 0);
+
+	if(buffer_open(&saved, test->path, 1) < 0) {
+		expect(test, !"the saved file");
+	} else {
+		expect(test, buffer_get_size(saved) == buffer_get_size(test->buffer) &&
+		       memcmp(buffer_get_data(saved), buffer_get_data(test->buffer),
+			      buffer_get_size(saved)) == 0);
+		buffer_close(&saved);
+	}
+
+	buffer_splice(test->buffer, 1, 1, NULL, 0);
+	expect(test, buffer_save(test->buffer) == 0);
+	textview_set_hex(test->textview, 0);
+	display_flush(test->display);
+
+	expect(test, _row_is(test, 1, "  2 line 2"));
+}
+
+/* a table has its fields lined up, and fields that are too long are cut short */
+static void _test_columns(struct test *test)
+{
+	const struct columns_field *fields;
+	struct columns *columns;
+	const char *data;
+	const char *pos;
+	int num;
+
+	if(columns_new(&columns, ' ') < 0) {
+		expect(test, !"columns");
+		return;
+	}
+
+	_select(test, ":1");
+	textview_set_columns(test->textview, columns);
+	display_flush(test->display);
+
+	/* the longest numbers have three digits */
+	expect(test, _row_is(test, 0, "  1 line | 1"));
+	expect(test, _row_is(test, 6, "  7 line | 7   | 00000000000000000000000"));
+	expect(test, _color_at(test, 10, 0) == UI_COLOR_LINES);
+	expect(test, _row_is(test, TEST_HEIGHT - 1, "Columns [   ] 3 fields  Selection [ :1 :"));
+
+	data = buffer_get_data(test->buffer);
+	pos = strstr(data, "line 7 ");
+	expect(test, columns_get_fields(columns, test->buffer, pos - data, 88, &fields, &num) == 0);
+	expect(test, num == 3 && fields[2].start == 7 && fields[2].len == 80);
+	expect(test, columns_find_field(columns, test->buffer, pos - data + 50) == 2);
+
+	/* the zeros are cut short at 32 cells */
+	textview_scroll_horizontal(test->textview, 13);
+	display_flush(test->display);
+
+	expect(test, _row_is(test, 6, "  7 0000000000000000000000000000000>"));
+	expect(test, _color_at(test, 35, 6) == UI_COLOR_LINES);
+
+	textview_set_columns(test->textview, NULL);
+	columns_free(&columns);
+	_select(test, ":1");
+
+	expect(test, _row_is(test, 6, "  7 line 7 00000000000000000000000000000"));
+}
+
+/* JSON is shown with one row per member and element, and can be folded */
+static void _test_json(struct test *test)
+{
+	static const char text[] = "{\"a\":1,\"b\":[true,{\"c\":\"d\"}],\"e\":{}}";
+	struct buffer *buffer;
+	struct json *json;
+	char path[256];
+
+	if(_open_file(test, "json", text, 1, path, sizeof(path), &buffer) < 0) {
+		expect(test, !"a JSON buffer");
+		return;
+	}
+
+	if(json_new(&json) < 0) {
+		expect(test, !"a JSON parser");
+		_close_file(&buffer, path);
+		return;
+	}
+
+	textview_set_buffer(test->textview, buffer);
+	textview_set_json(test->textview, json);
+	_select(test, "#22");
+
+	expect(test, _row_is(test, 0, " 0 {"));
+	expect(test, _row_is(test, 1, " 1   \"a\": 1,"));
+	expect(test, _row_is(test, 2, " 7   \"b\": ["));
+	expect(test, _row_is(test, 5, "18       \"c\": \"d\""));
+	expect(test, _row_is(test, 7, "26   ],"));
+	expect(test, _row_is(test, 8, "28   \"e\": {}"));
+	expect(test, _color_at(test, 9, 5) == UI_COLOR_SELECTION);
+	expect(test, _row_is(test, TEST_HEIGHT - 1, "Json [ depth 3 ]  Selection [ #22 :  ]"));
+
+	/* the selection is in the array that is folded */
+	expect(test, json_toggle(json, buffer, 11) == 0);
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, _row_is(test, 2, " 7   \"b\": [...],"));
+	expect(test, _row_is(test, 3, "28   \"e\": {}"));
+	expect(test, _row_is(test, 4, "34 }"));
+	expect(test, _color_at(test, 5, 2) == UI_COLOR_SELECTION);
+
+	textview_set_json(test->textview, NULL);
+	textview_set_buffer(test->textview, test->buffer);
+	_select(test, ":1");
+
+	expect(test, _row_is(test, 0, "  1 line 1"));
+
+	json_free(&json);
+	_close_file(&buffer, path);
+}
+
+/* the lines that were removed are shown above the lines that replaced them */
+static void _test_diff(struct test *test)
+{
+	struct buffer *buffer;
+	struct buffer *base;
+	struct diff *diff;
+	char path[256];
+
+	if(_open_file(test, "diff", "a\nb\nc\nd\ne\n", 0, path, sizeof(path), &buffer) < 0) {
+		expect(test, !"a buffer to change");
+		return;
+	}
+
+	if(buffer_clone(buffer, &base) < 0 || diff_new(&diff, base) < 0) {
+		expect(test, !"a diff");
+		_close_file(&buffer, path);
+		return;
+	}
+
+	buffer_splice(buffer, 6, 2, NULL, 0);
+	buffer_splice(buffer, 2, 1, "B", 1);
+	buffer_splice(buffer, buffer_get_size(buffer), 0, "f\n", 2);
+
+	textview_set_buffer(test->textview, buffer);
+	textview_set_diff(test->textview, diff);
+	_select(test, ":3");
+
+	expect(test, _row_is(test, 0, "1   a"));
+	expect(test, _row_is(test, 1, "  - b"));
+	expect(test, _row_is(test, 2, "2 + B"));
+	expect(test, _row_is(test, 3, "3   c"));
+	expect(test, _row_is(test, 4, "  - d"));
+	expect(test, _row_is(test, 5, "4   e"));
+	expect(test, _row_is(test, 6, "5 + f"));
+	expect(test, _color_at(test, 4, 1) == UI_COLOR_DELETION);
+	expect(test, _color_at(test, 4, 2) == UI_COLOR_INSERTION);
+	expect(test, _color_at(test, 4, 3) == UI_COLOR_SELECTION);
+	expect(test, _color_at(test, 4, 5) == UI_COLOR_NORMAL);
+	expect(test, _row_is(test, TEST_HEIGHT - 1, "Diff [ +2 -2 ]  Selection [ :3 :  ]"));
+
+	/* without the edits, there is nothing left to show */
+	buffer_splice(buffer, 0, buffer_get_size(buffer), buffer_get_data(base),
+		      buffer_get_size(base));
+	widget_redraw((struct widget*)test->textview);
+	display_flush(test->display);
+
+	expect(test, _row_is(test, 1, "2   b"));
+	expect(test, _row_is(test, 4, "5   e"));
+	expect(test, _row_is(test, 5, ""));
+	expect(test, _row_is(test, TEST_HEIGHT - 1, "Diff [ +0 -0 ]  Selection [ :3 :  ]"));
+
+	textview_set_diff(test->textview, NULL);
+	textview_set_buffer(test->textview, test->buffer);
+	_select(test, ":1");
+
+	expect(test, _row_is(test, 0, "  1 line 1"));
+
+	diff_free(&diff);
+	_close_file(&buffer, path);
+}
+
+/* the lines that no hunk covers are the same on both sides */
+static int _hunks_hold(struct diff *diff)
+{
+	const struct diff_hunk *hunks;
+	int num;
+	int old;
+	int new;
+	int h;
+
+	if(diff_get_hunks(diff, &hunks, &num) < 0) {
+		return(0);
+	}
+
+	for(old = 1, new = 1, h = 0; h <= num; h++) {
+		int old_end;
+		int new_end;
+
+		old_end = h < num ? hunks[h].old_line : diff_get_count(diff, DIFF_OLD) + 1;
+		new_end = h < num ? hunks[h].new_line : diff_get_count(diff, DIFF_NEW) + 1;
+
+		if(old_end - old != new_end - new) {
+			return(0);
+		}
+
+		for( ; old < old_end; old++, new++) {
+			const char *old_data;
+			const char *new_data;
+			size_t old_len;
+			size_t new_len;
+
+			if(diff_get_line(diff, DIFF_OLD, old, &old_data, &old_len) < 0 ||
+			   diff_get_line(diff, DIFF_NEW, new, &new_data, &new_len) < 0 ||
+			   old_len != new_len || memcmp(old_data, new_data, old_len) != 0) {
+				return(0);
+			}
+		}
+
+		if(h < num) {
+			old += hunks[h].old_lines;
+			new += hunks[h].new_lines;
+		}
+	}
+
+	return(1);
+}
+
+/* a diff that follows the edits stays correct and doesn't grow */
+static void _test_diff_edits(struct test *test)
+{
+	static const char *insertions[] = { "", "x", "\n", "a\n", "b\nc\n", "line 1\n" };
+	const struct diff_hunk *hunks;
+	struct buffer *buffer;
+	struct buffer *base;
+	struct buffer *copy;
+	struct diff *fresh;
+	struct diff *diff;
+	unsigned int seed;
+	int changed[2];
+	int holds;
+	int num;
+	int i;
+
+	if(buffer_clone(test->buffer, &buffer) < 0 ||
+	   buffer_clone(test->buffer, &base) < 0 || diff_new(&diff, base) < 0) {
+		expect(test, !"a buffer and a diff");
+		return;
+	}
+
+	for(seed = 1, holds = 1, i = 0; i < 500 && holds; i++) {
+		const char *insertion;
+		size_t offset;
+		size_t len;
+
+		seed = seed * 1103515245 + 12345;
+		offset = (seed >> 8) % (buffer_get_size(buffer) + 1);
+
+		/* every so often at the end, which may leave the last line open */
+		if(seed % 4 == 0) {
+			offset = buffer_get_size(buffer);
+		}
+
+		len = (seed >> 4) % 4;
+		len = len < buffer_get_size(buffer) - offset ? len : buffer_get_size(buffer) - offset;
+		insertion = insertions[(seed >> 16) % (sizeof(insertions) / sizeof(*insertions))];
+
+		buffer_splice(buffer, offset, len, insertion, strlen(insertion));
+		holds = diff_update(diff, buffer) == 0 && _hunks_hold(diff);
+	}
+
+	expect(test, holds);
+
+	/* only the hunks around the edits were made again, and here that lost nothing */
+	if(buffer_clone(base, &copy) < 0 || diff_new(&fresh, copy) < 0) {
+		expect(test, !"a fresh diff");
+	} else {
+		for(i = 0; i < 2; i++) {
+			int h;
+
+			diff_update(i ? fresh : diff, buffer);
+			diff_get_hunks(i ? fresh : diff, &hunks, &num);
+
+			for(changed[i] = 0, h = 0; h < num; h++) {
+				changed[i] += hunks[h].old_lines + hunks[h].new_lines;
+			}
+		}
+
+		expect(test, changed[0] == changed[1]);
+		diff_free(&fresh);
+	}
+
+	diff_free(&diff);
+	buffer_close(&buffer);
+}
+
+/* edits made after the file was reloaded are recovered from the journal */
+static void _test_reload_journal(struct test *test)
+{
+	struct journal *journal;
+	struct buffer *buffer;
+	char path[256];
+	FILE *file;
+
+	if(_open_file(test, "reload", "one\ntwo\n", 0, path, sizeof(path), &buffer) < 0) {
+		expect(test, !"a buffer to reload");
+		return;
+	}
+
+	if(journal_open(&journal, path) < 0) {
+		expect(test, !"a journal");
+		_close_file(&buffer, path);
+		return;
+	}
+
+	buffer_set_journal(buffer, journal);
+
+	/* another program changes the file */
+	if((file = fopen(path, "w"))) {
+		fputs("one\n2\n", file);
+		fclose(file);
+	}
+
+	expect(test, buffer_refresh(buffer) == 1);
+	expect(test, buffer_splice(buffer, 0, 3, "ONE", 3) == 0);
+	expect(test, journal_flush(journal) == 0);
+
+	/* as if we crashed before saving */
+	journal_close(&journal);
+	buffer_close(&buffer);
+
+	if(buffer_open(&buffer, path, 0) < 0) {
+		expect(test, !"the buffer again");
+		unlink(path);
+		return;
+	}
+
+	if(journal_open(&journal, path) < 0) {
+		expect(test, !"the journal again");
+		_close_file(&buffer, path);
+		return;
+	}
+
+	expect(test, journal_replay(journal, buffer) == 1);
+	expect(test, buffer_get_size(buffer) == 6 &&
+	       memcmp(buffer_get_data(buffer), "ONE\n2\n", 6) == 0);
+
+	journal_discard(&journal);
+	_close_file(&buffer, path);
+}
+
+static void _test_analysis_finished(struct analysis *analysis, const analysis_task_t task,
+				    void *user_data)
+{
+	(*(int*)user_data)++;
+}
+
+/* an analysis lets go of its snapshot when done, and the buffer can still be saved */
+static void _test_analysis_save(struct test *test)
+{
+	struct worker_pool *pool;
+	struct analysis *analysis;
+	struct buffer *buffer;
+	struct pollfd pfd;
+	char path[256];
+	int watched;
+	int done;
+	int i;
+
+	if(_open_file(test, "analysis", "one\n", 0, path, sizeof(path), &buffer) < 0) {
+		expect(test, !"a buffer to analyse");
+		return;
+	}
+
+	if(worker_pool_new(&pool, 1) < 0) {
+		expect(test, !"a worker pool");
+		_close_file(&buffer, path);
+		return;
+	}
+
+	watched = buffer_watch(buffer) == 0 && buffer_get_watch_fd(buffer) >= 0;
+	done = 0;
+
+	expect(test, analysis_start(&analysis, pool, buffer, ANALYSIS_TASK(ANALYSIS_STATS), 0, 3,
+				    _test_analysis_finished, &done) == 0);
+
+	pfd.fd = worker_pool_get_fd(pool);
+	pfd.events = POLLIN;
+
+	for(i = 0; !done && i < 100; i++) {
+		poll(&pfd, 1, 100);
+		worker_pool_collect(pool);
+	}
+
+	expect(test, done == 1);
+	expect(test, analysis_get_stats(analysis)->hits == 1);
+	expect(test, !analysis_get_snapshot(analysis));
+	analysis_cancel(&analysis);
+
+	expect(test, buffer_splice(buffer, 0, 3, "two", 3) == 0);
+	expect(test, buffer_save(buffer) == 0);
+	expect(test, !watched || buffer_get_watch_fd(buffer) >= 0);
+
+	worker_pool_free(&pool);
+	_close_file(&buffer, path);
+}
+
+/* a buffer can still be saved after the snapshot diff was turned off */
+static void _test_snapshot_diff_save(struct test *test)
+{
+	struct buffer *buffer;
+	struct buffer *base;
+	struct diff *diff;
+	char path[256];
+	int watched;
+
+	if(_open_file(test, "snapdiff", "one\n", 0, path, sizeof(path), &buffer) < 0) {
+		expect(test, !"a buffer to diff");
+		return;
+	}
+
+	watched = buffer_watch(buffer) == 0 && buffer_get_watch_fd(buffer) >= 0;
+
+	if(buffer_clone(buffer, &base) < 0 || diff_new(&diff, base) < 0) {
+		expect(test, !"a snapshot diff");
+		_close_file(&buffer, path);
+		return;
+	}
+
+	/* toggle the snapshot diff on and off again */
+	textview_set_buffer(test->textview, buffer);
+	textview_set_diff(test->textview, diff);
+	textview_set_diff(test->textview, NULL);
+	diff_free(&diff);
+	textview_set_buffer(test->textview, test->buffer);
+
+	expect(test, buffer_splice(buffer, 0, 3, "two", 3) == 0);
+	expect(test, buffer_save(buffer) == 0);
+	expect(test, !watched || buffer_get_watch_fd(buffer) >= 0);
+
+	_close_file(&buffer, path);
+}
+
+/* snapshots share the contents until the buffer changes */
+static void _test_snapshot(struct test *test)
+{
+	struct buffer *first;
+	struct buffer *second;
+	const char *data;
+
+	if(buffer_snapshot(test->buffer, &first) < 0 ||
+	   buffer_snapshot(test->buffer, &second) < 0) {
+		expect(test, !"two snapshots");
+		return;
+	}
+
+	data = buffer_get_data(test->buffer);
+	expect(test, buffer_get_data(first) == data && buffer_get_data(second) == data);
+
+	expect(test, buffer_splice(test->buffer, 0, 4, "LINE", 4) == 0);
+	expect(test, buffer_get_data(test->buffer) != data);
+	expect(test, memcmp(buffer_get_data(first), "line 1\n", 7) == 0);
+	expect(test, memcmp(buffer_get_data(test->buffer), "LINE 1\n", 7) == 0);
+
+	buffer_close(&first);
+	expect(test, memcmp(buffer_get_data(second), "line 1\n", 7) == 0);
+	buffer_close(&second);
+
+	expect(test, buffer_splice(test->buffer, 0, 4, "line", 4) == 0);
+}
+
+/* the VT display sends what changed, the cheapest way it can */
+static void _test_vt(struct test *test)
+{
+	struct display *display;
+	char output[256];
+	FILE *file;
+	size_t len;
+
+	if(!(file = tmpfile()) || display_vt_new(&display, fileno(file), 10, 2) < 0) {
+		expect(test, !"a VT display");
+		return;
+	}
+
+	display_set_colors(display, UI_COLOR_NORMAL, COLOR_BLACK, COLOR_WHITE);
+	display_put(display, 1, 0, "ab", 2, UI_COLOR_NORMAL);
+	display_fill(display, 3, 1, -1, ' ', UI_COLOR_NORMAL);
+	display_flush(display);
+
+	/* nothing changed */
+	display_flush(display);
+
+	rewind(file);
+	len = fread(output, 1, sizeof(output) - 1, file);
+	output[len] = 0;
+
+	expect(test, strcmp(output, "\033[0m\033[H\033[2J \033[0;30;47mab"
+			    "\033[2;4H\033[K\033[1;1H") == 0);
+
+	display_free(&display);
+	fclose(file);
+}
+
+int main(int argc, char *argv[])
+{
+	struct widget *widget;
+	struct test test;
+	int err;
+
+	memset(&test, 0, sizeof(test));
+	test.path = argc > 1 ? argv[1] : "render_test.txt";
+
+	if((err = _make_file(test.path)) < 0 ||
+	   (err = buffer_open(&test.buffer, test.path, 0)) < 0 ||
+	   (err = display_grid_new(&test.display, TEST_WIDTH, TEST_HEIGHT)) < 0 ||
+	   (err = textview_new(&test.textview)) < 0) {
+		fprintf(stderr, "setup: %s\n", strerror(-err));
+		return(1);
+	}
+
+	widget = (struct widget*)test.textview;
+	widget->display = test.display;
+	widget_set_position(widget, 0, 0);
+	widget_set_size(widget, TEST_WIDTH, TEST_HEIGHT);
+	widget_resize(widget);
+	textview_set_buffer(test.textview, test.buffer);
+
+	_test_contents(&test);
+	_test_wrap(&test);
+	_test_idle(&test);
+	_test_scroll(&test);
+	_test_edit(&test);
+	_test_highlights(&test);
+	_test_syntax(&test);
+	_test_split(&test);
+	_test_grep(&test);
+	_test_fold(&test);
+	_test_hex(&test);
+	_test_columns(&test);
+	_test_json(&test);
+	_test_diff(&test);
+	_test_diff_edits(&test);
+	_test_reload_journal(&test);
+	_test_analysis_save(&test);
+	_test_snapshot_diff_save(&test);
+	_test_snapshot(&test);
+	_test_vt(&test);
+
+	widget_free(widget);
+	display_free(&test.display);
+
+	if(test.selection) {
+		telex_free(&test.selection);
+	}
+
+	buffer_close(&test.buffer);
+	unlink(test.path);
+
+	if(test.failures) {
+		fprintf(stderr, "%d checks failed\n", test.failures);
+		return(1);
+	}
+
+	printf("render_test: ok\n");
+	return(0);
+}
@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "span.h"
+
+#define SPANS_INIT_SIZE 8
+
+struct spans {
+	struct span *spans;
+	int num_spans;
+	int max_spans;
+};
+
+int spans_new(struct spans **spans)
+{
+	if(!spans) {
+		return(-EINVAL);
+	}
+
+	if(!(*spans = calloc(1, sizeof(**spans)))) {
+		return(-ENOMEM);
+	}
+
+	return(0);
+}
+
+int spans_free(struct spans **spans)
+{
+	if(!spans || !*spans) {
+		return(-EINVAL);
+	}
+
+	free((*spans)->spans);
+	free(*spans);
+	*spans = NULL;
+
+	return(0);
+}
+
+int spans_clear(struct spans *spans)
+{
+	if(!spans) {
+		return(-EINVAL);
+	}
+
+	spans->num_spans = 0;
+	return(0);
+}
+
+/* find the first span that ends after `offset' */
+static int _spans_find(const struct spans *spans, const size_t offset)
+{
+	int lo;
+	int hi;
+
+	lo = 0;
+	hi = spans->num_spans;
+
+	while(lo < hi) {
+		int mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if(spans->spans[mid].offset + spans->spans[mid].len <= offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return(lo);
+}
+
+/*
+ * Spans are usually added in the order they appear in, in which case
+ * they are simply appended.
+ */
+int spans_add(struct spans *spans, const size_t offset, const size_t len, const int color)
+{
+	int idx;
+
+	if(!spans) {
+		return(-EINVAL);
+	}
+
+	if(len == 0) {
+		return(0);
+	}
+
+	idx = _spans_find(spans, offset);
+
+	if(idx < spans->num_spans && spans->spans[idx].offset < offset + len) {
+		return(-EEXIST);
+	}
+
+	if(spans->num_spans == spans->max_spans) {
+		struct span *new_spans;
+		int new_max;
+
+		new_max = spans->max_spans ? spans->max_spans * 2 : SPANS_INIT_SIZE;
+
+		if(!(new_spans = realloc(spans->spans, new_max * sizeof(*new_spans)))) {
+			return(-ENOMEM);
+		}
+
+		spans->spans = new_spans;
+		spans->max_spans = new_max;
+	}
+
+	memmove(spans->spans + idx + 1, spans->spans + idx,
+		(spans->num_spans - idx) * sizeof(*spans->spans));
+
+	spans->spans[idx].offset = offset;
+	spans->spans[idx].len = len;
+	spans->spans[idx].color = color;
+	spans->num_spans++;
+
+	return(0);
+}
+
+/*
+ * Get the spans that overlap with the bytes from `start' to `end'. They
+ * follow each other in memory, starting at `first', and their number is
+ * returned.
+ */
+int spans_get_range(const struct spans *spans, const size_t start, const size_t end,
+		    const struct span **first)
+{
+	int idx;
+	int num;
+
+	if(!spans || !first) {
+		return(-EINVAL);
+	}
+
+	idx = _spans_find(spans, start);
+
+	for(num = 0; idx + num < spans->num_spans &&
+		    spans->spans[idx + num].offset < end; num++);
+
+	*first = spans->spans + idx;
+	return(num);
+}
@@ -0,0 +1,29 @@
+#ifndef E_SPAN_H
+#define E_SPAN_H
+
+#include <stddef.h>
+
+struct spans;
+
+/* `len' bytes of the buffer, starting at `offset', shown in `color' */
+struct span {
+	size_t offset;
+	size_t len;
+	int color;
+};
+
+/*
+ * A layer of highlights, such as the selection or the hits of a search.
+ * The spans of a layer don't overlap and are kept sorted by their offset,
+ * so the ones that fall onto a row can be found without looking at all
+ * of them.
+ */
+int spans_new(struct spans **spans);
+int spans_free(struct spans **spans);
+
+int spans_clear(struct spans *spans);
+int spans_add(struct spans *spans, const size_t offset, const size_t len, const int color);
+int spans_get_range(const struct spans *spans, const size_t start, const size_t end,
+		    const struct span **first);
+
+#endif /* E_SPAN_H */
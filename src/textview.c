@@ -2,19 +2,71 @@
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
+#include <ctype.h>
 #include "ui.h"
 #include "buffer.h"
+#include "layout.h"
+#include "span.h"
+#include "highlight.h"
+#include "filter.h"
+#include "columns.h"
+#include "json.h"
+#include "diff.h"
 #include <telex/telex.h>
 #include "config.h"
 
+/*
+ * A row of the text area, along with the range of the buffer and the line
+ * it shows. The textview keeps one set of rows for what is currently on
+ * the screen and one for the frame that is being composed, so it can tell
+ * which rows actually need to be painted. Characters and colors are kept
+ * apart so that runs of the same color can be painted straight from the
+ * row.
+ */
+struct textview_row {
+	int line;
+	size_t start;
+	size_t end;
+	char *chars;
+	unsigned char *colors;
+};
+
+#define TEXTVIEW_MAX_DAMAGE 3
+
 struct textview {
 	struct widget _parent;
 
 	struct buffer *buffer;
 	struct telex *start;
 	struct telex *end;
+	struct layout *layout;
+
+	/* the other views of the same buffer, in a ring */
+	struct textview *peer;
 
 	int tab_width;
+	int tail;
+	int wrap;
+	size_t hscroll;
+
+	/* the hex view starts with the row that shows `hex_offset' */
+	int hex;
+	size_t hex_offset;
+
+	/* the structural view of a JSON buffer starts with `json_top' */
+	struct json *json;
+	struct json_row json_top;
+	int json_depth;
+
+	/*
+	 * The diff view starts with the row of `diff_top_line' that is
+	 * `diff_top_del' rows down. The lines that were removed in front of
+	 * a line are shown above it.
+	 */
+	struct diff *diff;
+	int diff_top_line;
+	int diff_top_del;
 
 	int first_line;
 	int pos_x;
@@ -22,11 +74,38 @@ struct textview {
 	int num_width;
 	int text_width;
 	int cur_line;
-	ui_color_t cur_color;
+
+	/*
+	 * The highlights of all layers are merged into `span_colors' once
+	 * per row, which has the color of every byte from `span_start' on.
+	 */
+	struct spans *layers[UI_LAYER_COUNT];
+	struct spans *selection;
+	struct highlight *highlight;
+
+	/* not owned by the view */
+	struct filter *filter;
+	struct columns *columns;
+	unsigned char *span_colors;
+	size_t span_start;
+	size_t span_len;
+
+	struct textview_row *screen;
+	struct textview_row *frame;
+	int rows;
+	int cols;
+	int screen_valid;
+	int screen_num_width;
+	unsigned long generation;
+	unsigned long fold_generation;
+	char status[384];
+	char info[128];
+
 	struct {
-		const char *start;
-		const char *end;
-	} sel;
+		size_t start;
+		size_t end;
+	} screen_sel, restyle, damage[TEXTVIEW_MAX_DAMAGE];
+	int num_damage;
 };
 
 static int _number_width(int number)
@@ -40,359 +119,2142 @@ static int _number_width(int number)
 	return(width);
 }
 
-static int _textview_reset(struct textview *textview, const int first_line,
-			   const char *sel_start, const char *sel_end)
+static void _textview_free_rows(struct textview_row **rows, const int num_rows)
 {
-	int last_line;
+	int row;
 
-	if(!textview) {
-		return(-EINVAL);
+	if(!*rows) {
+		return;
 	}
 
-	textview->first_line = first_line;
-	textview->cur_line = first_line;
-	last_line = first_line + ((struct widget*)textview)->height - 1;
+	for(row = 0; row < num_rows; row++) {
+		free((*rows)[row].chars);
+		free((*rows)[row].colors);
+	}
 
-	textview->num_width = _number_width(last_line) + 1;
-	textview->text_width = ((struct widget*)textview)->width - textview->num_width;
-	textview->pos_x = textview->num_width;
-	textview->pos_y = 0;
-	textview->cur_color = UI_COLOR_NORMAL;
+	free(*rows);
+	*rows = NULL;
+}
+
+static int _textview_alloc_rows(struct textview_row **dst, const int num_rows, const int cols)
+{
+	struct textview_row *rows;
+	int row;
+
+	if(!(rows = calloc(num_rows, sizeof(*rows)))) {
+		return(-ENOMEM);
+	}
 
-	textview->sel.start = sel_start;
-	textview->sel.end = sel_end;
+	for(row = 0; row < num_rows; row++) {
+		rows[row].chars = malloc(cols);
+		rows[row].colors = malloc(cols);
+
+		if(!rows[row].chars || !rows[row].colors) {
+			_textview_free_rows(&rows, row + 1);
+			return(-ENOMEM);
+		}
+	}
 
+	*dst = rows;
 	return(0);
 }
 
-static int _textview_put_linenum(struct textview *textview)
+/*
+ * Make sure the screen model matches the size of the widget. If it
+ * doesn't, whatever is on the screen is unknown and gets repainted.
+ */
+static int _textview_adjust_rows(struct textview *textview)
 {
 	struct widget *widget;
+	int rows;
+	int err;
 
-	if(!textview) {
-		return(-EINVAL);
+	widget = (struct widget*)textview;
+	rows = widget->height > 1 ? widget->height - 1 : 0;
+
+	if(textview->screen && rows == textview->rows && widget->width == textview->cols) {
+		return(0);
 	}
 
-	widget = (struct widget*)textview;
+	_textview_free_rows(&textview->screen, textview->rows);
+	_textview_free_rows(&textview->frame, textview->rows);
+	free(textview->span_colors);
+	textview->span_colors = NULL;
+	textview->rows = 0;
+	textview->cols = 0;
+	textview->screen_valid = FALSE;
 
-	mvprintw(widget->y + textview->pos_y, widget->x, "%*d ",
-		 textview->num_width - 1, textview->cur_line);
-	mvchgat(widget->y + textview->pos_y, widget->x,
-		textview->num_width, 0, UI_COLOR_LINES, NULL);
+	if(rows < 1 || widget->width < 1) {
+		return(-ERANGE);
+	}
+
+	/* a row shows no more bytes than it has cells, plus the rest of a tab */
+	if(!(textview->span_colors = malloc(widget->width + 1))) {
+		return(-ENOMEM);
+	}
+
+	if((err = _textview_alloc_rows(&textview->screen, rows, widget->width)) < 0 ||
+	   (err = _textview_alloc_rows(&textview->frame, rows, widget->width)) < 0) {
+		_textview_free_rows(&textview->screen, rows);
+		free(textview->span_colors);
+		textview->span_colors = NULL;
+		return(err);
+	}
+
+	textview->rows = rows;
+	textview->cols = widget->width;
 
 	return(0);
 }
 
-static int _textview_putc(struct textview *textview, const char chr)
+static void _textview_add_damage(struct textview *textview, size_t start, size_t end)
 {
-	struct widget *widget;
-
-	if(!textview) {
-		return(-EINVAL);
+	if(start >= end) {
+		return;
 	}
 
-	widget = (struct widget*)textview;
+	if(textview->num_damage == TEXTVIEW_MAX_DAMAGE) {
+		/* merge with the last range rather than losing track */
+		textview->num_damage--;
 
-	if(textview->pos_x >= widget->width) {
-		textview->pos_x = textview->num_width;
-		textview->pos_y++;
+		if(textview->damage[textview->num_damage].start < start) {
+			start = textview->damage[textview->num_damage].start;
+		}
+		if(textview->damage[textview->num_damage].end > end) {
+			end = textview->damage[textview->num_damage].end;
+		}
 	}
 
-	if(textview->pos_x == textview->num_width) {
-	        _textview_put_linenum(textview);
+	textview->damage[textview->num_damage].start = start;
+	textview->damage[textview->num_damage].end = end;
+	textview->num_damage++;
+}
+
+static int _textview_is_damaged(struct textview *textview, const size_t start, const size_t end)
+{
+	int i;
+
+	for(i = 0; i < textview->num_damage; i++) {
+		if(textview->damage[i].start <= end && textview->damage[i].end > start) {
+			return(TRUE);
+		}
 	}
 
-	if(chr == '\n') {
-		mvchgat(widget->y + textview->pos_y,
-			widget->x + textview->pos_x,
-			-1, 0, textview->cur_color, NULL);
+	return(FALSE);
+}
 
-		textview->pos_x = textview->num_width;
-		textview->pos_y++;
-		textview->cur_line++;
-	} else {
-		mvprintw(widget->y + textview->pos_y,
-			 widget->x + textview->pos_x,
-			 "%c", chr);
-		mvchgat(widget->y + textview->pos_y,
-			widget->x + textview->pos_x,
-			1, 0, textview->cur_color, NULL);
+static void _textview_clear_row(struct textview *textview, struct textview_row *row)
+{
+	row->line = 0;
+	row->start = 0;
+	row->end = 0;
+
+	memset(row->chars, ' ', textview->cols);
+	memset(row->colors, UI_COLOR_NORMAL, textview->cols);
+}
+
+static void _textview_set_num_width(struct textview *textview, const int last_line)
+{
+	textview->num_width = _number_width(last_line) + 1;
+	textview->text_width = ((struct widget*)textview)->width - textview->num_width;
+	textview->pos_x = textview->num_width;
+}
 
-		textview->pos_x++;
+static int _textview_reset(struct textview *textview, const int first_line)
+{
+	if(!textview) {
+		return(-EINVAL);
 	}
 
+	textview->first_line = first_line;
+	textview->cur_line = first_line;
+	_textview_set_num_width(textview, first_line + ((struct widget*)textview)->height - 1);
+	textview->pos_y = 0;
+
 	return(0);
 }
 
-static int _textview_puts(struct textview *textview, const char *str)
+static int _textview_put_linenum(struct textview *textview)
 {
-	int len;
+	struct textview_row *row;
+	char num[16];
+	int x;
 
 	if(!textview) {
 		return(-EINVAL);
 	}
 
-	for(len = 0; *str; len++, str++) {
-		int err;
+	row = &textview->frame[textview->pos_y];
+	snprintf(num, sizeof(num), "%*d ", textview->num_width - 1, textview->cur_line);
 
-		err = 0;
+	for(x = 0; x < textview->num_width && x < textview->cols && num[x]; x++) {
+		row->chars[x] = num[x];
+		row->colors[x] = UI_COLOR_LINES;
+	}
 
-		if(textview->sel.start && textview->sel.start == str) {
-			textview->cur_color = UI_COLOR_SELECTION;
-		} else if(textview->sel.end && textview->sel.end == str) {
-			textview->cur_color = UI_COLOR_NORMAL;
-		} else if(textview->sel.start && !textview->sel.end &&
-			  textview->sel.start != str) {
-			textview->cur_color = UI_COLOR_NORMAL;
-		}
+	return(0);
+}
 
-	        if(*str == '\t') {
-			int cur_pos;
-			int cols_since_tabstop;
-			int cols_to_tabstop;
+/*
+ * Work out the colors of the bytes from `start' to `end' of the buffer by
+ * painting the spans that overlap with them, one layer over the other.
+ * This only looks at the spans of the row, no matter how many layers
+ * there are.
+ */
+static void _textview_merge_spans(struct textview *textview, const size_t start, size_t end)
+{
+	int layer;
 
-			cur_pos = textview->pos_x - textview->num_width;
-			cols_since_tabstop = cur_pos % textview->tab_width;
-			cols_to_tabstop = textview->tab_width - cols_since_tabstop;
+	if(end - start > (size_t)textview->cols + 1) {
+		end = start + textview->cols + 1;
+	}
 
-			while(cols_to_tabstop-- > 0) {
-				err = _textview_putc(textview, ' ');
+	textview->span_start = start;
+	textview->span_len = end - start;
+	memset(textview->span_colors, UI_COLOR_NORMAL, textview->span_len);
 
-				if(err < 0) {
-					break;
-				}
-			}
-		} else {
-			err = _textview_putc(textview, *str);
+	for(layer = 0; layer < UI_LAYER_COUNT; layer++) {
+		const struct span *span;
+		int num;
+
+		if(!textview->layers[layer]) {
+			continue;
 		}
 
-		if(err < 0) {
-			break;
+		num = spans_get_range(textview->layers[layer], start, end, &span);
+
+		for( ; num > 0; num--, span++) {
+			size_t span_start;
+			size_t span_end;
+
+			span_start = span->offset > start ? span->offset : start;
+			span_end = span->offset + span->len < end ? span->offset + span->len : end;
+
+			memset(textview->span_colors + (span_start - start), span->color,
+			       span_end - span_start);
 		}
 	}
-
-	return(len);
 }
 
-static int _textview_input(struct widget *widget, const int event)
+static ui_color_t _textview_get_color(struct textview *textview, const size_t offset)
 {
-	return(0);
+	if(offset - textview->span_start < textview->span_len) {
+		return(textview->span_colors[offset - textview->span_start]);
+	}
+
+	return(UI_COLOR_NORMAL);
 }
 
-static int _textview_resize(struct widget *widget)
+/*
+ * Color the cells that show the bytes from `start' to `end' of a plain
+ * row, where every byte takes exactly one cell.
+ */
+static void _textview_color_plain(struct textview *textview, struct textview_row *row,
+				  const int x, const size_t start, const size_t end)
 {
-	return(0);
+	memcpy(row->colors + x, textview->span_colors + (start - textview->span_start),
+	       end - start);
 }
 
-static int _textview_draw_status(struct textview *textview)
+/*
+ * Compose the bytes from `start' to `end' of a line into a row, starting
+ * at column `x'. Tabs are expanded to the next tab stop unless the line
+ * was laid out with one column per byte.
+ */
+static int _textview_draw_bytes(struct textview *textview, struct textview_row *row, int x,
+				const char *data, const size_t offset, const size_t start,
+				const size_t end, const int expand_tabs)
 {
-	struct widget *widget;
-	char from[128];
-	char to[128];
-	char status[384];
+	size_t i;
 
-	if(!textview) {
-		return(-EINVAL);
-	}
+	for(i = start; i < end && x < textview->cols; i++) {
+		ui_color_t color;
+		unsigned char chr;
 
-	widget = (struct widget*)textview;
+		chr = (unsigned char)data[i];
+		color = _textview_get_color(textview, offset + i);
 
-	if(textview->start) {
-		telex_to_string(textview->start, from, sizeof(from));
-	} else {
-		from[0] = 0;
-	}
+		if(chr == '\n') {
+			memset(row->colors + x, color, textview->cols - x);
+			break;
+		} else if(chr == '\t' && expand_tabs) {
+			int cols;
 
-	if(textview->end) {
-		telex_to_string(textview->end, to, sizeof(to));
-	} else {
-		to[0] = 0;
+			cols = textview->tab_width - (x - textview->num_width) % textview->tab_width;
+
+			if(cols > textview->cols - x) {
+				cols = textview->cols - x;
+			}
+
+			memset(row->colors + x, color, cols);
+			x += cols;
+		} else {
+			/*
+			 * Characters that curses would expand to more than one cell
+			 * would push the rest of the run out of place.
+			 */
+			row->chars[x] = chr == '\t' ? ' ' : UI_CELL_CHAR(chr);
+			row->colors[x] = color;
+			x++;
+		}
 	}
 
-	if(!textview->start && !textview->end) {
-		status[0] = 0;
-	} else {
-		snprintf(status, sizeof(status), "Selection [ %s : %s ]",
-			 from, to);
+	return(x);
+}
+
+static void _textview_start_row(struct textview *textview, struct textview_row *row,
+				const size_t start, const size_t end)
+{
+	_textview_clear_row(textview, row);
+	row->line = textview->cur_line;
+	row->start = start;
+	row->end = end;
+	_textview_put_linenum(textview);
+	_textview_merge_spans(textview, start, end);
+}
+
+/*
+ * Compose one visual row of a line. The bytes from `start' to `end' are
+ * relative to `offset', the position of the line in the buffer.
+ */
+static void _textview_draw_row(struct textview *textview, const char *data, const size_t offset,
+			       const struct layout_line *layout, const int r, const size_t end)
+{
+	struct layout_row lrow;
+	struct textview_row *row;
+	size_t start;
+	int x;
+
+	layout_line_get_row(layout, r, &lrow);
+	row = &textview->frame[textview->pos_y];
+	start = lrow.offset;
+
+	_textview_start_row(textview, row, offset + start - (lrow.indent > 0), offset + end);
+	x = textview->num_width;
+
+	if(lrow.indent > 0) {
+		/* the rest of a tab that didn't fit into the previous row */
+		memset(row->colors + x, _textview_get_color(textview, offset + start - 1),
+		       lrow.indent);
+		x += lrow.indent;
 	}
 
-	widget_clear(widget, 0, widget->height - 1, widget->width, 1);
+	if(layout->plain) {
+		size_t len;
 
-	mvprintw(widget->y + widget->height - 1, 0, "%s", status);
-	mvchgat(widget->y + widget->height - 1, 0, -1, 0, UI_COLOR_STATUS, NULL);
+		len = end > start && data[end - 1] == '\n' ? end - start - 1 : end - start;
+		memcpy(row->chars + x, data + start, len);
+		_textview_color_plain(textview, row, x, offset + start, offset + start + len);
+		x += len;
+		start += len;
+	}
 
-	return(0);
+	_textview_draw_bytes(textview, row, x, data, offset, start, end, !layout->stride);
+	textview->pos_y++;
 }
 
-static int _textview_draw_snippet(struct textview *textview, struct snippet *snippet)
+/*
+ * Without wrapping, a line is shown from byte `hscroll' on, and tabs are
+ * expanded from there. Counting columns from the start of the line would
+ * mean walking over everything that was scrolled past, which is what we
+ * don't want for lines that are megabytes long.
+ */
+static void _textview_draw_clipped(struct textview *textview, const char *data,
+				   const size_t offset, const size_t len)
 {
-	struct line *line;
-	const char *sel_start;
-	const char *sel_end;
+	struct textview_row *row;
+	size_t start;
 
-	if(!textview || !snippet) {
-		return(-EINVAL);
-	}
+	row = &textview->frame[textview->pos_y];
+	start = textview->hscroll < len ? textview->hscroll : len;
 
-	sel_start = snippet_get_selection_start(snippet);
-	sel_end = snippet_get_selection_end(snippet);
+	/* the newline stays in view, so a selected one can still be seen */
+	if(start == len && data[len - 1] == '\n') {
+		start--;
+	}
 
-	line = snippet_get_first_line(snippet);
+	_textview_start_row(textview, row, offset + start, offset + len);
+	_textview_draw_bytes(textview, row, textview->num_width, data, offset, start, len, TRUE);
+	textview->pos_y++;
+}
 
-	if(!line) {
-		return(-EINVAL);
+/*
+ * A line of a table is drawn as one row, with each field in a column of
+ * its own. Fields that don't fit into their column are cut short, and only
+ * the fields that are in view are looked at.
+ */
+static void _textview_draw_columns(struct textview *textview, const char *data,
+				   const size_t offset, const size_t len)
+{
+	const struct columns_field *fields;
+	struct textview_row *row;
+	size_t right;
+	size_t vx;
+	int num;
+	int i;
+
+	if(columns_get_fields(textview->columns, textview->buffer, offset, len,
+			      &fields, &num) < 0) {
+		_textview_draw_clipped(textview, data, offset, len);
+		return;
 	}
 
-	_textview_reset(textview, line_get_number(line), sel_start, sel_end);
+	row = &textview->frame[textview->pos_y];
+	_textview_clear_row(textview, row);
+	row->line = textview->cur_line;
+	row->start = offset;
+	row->end = offset + len;
+	_textview_put_linenum(textview);
+
+	/* cells are counted from the left edge of the table */
+	right = textview->hscroll + textview->text_width;
+
+	for(vx = 0, i = 0; i < num && vx < right; i++) {
+		size_t shown;
+		int width;
+		int cells;
+		int j;
+
+		width = columns_get_width(textview->columns, i);
+		cells = i + 1 < num ? width + (int)sizeof(COLUMNS_SEPARATOR) - 1 : width;
+		shown = fields[i].len <= (size_t)width ? fields[i].len : (size_t)width - 1;
+		_textview_merge_spans(textview, offset + fields[i].start,
+				      offset + fields[i].start + shown);
+
+		for(j = 0; j < cells && vx + j < right; j++) {
+			unsigned char chr;
+			int x;
+
+			if(vx + j < textview->hscroll) {
+				continue;
+			}
+
+			x = textview->num_width + (vx + j - textview->hscroll);
+
+			if(j < (int)shown) {
+				chr = (unsigned char)data[fields[i].start + j];
+				row->chars[x] = UI_CELL_CHAR(chr);
+				row->colors[x] = _textview_get_color(textview,
+								     offset + fields[i].start + j);
+			} else if(j == width - 1 && shown < fields[i].len) {
+				/* there's more to the field than fits */
+				row->chars[x] = '>';
+				row->colors[x] = UI_COLOR_LINES;
+			} else if(j >= width) {
+				row->chars[x] = COLUMNS_SEPARATOR[j - width];
+				row->colors[x] = UI_COLOR_LINES;
+			}
+		}
 
-	for( ; line; line = line_get_next(line)) {
-		_textview_puts(textview, line_get_data(line));
+		vx += width + sizeof(COLUMNS_SEPARATOR) - 1;
 	}
 
-	return(0);
+	textview->pos_y++;
 }
 
-static int _textview_redraw(struct widget *widget)
+/*
+ * Compose a line from its layout, which tells where the line wraps. The
+ * layout is cached, so lines that didn't change don't have to be measured
+ * again.
+ */
+static int _textview_draw_line(struct textview *textview, const size_t offset, const size_t len,
+			       const int first_row)
 {
-	struct textview *textview;
-	struct snippet *snip;
-	int max_lines;
+	const struct layout_line *layout;
+	const char *data;
 	int err;
+	int r;
 
-	if(!widget) {
-		return(-EINVAL);
+	if(len == 0) {
+		return(0);
 	}
 
-	textview = (struct textview*)widget;
-	max_lines = widget->height - 1;
+	if(textview->text_width < 1) {
+		return(-ERANGE);
+	}
 
-	widget_clear(widget, 0, 0, widget->width, widget->height);
+	if(textview->pos_y >= textview->rows) {
+		return(-ENOSPC);
+	}
 
-	if(textview->start) {
-		err = buffer_get_snippet_telex(textview->buffer,
-					       textview->start,
-					       textview->end,
-					       max_lines,
-					       &snip);
+	data = buffer_get_data(textview->buffer) + offset;
+
+	if(textview->columns) {
+		_textview_draw_columns(textview, data, offset, len);
+	} else if(!textview->wrap) {
+		_textview_draw_clipped(textview, data, offset, len);
+	} else if((err = layout_get_line(textview->layout, textview->buffer,
+					 offset, len, &layout)) < 0) {
+		return(err);
 	} else {
-		err = buffer_get_snippet(textview->buffer, 1, max_lines,
-					 NULL, NULL, &snip);
-	}
+		for(r = first_row; r < layout->num_rows; r++) {
+			struct layout_row next;
 
-	if(!err) {
-		err = _textview_draw_snippet(textview, snip);
-		snippet_free(&snip);
+			if(textview->pos_y >= textview->rows) {
+				return(-ENOSPC);
+			}
+
+			if(r + 1 < layout->num_rows) {
+				layout_line_get_row(layout, r + 1, &next);
+			} else {
+				next.offset = len;
+			}
+
+			_textview_draw_row(textview, data, offset, layout, r, next.offset);
+		}
 	}
 
-	_textview_draw_status(textview);
+	textview->pos_x = textview->num_width;
+	textview->cur_line++;
 
-	return(err);
+	return(0);
 }
 
-static int _textview_free(struct widget *widget)
+/*
+ * A fold is drawn as a single row that tells how many lines it hides,
+ * without looking at them.
+ */
+static int _textview_draw_fold(struct textview *textview, const size_t offset,
+			       const size_t len, const int lines)
 {
-	struct textview *textview;
+	struct textview_row *row;
+	char text[32];
+	int x;
+	int i;
 
-	textview = (struct textview*)widget;
+	if(textview->pos_y >= textview->rows) {
+		return(-ENOSPC);
+	}
 
-	memset(textview, 0, sizeof(*textview));
-	free(textview);
+	row = &textview->frame[textview->pos_y];
+
+	_textview_clear_row(textview, row);
+	row->line = textview->cur_line;
+	row->start = offset;
+	row->end = offset + len;
+	_textview_put_linenum(textview);
+
+	snprintf(text, sizeof(text), "[+] %d lines", lines);
+
+	for(i = 0, x = textview->num_width; text[i] && x < textview->cols; i++, x++) {
+		row->chars[x] = text[i];
+		row->colors[x] = UI_COLOR_LINES;
+	}
+
+	textview->pos_x = textview->num_width;
+	textview->pos_y++;
 
 	return(0);
 }
 
-int textview_new(struct textview **textview)
+/*
+ * If a line is not affected by any damage and was drawn at the same
+ * position of the screen before, the rows on the screen are reused
+ * instead of composing the line again.
+ */
+static int _textview_reuse_line(struct textview *textview, const int line,
+				const size_t start, const size_t len)
 {
-	struct textview *view;
+	int row;
 
-	if(!textview) {
-		return(-EINVAL);
+	row = textview->pos_y;
+
+	if(!textview->screen_valid ||
+	   textview->num_width != textview->screen_num_width ||
+	   row >= textview->rows ||
+	   textview->screen[row].line != line ||
+	   textview->screen[row].start != start ||
+	   _textview_is_damaged(textview, start, start + len)) {
+		return(FALSE);
 	}
 
-	view = malloc(sizeof(*view));
+	for( ; row < textview->rows && textview->screen[row].line == line; row++) {
+		struct textview_row *src;
+		struct textview_row *dst;
 
-	if(!view) {
-		return(-ENOMEM);
+		src = &textview->screen[row];
+		dst = &textview->frame[row];
+
+		dst->line = src->line;
+		dst->start = src->start;
+		dst->end = src->end;
+		memcpy(dst->chars, src->chars, textview->cols);
+		memcpy(dst->colors, src->colors, textview->cols);
 	}
 
-	memset(view, 0, sizeof(*view));
+	textview->pos_x = textview->num_width;
+	textview->pos_y = row;
+	textview->cur_line++;
 
-	widget_init((struct widget*)view);
+	return(TRUE);
+}
 
-	((struct widget*)view)->input = _textview_input;
-	((struct widget*)view)->resize = _textview_resize;
-	((struct widget*)view)->redraw = _textview_redraw;
-	((struct widget*)view)->free = _textview_free;
+/*
+ * Paint a row one run of equally colored cells at a time, rather than
+ * moving the cursor and changing the attributes for every single cell.
+ */
+static int _textview_paint_row(struct textview *textview, const int y)
+{
+	struct textview_row *row;
+	struct widget *widget;
+	int x;
 
-	view->tab_width = config.tab_width;
-	view->pos_x = 0;
-	view->pos_y = 0;
+	widget = (struct widget*)textview;
+	row = &textview->frame[y];
+
+	for(x = 0; x < textview->cols; ) {
+		int len;
+
+		for(len = 1; x + len < textview->cols && row->colors[x + len] == row->colors[x]; len++);
+
+		display_put(widget->display, widget->x + x, widget->y + y,
+			    row->chars + x, len, row->colors[x]);
+
+		x += len;
+	}
 
-	*textview = view;
 	return(0);
 }
 
-int textview_set_buffer(struct textview *textview, struct buffer *buffer)
+static int _textview_rows_match(struct textview *textview, struct textview_row *a,
+			       struct textview_row *b)
 {
-	if(!textview || !buffer) {
-		return(-EINVAL);
+	return(a->line && a->line == b->line && a->start == b->start &&
+	       memcmp(a->chars, b->chars, textview->cols) == 0 &&
+	       memcmp(a->colors, b->colors, textview->cols) == 0);
+}
+
+/*
+ * Find out if the frame shows the same rows as the screen, only shifted
+ * by a few rows. A positive distance means the contents moved up.
+ */
+static int _textview_get_scroll_distance(struct textview *textview)
+{
+	int last;
+	int dist;
+
+	if(!textview->screen_valid) {
+		return(0);
+	}
+
+	last = textview->rows - 1;
+
+	for(dist = 1; dist <= textview->rows / 2; dist++) {
+		if(_textview_rows_match(textview, &textview->frame[0], &textview->screen[dist]) &&
+		   _textview_rows_match(textview, &textview->frame[last - dist],
+					&textview->screen[last])) {
+			return(dist);
+		}
+
+		if(_textview_rows_match(textview, &textview->frame[dist], &textview->screen[0]) &&
+		   _textview_rows_match(textview, &textview->frame[last],
+					&textview->screen[last - dist])) {
+			return(-dist);
+		}
 	}
 
-	textview->buffer = buffer;
 	return(0);
 }
 
-int textview_set_selection(struct textview *textview, struct telex *start, struct telex *end)
+/*
+ * Let the terminal move the rows that are still visible, so that only the
+ * rows that came into view have to be sent. The screen model is shifted
+ * along with the screen, leaving blank rows where new ones appeared.
+ */
+static int _textview_scroll(struct textview *textview, const int dist)
 {
-	int selection_changed;
+	struct textview_row *rows;
+	struct widget *widget;
+	int y;
 
-	if(!textview) {
-		return(-EINVAL);
-	}
+	widget = (struct widget*)textview;
 
-	selection_changed = FALSE;
+	display_scroll(widget->display, widget->y, widget->y + textview->rows - 1, dist);
 
-	if(textview->start != start || textview->end != end) {
-		selection_changed = TRUE;
+	if(!(rows = malloc(sizeof(*rows) * textview->rows))) {
+		textview->screen_valid = FALSE;
+		return(-ENOMEM);
 	}
 
-	textview->start = start;
-	textview->end = end;
+	for(y = 0; y < textview->rows; y++) {
+		rows[y] = textview->screen[(y + dist + textview->rows) % textview->rows];
+	}
 
-	if(selection_changed) {
-		widget_redraw((struct widget*)textview);
+	memcpy(textview->screen, rows, sizeof(*rows) * textview->rows);
+	free(rows);
+
+	for(y = dist > 0 ? textview->rows - dist : 0;
+	    y < (dist > 0 ? textview->rows : -dist); y++) {
+		textview->screen[y].line = 0;
+		memset(textview->screen[y].chars, ' ', textview->cols);
+		memset(textview->screen[y].colors, UI_COLOR_DEFAULT, textview->cols);
 	}
 
 	return(0);
 }
 
-int textview_set_selection_start(struct textview *textview, struct telex *start)
+/*
+ * Paint the rows of the composed frame that differ from what is on the
+ * screen, and make the frame the new screen model.
+ */
+static int _textview_paint(struct textview *textview)
 {
-	int selection_changed;
+	struct textview_row *swap;
+	int dist;
+	int y;
 
-	if(!textview) {
-		return(-EINVAL);
+	if((dist = _textview_get_scroll_distance(textview)) != 0) {
+		_textview_scroll(textview, dist);
 	}
 
-	selection_changed = textview->start != start;
-	textview->start = start;
+	for(y = 0; y < textview->rows; y++) {
+		if(textview->screen_valid &&
+		   memcmp(textview->frame[y].chars, textview->screen[y].chars, textview->cols) == 0 &&
+		   memcmp(textview->frame[y].colors, textview->screen[y].colors, textview->cols) == 0) {
+			continue;
+		}
 
-	if(selection_changed) {
-		widget_redraw((struct widget*)textview);
+		_textview_paint_row(textview, y);
 	}
 
+	swap = textview->screen;
+	textview->screen = textview->frame;
+	textview->frame = swap;
+	textview->screen_valid = TRUE;
+	textview->screen_num_width = textview->num_width;
+
 	return(0);
 }
 
-int textview_set_selection_end(struct textview *textview, struct telex *end)
+static int _textview_input(struct widget *widget, const int event)
 {
-	int selection_changed;
+	return(0);
+}
 
-	if(!textview) {
+static int _textview_resize(struct widget *widget)
+{
+	if(!widget) {
 		return(-EINVAL);
 	}
 
-	selection_changed = textview->end != end;
+	((struct textview*)widget)->screen_valid = FALSE;
+	return(0);
+}
+
+static int _textview_draw_status(struct textview *textview)
+{
+	struct widget *widget;
+	char from[128];
+	char to[128];
+	char status[384];
+	int info;
+	int len;
+
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	widget = (struct widget*)textview;
+	len = 0;
+
+	if(textview->hex) {
+		len = snprintf(status, sizeof(status), "Hex [ %zx ]  ", textview->screen_sel.start);
+	} else if(textview->filter) {
+		len = snprintf(status, sizeof(status), "Grep [ %s ] %d lines  ",
+			       filter_get_pattern(textview->filter),
+			       filter_get_count(textview->filter));
+
+		if(len >= (int)sizeof(status)) {
+			len = sizeof(status) - 1;
+		}
+	}
+
+	if(textview->json && !textview->hex) {
+		len += snprintf(status + len, sizeof(status) - len, "Json [ depth %d ]  ",
+				textview->json_depth);
+	}
+
+	if(textview->diff && !textview->hex) {
+		const struct diff_hunk *hunks;
+		int added;
+		int removed;
+		int num;
+		int i;
+
+		added = 0;
+		removed = 0;
+
+		if(diff_get_hunks(textview->diff, &hunks, &num) == 0) {
+			for(i = 0; i < num; i++) {
+				added += hunks[i].new_lines;
+				removed += hunks[i].old_lines;
+			}
+		}
+
+		len += snprintf(status + len, sizeof(status) - len, "Diff [ +%d -%d ]  ",
+				added, removed);
+	}
+
+	if(textview->columns && !textview->hex) {
+		char delimiter[2];
+
+		delimiter[0] = columns_get_delimiter(textview->columns);
+		delimiter[1] = 0;
+		len += snprintf(status + len, sizeof(status) - len, "Columns [ %s ] %d fields  ",
+				delimiter[0] == '\t' ? "tab" : delimiter,
+				columns_get_count(textview->columns));
+
+		if(len >= (int)sizeof(status)) {
+			len = sizeof(status) - 1;
+		}
+	}
+
+	if(textview->start) {
+		telex_to_string(textview->start, from, sizeof(from));
+	} else {
+		from[0] = 0;
+	}
+
+	if(textview->end) {
+		telex_to_string(textview->end, to, sizeof(to));
+	} else {
+		to[0] = 0;
+	}
+
+	if(!textview->start && !textview->end) {
+		status[len] = 0;
+	} else {
+		snprintf(status + len, sizeof(status) - len, "Selection [ %s : %s ]",
+			 from, to);
+	}
+
+	/* the info goes to the right end of the status line, if there is room */
+	len = strlen(status);
+	info = strlen(textview->info);
+
+	if(info > 0 && len + info < widget->width && widget->width < (int)sizeof(status)) {
+		snprintf(status + len, sizeof(status) - len, "%*s",
+			 widget->width - len, textview->info);
+	}
+
+	/* the status line is only painted when it changed */
+	if(textview->screen_valid && strcmp(status, textview->status) == 0) {
+		return(0);
+	}
+
+	snprintf(textview->status, sizeof(textview->status), "%s", status);
+	display_fill(widget->display, widget->x, widget->y + widget->height - 1,
+		     widget->width, ' ', UI_COLOR_STATUS);
+	display_put(widget->display, widget->x, widget->y + widget->height - 1,
+		    status, widget->width, UI_COLOR_STATUS);
+
+	return(0);
+}
+
+/*
+ * The snippet's selection points into its copies of the lines, so we look
+ * for the line that contains it to get the offset in the buffer.
+ */
+static int _snippet_get_offset(struct snippet *snippet, const char *base, const char *pos,
+			       size_t *offset)
+{
+	struct line *line;
+
+	if(!pos) {
+		return(-ENOENT);
+	}
+
+	for(line = snippet_get_first_line(snippet); line; line = line_get_next(line)) {
+		const char *data;
+
+		data = line_get_data(line);
+
+		if(pos >= data && pos < data + line_get_length(line)) {
+			*offset = (line_get_source(line) - base) + (pos - data);
+			return(0);
+		}
+	}
+
+	return(-ENOENT);
+}
+
+static int _textview_set_selection_range(struct textview *textview, struct snippet *snippet)
+{
+	const char *base;
+	size_t start;
+	size_t end;
+
+	base = buffer_get_data(textview->buffer);
+
+	if(_snippet_get_offset(snippet, base, snippet_get_selection_start(snippet), &start) < 0) {
+		/* without a visible start, nothing is highlighted */
+		start = 0;
+		end = 0;
+	} else if(_snippet_get_offset(snippet, base, snippet_get_selection_end(snippet), &end) < 0) {
+		end = start + 1;
+	}
+
+	spans_clear(textview->selection);
+
+	if(start < end) {
+		spans_add(textview->selection, start, end - start, UI_COLOR_SELECTION);
+	}
+
+	if(start != textview->screen_sel.start || end != textview->screen_sel.end) {
+		_textview_add_damage(textview, textview->screen_sel.start, textview->screen_sel.end);
+		_textview_add_damage(textview, start, end);
+
+		textview->screen_sel.start = start;
+		textview->screen_sel.end = end;
+	}
+
+	return(0);
+}
+
+/*
+ * Have the syntax highlighter catch up with the lines of the snippet.
+ * Lines that start in a different state than before are drawn again,
+ * even if they weren't edited.
+ */
+static void _textview_update_highlight(struct textview *textview, struct snippet *snippet)
+{
+	struct line *first;
+	struct line *last;
+	size_t start;
+	size_t end;
+
+	/* the lines between those of a filtered view would all have to be lexed */
+	if(!textview->highlight || textview->filter) {
+		return;
+	}
+
+	first = snippet_get_first_line(snippet);
+
+	for(last = first; line_get_next(last); last = line_get_next(last));
+
+	if(highlight_update(textview->highlight, textview->buffer, line_get_number(first),
+			    line_get_number(last), &start, &end) == 0) {
+		_textview_add_damage(textview, start, end);
+	}
+}
+
+/*
+ * Views of the same buffer share a layout as long as they lay out lines
+ * alike. A view that needs a different layout takes a peer's if it fits,
+ * and otherwise gets one of its own rather than flushing the shared one.
+ */
+static void _textview_configure_layout(struct textview *textview)
+{
+	struct textview *peer;
+	struct layout *layout;
+	int wrap;
+
+	/* the rows of a table aren't wrapped */
+	wrap = textview->wrap && !textview->columns;
+
+	if(layout_is_configured(textview->layout, textview->text_width, textview->tab_width,
+				wrap)) {
+		return;
+	}
+
+	for(peer = textview->peer; peer != textview; peer = peer->peer) {
+		if(layout_is_configured(peer->layout, textview->text_width, textview->tab_width,
+					wrap)) {
+			layout_ref(peer->layout);
+			layout_free(&textview->layout);
+			textview->layout = peer->layout;
+			return;
+		}
+	}
+
+	if(layout_get_refs(textview->layout) > 1 && layout_new(&layout) == 0) {
+		layout_free(&textview->layout);
+		textview->layout = layout;
+	}
+
+	layout_configure(textview->layout, textview->text_width, textview->tab_width, wrap);
+}
+
+static int _textview_draw_snippet(struct textview *textview, struct snippet *snippet,
+				  int first_row)
+{
+	struct line *line;
+	struct line *last;
+	const char *base;
+
+	if(!textview || !snippet) {
+		return(-EINVAL);
+	}
+
+	line = snippet_get_first_line(snippet);
+
+	if(!line) {
+		return(-EINVAL);
+	}
+
+	_textview_set_selection_range(textview, snippet);
+	_textview_update_highlight(textview, snippet);
+	_textview_reset(textview, line_get_number(line));
+
+	/* the lines of a filtered view are far apart, so the numbers may be wider */
+	for(last = line; line_get_next(last); last = line_get_next(last));
+
+	if(line_get_number(last) > textview->first_line + ((struct widget*)textview)->height - 1) {
+		_textview_set_num_width(textview, line_get_number(last));
+	}
+
+	_textview_configure_layout(textview);
+	base = buffer_get_data(textview->buffer);
+
+	for( ; line && textview->pos_y < textview->rows; line = line_get_next(line)) {
+		size_t offset;
+
+		offset = line_get_source(line) - base;
+		textview->cur_line = line_get_number(line);
+
+		if(line_get_folded(line) > 0) {
+			if(_textview_draw_fold(textview, offset, line_get_length(line),
+					       line_get_folded(line)) < 0) {
+				break;
+			}
+		} else if((first_row > 0 ||
+			   !_textview_reuse_line(textview, line_get_number(line), offset,
+						 line_get_length(line))) &&
+			  _textview_draw_line(textview, offset, line_get_length(line), first_row) < 0) {
+			break;
+		}
+
+		first_row = 0;
+	}
+
+	return(0);
+}
+
+/*
+ * Find the visual row that the view starts with: the selection is centered
+ * if it fits on the screen, and the last row of the buffer is at the bottom
+ * in tail mode.
+ */
+static int _textview_get_first_row(struct textview *textview, const char *sel_start,
+				   const char *sel_end, struct layout_pos *first)
+{
+	struct layout_pos last;
+	struct layout_pos cur;
+	const char *data;
+	int span;
+	int err;
+
+	data = buffer_get_data(textview->buffer);
+
+	if(!sel_start) {
+		if(!textview->tail) {
+			return(layout_get_pos(textview->layout, textview->buffer, 0, first));
+		}
+
+		if((err = layout_get_pos(textview->layout, textview->buffer,
+					 buffer_get_size(textview->buffer), first)) < 0) {
+			return(err);
+		}
+
+		return(layout_move(textview->layout, textview->buffer, first, 1 - textview->rows));
+	}
+
+	if((err = layout_get_pos(textview->layout, textview->buffer, sel_start - data, first)) < 0 ||
+	   (err = layout_get_pos(textview->layout, textview->buffer, sel_end - data - 1, &last)) < 0) {
+		return(err);
+	}
+
+	/* a selection that doesn't fit on the screen is shown from its start */
+	for(cur = *first, span = 1; span < textview->rows; span++) {
+		if((cur.offset == last.offset && cur.row == last.row) ||
+		   layout_move(textview->layout, textview->buffer, &cur, 1) < 1) {
+			break;
+		}
+	}
+
+	if(span < textview->rows) {
+		return(layout_move(textview->layout, textview->buffer, first,
+				   (span - textview->rows) / 2));
+	}
+
+	return(0);
+}
+
+/*
+ * When lines aren't wrapped, scroll horizontally to a selection that moved
+ * out of view, so that it ends up in the middle.
+ */
+static void _textview_follow_selection(struct textview *textview, const char *sel_start)
+{
+	size_t offset;
+	size_t start;
+	size_t len;
+	size_t col;
+	int field;
+	int line;
+	int x;
+
+	offset = sel_start - buffer_get_data(textview->buffer);
+
+	if(offset == textview->screen_sel.start ||
+	   buffer_get_line_range(textview->buffer, offset, &line, &start, &len) < 0) {
+		return;
+	}
+
+	if(textview->columns) {
+		/* if the field can't be found, the view stays where it is */
+		if((field = columns_find_field(textview->columns, textview->buffer, offset)) < 0 ||
+		   (x = columns_get_x(textview->columns, field)) < 0) {
+			return;
+		}
+
+		col = x;
+	} else {
+		col = offset - start;
+	}
+
+	if(col >= textview->hscroll && col < textview->hscroll + textview->text_width) {
+		return;
+	}
+
+	textview->hscroll = col > textview->text_width / 2 ? col - textview->text_width / 2 : 0;
+	textview->screen_valid = FALSE;
+}
+
+/*
+ * A filtered view shows the matches around the selection, or the last ones
+ * in tail mode. Each of them is taken to fill one row.
+ */
+static int _textview_get_filtered_snippet(struct textview *textview, const char *sel_start,
+					  const char *sel_end, struct snippet **snip)
+{
+	int count;
+	int first;
+	int err;
+
+	if((err = filter_update(textview->filter, textview->buffer)) < 0) {
+		return(err);
+	}
+
+	count = filter_get_count(textview->filter);
+
+	if(sel_start) {
+		first = filter_find(textview->filter,
+				    buffer_get_line_at(textview->buffer, sel_start));
+		first -= textview->rows / 2;
+	} else if(textview->tail) {
+		first = count;
+	} else {
+		first = 0;
+	}
+
+	if(first > count - textview->rows) {
+		first = count - textview->rows;
+	}
+
+	if(first < 0) {
+		first = 0;
+	}
+
+	return(buffer_get_snippet_lines(textview->buffer, filter_get_lines(textview->filter) + first,
+					count - first < textview->rows ? count - first : textview->rows,
+					sel_start, sel_end, snip));
+}
+
+/*
+ * Get the lines that fill the screen, counting the rows that wrapped lines
+ * take. The first line may have been wrapped into more rows than fit above
+ * the selection, in which case the view starts with `first_row' of them.
+ */
+static int _textview_get_snippet(struct textview *textview, struct snippet **snip,
+				 int *first_row)
+{
+	struct layout_pos first;
+	struct layout_pos last;
+	const char *sel_start;
+	const char *sel_end;
+	int lines;
+	int guess;
+	int err;
+	int i;
+
+	if(!textview->buffer) {
+		return(-EBADFD);
+	}
+
+	sel_start = NULL;
+	sel_end = NULL;
+
+	if(textview->start &&
+	   (err = buffer_get_selection(textview->buffer, textview->start, textview->end,
+				       &sel_start, &sel_end)) < 0) {
+		return(err);
+	}
+
+	if(textview->filter) {
+		*first_row = 0;
+		return(_textview_get_filtered_snippet(textview, sel_start, sel_end, snip));
+	}
+
+	/*
+	 * The width of the text depends on the width of the line numbers, so
+	 * the first line may have to be looked for again with the right one.
+	 */
+	for(guess = textview->first_line, i = 0; i < 2; i++) {
+		_textview_reset(textview, guess);
+		_textview_configure_layout(textview);
+
+		if((err = _textview_get_first_row(textview, sel_start, sel_end, &first)) < 0 ||
+		   _number_width(first.line + textview->rows) == _number_width(guess + textview->rows)) {
+			break;
+		}
+
+		guess = first.line;
+	}
+
+	if((!textview->wrap || textview->columns) && sel_start) {
+		_textview_follow_selection(textview, sel_start);
+	}
+
+	if(err < 0) {
+		/* there is nothing to lay out in an empty buffer */
+		first.line = 1;
+		first.row = 0;
+		lines = textview->rows;
+	} else {
+		last = first;
+		layout_move(textview->layout, textview->buffer, &last, textview->rows - 1);
+		lines = last.line - first.line + 1;
+	}
+
+	*first_row = first.row;
+	return(buffer_get_snippet(textview->buffer, first.line, lines, sel_start, sel_end, snip));
+}
+
+static void _textview_draw_hex_row(struct textview *textview, const char *data,
+				   const size_t size, const size_t offset, const int bytes)
+{
+	static const char digits[] = "0123456789abcdef";
+	struct textview_row *row;
+	char addr[32];
+	size_t end;
+	size_t i;
+	int x;
+
+	row = &textview->frame[textview->pos_y];
+	end = offset + bytes < size ? offset + bytes : size;
+
+	_textview_clear_row(textview, row);
+	row->line = (int)(offset / bytes) + 1;
+	row->start = offset;
+	row->end = end;
+
+	snprintf(addr, sizeof(addr), "%0*zx", textview->num_width - 2, offset);
+
+	for(x = 0; x < textview->num_width - 2 && x < textview->cols; x++) {
+		row->chars[x] = addr[x];
+		row->colors[x] = UI_COLOR_LINES;
+	}
+
+	_textview_merge_spans(textview, offset, end);
+
+	for(i = offset; i < end; i++) {
+		unsigned char chr;
+		ui_color_t color;
+
+		chr = (unsigned char)data[i];
+		color = _textview_get_color(textview, i);
+		x = textview->num_width + (i - offset) * 3;
+
+		if(x + 1 < textview->cols) {
+			row->chars[x] = digits[chr >> 4];
+			row->chars[x + 1] = digits[chr & 0xf];
+			row->colors[x] = color;
+			row->colors[x + 1] = color;
+		}
+
+		x = textview->num_width + bytes * 3 + 1 + (i - offset);
+
+		if(x < textview->cols) {
+			row->chars[x] = isprint(chr) ? chr : '.';
+			row->colors[x] = color;
+		}
+	}
+
+	textview->pos_y++;
+}
+
+/*
+ * The hex view shows a fixed number of bytes per row, so the offset of
+ * every row follows from the first one and nothing has to be scanned for
+ * newlines, no matter how large the buffer is. Only the rows on the screen
+ * are composed.
+ */
+static int _textview_draw_hex(struct textview *textview)
+{
+	const char *sel_start;
+	const char *sel_end;
+	const char *data;
+	size_t first;
+	size_t total;
+	size_t size;
+	size_t row;
+	int digits;
+	int bytes;
+	int err;
+
+	if(!textview->buffer) {
+		return(-EBADFD);
+	}
+
+	sel_start = NULL;
+	sel_end = NULL;
+
+	if(textview->start &&
+	   (err = buffer_get_selection(textview->buffer, textview->start, textview->end,
+				       &sel_start, &sel_end)) < 0) {
+		return(err);
+	}
+
+	data = buffer_get_data(textview->buffer);
+	size = buffer_get_size(textview->buffer);
+
+	for(digits = 8; digits < 16 && size >> (digits * 4); digits++);
+
+	/* the address takes the place of the line number */
+	textview->num_width = digits + 2;
+	textview->text_width = ((struct widget*)textview)->width - textview->num_width;
+	textview->pos_x = textview->num_width;
+
+	/* each byte takes three cells in the middle and one on the right */
+	for(bytes = 16; bytes > 1 && bytes * 4 + 1 > textview->text_width; bytes /= 2);
+
+	total = size > 0 ? (size - 1) / bytes + 1 : 1;
+	first = textview->hex_offset / bytes;
+
+	if(sel_start) {
+		row = (sel_start - data) / bytes;
+
+		if(row < first || row >= first + textview->rows) {
+			first = row > (size_t)textview->rows / 2 ? row - textview->rows / 2 : 0;
+		}
+	} else if(textview->tail) {
+		first = total > (size_t)textview->rows ? total - textview->rows : 0;
+	}
+
+	if(first >= total) {
+		first = total - 1;
+	}
+
+	textview->hex_offset = first * bytes;
+
+	spans_clear(textview->selection);
+	textview->screen_sel.start = 0;
+	textview->screen_sel.end = 0;
+
+	if(sel_start) {
+		spans_add(textview->selection, sel_start - data, sel_end - sel_start,
+			  UI_COLOR_SELECTION);
+		textview->screen_sel.start = sel_start - data;
+		textview->screen_sel.end = sel_end - data;
+	}
+
+	for(row = first; row < total && textview->pos_y < textview->rows; row++) {
+		_textview_draw_hex_row(textview, data, size, row * bytes, bytes);
+	}
+
+	return(0);
+}
+
+static void _textview_draw_json_row(struct textview *textview, const struct json_row *json_row,
+				    const int selected)
+{
+	struct textview_row *row;
+	char offset[32];
+	int width;
+	int x;
+
+	row = &textview->frame[textview->pos_y];
+
+	_textview_clear_row(textview, row);
+	row->line = 1;
+	row->start = json_row->start;
+	row->end = json_row->start + 1;
+
+	snprintf(offset, sizeof(offset), "%*zu", textview->num_width - 1, json_row->start);
+
+	for(x = 0; x < textview->num_width - 1 && x < textview->cols; x++) {
+		row->chars[x] = offset[x];
+		row->colors[x] = UI_COLOR_LINES;
+	}
+
+	width = json_format_row(textview->json, textview->buffer, json_row,
+				row->chars + textview->num_width,
+				row->colors + textview->num_width, textview->text_width);
+
+	if(selected) {
+		for(x = 0; x < width; x++) {
+			row->colors[textview->num_width + x] = UI_COLOR_SELECTION;
+		}
+	}
+
+	textview->pos_y++;
+}
+
+/*
+ * The structural view formats one row for each member of an object and
+ * each element of an array, starting with the row that was on top of the
+ * screen the last time. Only the rows on the screen are ever formatted,
+ * and they are found by stepping from one row to the next, which is why
+ * the row at the top is kept instead of a row number.
+ */
+static int _textview_draw_json(struct textview *textview)
+{
+	struct json_row selected;
+	struct json_row row;
+	const char *sel_start;
+	const char *sel_end;
+	size_t size;
+	int digits;
+	int err;
+	int y;
+
+	if(!textview->buffer) {
+		return(-EBADFD);
+	}
+
+	if((err = json_update(textview->json, textview->buffer)) < 0) {
+		return(err);
+	}
+
+	sel_start = NULL;
+	sel_end = NULL;
+
+	if(textview->start &&
+	   (err = buffer_get_selection(textview->buffer, textview->start, textview->end,
+				       &sel_start, &sel_end)) < 0) {
+		return(err);
+	}
+
+	size = buffer_get_size(textview->buffer);
+
+	for(digits = 1; size >= 10; size /= 10) {
+		digits++;
+	}
+
+	/* the offset of a row takes the place of the line number */
+	textview->num_width = digits + 1;
+	textview->text_width = ((struct widget*)textview)->width - textview->num_width;
+	textview->pos_x = textview->num_width;
+
+	if(textview->text_width < 1) {
+		return(-ERANGE);
+	}
+
+	/* the top row may have been folded away, or edited */
+	if(json_find_row(textview->json, textview->buffer, textview->json_top.start, &row) < 0) {
+		return(0);
+	}
+
+	spans_clear(textview->selection);
+	textview->screen_sel.start = 0;
+	textview->screen_sel.end = 0;
+	textview->json_depth = row.depth;
+
+	if(sel_start &&
+	   json_find_row(textview->json, textview->buffer,
+			 sel_start - buffer_get_data(textview->buffer), &selected) == 0) {
+		struct json_row probe;
+
+		textview->screen_sel.start = sel_start - buffer_get_data(textview->buffer);
+		textview->screen_sel.end = sel_end - buffer_get_data(textview->buffer);
+		textview->json_depth = selected.depth;
+
+		for(probe = row, y = 1;
+		    probe.start != selected.start && y < textview->rows &&
+			    json_next_row(textview->json, textview->buffer, &probe) == 0;
+		    y++);
+
+		/* scroll the selected row into the middle of the screen */
+		if(probe.start != selected.start) {
+			row = selected;
+
+			for(y = 0; y < textview->rows / 2 &&
+				    json_prev_row(textview->json, textview->buffer, &row) == 0; y++);
+		}
+	} else {
+		selected.start = SIZE_MAX;
+	}
+
+	textview->json_top = row;
+
+	do {
+		_textview_draw_json_row(textview, &row, row.start == selected.start);
+	} while(textview->pos_y < textview->rows &&
+		json_next_row(textview->json, textview->buffer, &row) == 0);
+
+	return(0);
+}
+
+/* the number of lines that were removed in front of new line `line' */
+static int _textview_diff_deleted(struct textview *textview, const int line)
+{
+	const struct diff_hunk *hunks;
+	int num;
+	int h;
+
+	if(diff_get_hunks(textview->diff, &hunks, &num) < 0) {
+		return(0);
+	}
+
+	h = diff_find(textview->diff, line);
+
+	return(h < num && hunks[h].new_line == line ? hunks[h].old_lines : 0);
+}
+
+/*
+ * A row of the diff view is either the `del'-th line that was removed in
+ * front of new line `line', or the line itself if `del' is the number of
+ * removed lines. The lines that were removed at the end of the buffer are
+ * in front of the line after the last one.
+ */
+static int _textview_diff_valid(struct textview *textview, const int line, const int del)
+{
+	int lines;
+
+	lines = diff_get_count(textview->diff, DIFF_NEW);
+
+	if(line < 1 || line > lines + 1 || del < 0) {
+		return(FALSE);
+	}
+
+	return(line <= lines ? del <= _textview_diff_deleted(textview, line) :
+	       del < _textview_diff_deleted(textview, line));
+}
+
+static int _textview_diff_next(struct textview *textview, int *line, int *del)
+{
+	if(_textview_diff_valid(textview, *line, *del + 1)) {
+		(*del)++;
+	} else if(_textview_diff_valid(textview, *line + 1, 0)) {
+		(*line)++;
+		*del = 0;
+	} else {
+		return(-ERANGE);
+	}
+
+	return(0);
+}
+
+static int _textview_diff_prev(struct textview *textview, int *line, int *del)
+{
+	if(*del > 0) {
+		(*del)--;
+	} else if(*line > 1) {
+		(*line)--;
+		*del = _textview_diff_deleted(textview, *line);
+	} else {
+		return(-ERANGE);
+	}
+
+	return(0);
+}
+
+/* whether new line `line' was added or changed */
+static int _textview_diff_inserted(struct textview *textview, const int line)
+{
+	const struct diff_hunk *hunks;
+	int num;
+	int h;
+
+	if(diff_get_hunks(textview->diff, &hunks, &num) < 0) {
+		return(FALSE);
+	}
+
+	/* the last hunk that starts on the line or in front of it */
+	h = diff_find(textview->diff, line + 1) - 1;
+
+	return(h >= 0 && line < hunks[h].new_line + hunks[h].new_lines);
+}
+
+static void _textview_draw_diff_row(struct textview *textview, const int line, const int del,
+				    const int selected)
+{
+	struct textview_row *row;
+	const char *data;
+	ui_color_t color;
+	char num[16];
+	size_t len;
+	size_t i;
+	int deleted;
+	char mark;
+	int x;
+
+	row = &textview->frame[textview->pos_y];
+	deleted = _textview_diff_deleted(textview, line);
+
+	_textview_clear_row(textview, row);
+	row->line = line;
+	row->start = del;
+	row->end = del + 1;
+
+	if(del < deleted) {
+		const struct diff_hunk *hunks;
+		int n;
+
+		diff_get_hunks(textview->diff, &hunks, &n);
+
+		if(diff_get_line(textview->diff, DIFF_OLD,
+				 hunks[diff_find(textview->diff, line)].old_line + del, &data, &len) < 0) {
+			len = 0;
+		}
+
+		snprintf(num, sizeof(num), "%*s", textview->num_width - 3, "");
+		color = UI_COLOR_DELETION;
+		mark = '-';
+	} else {
+		if(diff_get_line(textview->diff, DIFF_NEW, line, &data, &len) < 0) {
+			len = 0;
+		}
+
+		snprintf(num, sizeof(num), "%*d", textview->num_width - 3, line);
+
+		if(_textview_diff_inserted(textview, line)) {
+			color = UI_COLOR_INSERTION;
+			mark = '+';
+		} else {
+			color = UI_COLOR_NORMAL;
+			mark = ' ';
+		}
+	}
+
+	for(x = 0; x < textview->num_width - 3 && x < textview->cols; x++) {
+		row->chars[x] = num[x];
+		row->colors[x] = UI_COLOR_LINES;
+	}
+
+	if(x + 1 < textview->cols) {
+		row->chars[x + 1] = mark;
+		row->colors[x + 1] = color;
+	}
+
+	if(selected) {
+		color = UI_COLOR_SELECTION;
+	}
+
+	/* like the text, the lines are shown from byte `hscroll' on */
+	for(i = textview->hscroll, x = textview->num_width; i < len && x < textview->cols; i++) {
+		unsigned char chr;
+
+		chr = (unsigned char)data[i];
+
+		if(chr == '\t') {
+			int cols;
+
+			cols = textview->tab_width - (x - textview->num_width) % textview->tab_width;
+
+			if(cols > textview->cols - x) {
+				cols = textview->cols - x;
+			}
+
+			memset(row->colors + x, color, cols);
+			x += cols;
+		} else {
+			row->chars[x] = UI_CELL_CHAR(chr);
+			row->colors[x] = color;
+			x++;
+		}
+	}
+
+	textview->pos_y++;
+}
+
+/*
+ * The diff view shows the lines of the buffer along with the lines of the
+ * base that were removed, which are found with the hunks of the diff. The
+ * rows are found by stepping from the row on top of the screen, so only
+ * the hunks around the rows on the screen are ever looked at.
+ */
+static int _textview_draw_diff(struct textview *textview)
+{
+	const char *sel_start;
+	const char *sel_end;
+	int selected;
+	int lines;
+	int line;
+	int del;
+	int err;
+	int y;
+
+	if(!textview->buffer) {
+		return(-EBADFD);
+	}
+
+	if((err = diff_update(textview->diff, textview->buffer)) < 0) {
+		return(err);
+	}
+
+	sel_start = NULL;
+	sel_end = NULL;
+
+	if(textview->start &&
+	   (err = buffer_get_selection(textview->buffer, textview->start, textview->end,
+				       &sel_start, &sel_end)) < 0) {
+		return(err);
+	}
+
+	lines = diff_get_count(textview->diff, DIFF_NEW);
+	line = diff_get_count(textview->diff, DIFF_OLD);
+
+	/* the number, a blank, the mark, and another blank */
+	textview->num_width = _number_width(lines > line ? lines : line) + 2;
+	textview->text_width = ((struct widget*)textview)->width - textview->num_width;
+	textview->pos_x = textview->num_width;
+
+	if(textview->text_width < 1) {
+		return(-ERANGE);
+	}
+
+	/* the buffer may have lost the lines that were on top of the screen */
+	line = textview->diff_top_line < lines + 1 ? textview->diff_top_line : lines + 1;
+	del = textview->diff_top_del;
+
+	if(line < 1) {
+		line = 1;
+	}
+
+	if(!_textview_diff_valid(textview, line, del)) {
+		del = _textview_diff_deleted(textview, line);
+
+		if(!_textview_diff_valid(textview, line, del) &&
+		   _textview_diff_prev(textview, &line, &del) < 0) {
+			/* neither side has any lines */
+			return(0);
+		}
+	}
+
+	spans_clear(textview->selection);
+	textview->screen_sel.start = 0;
+	textview->screen_sel.end = 0;
+	selected = 0;
+
+	if(sel_start) {
+		int probe_line;
+		int probe_del;
+		int sel_del;
+
+		textview->screen_sel.start = sel_start - buffer_get_data(textview->buffer);
+		textview->screen_sel.end = sel_end - buffer_get_data(textview->buffer);
+		selected = diff_find_line(textview->diff, DIFF_NEW, textview->screen_sel.start);
+
+		if(selected > lines) {
+			selected = lines;
+		}
+
+		sel_del = _textview_diff_deleted(textview, selected);
+		probe_line = line;
+		probe_del = del;
+
+		for(y = 1; (probe_line != selected || probe_del != sel_del) && y < textview->rows &&
+			    _textview_diff_next(textview, &probe_line, &probe_del) == 0; y++);
+
+		/* scroll the selected line into the middle of the screen */
+		if(selected > 0 && (probe_line != selected || probe_del != sel_del)) {
+			line = selected;
+			del = sel_del;
+
+			for(y = 0; y < textview->rows / 2 &&
+				    _textview_diff_prev(textview, &line, &del) == 0; y++);
+		}
+	}
+
+	textview->diff_top_line = line;
+	textview->diff_top_del = del;
+
+	do {
+		_textview_draw_diff_row(textview, line, del,
+					line == selected && del == _textview_diff_deleted(textview, line));
+	} while(textview->pos_y < textview->rows &&
+		_textview_diff_next(textview, &line, &del) == 0);
+
+	return(0);
+}
+
+/*
+ * Find out which parts of the buffer were changed since the last redraw.
+ * The selection is added to the damage once the snippet is known.
+ */
+static void _textview_collect_damage(struct textview *textview)
+{
+	size_t start;
+	size_t end;
+
+	textview->num_damage = 0;
+
+	if(!textview->buffer) {
+		return;
+	}
+
+	if(buffer_get_damage(textview->buffer, textview->generation, &start, &end) > 0) {
+		_textview_add_damage(textview, start, end);
+	}
+
+	/* rows may have been folded into one, or unfolded */
+	if(textview->fold_generation != buffer_get_fold_generation(textview->buffer)) {
+		textview->fold_generation = buffer_get_fold_generation(textview->buffer);
+		textview->screen_valid = FALSE;
+	}
+
+	/* lines whose highlights changed have to be composed again, too */
+	_textview_add_damage(textview, textview->restyle.start, textview->restyle.end);
+	textview->restyle.start = 0;
+	textview->restyle.end = 0;
+
+	textview->generation = buffer_get_generation(textview->buffer);
+	layout_update(textview->layout, textview->buffer);
+}
+
+static int _textview_redraw(struct widget *widget)
+{
+	struct textview *textview;
+	struct snippet *snip;
+	int first_row;
+	int err;
+
+	if(!widget) {
+		return(-EINVAL);
+	}
+
+	textview = (struct textview*)widget;
+
+	if(_textview_adjust_rows(textview) < 0) {
+		return(0);
+	}
+
+	_textview_collect_damage(textview);
+	_textview_reset(textview, textview->first_line);
+
+	if(textview->hex) {
+		err = _textview_draw_hex(textview);
+	} else if(textview->json && json_update(textview->json, textview->buffer) == 0) {
+		err = _textview_draw_json(textview);
+	} else if(textview->diff && diff_update(textview->diff, textview->buffer) == 0) {
+		err = _textview_draw_diff(textview);
+	} else if(!(err = _textview_get_snippet(textview, &snip, &first_row))) {
+		err = _textview_draw_snippet(textview, snip, first_row);
+		snippet_free(&snip);
+	}
+
+	/* whatever wasn't drawn on is blank */
+	if(textview->pos_x > textview->num_width) {
+		textview->pos_y++;
+	}
+
+	for( ; textview->pos_y < textview->rows; textview->pos_y++) {
+		_textview_clear_row(textview, &textview->frame[textview->pos_y]);
+	}
+
+	_textview_draw_status(textview);
+	_textview_paint(textview);
+
+	return(err == -EBADFD ? 0 : err);
+}
+
+/* take the view out of the ring of views of its buffer */
+static void _textview_leave_peers(struct textview *textview)
+{
+	struct textview *prev;
+
+	for(prev = textview->peer; prev->peer != textview; prev = prev->peer);
+
+	prev->peer = textview->peer;
+	textview->peer = textview;
+}
+
+static int _textview_free(struct widget *widget)
+{
+	struct textview *textview;
+
+	textview = (struct textview*)widget;
+
+	_textview_leave_peers(textview);
+	_textview_free_rows(&textview->screen, textview->rows);
+	_textview_free_rows(&textview->frame, textview->rows);
+	free(textview->span_colors);
+	spans_free(&textview->selection);
+
+	if(textview->highlight) {
+		highlight_free(&textview->highlight);
+	}
+
+	layout_free(&textview->layout);
+	memset(textview, 0, sizeof(*textview));
+	free(textview);
+
+	return(0);
+}
+
+int textview_new(struct textview **textview)
+{
+	struct textview *view;
+
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	view = malloc(sizeof(*view));
+
+	if(!view) {
+		return(-ENOMEM);
+	}
+
+	memset(view, 0, sizeof(*view));
+
+	if(layout_new(&view->layout) < 0) {
+		free(view);
+		return(-ENOMEM);
+	}
+
+	if(spans_new(&view->selection) < 0) {
+		layout_free(&view->layout);
+		free(view);
+		return(-ENOMEM);
+	}
+
+	view->layers[UI_LAYER_SELECTION] = view->selection;
+	view->peer = view;
+
+	widget_init((struct widget*)view);
+
+	((struct widget*)view)->input = _textview_input;
+	((struct widget*)view)->resize = _textview_resize;
+	((struct widget*)view)->redraw = _textview_redraw;
+	((struct widget*)view)->free = _textview_free;
+
+	view->tab_width = config.tab_width;
+	view->wrap = config.wrap_lines;
+	view->first_line = 1;
+	view->pos_x = 0;
+	view->pos_y = 0;
+
+	if(config.syntax && textview_set_syntax(view, 1) < 0) {
+		_textview_free((struct widget*)view);
+		return(-ENOMEM);
+	}
+
+	*textview = view;
+	return(0);
+}
+
+int textview_set_buffer(struct textview *textview, struct buffer *buffer)
+{
+	if(!textview || !buffer) {
+		return(-EINVAL);
+	}
+
+	if(textview->buffer != buffer) {
+		struct layout *layout;
+
+		/* a shared layout belongs to the views of the old buffer */
+		_textview_leave_peers(textview);
+
+		if(layout_get_refs(textview->layout) > 1 && layout_new(&layout) == 0) {
+			layout_free(&textview->layout);
+			textview->layout = layout;
+		}
+
+		textview->buffer = buffer;
+		textview->generation = buffer_get_generation(buffer);
+		textview->hex_offset = 0;
+		textview->json_top.start = 0;
+		textview->diff_top_line = 1;
+		textview->diff_top_del = 0;
+		textview->screen_valid = FALSE;
+	}
+
+	return(0);
+}
+
+/*
+ * Show the buffer of `peer' in `textview' as well. The views keep their
+ * own positions and selections, but they share the layout of the buffer,
+ * and each of them only redraws what an edit damaged.
+ */
+int textview_share(struct textview *textview, struct textview *peer)
+{
+	struct textview *member;
+
+	if(!textview || !peer || !peer->buffer || textview == peer) {
+		return(-EINVAL);
+	}
+
+	textview_set_buffer(textview, peer->buffer);
+
+	for(member = peer->peer; member != peer && member != textview; member = member->peer);
+
+	if(member != textview) {
+		_textview_leave_peers(textview);
+		textview->peer = peer->peer;
+		peer->peer = textview;
+	}
+
+	textview->wrap = peer->wrap;
+	textview->tab_width = peer->tab_width;
+
+	if(textview->layout != peer->layout) {
+		layout_ref(peer->layout);
+		layout_free(&textview->layout);
+		textview->layout = peer->layout;
+	}
+
+	textview->screen_valid = FALSE;
+	widget_redraw((struct widget*)textview);
+
+	return(0);
+}
+
+int textview_set_tail(struct textview *textview, const int tail)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	textview->tail = tail;
+	return(0);
+}
+
+int textview_set_wrap(struct textview *textview, const int wrap)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(!wrap != !textview->wrap) {
+		textview->wrap = wrap;
+		textview->hscroll = 0;
+		textview->screen_valid = FALSE;
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+/* show the bytes of the buffer as a hex dump, or as text again */
+int textview_set_hex(struct textview *textview, const int hex)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(!hex != !textview->hex) {
+		textview->hex = hex;
+		textview->screen_valid = FALSE;
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+int textview_get_hex(struct textview *textview)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	return(textview->hex);
+}
+
+int textview_get_wrap(struct textview *textview)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	return(textview->wrap);
+}
+
+/*
+ * Scroll the view to the right by `cols' columns, or to the left if it is
+ * negative. This only has an effect if lines aren't wrapped.
+ */
+int textview_scroll_horizontal(struct textview *textview, const int cols)
+{
+	size_t hscroll;
+
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(textview->wrap && !textview->columns) {
+		return(-EPERM);
+	}
+
+	if(cols < 0) {
+		hscroll = textview->hscroll > (size_t)-cols ? textview->hscroll + cols : 0;
+	} else {
+		hscroll = textview->hscroll + cols;
+	}
+
+	if(hscroll != textview->hscroll) {
+		textview->hscroll = hscroll;
+		textview->screen_valid = FALSE;
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+int textview_set_selection(struct textview *textview, struct telex *start, struct telex *end)
+{
+	int selection_changed;
+
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	selection_changed = FALSE;
+
+	if(textview->start != start || textview->end != end) {
+		selection_changed = TRUE;
+	}
+
+	textview->start = start;
+	textview->end = end;
+
+	if(selection_changed) {
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+int textview_set_selection_start(struct textview *textview, struct telex *start)
+{
+	int selection_changed;
+
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	selection_changed = textview->start != start;
+	textview->start = start;
+
+	if(selection_changed) {
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+int textview_set_selection_end(struct textview *textview, struct telex *end)
+{
+	int selection_changed;
+
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	selection_changed = textview->end != end;
 	textview->end = end;
 
 	if(selection_changed) {
@@ -401,3 +2263,201 @@ int textview_set_selection_end(struct textview *textview, struct telex *end)
 
 	return(0);
 }
+
+struct highlight* textview_get_highlight(struct textview *textview)
+{
+	return(textview ? textview->highlight : NULL);
+}
+
+/*
+ * Show only the lines that `filter' matches, each with its own line number,
+ * or all lines again if `filter' is NULL. The filter remains owned by the
+ * caller.
+ */
+int textview_set_filter(struct textview *textview, struct filter *filter)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(textview->filter != filter) {
+		textview->filter = filter;
+		textview->screen_valid = FALSE;
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+struct filter* textview_get_filter(struct textview *textview)
+{
+	return(textview ? textview->filter : NULL);
+}
+
+/* show the lines as the rows of a table with the fields in `columns' */
+int textview_set_columns(struct textview *textview, struct columns *columns)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(textview->columns != columns) {
+		textview->columns = columns;
+		textview->hscroll = 0;
+		textview->screen_valid = FALSE;
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+struct columns* textview_get_columns(struct textview *textview)
+{
+	return(textview ? textview->columns : NULL);
+}
+
+/*
+ * Show the buffer as pretty-printed JSON, with the objects and arrays that
+ * are folded in `json' shown in one row, or as text again if `json' is
+ * NULL. A buffer that isn't JSON is shown as text, too. The structure
+ * remains owned by the caller.
+ */
+int textview_set_json(struct textview *textview, struct json *json)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(textview->json != json) {
+		textview->json = json;
+		textview->json_top.start = 0;
+		textview->json_top.depth = 0;
+		textview->screen_valid = FALSE;
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+struct json* textview_get_json(struct textview *textview)
+{
+	return(textview ? textview->json : NULL);
+}
+
+/*
+ * Show the lines of the buffer that differ from the base of `diff', along
+ * with the lines of the base that were removed, or the buffer as it is if
+ * `diff' is NULL. The diff remains owned by the caller.
+ */
+int textview_set_diff(struct textview *textview, struct diff *diff)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(textview->diff != diff) {
+		textview->diff = diff;
+		textview->diff_top_line = 1;
+		textview->diff_top_del = 0;
+		textview->screen_valid = FALSE;
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+struct diff* textview_get_diff(struct textview *textview)
+{
+	return(textview ? textview->diff : NULL);
+}
+
+/* show `info' in the status line, next to the selection */
+int textview_set_info(struct textview *textview, const char *info)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	snprintf(textview->info, sizeof(textview->info), "%s", info ? info : "");
+	widget_redraw((struct widget*)textview);
+
+	return(0);
+}
+
+/* highlight comments, strings, keywords and numbers */
+int textview_set_syntax(struct textview *textview, const int syntax)
+{
+	int err;
+
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(!syntax == !textview->highlight) {
+		return(0);
+	}
+
+	if(syntax) {
+		if((err = highlight_new(&textview->highlight)) < 0) {
+			return(err);
+		}
+
+		textview->layers[UI_LAYER_SYNTAX] = highlight_get_spans(textview->highlight);
+	} else {
+		textview->layers[UI_LAYER_SYNTAX] = NULL;
+		highlight_free(&textview->highlight);
+	}
+
+	textview_restyle(textview, 0, SIZE_MAX);
+	widget_redraw((struct widget*)textview);
+
+	return(0);
+}
+
+/*
+ * Show the highlights in `spans' on one of the layers between the syntax
+ * highlighting and the selection, or remove the layer if `spans' is NULL.
+ * The spans remain owned by the caller, who has to tell the textview with
+ * textview_restyle() when they change.
+ */
+int textview_set_highlights(struct textview *textview, const ui_layer_t layer,
+			    struct spans *spans)
+{
+	if(!textview || layer <= UI_LAYER_SYNTAX || layer >= UI_LAYER_SELECTION) {
+		return(-EINVAL);
+	}
+
+	if(textview->layers[layer] != spans) {
+		textview->layers[layer] = spans;
+		textview_restyle(textview, 0, SIZE_MAX);
+		widget_redraw((struct widget*)textview);
+	}
+
+	return(0);
+}
+
+/* the highlights of the bytes from `start' to `end' changed */
+int textview_restyle(struct textview *textview, size_t start, size_t end)
+{
+	if(!textview) {
+		return(-EINVAL);
+	}
+
+	if(start >= end) {
+		return(0);
+	}
+
+	if(textview->restyle.start < textview->restyle.end) {
+		if(textview->restyle.start < start) {
+			start = textview->restyle.start;
+		}
+		if(textview->restyle.end > end) {
+			end = textview->restyle.end;
+		}
+	}
+
+	textview->restyle.start = start;
+	textview->restyle.end = end;
+
+	return(0);
+}
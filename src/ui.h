@@ -3,6 +3,8 @@
 
 #include <ncurses.h>
 #include "buffer.h"
+#include "display.h"
+#include "span.h"
 
 typedef enum {
 	UI_COLOR_DEFAULT = 0,
@@ -12,7 +14,11 @@ typedef enum {
 	UI_COLOR_DELETION,
 	UI_COLOR_INSERTION,
 	UI_COLOR_STATUS,
-	UI_COLOR_COMMAND
+	UI_COLOR_COMMAND,
+	UI_COLOR_COMMENT,
+	UI_COLOR_STRING,
+	UI_COLOR_KEYWORD,
+	UI_COLOR_NUMBER
 } ui_color_t;
 
 typedef enum {
@@ -22,6 +28,22 @@ typedef enum {
 	UI_ATTR_VISIBLE = (1 << 2)
 } ui_attr_t;
 
+/*
+ * The character that a cell shows for the byte `c'. Control characters
+ * would move the cursor, so they are shown as '?'. All other bytes are
+ * passed through, so the terminal still puts UTF-8 sequences together.
+ */
+#define UI_CELL_CHAR(c) ((unsigned char)(c) < 0x20 || (c) == 0x7f ? '?' : (c))
+
+/* layers of highlights, from the bottom up; the selection is on top */
+typedef enum {
+	UI_LAYER_SYNTAX = 0,
+	UI_LAYER_DIFF,
+	UI_LAYER_SEARCH,
+	UI_LAYER_SELECTION,
+	UI_LAYER_COUNT
+} ui_layer_t;
+
 struct signal;
 
 struct widget {
@@ -32,7 +54,7 @@ struct widget {
 	int color;
 	ui_attr_t attrs;
 
-	WINDOW *window;
+	struct display *display;
 	struct widget *parent;
 	struct signal *signals;
 
@@ -46,18 +68,23 @@ struct container {
 	struct widget _parent;
 
 	int (*add)(struct container*, struct widget*);
+	int (*remove)(struct container*, struct widget*);
 };
 
 struct window;
 struct cmdbox;
 struct vbox;
 struct textview;
+struct highlight;
+struct filter;
+struct columns;
+struct json;
+struct diff;
 
 typedef int (widget_handler_t)(struct widget*, void*, void*);
 
 #define widget_input(w,c) ((w)->input((w), (c)))
 #define widget_resize(w)  ((w)->resize((w)))
-#define widget_redraw(w)  ((w)->redraw((w)))
 #define widget_free(w)    ((w)->free((w)))
 #define widget_set_size(widget,w,h) do {	\
 		(widget)->width = (w);	\
@@ -69,6 +96,10 @@ typedef int (widget_handler_t)(struct widget*, void*, void*);
 	} while(0);
 
 int widget_init(struct widget *widget);
+int widget_redraw(struct widget *widget);
+
+int ui_freeze(void);
+int ui_thaw(void);
 
 int widget_set_visible(struct widget *widget, int is_visible);
 int widget_is_visible(struct widget *widget);
@@ -90,8 +121,10 @@ int widget_emit_signal(struct widget *widget, const char *name, void *data);
 
 int container_init(struct container *container);
 #define container_add(c,w) ((c)->add((c), (w)))
+#define container_remove(c,w) ((c)->remove((c), (w)))
 
 int window_new(struct window **window);
+int window_new_with_display(struct window **window, struct display *display);
 int window_adjust_size(struct window *window);
 int cmdbox_new(struct cmdbox **cmdbox);
 int cmdbox_highlight(struct cmdbox *box, const ui_color_t color,
@@ -105,8 +138,29 @@ int vbox_new(struct vbox **vbox, int size);
 int textview_new(struct textview **textview);
 
 int textview_set_buffer(struct textview *textview, struct buffer *buffer);
+int textview_share(struct textview *textview, struct textview *peer);
+int textview_set_tail(struct textview *textview, const int tail);
+int textview_set_wrap(struct textview *textview, const int wrap);
+int textview_get_wrap(struct textview *textview);
+int textview_set_hex(struct textview *textview, const int hex);
+int textview_get_hex(struct textview *textview);
+int textview_scroll_horizontal(struct textview *textview, const int cols);
 int textview_set_selection(struct textview *textview, struct telex *start, struct telex *end);
 int textview_set_selection_start(struct textview *textview, struct telex *start);
 int textview_set_selection_end(struct textview *textview, struct telex *end);
+int textview_set_syntax(struct textview *textview, const int syntax);
+struct highlight* textview_get_highlight(struct textview *textview);
+int textview_set_info(struct textview *textview, const char *info);
+int textview_set_filter(struct textview *textview, struct filter *filter);
+struct filter* textview_get_filter(struct textview *textview);
+int textview_set_columns(struct textview *textview, struct columns *columns);
+struct columns* textview_get_columns(struct textview *textview);
+int textview_set_json(struct textview *textview, struct json *json);
+struct json* textview_get_json(struct textview *textview);
+int textview_set_diff(struct textview *textview, struct diff *diff);
+struct diff* textview_get_diff(struct textview *textview);
+int textview_set_highlights(struct textview *textview, const ui_layer_t layer,
+			    struct spans *spans);
+int textview_restyle(struct textview *textview, size_t start, size_t end);
 
 #endif /* E_UI_H */
@@ -195,7 +195,42 @@ static int _vbox_add(struct container *container, struct widget *child)
 
 	vbox->num_children++;
 	child->parent = (struct widget*)vbox;
-	child->window = ((struct widget*)vbox)->window;
+	child->display = ((struct widget*)vbox)->display;
+
+	widget_resize((struct widget*)vbox);
+	widget_redraw((struct widget*)vbox);
+
+	return(0);
+}
+
+/*
+ * The slot of a removed child is left empty, so a widget that is added
+ * in its place ends up at the same position.
+ */
+static int _vbox_remove(struct container *container, struct widget *child)
+{
+	struct vbox *vbox;
+	size_t slot;
+
+	if(!container || !child) {
+		return(-EINVAL);
+	}
+
+	vbox = (struct vbox*)container;
+
+	for(slot = 0; slot < vbox->max_children; slot++) {
+		if(vbox->children[slot] == child) {
+			break;
+		}
+	}
+
+	if(slot == vbox->max_children) {
+		return(-ENOENT);
+	}
+
+	vbox->children[slot] = NULL;
+	vbox->num_children--;
+	child->parent = NULL;
 
 	widget_resize((struct widget*)vbox);
 	widget_redraw((struct widget*)vbox);
@@ -236,6 +271,7 @@ int vbox_new(struct vbox **dst, int size)
 	((struct widget*)vbox)->redraw = _vbox_redraw;
 	((struct widget*)vbox)->free = _vbox_free;
 	((struct container*)vbox)->add = _vbox_add;
+	((struct container*)vbox)->remove = _vbox_remove;
 
 	*dst = vbox;
 
@@ -17,6 +17,15 @@ struct signal {
 	struct signal_handler *handlers;
 };
 
+#define WIDGET_MAX_DEFERRED 8
+
+/* redraws that were requested while the UI was frozen */
+static struct {
+	int frozen;
+	int num_widgets;
+	struct widget *widgets[WIDGET_MAX_DEFERRED];
+} _deferred;
+
 static int _widget_input(struct widget *widget, const int event)
 {
 	return(-ENOSYS);
@@ -54,6 +63,93 @@ int widget_init(struct widget *widget)
 	return(0);
 }
 
+static int _widget_is_ancestor(struct widget *ancestor, struct widget *widget)
+{
+	for(widget = widget->parent; widget; widget = widget->parent) {
+		if(widget == ancestor) {
+			return(TRUE);
+		}
+	}
+
+	return(FALSE);
+}
+
+static int _widget_defer_redraw(struct widget *widget)
+{
+	int i;
+
+	for(i = 0; i < _deferred.num_widgets; i++) {
+		struct widget *pending;
+
+		pending = _deferred.widgets[i];
+
+		if(pending == widget || _widget_is_ancestor(pending, widget)) {
+			return(0);
+		}
+
+		/* the new widget covers this one */
+		if(_widget_is_ancestor(widget, pending)) {
+			_deferred.widgets[i--] = _deferred.widgets[--_deferred.num_widgets];
+		}
+	}
+
+	if(_deferred.num_widgets == WIDGET_MAX_DEFERRED) {
+		/* too many to keep track of, just redraw everything */
+		while(widget->parent) {
+			widget = widget->parent;
+		}
+
+		_deferred.num_widgets = 0;
+	}
+
+	_deferred.widgets[_deferred.num_widgets++] = widget;
+	return(0);
+}
+
+int widget_redraw(struct widget *widget)
+{
+	if(!widget) {
+		return(-EINVAL);
+	}
+
+	if(_deferred.frozen) {
+		return(_widget_defer_redraw(widget));
+	}
+
+	return(widget->redraw(widget));
+}
+
+/*
+ * While the UI is frozen, redraws are only recorded. Once it is thawed,
+ * every widget that asked to be redrawn is redrawn exactly once, no matter
+ * how many times it asked, so a burst of input costs only one redraw.
+ */
+int ui_freeze(void)
+{
+	_deferred.frozen++;
+	return(0);
+}
+
+int ui_thaw(void)
+{
+	if(!_deferred.frozen) {
+		return(-EALREADY);
+	}
+
+	if(--_deferred.frozen > 0) {
+		return(0);
+	}
+
+	while(_deferred.num_widgets > 0) {
+		struct widget *widget;
+
+		widget = _deferred.widgets[--_deferred.num_widgets];
+		widget->redraw(widget);
+	}
+
+	return(0);
+}
+
 int widget_clear(struct widget *widget, const int x, const int y,
 		 const int width, const int height)
 {
@@ -64,18 +160,10 @@ int widget_clear(struct widget *widget, const int x, const int y,
         }
 
         for(cur_y = 0; cur_y < height; cur_y++) {
-                int cur_x;
-
-                for(cur_x = 0; cur_x < width; cur_x++) {
-                        mvwaddch(widget->window,
-				 widget->y + y + cur_y,
-				 widget->x + x + cur_x,
-				 ' ');
-                }
-
-		mvchgat(widget->y + y + cur_y,
-			widget->x + x,
-			width, 0, UI_COLOR_NORMAL, NULL);
+		display_fill(widget->display,
+			     widget->x + x,
+			     widget->y + y + cur_y,
+			     width, ' ', UI_COLOR_NORMAL);
         }
 
         return(0);
@@ -111,12 +199,12 @@ int widget_set_color(struct widget *widget, const ui_color_t color,
 
 	for(row = 0; row < h; row++) {
 #ifdef DEBUG
-		fprintf(stderr, "mvchgat(%d, %d, %d, 0, %d, NULL)\n",
-			widget->y + y + row, widget->x + x, w,
+		fprintf(stderr, "display_recolor(%d, %d, %d, %d)\n",
+			widget->x + x, widget->y + y + row, w,
 			color);
 #endif /* DEBUG */
-		mvchgat(widget->y + y + row, widget->x + x,
-			w, 0, color, NULL);
+		display_recolor(widget->display, widget->x + x,
+				widget->y + y + row, w, color);
 	}
 
 	return(0);
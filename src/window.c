@@ -5,11 +5,13 @@
 #include <unistd.h>
 #include <errno.h>
 #include "ui.h"
+#include "config.h"
 
 struct window {
 	struct container _parent;
 
-	WINDOW *window;
+	struct display *display;
+	int own_display;
 	struct widget *child;
 };
 
@@ -62,10 +64,15 @@ int window_adjust_size(struct window *window)
 		return(0);
 	}
 
-	if(resizeterm(height, width) != OK) {
+	if(display_resize(window->display, width, height) < 0) {
 		return(-EIO);
 	}
 
+	if(config.vt_display) {
+		/* curses resized its screen, keep it from painting it */
+		wnoutrefresh(stdscr);
+	}
+
 	widget_resize((struct widget*)window);
 	widget_redraw((struct widget*)window);
 
@@ -84,7 +91,7 @@ int _window_resize(struct widget *widget)
 
 	window = (struct window*)widget;
 
-	getmaxyx(stdscr, max_height, max_width);
+	display_get_size(window->display, &max_width, &max_height);
 	widget->width = max_width;
 	widget->height = max_height;
 
@@ -116,7 +123,7 @@ int _window_redraw(struct widget *widget)
 		widget_redraw(window->child);
 	}
 
-	refresh();
+	display_flush(window->display);
 
 	return(0);
 }
@@ -135,7 +142,11 @@ int _window_free(struct widget *widget)
 		widget_free(window->child);
 	}
 
-	endwin();
+	if(window->own_display) {
+		display_free(&window->display);
+		endwin();
+	}
+
 	memset(window, 0, sizeof(*window));
 	free(window);
 
@@ -157,7 +168,7 @@ int _window_add(struct container *container, struct widget *child)
 	}
 
 	child->parent = (struct widget*)window;
-	child->window = window->window;
+	child->display = window->display;
 	window->child = child;
 
 	widget_resize((struct widget*)window);
@@ -184,23 +195,11 @@ static int _initialize_curses(void)
 	} else if(raw() == ERR) {
 		err = -EIO;
 	} else {
+		/* allow curses to use the terminal's scroll regions */
+		idlok(stdscr, TRUE);
+
 		err = 0;
 		_initialized = 1;
-
-		init_pair(UI_COLOR_NORMAL,
-			  COLOR_BLACK, COLOR_WHITE);
-		init_pair(UI_COLOR_LINES,
-			  COLOR_WHITE, COLOR_BLUE);
-		init_pair(UI_COLOR_SELECTION,
-			  COLOR_WHITE, COLOR_BLUE);
-		init_pair(UI_COLOR_DELETION,
-			  COLOR_WHITE, COLOR_RED);
-		init_pair(UI_COLOR_INSERTION,
-			  COLOR_GREEN, COLOR_WHITE);
-		init_pair(UI_COLOR_STATUS,
-			  COLOR_BLACK, COLOR_GREEN);
-		init_pair(UI_COLOR_COMMAND,
-			  COLOR_WHITE, COLOR_BLACK);
 	}
 
 	if(err < 0 && err != -EFAULT) {
@@ -210,20 +209,44 @@ static int _initialize_curses(void)
 	return(err);
 }
 
-int window_new(struct window **window)
+static void _window_init_colors(struct display *display)
+{
+	display_set_colors(display, UI_COLOR_NORMAL,
+			   COLOR_BLACK, COLOR_WHITE);
+	display_set_colors(display, UI_COLOR_LINES,
+			   COLOR_WHITE, COLOR_BLUE);
+	display_set_colors(display, UI_COLOR_SELECTION,
+			   COLOR_WHITE, COLOR_BLUE);
+	display_set_colors(display, UI_COLOR_DELETION,
+			   COLOR_WHITE, COLOR_RED);
+	display_set_colors(display, UI_COLOR_INSERTION,
+			   COLOR_GREEN, COLOR_WHITE);
+	display_set_colors(display, UI_COLOR_STATUS,
+			   COLOR_BLACK, COLOR_GREEN);
+	display_set_colors(display, UI_COLOR_COMMAND,
+			   COLOR_WHITE, COLOR_BLACK);
+	display_set_colors(display, UI_COLOR_COMMENT,
+			   COLOR_BLUE, COLOR_WHITE);
+	display_set_colors(display, UI_COLOR_STRING,
+			   COLOR_RED, COLOR_WHITE);
+	display_set_colors(display, UI_COLOR_KEYWORD,
+			   COLOR_MAGENTA, COLOR_WHITE);
+	display_set_colors(display, UI_COLOR_NUMBER,
+			   COLOR_CYAN, COLOR_WHITE);
+}
+
+/*
+ * A window that draws on the given display instead of the terminal. The
+ * display is not freed along with the window.
+ */
+int window_new_with_display(struct window **window, struct display *display)
 {
 	struct window *wind;
-	int max_width;
-	int max_height;
 
-	if(!window) {
+	if(!window || !display) {
 		return(-EINVAL);
 	}
 
-	if(_initialize_curses() < 0) {
-		return(-EIO);
-	}
-
 	wind = malloc(sizeof(*wind));
 
 	if(!wind) {
@@ -233,20 +256,60 @@ int window_new(struct window **window)
 	memset(wind, 0, sizeof(*wind));
 
 	container_init((struct container*)wind);
+	_window_init_colors(display);
 
-	getmaxyx(stdscr, max_height, max_width);
-	((struct widget*)wind)->width = max_width;
-	((struct widget*)wind)->height = max_height;
+	display_get_size(display, &((struct widget*)wind)->width,
+			 &((struct widget*)wind)->height);
 
 	((struct widget*)wind)->input = _window_input;
 	((struct widget*)wind)->resize = _window_resize;
 	((struct widget*)wind)->redraw = _window_redraw;
 	((struct widget*)wind)->free = _window_free;
+	((struct widget*)wind)->display = display;
 
 	((struct container*)wind)->add = _window_add;
 
-	wind->window = stdscr;
+	wind->display = display;
 	*window = wind;
 
 	return(0);
 }
+
+int window_new(struct window **window)
+{
+	struct display *display;
+	int err;
+
+	if(!window) {
+		return(-EINVAL);
+	}
+
+	if(_initialize_curses() < 0) {
+		return(-EIO);
+	}
+
+	if(config.vt_display) {
+		/*
+		 * Curses is only used to read the keyboard. Let it clear the
+		 * screen now, or it will do so when it is first asked for a key.
+		 */
+		refresh();
+		err = display_vt_new(&display, STDOUT_FILENO, 0, 0);
+	} else {
+		err = display_curses_new(&display, stdscr);
+	}
+
+	if(err < 0) {
+		endwin();
+		return(err);
+	}
+
+	if((err = window_new_with_display(window, display)) < 0) {
+		display_free(&display);
+		endwin();
+		return(err);
+	}
+
+	(*window)->own_display = 1;
+	return(0);
+}
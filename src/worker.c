@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "worker.h"
+
+/*
+ * Jobs are handed to the workers through a queue that is protected by a
+ * mutex, which the workers only hold for as long as it takes to take a
+ * job off the queue. Finished jobs are pushed onto a lock-free stack, so
+ * a worker never holds anything the submitting thread could wait for, and
+ * the submitting thread is woken up through a pipe. It takes all of the
+ * finished jobs off the stack at once and reverses them, so their `done'
+ * functions are called in the order the jobs finished.
+ */
+struct worker_pool {
+	pthread_t *threads;
+	int num_threads;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct worker_job *first;
+	struct worker_job *last;
+	int stopping;
+
+	_Atomic(struct worker_job*) finished;
+	int wake[2];
+};
+
+int worker_job_init(struct worker_job *job, int (*run)(struct worker_job*),
+		    void (*done)(struct worker_job*))
+{
+	if(!job || !run || !done) {
+		return(-EINVAL);
+	}
+
+	job->next = NULL;
+	atomic_init(&job->cancelled, 0);
+	job->result = 0;
+	job->run = run;
+	job->done = done;
+
+	return(0);
+}
+
+void worker_job_cancel(struct worker_job *job)
+{
+	if(job) {
+		atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+	}
+}
+
+int worker_job_cancelled(struct worker_job *job)
+{
+	return(atomic_load_explicit(&job->cancelled, memory_order_relaxed));
+}
+
+static void _worker_pool_finish(struct worker_pool *pool, struct worker_job *job)
+{
+	struct worker_job *head;
+	char chr;
+
+	head = atomic_load_explicit(&pool->finished, memory_order_relaxed);
+
+	do {
+		job->next = head;
+	} while(!atomic_compare_exchange_weak_explicit(&pool->finished, &head, job,
+						       memory_order_release,
+						       memory_order_relaxed));
+
+	/* if the pipe is full, the collector has yet to be woken up anyway */
+	chr = 0;
+	if(write(pool->wake[1], &chr, 1) < 0) {
+		return;
+	}
+}
+
+static void* _worker_pool_thread(void *data)
+{
+	struct worker_pool *pool;
+
+	pool = (struct worker_pool*)data;
+
+	while(1) {
+		struct worker_job *job;
+		int stopping;
+
+		pthread_mutex_lock(&pool->lock);
+
+		while(!pool->first && !pool->stopping) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+
+		if(!(job = pool->first)) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		if(!(pool->first = job->next)) {
+			pool->last = NULL;
+		}
+
+		stopping = pool->stopping;
+		pthread_mutex_unlock(&pool->lock);
+
+		if(stopping || worker_job_cancelled(job)) {
+			job->result = -ECANCELED;
+		} else {
+			job->result = job->run(job);
+		}
+
+		_worker_pool_finish(pool, job);
+	}
+
+	return(NULL);
+}
+
+int worker_pool_new(struct worker_pool **pool, const int threads)
+{
+	struct worker_pool *wp;
+	int i;
+
+	if(!pool || threads < 1) {
+		return(-EINVAL);
+	}
+
+	if(!(wp = calloc(1, sizeof(*wp)))) {
+		return(-ENOMEM);
+	}
+
+	if(!(wp->threads = calloc(threads, sizeof(*wp->threads)))) {
+		free(wp);
+		return(-ENOMEM);
+	}
+
+	if(pipe(wp->wake) < 0) {
+		free(wp->threads);
+		free(wp);
+		return(-errno);
+	}
+
+	fcntl(wp->wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(wp->wake[1], F_SETFL, O_NONBLOCK);
+	fcntl(wp->wake[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wp->wake[1], F_SETFD, FD_CLOEXEC);
+
+	pthread_mutex_init(&wp->lock, NULL);
+	pthread_cond_init(&wp->cond, NULL);
+	atomic_init(&wp->finished, NULL);
+
+	for(i = 0; i < threads; i++) {
+		if(pthread_create(&wp->threads[i], NULL, _worker_pool_thread, wp) != 0) {
+			break;
+		}
+	}
+
+	wp->num_threads = i;
+
+	if(i == 0) {
+		worker_pool_free(&wp);
+		return(-EAGAIN);
+	}
+
+	*pool = wp;
+	return(0);
+}
+
+/*
+ * Jobs that didn't run yet are cancelled, and the ones that are running
+ * are asked to stop. Either way, their `done' functions are called before
+ * the pool is gone.
+ */
+int worker_pool_free(struct worker_pool **pool)
+{
+	struct worker_pool *wp;
+	struct worker_job *job;
+	int i;
+
+	if(!pool || !*pool) {
+		return(-EINVAL);
+	}
+
+	wp = *pool;
+
+	pthread_mutex_lock(&wp->lock);
+	wp->stopping = 1;
+
+	for(job = wp->first; job; job = job->next) {
+		worker_job_cancel(job);
+	}
+
+	pthread_cond_broadcast(&wp->cond);
+	pthread_mutex_unlock(&wp->lock);
+
+	for(i = 0; i < wp->num_threads; i++) {
+		pthread_join(wp->threads[i], NULL);
+	}
+
+	worker_pool_collect(wp);
+
+	pthread_cond_destroy(&wp->cond);
+	pthread_mutex_destroy(&wp->lock);
+	close(wp->wake[0]);
+	close(wp->wake[1]);
+	free(wp->threads);
+	free(wp);
+	*pool = NULL;
+
+	return(0);
+}
+
+int worker_pool_submit(struct worker_pool *pool, struct worker_job *job)
+{
+	if(!pool || !job) {
+		return(-EINVAL);
+	}
+
+	job->next = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+
+	if(pool->last) {
+		pool->last->next = job;
+	} else {
+		pool->first = job;
+	}
+
+	pool->last = job;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return(0);
+}
+
+/* becomes readable when there are finished jobs to collect */
+int worker_pool_get_fd(struct worker_pool *pool)
+{
+	return(pool ? pool->wake[0] : -EINVAL);
+}
+
+/*
+ * Call the `done' functions of all jobs that finished so far, and return
+ * how many there were. This never waits for a job.
+ */
+int worker_pool_collect(struct worker_pool *pool)
+{
+	struct worker_job *job;
+	struct worker_job *order;
+	char buf[64];
+	int num;
+
+	if(!pool) {
+		return(-EINVAL);
+	}
+
+	while(read(pool->wake[0], buf, sizeof(buf)) > 0);
+
+	job = atomic_exchange_explicit(&pool->finished, NULL, memory_order_acquire);
+
+	for(order = NULL; job; ) {
+		struct worker_job *next;
+
+		next = job->next;
+		job->next = order;
+		order = job;
+		job = next;
+	}
+
+	for(num = 0; order; num++) {
+		job = order;
+		order = order->next;
+		job->done(job);
+	}
+
+	return(num);
+}
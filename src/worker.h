@@ -0,0 +1,36 @@
+#ifndef E_WORKER_H
+#define E_WORKER_H
+
+#include <stdatomic.h>
+
+struct worker_pool;
+
+/*
+ * A piece of work that runs on one of the threads of a worker pool. Jobs
+ * are embedded into structs that hold their input and results. `run' is
+ * called on a worker thread and should check worker_job_cancelled() every
+ * now and then; `done' is called on the thread that collects the results,
+ * whether the job ran, was cancelled, or failed.
+ */
+struct worker_job {
+	struct worker_job *next;
+	atomic_int cancelled;
+	int result;
+
+	int (*run)(struct worker_job*);
+	void (*done)(struct worker_job*);
+};
+
+int worker_pool_new(struct worker_pool **pool, const int threads);
+int worker_pool_free(struct worker_pool **pool);
+
+int worker_pool_submit(struct worker_pool *pool, struct worker_job *job);
+int worker_pool_get_fd(struct worker_pool *pool);
+int worker_pool_collect(struct worker_pool *pool);
+
+int worker_job_init(struct worker_job *job, int (*run)(struct worker_job*),
+		    void (*done)(struct worker_job*));
+void worker_job_cancel(struct worker_job *job);
+int worker_job_cancelled(struct worker_job *job);
+
+#endif /* E_WORKER_H */